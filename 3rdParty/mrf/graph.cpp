@@ -10,6 +10,7 @@
 #include "icm_graph.h"
 #include "lbp_graph.h"
 #include "gco_graph.h"
+#include "multilevel_graph.h"
 #include "graph.h"
 
 MRF_NAMESPACE_BEGIN
@@ -18,6 +19,7 @@ Graph::Ptr Graph::create(int num_sites, int num_labels, SOLVER_TYPE solver_type)
     switch (solver_type) {
         case ICM: return Graph::Ptr(new ICMGraph(num_sites, num_labels));
         case LBP: return Graph::Ptr(new LBPGraph(num_sites, num_labels));
+        case MULTILEVEL: return Graph::Ptr(new MultilevelGraph(num_sites, num_labels));
         #ifdef RESEARCH
         case GCO: return Graph::Ptr(new GCOGraph(num_sites, num_labels));
         #endif
@@ -30,6 +30,7 @@ struct SparseDataCost {
 enum SOLVER_TYPE {
     ICM,
     LBP,
+    MULTILEVEL,
     #ifdef RESEARCH
     GCO
     #endif
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "multilevel_graph.h"
+
+MRF_NAMESPACE_BEGIN
+
+MultilevelGraph::MultilevelGraph(int num_sites, int) :
+    sites(num_sites), num_cycles(0) {}
+
+void MultilevelGraph::build_finest_level(void) {
+    levels.resize(1);
+    Level & level = levels[0];
+    std::size_t const num_sites = sites.size();
+
+    level.label_offsets.resize(num_sites + 1, 0);
+    level.adj_offsets.resize(num_sites + 1, 0);
+    for (std::size_t i = 0; i < num_sites; ++i) {
+        level.label_offsets[i + 1] = level.label_offsets[i] + sites[i].labels.size();
+        level.adj_offsets[i + 1] = level.adj_offsets[i] + sites[i].neighbors.size();
+    }
+    level.labels.resize(level.label_offsets.back());
+    level.data_costs.resize(level.label_offsets.back());
+    level.adj.resize(level.adj_offsets.back());
+    level.adj_weights.resize(level.adj_offsets.back(), ENERGY_TYPE(1));
+
+    #pragma omp parallel for
+    for (std::size_t i = 0; i < num_sites; ++i) {
+        Site const & site = sites[i];
+        std::vector<std::pair<int, ENERGY_TYPE> > costs(site.labels.size());
+        for (std::size_t j = 0; j < costs.size(); ++j)
+            costs[j] = std::make_pair(site.labels[j], site.data_costs[j]);
+        std::sort(costs.begin(), costs.end());
+
+        std::size_t const offset = level.label_offsets[i];
+        for (std::size_t j = 0; j < costs.size(); ++j) {
+            level.labels[offset + j] = costs[j].first;
+            level.data_costs[offset + j] = costs[j].second;
+        }
+        std::copy(site.neighbors.begin(), site.neighbors.end(),
+            level.adj.begin() + level.adj_offsets[i]);
+    }
+
+    level.site_labels.resize(num_sites);
+    level.representatives.resize(num_sites);
+    for (std::size_t i = 0; i < num_sites; ++i) {
+        level.site_labels[i] = sites[i].label;
+        level.representatives[i] = static_cast<int>(i);
+    }
+
+    color(&level);
+}
+
+void MultilevelGraph::coarsen(Level * fine, Level * coarse) {
+    std::size_t const num_fine_sites = fine->num_sites();
+
+    /*
+     * Greedy matching of neighbors with equal labels along the heaviest edge.
+     * The visiting order alternates between cycles to vary the clusters.
+     */
+    std::vector<std::pair<int, int> > members;
+    std::vector<ENERGY_TYPE> member_weights;
+    fine->parents.assign(num_fine_sites, -1);
+    for (std::size_t t = 0; t < num_fine_sites; ++t) {
+        std::size_t const i = num_cycles % 2 == 0 ? t : num_fine_sites - 1 - t;
+        if (fine->parents[i] != -1) continue;
+
+        int match = -1;
+        ENERGY_TYPE match_weight = ENERGY_TYPE(0);
+        for (std::size_t k = fine->adj_offsets[i]; k < fine->adj_offsets[i + 1]; ++k) {
+            int const j = fine->adj[k];
+            if (fine->parents[j] != -1 || fine->site_labels[j] != fine->site_labels[i]) continue;
+            if (fine->adj_weights[k] > match_weight) {
+                match = j;
+                match_weight = fine->adj_weights[k];
+            }
+        }
+
+        int const parent = static_cast<int>(members.size());
+        fine->parents[i] = parent;
+        if (match != -1) fine->parents[match] = parent;
+        members.push_back(std::make_pair(static_cast<int>(i), match));
+        member_weights.push_back(match_weight);
+    }
+
+    std::size_t const num_sites = members.size();
+    if (num_sites > MRF_MULTILEVEL_MIN_REDUCTION * num_fine_sites) return;
+
+    /* Labels available to both members with the summed costs. */
+    auto merge_labels = [this, fine, &members, &member_weights]
+        (std::size_t i, int * labels, ENERGY_TYPE * data_costs) -> std::size_t {
+        int const site1 = members[i].first;
+        int const site2 = members[i].second;
+        std::size_t k1 = fine->label_offsets[site1];
+        std::size_t const end1 = fine->label_offsets[site1 + 1];
+        if (site2 == -1) {
+            if (labels != nullptr) {
+                std::copy(fine->labels.begin() + k1, fine->labels.begin() + end1, labels);
+                std::copy(fine->data_costs.begin() + k1, fine->data_costs.begin() + end1, data_costs);
+            }
+            return end1 - k1;
+        }
+
+        int const rep1 = fine->representatives[site1];
+        int const rep2 = fine->representatives[site2];
+        std::size_t k2 = fine->label_offsets[site2];
+        std::size_t const end2 = fine->label_offsets[site2 + 1];
+        std::size_t num_labels = 0;
+        while (k1 < end1 && k2 < end2) {
+            int const label1 = fine->labels[k1];
+            int const label2 = fine->labels[k2];
+            if (label1 < label2) {
+                ++k1;
+            } else if (label2 < label1) {
+                ++k2;
+            } else {
+                if (labels != nullptr) {
+                    labels[num_labels] = label1;
+                    data_costs[num_labels] = fine->data_costs[k1] + fine->data_costs[k2]
+                        + member_weights[i] * smooth_cost_func(rep1, rep2, label1, label1);
+                }
+                ++num_labels;
+                ++k1;
+                ++k2;
+            }
+        }
+        return num_labels;
+    };
+
+    /* Coarse neighbors with the summed weights of the edges to them. */
+    auto merge_neighbors = [fine, &members] (std::size_t i,
+        std::vector<std::pair<int, ENERGY_TYPE> > * neighbors) {
+        neighbors->clear();
+        int const member_sites[] = {members[i].first, members[i].second};
+        for (int site : member_sites) {
+            if (site == -1) continue;
+            for (std::size_t k = fine->adj_offsets[site]; k < fine->adj_offsets[site + 1]; ++k) {
+                int const parent = fine->parents[fine->adj[k]];
+                if (parent == static_cast<int>(i)) continue;
+                neighbors->push_back(std::make_pair(parent, fine->adj_weights[k]));
+            }
+        }
+        std::sort(neighbors->begin(), neighbors->end());
+
+        std::size_t num_neighbors = 0;
+        for (std::size_t k = 0; k < neighbors->size(); ++k) {
+            if (num_neighbors > 0 && neighbors->at(num_neighbors - 1).first == neighbors->at(k).first) {
+                neighbors->at(num_neighbors - 1).second += neighbors->at(k).second;
+            } else {
+                neighbors->at(num_neighbors++) = neighbors->at(k);
+            }
+        }
+        neighbors->resize(num_neighbors);
+    };
+
+    coarse->label_offsets.assign(num_sites + 1, 0);
+    coarse->adj_offsets.assign(num_sites + 1, 0);
+    coarse->site_labels.resize(num_sites);
+    coarse->representatives.resize(num_sites);
+
+    /* Count pass. */
+    #pragma omp parallel
+    {
+        std::vector<std::pair<int, ENERGY_TYPE> > neighbors;
+
+        #pragma omp for
+        for (std::size_t i = 0; i < num_sites; ++i) {
+            coarse->label_offsets[i + 1] = merge_labels(i, nullptr, nullptr);
+            merge_neighbors(i, &neighbors);
+            coarse->adj_offsets[i + 1] = neighbors.size();
+            coarse->site_labels[i] = fine->site_labels[members[i].first];
+            coarse->representatives[i] = fine->representatives[members[i].first];
+        }
+    }
+
+    for (std::size_t i = 0; i < num_sites; ++i) {
+        coarse->label_offsets[i + 1] += coarse->label_offsets[i];
+        coarse->adj_offsets[i + 1] += coarse->adj_offsets[i];
+    }
+    coarse->labels.resize(coarse->label_offsets.back());
+    coarse->data_costs.resize(coarse->label_offsets.back());
+    coarse->adj.resize(coarse->adj_offsets.back());
+    coarse->adj_weights.resize(coarse->adj_offsets.back());
+
+    /* Fill pass. */
+    #pragma omp parallel
+    {
+        std::vector<std::pair<int, ENERGY_TYPE> > neighbors;
+
+        #pragma omp for
+        for (std::size_t i = 0; i < num_sites; ++i) {
+            std::size_t const label_offset = coarse->label_offsets[i];
+            merge_labels(i, coarse->labels.data() + label_offset,
+                coarse->data_costs.data() + label_offset);
+
+            merge_neighbors(i, &neighbors);
+            std::size_t const adj_offset = coarse->adj_offsets[i];
+            for (std::size_t k = 0; k < neighbors.size(); ++k) {
+                coarse->adj[adj_offset + k] = neighbors[k].first;
+                coarse->adj_weights[adj_offset + k] = neighbors[k].second;
+            }
+        }
+    }
+
+    color(coarse);
+}
+
+void MultilevelGraph::color(Level * level) {
+    std::size_t const num_sites = level->num_sites();
+
+    std::vector<int> colors(num_sites);
+    /* Last site for which the color is taken by a neighbor. */
+    std::vector<std::size_t> taken;
+    for (std::size_t i = 0; i < num_sites; ++i) {
+        for (std::size_t k = level->adj_offsets[i]; k < level->adj_offsets[i + 1]; ++k) {
+            std::size_t const j = level->adj[k];
+            if (j < i) taken[colors[j]] = i;
+        }
+        std::size_t color = 0;
+        while (color < taken.size() && taken[color] == i) ++color;
+        if (color == taken.size()) taken.push_back(num_sites);
+        colors[i] = static_cast<int>(color);
+    }
+
+    level->color_offsets.assign(taken.size() + 1, 0);
+    for (std::size_t i = 0; i < num_sites; ++i)
+        level->color_offsets[colors[i] + 1] += 1;
+    for (std::size_t c = 0; c < taken.size(); ++c)
+        level->color_offsets[c + 1] += level->color_offsets[c];
+
+    std::vector<std::size_t> fill(level->color_offsets.begin(), level->color_offsets.end() - 1);
+    level->color_sites.resize(num_sites);
+    for (std::size_t i = 0; i < num_sites; ++i)
+        level->color_sites[fill[colors[i]]++] = static_cast<int>(i);
+}
+
+void MultilevelGraph::relax(Level * level) {
+    for (std::size_t c = 0; c + 1 < level->color_offsets.size(); ++c) {
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (std::size_t k = level->color_offsets[c]; k < level->color_offsets[c + 1]; ++k) {
+            int const site = level->color_sites[k];
+            int const rep = level->representatives[site];
+            std::size_t const adj_begin = level->adj_offsets[site];
+            std::size_t const adj_end = level->adj_offsets[site + 1];
+
+            auto smooth_cost = [&] (int label) -> ENERGY_TYPE {
+                ENERGY_TYPE cost = ENERGY_TYPE(0);
+                for (std::size_t n = adj_begin; n < adj_end; ++n) {
+                    int const neighbor = level->adj[n];
+                    cost += level->adj_weights[n] * smooth_cost_func(rep,
+                        level->representatives[neighbor], label, level->site_labels[neighbor]);
+                }
+                return cost;
+            };
+
+            int const label = level->site_labels[site];
+            bool label_available = false;
+            ENERGY_TYPE current_cost = ENERGY_TYPE(0);
+            ENERGY_TYPE min_cost = std::numeric_limits<ENERGY_TYPE>::max();
+            int min_label = label;
+            for (std::size_t l = level->label_offsets[site]; l < level->label_offsets[site + 1]; ++l) {
+                ENERGY_TYPE const cost = level->data_costs[l] + smooth_cost(level->labels[l]);
+                if (level->labels[l] == label) {
+                    label_available = true;
+                    current_cost = cost;
+                }
+                if (cost < min_cost) {
+                    min_cost = cost;
+                    min_label = level->labels[l];
+                }
+            }
+            if (!label_available)
+                current_cost = MRF_MAX_ENERGYTERM + smooth_cost(label);
+
+            /* Only strict improvements, ties keep the current label. */
+            if (min_cost < current_cost)
+                level->site_labels[site] = min_label;
+        }
+    }
+}
+
+ENERGY_TYPE MultilevelGraph::compute_energy() {
+    if (levels.empty()) build_finest_level();
+    Level const & level = levels[0];
+
+    /* Accumulate in double, the costs of undefined labels are huge. */
+    double energy = 0.0;
+    #pragma omp parallel for reduction(+:energy)
+    for (std::size_t i = 0; i < level.num_sites(); ++i) {
+        int const label = level.site_labels[i];
+        ENERGY_TYPE data_cost = MRF_MAX_ENERGYTERM;
+        for (std::size_t l = level.label_offsets[i]; l < level.label_offsets[i + 1]; ++l) {
+            if (level.labels[l] == label) data_cost = level.data_costs[l];
+        }
+        energy += data_cost;
+
+        /* Count every edge once. */
+        for (std::size_t n = level.adj_offsets[i]; n < level.adj_offsets[i + 1]; ++n) {
+            std::size_t const neighbor = level.adj[n];
+            if (neighbor < i) continue;
+            energy += level.adj_weights[n] * smooth_cost_func(static_cast<int>(i),
+                static_cast<int>(neighbor), label, level.site_labels[neighbor]);
+        }
+    }
+
+    return static_cast<ENERGY_TYPE>(energy);
+}
+
+ENERGY_TYPE MultilevelGraph::optimize(int num_iterations) {
+    if (levels.empty()) build_finest_level();
+
+    for (int i = 0; i < num_iterations; ++i) {
+        /* Coarsen with respect to the current labeling. */
+        while (levels.size() <= MRF_MULTILEVEL_MAX_LEVELS) {
+            Level coarse;
+            coarsen(&levels.back(), &coarse);
+            if (coarse.num_sites() == 0) break;
+            levels.push_back(std::move(coarse));
+        }
+
+        /* Optimize from the coarsest level and refine. */
+        for (std::size_t k = levels.size(); k-- > 0;) {
+            Level & level = levels[k];
+            if (k + 1 < levels.size()) {
+                Level const & coarse = levels[k + 1];
+                #pragma omp parallel for
+                for (std::size_t j = 0; j < level.num_sites(); ++j)
+                    level.site_labels[j] = coarse.site_labels[level.parents[j]];
+            }
+            relax(&level);
+        }
+        levels.resize(1);
+        num_cycles += 1;
+    }
+
+    return compute_energy();
+}
+
+void MultilevelGraph::set_smooth_cost(SmoothCostFunction func) {
+    smooth_cost_func = func;
+}
+
+void MultilevelGraph::set_neighbors(int site1, int site2) {
+    sites[site1].neighbors.push_back(site2);
+    sites[site2].neighbors.push_back(site1);
+    levels.clear();
+}
+
+void MultilevelGraph::set_data_costs(int label, std::vector<SparseDataCost> const & costs) {
+    for (std::size_t i = 0; i < costs.size(); ++i) {
+        Site * site = &sites[costs[i].site];
+        site->labels.push_back(label);
+        ENERGY_TYPE data_cost = costs[i].cost;
+        site->data_costs.push_back(data_cost);
+
+        if (data_cost < site->data_cost) {
+            site->label = label;
+            site->data_cost = data_cost;
+        }
+    }
+    levels.clear();
+}
+
+int MultilevelGraph::what_label(int site) {
+    if (levels.empty()) return sites[site].label;
+    return levels[0].site_labels[site];
+}
+
+int MultilevelGraph::num_sites() {
+    return static_cast<int>(sites.size());
+}
+
+MRF_NAMESPACE_END
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MRF_MULTILEVELGRAPH_HEADER
+#define MRF_MULTILEVELGRAPH_HEADER
+
+#include "graph.h"
+
+/* Maximal number of coarse levels of a V-cycle. */
+#define MRF_MULTILEVEL_MAX_LEVELS 24
+/* Coarsening stops if a level shrinks by less than this ratio. */
+#define MRF_MULTILEVEL_MIN_REDUCTION 0.9f
+
+MRF_NAMESPACE_BEGIN
+
+/**
+  * Multilevel solver which coarsens the graph by merging neighboring sites
+  * with equal labels, optimizes the coarsest level and refines the labeling
+  * level by level. Every optimize iteration is one such V-cycle, starting
+  * from the current labeling.
+  *
+  * Each level is optimized with iterated conditional modes in parallel:
+  * the sites are greedily colored and all sites of one color, which are not
+  * adjacent, are updated simultaneously. A coarse site carries the data
+  * costs of its fine sites plus the smoothness costs of the edges between
+  * them, so moving it changes the fine energy by exactly the coarse change
+  * and the energy never increases. Relabeling whole regions on the coarse
+  * levels escapes the local minima of single site updates.
+  *
+  * The coarse levels evaluate the smoothness cost function once per coarse
+  * edge for representative sites, which is exact for costs that do not
+  * depend on the sites (e.g. the Potts model).
+  */
+class MultilevelGraph : public Graph {
+    private:
+        struct Site {
+            int label;
+            ENERGY_TYPE data_cost;
+            std::vector<int> labels;
+            std::vector<ENERGY_TYPE> data_costs;
+            std::vector<int> neighbors;
+            Site() : label(0), data_cost(MRF_MAX_ENERGYTERM) {}
+        };
+
+        /** Graph of one level in compressed row format. */
+        struct Level {
+            /* Available labels of each site in ascending order with their costs. */
+            std::vector<std::size_t> label_offsets;
+            std::vector<int> labels;
+            std::vector<ENERGY_TYPE> data_costs;
+
+            /* Neighbors of each site with the number of finest edges between them. */
+            std::vector<std::size_t> adj_offsets;
+            std::vector<int> adj;
+            std::vector<ENERGY_TYPE> adj_weights;
+
+            /* Sites of each color, the sites of one color are not adjacent. */
+            std::vector<std::size_t> color_offsets;
+            std::vector<int> color_sites;
+
+            std::vector<int> site_labels;
+            /* Finest site passed to the smoothness cost function. */
+            std::vector<int> representatives;
+            /* Site of the next coarser level containing the site. */
+            std::vector<int> parents;
+
+            std::size_t num_sites() const { return site_labels.size(); }
+        };
+
+        std::vector<Site> sites;
+        std::vector<Level> levels;
+        SmoothCostFunction smooth_cost_func;
+        /* Number of V-cycles run so far. */
+        int num_cycles;
+
+        void build_finest_level(void);
+        void coarsen(Level * fine, Level * coarse);
+        void color(Level * level);
+        void relax(Level * level);
+
+    public:
+        MultilevelGraph(int num_sites, int num_labels);
+
+        void set_smooth_cost(SmoothCostFunction func);
+        void set_data_costs(int label, std::vector<SparseDataCost> const & costs);
+        void set_neighbors(int site1, int site2);
+        ENERGY_TYPE compute_energy();
+        ENERGY_TYPE optimize(int num_iterations);
+        int what_label(int site);
+
+        int num_sites();
+};
+
+MRF_NAMESPACE_END
+
+#endif /* MRF_MULTILEVELGRAPH_HEADER */
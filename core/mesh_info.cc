@@ -31,7 +31,8 @@ VertexInfoList::calculate (TriangleMesh::ConstPtr mesh)
         for (std::size_t j = 0; j < 3; ++j, ++i3)
             this->at(faces[i3]).faces.push_back(i);
 
-    /* Order and classify all vertices. */
+    /* Order and classify all vertices, each only modifies its own info. */
+#pragma omp parallel for schedule(dynamic, 1024)
     for (std::size_t i = 0; i < this->size(); ++i)
         this->order_and_classify(*mesh, i);
 }
@@ -880,6 +880,158 @@ save_ply_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename,
 
 /* ---------------------------------------------------------------- */
 
+namespace
+{
+    /* Fixed width of the vertex amount, patched on close. */
+    int const PLY_COUNT_DIGITS = 20;
+}
+
+PLYPointWriter::PLYPointWriter (std::string const& filename,
+    SavePLYOptions const& options)
+    : filename(filename)
+    , options(options)
+    , num_written(0)
+{
+    if (filename.empty())
+        throw std::invalid_argument("No filename given");
+
+    this->out.open(filename.c_str(), std::ios::binary);
+    if (!this->out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    this->out << "ply" << std::endl;
+    this->out << "format binary_little_endian 1.0" << std::endl;
+    this->out << "comment Export generated by libcore" << std::endl;
+    this->out << "element vertex ";
+    this->count_pos = this->out.tellp();
+    this->out << std::string(PLY_COUNT_DIGITS, '0') << std::endl;
+    this->out << "property float x" << std::endl;
+    this->out << "property float y" << std::endl;
+    this->out << "property float z" << std::endl;
+    if (options.write_vertex_normals)
+    {
+        this->out << "property float nx" << std::endl;
+        this->out << "property float ny" << std::endl;
+        this->out << "property float nz" << std::endl;
+    }
+    if (options.write_vertex_colors)
+    {
+        this->out << "property uchar red" << std::endl;
+        this->out << "property uchar green" << std::endl;
+        this->out << "property uchar blue" << std::endl;
+    }
+    if (options.write_vertex_confidences)
+        this->out << "property float confidence" << std::endl;
+    if (options.write_vertex_values)
+        this->out << "property float value" << std::endl;
+    this->out << "end_header" << std::endl;
+}
+
+PLYPointWriter::~PLYPointWriter (void)
+{
+    try
+    {
+        this->close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void
+PLYPointWriter::write (TriangleMesh const& chunk,
+    std::vector<bool> const* mask)
+{
+    if (!this->out.is_open())
+        throw std::runtime_error("PLY point writer already closed");
+
+    TriangleMesh::VertexList const& verts(chunk.get_vertices());
+    TriangleMesh::ColorList const& vcolors(chunk.get_vertex_colors());
+    TriangleMesh::NormalList const& vnormals(chunk.get_vertex_normals());
+    TriangleMesh::ConfidenceList const& conf(chunk.get_vertex_confidences());
+    TriangleMesh::ValueList const& vvalues(chunk.get_vertex_values());
+
+    bool const write_vnormals = this->options.write_vertex_normals;
+    bool const write_vcolors = this->options.write_vertex_colors;
+    bool const write_vconfidences = this->options.write_vertex_confidences;
+    bool const write_vvalues = this->options.write_vertex_values;
+    bool const has_vnormals = vnormals.size() == verts.size();
+    bool const has_vcolors = vcolors.size() == verts.size();
+    bool const has_vconfidences = conf.size() == verts.size();
+    bool const has_vvalues = vvalues.size() == verts.size();
+
+    std::size_t record_size = 3 * sizeof(float);
+    record_size += write_vnormals ? 3 * sizeof(float) : 0;
+    record_size += write_vcolors ? 3 : 0;
+    record_size += write_vconfidences ? sizeof(float) : 0;
+    record_size += write_vvalues ? sizeof(float) : 0;
+
+    /* Encode the whole chunk into one buffer, then write it at once. */
+    this->buffer.resize(verts.size() * record_size);
+    char* ptr = this->buffer.data();
+    float const zero[3] = { 0.0f, 0.0f, 0.0f };
+    std::size_t num_chunk = 0;
+    for (std::size_t i = 0; i < verts.size(); ++i)
+    {
+        if (mask != nullptr && !mask->at(i))
+            continue;
+
+        std::memcpy(ptr, *verts[i], 3 * sizeof(float));
+        ptr += 3 * sizeof(float);
+        if (write_vnormals)
+        {
+            std::memcpy(ptr, has_vnormals ? *vnormals[i] : zero,
+                3 * sizeof(float));
+            ptr += 3 * sizeof(float);
+        }
+        if (write_vcolors)
+        {
+            unsigned char color[3] = { 0, 0, 0 };
+            if (has_vcolors)
+                ply_color_convert(*vcolors[i], color);
+            std::memcpy(ptr, color, 3);
+            ptr += 3;
+        }
+        if (write_vconfidences)
+        {
+            std::memcpy(ptr, has_vconfidences ? &conf[i] : zero,
+                sizeof(float));
+            ptr += sizeof(float);
+        }
+        if (write_vvalues)
+        {
+            std::memcpy(ptr, has_vvalues ? &vvalues[i] : zero,
+                sizeof(float));
+            ptr += sizeof(float);
+        }
+        num_chunk += 1;
+    }
+
+    this->out.write(this->buffer.data(), num_chunk * record_size);
+    if (!this->out.good())
+        throw util::FileException(this->filename, std::strerror(errno));
+    this->num_written += num_chunk;
+}
+
+void
+PLYPointWriter::close (void)
+{
+    if (!this->out.is_open())
+        return;
+
+    std::string count = util::string::get(this->num_written);
+    if (count.size() > static_cast<std::size_t>(PLY_COUNT_DIGITS))
+        throw std::runtime_error("Too many vertices for PLY header");
+    count.insert(0, PLY_COUNT_DIGITS - count.size(), '0');
+
+    this->out.seekp(this->count_pos);
+    this->out.write(count.c_str(), PLY_COUNT_DIGITS);
+    this->out.close();
+    std::vector<char>().swap(this->buffer);
+}
+
+/* ---------------------------------------------------------------- */
+
 void
 save_ply_view (std::string const& filename, CameraInfo const& camera,
     FloatImage::ConstPtr depth_map, FloatImage::ConstPtr confidence_map,
@@ -10,8 +10,10 @@
 #ifndef MVE_PLY_FILE_HEADER
 #define MVE_PLY_FILE_HEADER
 
+#include <fstream>
 #include <istream>
 #include <string>
+#include <vector>
 
 #include "util/system.h"
 #include "core/defines.h"
@@ -68,6 +70,47 @@ void
 save_ply_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename,
     SavePLYOptions const& options = SavePLYOptions());
 
+/**
+ * Writes a binary PLY point set incrementally in chunks. The vertex
+ * properties are fixed by the options on construction, the vertex amount
+ * in the header is patched when the writer is closed. Memory usage is
+ * thus independent of the total amount of points. Not thread-safe.
+ */
+class PLYPointWriter
+{
+public:
+    PLYPointWriter (std::string const& filename,
+        SavePLYOptions const& options = SavePLYOptions());
+    ~PLYPointWriter (void);
+
+    /**
+     * Appends the vertices of 'chunk'. Attributes requested in the options
+     * but missing in the chunk are written with zero values. If 'mask' is
+     * given, only vertices with a non-zero mask entry are written.
+     */
+    void write (TriangleMesh const& chunk,
+        std::vector<bool> const* mask = nullptr);
+
+    /** Patches the header and closes the file. */
+    void close (void);
+
+    std::size_t get_num_written (void) const;
+
+private:
+    std::string filename;
+    SavePLYOptions options;
+    std::ofstream out;
+    std::streampos count_pos;
+    std::size_t num_written;
+    std::vector<char> buffer;
+};
+
+inline std::size_t
+PLYPointWriter::get_num_written (void) const
+{
+    return this->num_written;
+}
+
 /**
  * Stores a scanalize-compatible PLY file from a depth map.
  * If the confidence map is given, confidence values are stored and
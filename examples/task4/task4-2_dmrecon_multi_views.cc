@@ -31,6 +31,8 @@ struct AppSettings{
     int max_pixels = 1500000;
     bool force_recon = false;
     bool write_ply = false;
+    std::size_t cache_budget = std::size_t(1) << 30;
+    std::string spill_path;
     mvs::Settings mvs;
 };
 
@@ -39,18 +41,57 @@ struct AppSettings{
 int
 main (int argc, char** argv)
 {
-    if(argc<3){
-        std::cout<<"usage: scendir scale"<<std::endl;
-        return -1;
-    }
+    /* Setup argument parser. */
+    util::Arguments args;
+    args.set_exit_on_error(true);
+    args.set_nonopt_minnum(2);
+    args.set_nonopt_maxnum(2);
+    args.set_helptext_indent(25);
+    args.set_usage(argv[0], "[ OPTS ] SCENEDIR SCALE");
+    args.add_option('\0', "coarse-to-fine", true, "Number of coarser levels "
+        "reconstructed before SCALE, 0 disables [0]");
+    args.add_option('\0', "keep-conf", true, "Confidence above which upsampled "
+        "coarse-to-fine pixels are kept [0.5]");
+    args.add_option('\0', "cache-budget", true, "Memory budget of the image "
+        "pyramid cache in MB [1024]");
+    args.add_option('\0', "spill-path", true, "Directory to spill image "
+        "pyramid levels to for reuse []");
+    args.add_option('\0', "profile-path", true, "Directory for per-view JSON "
+        "profiling reports []");
+    args.add_option('f', "force", false, "Reconstruct and overwrite existing "
+        "depth maps");
+    args.set_description("Reconstructs a depth map for every view of the "
+        "scene at the given image scale.");
+    args.parse(argc, argv);
 
     AppSettings conf;
 
     // 场景文件夹
-    conf.scene_path = argv[1];
+    conf.scene_path = args.get_nth_nonopt(0);
     // 获取图像尺度
-    std::stringstream stream1(argv[2]);
-    stream1>>conf.mvs.scale;
+    conf.mvs.scale = args.get_nth_nonopt_as<int>(1);
+
+    /* Scan arguments. */
+    while (util::ArgResult const* arg = args.next_option())
+    {
+        if (arg->opt->lopt == "coarse-to-fine")
+            conf.mvs.coarseToFineLevels = arg->get_arg<int>();
+        else if (arg->opt->lopt == "keep-conf")
+            conf.mvs.coarseToFineKeepConf = arg->get_arg<float>();
+        else if (arg->opt->lopt == "cache-budget")
+            conf.cache_budget = arg->get_arg<std::size_t>() << 20;
+        else if (arg->opt->lopt == "spill-path")
+            conf.spill_path = arg->get_arg<std::string>();
+        else if (arg->opt->lopt == "profile-path")
+            conf.mvs.profilePath = arg->get_arg<std::string>();
+        else if (arg->opt->lopt == "force")
+            conf.force_recon = true;
+        else
+        {
+            std::cerr << "Invalid option: " << arg->opt->lopt << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
 
     /* Load MVE scene. */
     core::Scene::Ptr scene;
@@ -65,6 +106,18 @@ main (int argc, char** argv)
         return EXIT_FAILURE;
     }
 
+    /* The image pyramid cache is shared by all views, configure it once. */
+    try
+    {
+        mvs::ImagePyramidCache::setMemoryBudget(conf.cache_budget);
+        mvs::ImagePyramidCache::setSpillDirectory(conf.spill_path);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error configuring pyramid cache: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
     /* Settings for Multi-view stereo */
     conf.mvs.writePlyFile = conf.write_ply;
     conf.mvs.plyPath = util::fs::join_path(conf.scene_path, conf.ply_dest);
@@ -83,6 +136,8 @@ main (int argc, char** argv)
 
      // 对于每一个视角单独进行重建
      util::WallTimer timer;
+     // 共视索引只与场景相关，所有参考视角共享
+     mvs::CovisibilityIndex::ConstPtr covis_index;
      for (std::size_t i = 0; i < conf.view_ids.size(); ++i)
      {
             std::size_t id = conf.view_ids[i];
@@ -106,7 +161,9 @@ main (int argc, char** argv)
             try {
                 // 重建场景
                 mvs::DMRecon recon(scene, settings);
+                recon.setCovisibilityIndex(covis_index);
                 recon.start();
+                covis_index = recon.getCovisibilityIndex();
                 views[id]->save_view();
             }
             catch (std::exception &err)
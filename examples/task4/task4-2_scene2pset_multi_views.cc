@@ -24,6 +24,7 @@
 #include "core/mesh_tools.h"
 #include "core/scene.h"
 #include "core/view.h"
+#include "mvs/depthmap_fusion.h"
 
 
 struct AppSettings
@@ -43,6 +44,7 @@ struct AppSettings
     std::vector<int> ids;
     int view_id = -1;
     float dd_factor = 5.0f;
+    float voxel_size = 0.0f;
     int scale = 0;
 };
 
@@ -51,7 +53,7 @@ main (int argc, char** argv)
 {
 
     if(argc<4){
-        std::cout<<"usage: scendir outmeshdir(.ply) scale"<<std::endl;
+        std::cout<<"usage: scendir outmeshdir(.ply) scale [voxel_size]"<<std::endl;
         return -1;
     }
 
@@ -64,6 +66,11 @@ main (int argc, char** argv)
     // 获取图像尺度
     std::stringstream stream(argv[3]);
     stream>>conf.scale;
+    // 去除重复点的体素大小，0表示不去重
+    if (argc > 4) {
+        std::stringstream stream_voxel(argv[4]);
+        stream_voxel>>conf.voxel_size;
+    }
 
     conf.dmname = std::string("depth-L") + argv[3];
     conf.imagename = (conf.scale == 0)
@@ -73,112 +80,33 @@ main (int argc, char** argv)
     std::cout << "Using depthmap \"" << conf.dmname
         << "\" and color image \"" << conf.imagename << "\"" << std::endl;
 
-    /* Prepare output mesh. */
-    core::TriangleMesh::Ptr pset(core::TriangleMesh::create());
-    core::TriangleMesh::VertexList& verts(pset->get_vertices());
-    core::TriangleMesh::NormalList& vnorm(pset->get_vertex_normals());
-    core::TriangleMesh::ColorList& vcolor(pset->get_vertex_colors());
-    core::TriangleMesh::ValueList& vvalues(pset->get_vertex_values()); // scale
-    core::TriangleMesh::ConfidenceList& vconfs(pset->get_vertex_confidences());
-
     /* Load scene. */
     core::Scene::Ptr scene = core::Scene::create(conf.scenedir);
 
-    /* Iterate over views and get points. */
-    core::Scene::ViewList& views(scene->get_views());
-
-    for (std::size_t i = 0; i < views.size(); ++i) {
-        core::View::Ptr view = views[i];
-        if (view == nullptr)
-            continue;
-
-        std::size_t view_id = view->get_id();
-
-        // 保证存在相机参数
-        core::CameraInfo const& cam = view->get_camera();
-        if (cam.flen == 0.0f)
-            continue;
-
-        core::FloatImage::Ptr dm = view->get_float_image(conf.dmname);
-        if (dm == nullptr)
-            continue;
-
-        // color image
-        core::ByteImage::Ptr ci;
-        if (!conf.imagename.empty())
-            ci = view->get_byte_image(conf.imagename);
-
-        std::cout << "Processing view \"" << view->get_name()
-            << "\"" << (ci != nullptr ? " (with colors)" : "")
-            << "..." << std::endl;
-
-        /* Triangulate depth map. */
-        core::TriangleMesh::Ptr mesh;
-        mesh = core::geom::depthmap_triangulate(dm, ci, cam);
-        core::TriangleMesh::VertexList const& mverts(mesh->get_vertices());
-        core::TriangleMesh::NormalList const& mnorms(mesh->get_vertex_normals());
-        core::TriangleMesh::ColorList const& mvcol(mesh->get_vertex_colors());
-        core::TriangleMesh::ConfidenceList& mconfs(mesh->get_vertex_confidences());
-
-
-        if (conf.with_normals)
-            mesh->ensure_normals();
-
-        /* If confidence is requested, compute it. */
-        if (conf.with_conf) {
-            /* Per-vertex confidence down-weighting boundaries. */
-            core::geom::depthmap_mesh_confidences(mesh, 4);
-        }
-
-        /* If scale is requested, compute it. */
-        std::vector<float> mvscale;
-        if (conf.with_scale) {
-            mvscale.resize(mverts.size(), 0.0f);
-            core::VertexInfoList::Ptr vinfo = core::VertexInfoList::create(mesh);
-            for (std::size_t j = 0; j < vinfo->size(); ++j)
-            {
-                core::MeshVertexInfo const& vinf = vinfo->at(j);
-                for (std::size_t k = 0; k < vinf.verts.size(); ++k)
-                    mvscale[j] += (mverts[j] - mverts[vinf.verts[k]]).norm();
-                mvscale[j] /= static_cast<float>(vinf.verts.size());
-                mvscale[j] *= conf.scale_factor;
-            }
-        }
-
-        // 将所有视角的三维点云集中到一起
-        // 顶点坐标
-        verts.insert(verts.end(), mverts.begin(), mverts.end());
-        // 顶点颜色
-        if (!mvcol.empty())
-           vcolor.insert(vcolor.end(), mvcol.begin(), mvcol.end());
-        //顶点法向量
-        if (conf.with_normals)
-           vnorm.insert(vnorm.end(), mnorms.begin(), mnorms.end());
-
-        // 顶点尺度(分辨率）
-        if (conf.with_scale)
-           vvalues.insert(vvalues.end(), mvscale.begin(), mvscale.end());
-
-        // 顶点置信度
-        if (conf.with_conf)
-           vconfs.insert(vconfs.end(), mconfs.begin(), mconfs.end());
-
-        dm.reset();
-        ci.reset();
-        view->cache_cleanup();
-    }
-
-    /* Write mesh to disc. */
-    std::cout << "Writing final point set (" << verts.size() << " points)..." << std::endl;
+    /* Fuse all depth maps, points are streamed to disc view by view. */
     assert(util::string::right(conf.outmesh, 4) == ".ply");
+    mvs::FusionSettings fusion;
+    fusion.dmName = conf.dmname;
+    fusion.imageName = conf.imagename;
+    fusion.viewIDs = conf.ids;
+    fusion.withNormals = conf.with_normals;
+    fusion.withScale = conf.with_scale;
+    fusion.withConf = conf.with_conf;
+    fusion.scaleFactor = conf.scale_factor;
+    fusion.voxelSize = conf.voxel_size;
+
+    try
     {
-        core::geom::SavePLYOptions opts;
-        opts.write_vertex_normals = conf.with_normals;
-        opts.write_vertex_values = conf.with_scale;
-        opts.write_vertex_confidences = conf.with_conf;
-        core::geom::save_ply_mesh(pset, conf.outmesh, opts);
+        mvs::DepthmapFusion fuser(scene, fusion);
+        std::size_t num_points = fuser.fuse(conf.outmesh);
+        std::cout << "Wrote final point set (" << num_points
+            << " points)." << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error fusing depth maps: " << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
-
 
     return EXIT_SUCCESS;
 }
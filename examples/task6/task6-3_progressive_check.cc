@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ *
+ * Regression check for the progressive evaluation of the implicit function:
+ * Reconstructs the input samples exhaustively and with a confidence
+ * threshold, and reports timings and the Hausdorff distance between the
+ * two surfaces.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/mesh.h"
+#include "util/timer.h"
+#include "util/arguments.h"
+#include "util/system.h"
+#include "surface/sample_io.h"
+#include "surface/iso_octree.h"
+#include "surface/iso_surface.h"
+#include "surface/defines.h"
+
+struct AppOptions
+{
+    std::vector<std::string> in_files;
+    float confidence_threshold = 5.0f;
+    float max_distance = 0.0f;
+    int refine_octree = 0;
+};
+
+struct Reconstruction
+{
+    std::vector<math::Vec3f> vertices;
+    std::size_t voxel_time = 0;
+    double mean_confidence = 0.0;
+};
+
+/** Uniform hash grid for nearest vertex queries. */
+class VertexGrid
+{
+public:
+    VertexGrid (std::vector<math::Vec3f> const& vertices, float cell_size);
+    float nearest_distance (math::Vec3f const& pos) const;
+
+private:
+    uint64_t cell_key (int x, int y, int z) const;
+
+private:
+    std::vector<math::Vec3f> const* vertices;
+    float cell_size;
+    std::unordered_map<uint64_t, std::vector<std::size_t> > cells;
+};
+
+VertexGrid::VertexGrid (std::vector<math::Vec3f> const& vertices,
+    float cell_size)
+    : vertices(&vertices), cell_size(cell_size)
+{
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        math::Vec3f const& v = vertices[i];
+        this->cells[this->cell_key(std::floor(v[0] / cell_size),
+            std::floor(v[1] / cell_size),
+            std::floor(v[2] / cell_size))].push_back(i);
+    }
+}
+
+uint64_t
+VertexGrid::cell_key (int x, int y, int z) const
+{
+    return (static_cast<uint64_t>(x & 0x1fffff) << 42)
+        | (static_cast<uint64_t>(y & 0x1fffff) << 21)
+        | static_cast<uint64_t>(z & 0x1fffff);
+}
+
+float
+VertexGrid::nearest_distance (math::Vec3f const& pos) const
+{
+    int const cx = std::floor(pos[0] / this->cell_size);
+    int const cy = std::floor(pos[1] / this->cell_size);
+    int const cz = std::floor(pos[2] / this->cell_size);
+
+    /*
+     * Search shells of cells around the cell of the position. Vertices
+     * outside of shell r are at least r cell sizes away, which bounds
+     * the search once a vertex has been found.
+     */
+    float best = std::numeric_limits<float>::max();
+    if (this->cells.empty())
+        return best;
+    for (int r = 0; r * this->cell_size < best; ++r) {
+        for (int x = cx - r; x <= cx + r; ++x)
+            for (int y = cy - r; y <= cy + r; ++y)
+                for (int z = cz - r; z <= cz + r; ++z) {
+                    if (std::abs(x - cx) != r && std::abs(y - cy) != r
+                        && std::abs(z - cz) != r)
+                        continue;
+                    auto iter = this->cells.find(this->cell_key(x, y, z));
+                    if (iter == this->cells.end())
+                        continue;
+                    for (std::size_t i : iter->second)
+                        best = std::min(best,
+                            (pos - (*this->vertices)[i]).norm());
+                }
+    }
+    return best;
+}
+
+/** Returns the largest distance from a vertex of 'a' to the vertices of 'b'. */
+float
+directed_hausdorff (std::vector<math::Vec3f> const& a,
+    VertexGrid const& grid_b)
+{
+    float result = 0.0f;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        result = std::max(result, grid_b.nearest_distance(a[i]));
+    return result;
+}
+
+/** Returns the mean edge length of the mesh, used as grid cell size. */
+float
+mean_edge_length (core::TriangleMesh::ConstPtr mesh)
+{
+    core::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    core::TriangleMesh::FaceList const& faces = mesh->get_faces();
+    double total = 0.0;
+    for (std::size_t i = 0; i < faces.size(); i += 3)
+        for (int j = 0; j < 3; ++j)
+            total += (verts[faces[i + j]]
+                - verts[faces[i + (j + 1) % 3]]).norm();
+    return faces.empty() ? 1.0f : static_cast<float>(total / faces.size());
+}
+
+Reconstruction
+reconstruct (fssr::IsoOctree* octree, float confidence_threshold,
+    float* cell_size)
+{
+    octree->clear_voxel_data();
+    octree->set_confidence_threshold(confidence_threshold);
+
+    Reconstruction recon;
+    util::WallTimer timer;
+    octree->compute_voxels();
+    recon.voxel_time = timer.get_elapsed();
+
+    fssr::IsoSurface iso_surface(octree, fssr::INTERPOLATION_CUBIC);
+    core::TriangleMesh::Ptr mesh = iso_surface.extract_mesh();
+    if (cell_size != nullptr)
+        *cell_size = 2.0f * mean_edge_length(mesh);
+
+    /* Vertices with zero confidence are removed by the reconstruction. */
+    core::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    core::TriangleMesh::ConfidenceList const& confs
+        = mesh->get_vertex_confidences();
+    for (std::size_t i = 0; i < verts.size(); ++i) {
+        if (confs[i] == 0.0f)
+            continue;
+        recon.vertices.push_back(verts[i]);
+        recon.mean_confidence += confs[i];
+    }
+    if (!recon.vertices.empty())
+        recon.mean_confidence /= recon.vertices.size();
+    return recon;
+}
+
+int
+main (int argc, char** argv)
+{
+    util::system::register_segfault_handler();
+    util::system::print_build_timestamp("FSSR Progressive Evaluation Check");
+
+    /* Setup argument parser. */
+    util::Arguments args;
+    args.set_exit_on_error(true);
+    args.set_nonopt_minnum(1);
+    args.set_helptext_indent(25);
+    args.set_usage(argv[0], "[ OPTS ] IN_PLY [ IN_PLY ... ]");
+    args.add_option('t', "conf-threshold", true, "Progressive evaluation confidence threshold [5]");
+    args.add_option('m', "max-distance", true, "Fails if the Hausdorff distance exceeds the value [0, no check]");
+    args.add_option('r', "refine-octree", true, "Refines octree with N levels [0]");
+    args.set_description("Reconstructs the input samples with exhaustive and "
+                         "progressive evaluation of the implicit function, and "
+                         "reports the evaluation times, the mean vertex confidence "
+                         "and the symmetric Hausdorff distance between the vertices "
+                         "of both surfaces.");
+    args.parse(argc, argv);
+
+    AppOptions app_opts;
+    while (util::ArgResult const* arg = args.next_result()) {
+        if (arg->opt == nullptr) {
+            app_opts.in_files.push_back(arg->arg);
+            continue;
+        }
+
+        if (arg->opt->lopt == "conf-threshold")
+            app_opts.confidence_threshold = arg->get_arg<float>();
+        else if (arg->opt->lopt == "max-distance")
+            app_opts.max_distance = arg->get_arg<float>();
+        else if (arg->opt->lopt == "refine-octree")
+            app_opts.refine_octree = arg->get_arg<int>();
+        else {
+            std::cerr << "Invalid option: " << arg->opt->sopt << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (app_opts.confidence_threshold <= 0.0f) {
+        std::cerr << "Confidence threshold must be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Reconstruction exhaustive, progressive;
+    float cell_size = 1.0f;
+    try
+    {
+        fssr::IsoOctree octree;
+        fssr::SampleIO::Options pset_opts;
+        for (std::size_t i = 0; i < app_opts.in_files.size(); ++i) {
+            std::cout << "Loading: " << app_opts.in_files[i] << "..."
+                      << std::endl;
+            fssr::SampleIO loader(pset_opts);
+            fssr::SampleList samples;
+            loader.read_file(app_opts.in_files[i], &samples);
+            octree.insert_samples(samples);
+        }
+
+        if (octree.get_num_samples() == 0) {
+            std::cerr << "Octree does not contain any samples, exiting."
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < app_opts.refine_octree; ++i)
+            octree.refine_octree();
+        octree.limit_octree_level();
+
+        exhaustive = reconstruct(&octree, 0.0f, &cell_size);
+        progressive = reconstruct(&octree,
+            app_opts.confidence_threshold, nullptr);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (exhaustive.vertices.empty() || progressive.vertices.empty()) {
+        std::cerr << "Isosurface does not contain any vertices, exiting."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VertexGrid const exhaustive_grid(exhaustive.vertices, cell_size);
+    VertexGrid const progressive_grid(progressive.vertices, cell_size);
+    float const dist_pe = directed_hausdorff(progressive.vertices,
+        exhaustive_grid);
+    float const dist_ep = directed_hausdorff(exhaustive.vertices,
+        progressive_grid);
+    float const distance = std::max(dist_pe, dist_ep);
+
+    std::cout << "Exhaustive: " << exhaustive.vertices.size()
+              << " vertices, " << exhaustive.voxel_time << "ms, mean confidence "
+              << exhaustive.mean_confidence << std::endl;
+    std::cout << "Progressive (threshold " << app_opts.confidence_threshold
+              << "): " << progressive.vertices.size() << " vertices, "
+              << progressive.voxel_time << "ms, mean confidence "
+              << progressive.mean_confidence << std::endl;
+    std::cout << "Hausdorff distance: " << distance << " (progressive to "
+              << "exhaustive " << dist_pe << ", exhaustive to progressive "
+              << dist_ep << ")" << std::endl;
+
+    if (app_opts.max_distance > 0.0f && distance > app_opts.max_distance) {
+        std::cerr << "Hausdorff distance exceeds " << app_opts.max_distance
+                  << ", check failed." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ *
+ * Benchmark of the influence queries: Times Octree::influence_query()
+ * against LinearOctree::influence_query() for query points close to the
+ * samples, and checks that both return the same number of samples.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "math/defines.h"
+#include "util/timer.h"
+#include "util/arguments.h"
+#include "util/system.h"
+#include "surface/sample_io.h"
+#include "surface/octree.h"
+#include "surface/linear_octree.h"
+#include "surface/defines.h"
+
+/* Influence distance factor of the basis functions, see IsoOctree. */
+#define INFLUENCE_FACTOR 3.0
+
+struct AppOptions
+{
+    std::vector<std::string> in_files;
+    std::size_t num_samples = 50000000;
+    std::size_t num_queries = 1000000;
+};
+
+struct QueryResult
+{
+    std::size_t time = 0;
+    std::size_t num_influences = 0;
+};
+
+/**
+ * Generates samples on a wavy unit sphere with noise and scales varying
+ * over three octree levels, similar to the samples of a depth map fusion.
+ */
+void
+generate_samples (std::size_t num_samples, fssr::SampleList* samples)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal_dist(0.0f, 1.0f);
+    std::uniform_real_distribution<float> uniform_dist(0.0f, 1.0f);
+
+    /* Sample spacing of the sphere, the smallest scale. */
+    float const spacing = std::sqrt(4.0f * MATH_PI / num_samples);
+    samples->resize(num_samples);
+    for (std::size_t i = 0; i < num_samples; ++i) {
+        math::Vec3f dir(normal_dist(rng), normal_dist(rng), normal_dist(rng));
+        dir.normalize();
+        float const radius = 1.0f + 0.05f * std::sin(9.0f * dir[0])
+            * std::cos(7.0f * dir[1]) + 0.1f * spacing * normal_dist(rng);
+
+        fssr::Sample& sample = samples->at(i);
+        sample.pos = dir * radius;
+        sample.normal = dir;
+        sample.color = math::Vec3f(0.5f);
+        sample.scale = spacing * std::pow(2.0f, 3.0f
+            * uniform_dist(rng) * uniform_dist(rng));
+        sample.confidence = 1.0f;
+    }
+}
+
+/** Returns query positions close to randomly chosen samples. */
+std::vector<math::Vec3d>
+generate_queries (fssr::SampleList const& samples, std::size_t num_queries)
+{
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<std::size_t> index_dist(0,
+        samples.size() - 1);
+    std::normal_distribution<double> normal_dist(0.0, 1.0);
+
+    std::vector<math::Vec3d> queries(num_queries);
+    for (std::size_t i = 0; i < num_queries; ++i) {
+        fssr::Sample const& sample = samples[index_dist(rng)];
+        for (int j = 0; j < 3; ++j)
+            queries[i][j] = sample.pos[j] + sample.scale * normal_dist(rng);
+    }
+    return queries;
+}
+
+QueryResult
+query_octree (fssr::Octree const& octree,
+    std::vector<math::Vec3d> const& queries)
+{
+    QueryResult result;
+    std::vector<fssr::Sample const*> samples;
+    util::WallTimer timer;
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        samples.clear();
+        octree.influence_query(queries[i], INFLUENCE_FACTOR, &samples);
+        result.num_influences += samples.size();
+    }
+    result.time = timer.get_elapsed();
+    return result;
+}
+
+QueryResult
+query_linear_octree (fssr::LinearOctree const& octree,
+    std::vector<math::Vec3d> const& queries)
+{
+    QueryResult result;
+    std::vector<std::size_t> samples;
+    util::WallTimer timer;
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        samples.clear();
+        octree.influence_query(queries[i], INFLUENCE_FACTOR, &samples);
+        result.num_influences += samples.size();
+    }
+    result.time = timer.get_elapsed();
+    return result;
+}
+
+void
+print_result (std::string const& name, QueryResult const& result,
+    std::size_t num_queries)
+{
+    double const seconds = std::max<std::size_t>(result.time, 1) / 1000.0;
+    std::cout << name << ": " << result.time << "ms, "
+              << static_cast<std::size_t>(num_queries / seconds)
+              << " queries/s, " << static_cast<double>(result.num_influences)
+              / num_queries << " samples per query" << std::endl;
+}
+
+int
+main (int argc, char** argv)
+{
+    util::system::register_segfault_handler();
+    util::system::print_build_timestamp("FSSR Influence Query Benchmark");
+
+    /* Setup argument parser. */
+    util::Arguments args;
+    args.set_exit_on_error(true);
+    args.set_nonopt_minnum(0);
+    args.set_helptext_indent(25);
+    args.set_usage(argv[0], "[ OPTS ] [ IN_PLY ... ]");
+    args.add_option('n', "num-samples", true, "Number of generated samples without input [50000000]");
+    args.add_option('q', "num-queries", true, "Number of influence queries [1000000]");
+    args.set_description("Times the influence queries of the pointer based "
+                         "octree and the linear octree and prints the queries "
+                         "per second. The samples are read from the input files, "
+                         "or generated on a sphere if no input is given. The "
+                         "queries are located around random samples.");
+    args.parse(argc, argv);
+
+    AppOptions app_opts;
+    while (util::ArgResult const* arg = args.next_result()) {
+        if (arg->opt == nullptr) {
+            app_opts.in_files.push_back(arg->arg);
+            continue;
+        }
+
+        if (arg->opt->lopt == "num-samples")
+            app_opts.num_samples = arg->get_arg<std::size_t>();
+        else if (arg->opt->lopt == "num-queries")
+            app_opts.num_queries = arg->get_arg<std::size_t>();
+        else {
+            std::cerr << "Invalid option: " << arg->opt->sopt << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    QueryResult octree_result, linear_result;
+    try
+    {
+        fssr::Octree octree;
+        std::vector<math::Vec3d> queries;
+        {
+            fssr::SampleList samples;
+            if (app_opts.in_files.empty()) {
+                std::cout << "Generating " << app_opts.num_samples
+                          << " samples..." << std::endl;
+                generate_samples(app_opts.num_samples, &samples);
+            }
+            for (std::size_t i = 0; i < app_opts.in_files.size(); ++i) {
+                std::cout << "Loading: " << app_opts.in_files[i] << "..."
+                          << std::endl;
+                fssr::SampleIO::Options pset_opts;
+                fssr::SampleIO loader(pset_opts);
+                fssr::SampleList file_samples;
+                loader.read_file(app_opts.in_files[i], &file_samples);
+                samples.insert(samples.end(), file_samples.begin(),
+                    file_samples.end());
+            }
+
+            if (samples.empty()) {
+                std::cerr << "No samples given, exiting." << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            queries = generate_queries(samples, app_opts.num_queries);
+            octree.insert_samples(samples);
+        }
+        octree.limit_octree_level();
+        octree.print_stats(std::cout);
+
+        std::cout << "Querying octree..." << std::endl;
+        octree_result = query_octree(octree, queries);
+
+        std::cout << "Building linear octree..." << std::endl;
+        util::WallTimer timer;
+        fssr::LinearOctree linear_octree;
+        linear_octree.build(&octree);
+        std::cout << "Built " << linear_octree.get_num_nodes() << " nodes in "
+                  << timer.get_elapsed() << "ms." << std::endl;
+
+        std::cout << "Querying linear octree..." << std::endl;
+        linear_result = query_linear_octree(linear_octree, queries);
+        linear_octree.restore(&octree);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    print_result("Octree", octree_result, app_opts.num_queries);
+    print_result("LinearOctree", linear_result, app_opts.num_queries);
+    std::cout << "Speedup: " << static_cast<double>(std::max<std::size_t>(
+        octree_result.time, 1)) / std::max<std::size_t>(linear_result.time, 1)
+              << std::endl;
+
+    if (octree_result.num_influences != linear_result.num_influences) {
+        std::cerr << "Query results differ, check failed." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
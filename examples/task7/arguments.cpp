@@ -10,10 +10,15 @@
 #include "arguments.h"
 
 #define SKIP_GLOBAL_SEAM_LEVELING "skip_global_seam_leveling"
+#define SEAM_LEVELING_SOLVER "seam_leveling_solver"
 #define SKIP_GEOMETRIC_VISIBILITY_TEST "skip_geometric_visibility_test"
+#define VISIBILITY_TEST "visibility_test"
+#define VIEW_SELECTION_SOLVER "view_selection_solver"
 #define SKIP_LOCAL_SEAM_LEVELING "skip_local_seam_leveling"
 #define NO_INTERMEDIATE_RESULTS "no_intermediate_results"
 #define WRITE_TIMINGS "write_timings"
+#define WRITE_GLB "write_glb"
+#define IMAGE_CACHE_BUDGET "image_cache_budget"
 
 Arguments parse_args(int argc, char **argv) {
     util::Arguments args;
@@ -64,12 +69,25 @@ Arguments parse_args(int argc, char **argv) {
         "Write out view selection model [false]");
     args.add_option('\0', SKIP_GEOMETRIC_VISIBILITY_TEST, false,
         "Skip geometric visibility test based on ray intersection [false]");
+    args.add_option('\0', VISIBILITY_TEST, true,
+        "Geometric visibility test: {" +
+        choices<VisibilityTest>() + "} [" + choice_string<VisibilityTest>(RAY_CASTING) + "]");
+    args.add_option('\0', VIEW_SELECTION_SOLVER, true,
+        "MRF solver of the view selection: {" +
+        choices<ViewSelectionSolver>() + "} [" + choice_string<ViewSelectionSolver>(GRAPH_CUTS) + "]");
     args.add_option('\0', SKIP_GLOBAL_SEAM_LEVELING, false,
         "Skip global seam leveling [false]");
+    args.add_option('\0', SEAM_LEVELING_SOLVER, true,
+        "Linear solver of the global seam leveling: {" +
+        choices<SeamLevelingSolver>() + "} [" + choice_string<SeamLevelingSolver>(MULTIGRID_CG) + "]");
     args.add_option('\0', SKIP_LOCAL_SEAM_LEVELING, false,
         "Skip local seam leveling (Poisson editing) [false]");
+    args.add_option('\0', IMAGE_CACHE_BUDGET, true,
+        "Memory budget in MB for keeping decoded view images between the texturing steps, 0 to disable [1024]");
     args.add_option('\0', WRITE_TIMINGS, false,
         "Write out timings for each algorithm step (OUT_PREFIX + _timings.csv)");
+    args.add_option('\0', WRITE_GLB, false,
+        "Additionally write the model as binary glTF (OUT_PREFIX + .glb) referencing the obj textures [false]");
     args.add_option('\0', NO_INTERMEDIATE_RESULTS, false,
         "Do not write out intermediate results");
     args.parse(argc, argv);
@@ -86,11 +104,17 @@ Arguments parse_args(int argc, char **argv) {
     conf.settings.data_term = GMI;
     conf.settings.smoothness_term = POTTS;
     conf.settings.outlier_removal = NONE;
+    conf.settings.view_selection_solver = GRAPH_CUTS;
     conf.settings.geometric_visibility_test = true;
+    conf.settings.visibility_test = RAY_CASTING;
     conf.settings.global_seam_leveling = true;
+    conf.settings.seam_leveling_solver = MULTIGRID_CG;
     conf.settings.local_seam_leveling = true;
 
+    conf.image_cache_budget = 1024;
+
     conf.write_timings = false;
+    conf.write_glb = false;
     conf.write_intermediate_results = true;
     conf.write_view_selection_model = false;
 
@@ -119,12 +143,22 @@ Arguments parse_args(int argc, char **argv) {
         case '\0':
             if (i->opt->lopt == SKIP_GEOMETRIC_VISIBILITY_TEST) {
                 conf.settings.geometric_visibility_test = false;
+            } else if (i->opt->lopt == VISIBILITY_TEST) {
+                conf.settings.visibility_test = parse_choice<VisibilityTest>(i->arg);
+            } else if (i->opt->lopt == VIEW_SELECTION_SOLVER) {
+                conf.settings.view_selection_solver = parse_choice<ViewSelectionSolver>(i->arg);
             } else if (i->opt->lopt == SKIP_GLOBAL_SEAM_LEVELING) {
                 conf.settings.global_seam_leveling = false;
+            } else if (i->opt->lopt == SEAM_LEVELING_SOLVER) {
+                conf.settings.seam_leveling_solver = parse_choice<SeamLevelingSolver>(i->arg);
             } else if (i->opt->lopt == SKIP_LOCAL_SEAM_LEVELING) {
                 conf.settings.local_seam_leveling = false;
+            } else if (i->opt->lopt == IMAGE_CACHE_BUDGET) {
+                conf.image_cache_budget = i->get_arg<std::size_t>();
             } else if (i->opt->lopt == WRITE_TIMINGS) {
                 conf.write_timings = true;
+            } else if (i->opt->lopt == WRITE_GLB) {
+                conf.write_glb = true;
             } else if (i->opt->lopt == NO_INTERMEDIATE_RESULTS) {
                 conf.write_intermediate_results = false;
             } else {
@@ -155,8 +189,13 @@ Arguments::to_string(){
         << "Data term: \t" << choice_string<DataTerm>(settings.data_term) << std::endl
         << "Smoothness term: \t" << choice_string<SmoothnessTerm>(settings.smoothness_term) << std::endl
         << "Outlier removal method: \t" << choice_string<OutlierRemoval>(settings.outlier_removal) << std::endl
+        << "View selection solver: \t" << choice_string<ViewSelectionSolver>(settings.view_selection_solver) << std::endl
+        << "Geometric visibility test: \t" << (settings.geometric_visibility_test
+            ? choice_string<VisibilityTest>(settings.visibility_test) : "none") << std::endl
         << "Apply global seam leveling: \t" << bool_to_string(settings.global_seam_leveling) << std::endl
-        << "Apply local seam leveling: \t" << bool_to_string(settings.local_seam_leveling) << std::endl;
+        << "Seam leveling solver: \t" << choice_string<SeamLevelingSolver>(settings.seam_leveling_solver) << std::endl
+        << "Apply local seam leveling: \t" << bool_to_string(settings.local_seam_leveling) << std::endl
+        << "Image cache budget (MB): \t" << image_cache_budget << std::endl;
 
     return out.str();
 }
@@ -24,7 +24,11 @@ struct Arguments {
 
     Settings settings;
 
+    /* Memory budget of the ImageCache in megabytes. */
+    std::size_t image_cache_budget;
+
     bool write_timings;
+    bool write_glb;
     bool write_intermediate_results;
     bool write_view_selection_model;
 
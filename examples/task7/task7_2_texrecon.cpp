@@ -68,6 +68,8 @@ int main(int argc, char **argv) {
     tex::prepare_mesh(vertex_infos, mesh);
 
 
+    ImageCache::set_memory_budget(conf.image_cache_budget * 1024 * 1024);
+
     //=================================Geneatring texture views=====================//
     std::size_t const num_faces = mesh->get_faces().size() / 3;
     std::cout << "Generating texture views: " << std::endl;
@@ -268,7 +270,8 @@ int main(int argc, char **argv) {
                                       mesh,
                                       vertex_infos,
                                       vertex_projection_infos,
-                                      &texture_patches);
+                                      &texture_patches,
+                                      conf.settings);
             timer.measure("Running global seam leveling");
 
             {
@@ -348,11 +351,23 @@ int main(int argc, char **argv) {
 
         std::cout << "\tSaving model... " << std::flush;
         tex::Model::save(model, conf.out_prefix);
+        if (conf.write_glb) {
+            model.save_to_glb_file(conf.out_prefix);
+        }
         std::cout << "done." << std::endl;
         timer.measure("Saving");
     }
 
     std::cout << "Whole texturing procedure took: " << wtimer.get_elapsed_sec() << "s" << std::endl;
+
+    {
+        ImageCache::Statistics const stats = ImageCache::get_statistics();
+        std::cout << "Image cache: " << stats.hits << " hits, "
+            << stats.misses << " misses, " << stats.prefetches << " prefetches, "
+            << stats.evictions << " evictions, peak "
+            << stats.peak_bytes / (1024 * 1024) << " MB, decoding took "
+            << stats.decode_seconds << "s" << std::endl;
+    }
     timer.measure("Total");
     if (conf.write_timings) {
         timer.write_to_file(conf.out_prefix + "_timings.csv");
@@ -362,6 +377,8 @@ int main(int argc, char **argv) {
         texture_atlases.clear();
         std::cout << "Generating debug texture patches:" << std::endl;
         {
+            /* The debug embeddings replace the view images. */
+            ImageCache::set_memory_budget(0);
             tex::TexturePatches texture_patches;
             generate_debug_embeddings(&texture_views);
             tex::VertexProjectionInfos vertex_projection_infos; // Will only be written
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015, Ronny Klowsky, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+
+#include "mvs/covisibility_index.h"
+
+MVS_NAMESPACE_BEGIN
+
+namespace
+{
+    bool
+    observationLess(CovisibilityIndex::Observation const& obs,
+        std::size_t feature)
+    {
+        return obs.feature < feature;
+    }
+}
+
+CovisibilityIndex::CovisibilityIndex(
+    std::vector<SingleView::Ptr> const& views,
+    core::Bundle::Features const& features)
+{
+    std::size_t const numViews = views.size();
+    this->observations.resize(numViews);
+    this->neighbors.resize(numViews);
+
+    /* Features are visited in order, observations are thus sorted. */
+    for (std::size_t i = 0; i < features.size(); ++i)
+    {
+        math::Vec3f featurePos(features[i].pos);
+        for (std::size_t j = 0; j < features[i].refs.size(); ++j)
+        {
+            int view_id = features[i].refs[j].view_id;
+            if (view_id < 0 || view_id >= static_cast<int>(numViews)
+                || views[view_id] == nullptr)
+                continue;
+
+            SingleView::Ptr view = views[view_id];
+            if (!view->pointInFrustum(featurePos))
+                continue;
+
+            Observations& obs = this->observations[view_id];
+            if (!obs.empty() && obs.back().feature == i)
+                continue;
+
+            Observation o;
+            o.feature = i;
+            o.dir = (featurePos - view->camPos).normalized();
+            o.footprint = view->footPrint(featurePos);
+            obs.push_back(o);
+        }
+    }
+
+    /* Count shared features per view pair, one dense row per thread. */
+#pragma omp parallel
+    {
+        std::vector<std::size_t> counts(numViews, 0);
+#pragma omp for schedule(dynamic)
+        for (std::size_t v = 0; v < numViews; ++v)
+        {
+            Observations const& obs = this->observations[v];
+            for (std::size_t k = 0; k < obs.size(); ++k)
+            {
+                core::Bundle::Feature3D const& feature
+                    = features[obs[k].feature];
+                for (std::size_t j = 0; j < feature.refs.size(); ++j)
+                {
+                    std::size_t w = feature.refs[j].view_id;
+                    if (w != v && this->findObservation(w, obs[k].feature))
+                        counts[w] += 1;
+                }
+            }
+
+            Neighbors& row = this->neighbors[v];
+            for (std::size_t w = 0; w < numViews; ++w)
+            {
+                if (counts[w] == 0)
+                    continue;
+                row.push_back(std::make_pair(w, counts[w]));
+                counts[w] = 0;
+            }
+        }
+    }
+}
+
+CovisibilityIndex::Observation const*
+CovisibilityIndex::findObservation(std::size_t view,
+    std::size_t feature) const
+{
+    if (view >= this->observations.size())
+        return nullptr;
+
+    Observations const& obs = this->observations[view];
+    Observations::const_iterator it = std::lower_bound(obs.begin(),
+        obs.end(), feature, observationLess);
+    if (it == obs.end() || it->feature != feature)
+        return nullptr;
+    return &*it;
+}
+
+std::size_t
+CovisibilityIndex::getNumShared(std::size_t view1, std::size_t view2) const
+{
+    Neighbors const& row = this->neighbors[view1];
+    Neighbors::const_iterator it = std::lower_bound(row.begin(), row.end(),
+        std::make_pair(view2, std::size_t(0)));
+    if (it == row.end() || it->first != view2)
+        return 0;
+    return it->second;
+}
+
+MVS_NAMESPACE_END
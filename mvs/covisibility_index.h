@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015, Ronny Klowsky, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef DMRECON_COVISIBILITY_INDEX_H
+#define DMRECON_COVISIBILITY_INDEX_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "math/vector.h"
+#include "core/bundle.h"
+#include "mvs/defines.h"
+#include "mvs/single_view.h"
+
+MVS_NAMESPACE_BEGIN
+
+/**
+ * Scene-level covisibility index which is built once from the bundle.
+ *
+ * For every view the index stores the features observed inside its frustum,
+ * sorted by feature ID, together with the normalized viewing direction and
+ * the pixel footprint of the feature in the original image resolution.
+ * A sparse view x view table holds the number of features shared by each
+ * pair of views. The index only depends on the bundle and the cameras and
+ * can thus be shared by all reference views of a reconstruction batch.
+ */
+class CovisibilityIndex
+{
+public:
+    typedef std::shared_ptr<CovisibilityIndex> Ptr;
+    typedef std::shared_ptr<CovisibilityIndex const> ConstPtr;
+
+    /** A feature observed by a view. */
+    struct Observation
+    {
+        /** Index of the feature in the bundle. */
+        std::size_t feature;
+        /** Normalized direction from the camera center to the feature. */
+        math::Vec3f dir;
+        /** Footprint of the feature in the original image. */
+        float footprint;
+    };
+
+    typedef std::vector<Observation> Observations;
+    /** Neighboring view IDs with the number of shared features. */
+    typedef std::vector<std::pair<std::size_t, std::size_t> > Neighbors;
+
+public:
+    static Ptr create(std::vector<SingleView::Ptr> const& views,
+        core::Bundle::Features const& features);
+
+    std::size_t getNumViews() const;
+
+    /** Returns the observations of a view, sorted by feature ID. */
+    Observations const& getObservations(std::size_t view) const;
+
+    /** Returns the observation of a feature in a view or nullptr. */
+    Observation const* findObservation(std::size_t view,
+        std::size_t feature) const;
+
+    /** Returns the views sharing features with 'view', sorted by ID. */
+    Neighbors const& getNeighbors(std::size_t view) const;
+
+    /** Returns the number of features shared by two views. */
+    std::size_t getNumShared(std::size_t view1, std::size_t view2) const;
+
+private:
+    CovisibilityIndex(std::vector<SingleView::Ptr> const& views,
+        core::Bundle::Features const& features);
+
+private:
+    std::vector<Observations> observations;
+    std::vector<Neighbors> neighbors;
+};
+
+/* ------------------------ Implementation ------------------------ */
+
+inline CovisibilityIndex::Ptr
+CovisibilityIndex::create(std::vector<SingleView::Ptr> const& views,
+    core::Bundle::Features const& features)
+{
+    return Ptr(new CovisibilityIndex(views, features));
+}
+
+inline std::size_t
+CovisibilityIndex::getNumViews() const
+{
+    return this->observations.size();
+}
+
+inline CovisibilityIndex::Observations const&
+CovisibilityIndex::getObservations(std::size_t view) const
+{
+    return this->observations[view];
+}
+
+inline CovisibilityIndex::Neighbors const&
+CovisibilityIndex::getNeighbors(std::size_t view) const
+{
+    return this->neighbors[view];
+}
+
+MVS_NAMESPACE_END
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "core/depthmap.h"
+#include "core/mesh_info.h"
+#include "core/mesh_io_ply.h"
+#include "mvs/depthmap_fusion.h"
+
+MVS_NAMESPACE_BEGIN
+
+namespace
+{
+    struct VoxelKey
+    {
+        int x, y, z;
+
+        bool operator== (VoxelKey const& rhs) const
+        {
+            return x == rhs.x && y == rhs.y && z == rhs.z;
+        }
+    };
+
+    struct VoxelKeyHash
+    {
+        std::size_t operator() (VoxelKey const& key) const
+        {
+            std::size_t h = static_cast<std::size_t>(key.x) * 73856093u;
+            h ^= static_cast<std::size_t>(key.y) * 19349663u;
+            h ^= static_cast<std::size_t>(key.z) * 83492791u;
+            return h;
+        }
+    };
+
+    typedef std::unordered_set<VoxelKey, VoxelKeyHash> VoxelSet;
+
+    /*
+     * Occupied voxels in two generations. Once the current generation
+     * holds half of the voxel limit, it replaces the previous one, which
+     * bounds the memory to the limit while keeping the recent views.
+     */
+    struct VoxelHistory
+    {
+        VoxelSet current;
+        VoxelSet previous;
+        std::size_t limit;
+
+        bool insert(VoxelKey const& key)
+        {
+            if (previous.count(key) > 0)
+                return false;
+            if (!current.insert(key).second)
+                return false;
+            if (current.size() >= std::max<std::size_t>(1, limit / 2))
+            {
+                previous.swap(current);
+                VoxelSet().swap(current);
+            }
+            return true;
+        }
+    };
+
+    /* Marks the points whose voxel is not occupied yet. */
+    std::size_t
+    markUniquePoints(core::TriangleMesh const& mesh, float voxelSize,
+        VoxelHistory* voxels, std::vector<bool>* mask)
+    {
+        core::TriangleMesh::VertexList const& verts(mesh.get_vertices());
+        mask->resize(verts.size());
+        std::size_t num_unique = 0;
+        for (std::size_t i = 0; i < verts.size(); ++i)
+        {
+            VoxelKey key;
+            key.x = static_cast<int>(std::floor(verts[i][0] / voxelSize));
+            key.y = static_cast<int>(std::floor(verts[i][1] / voxelSize));
+            key.z = static_cast<int>(std::floor(verts[i][2] / voxelSize));
+            (*mask)[i] = voxels->insert(key);
+            num_unique += (*mask)[i] ? 1 : 0;
+        }
+        return num_unique;
+    }
+}
+
+DepthmapFusion::DepthmapFusion(core::Scene::Ptr _scene,
+    FusionSettings const& _settings)
+    : scene(_scene)
+    , settings(_settings)
+{
+    if (scene == nullptr)
+        throw std::invalid_argument("Null scene given");
+    if (settings.dmName.empty())
+        throw std::invalid_argument("Invalid depth map embedding");
+    if (settings.voxelSize < 0.0f)
+        throw std::invalid_argument("Invalid voxel size");
+}
+
+core::TriangleMesh::Ptr
+DepthmapFusion::viewToPoints(core::View::Ptr view) const
+{
+    if (view == nullptr)
+        return core::TriangleMesh::Ptr();
+
+    // 保证存在相机参数
+    core::CameraInfo const& cam = view->get_camera();
+    if (cam.flen == 0.0f)
+        return core::TriangleMesh::Ptr();
+
+    core::FloatImage::Ptr dm = view->get_float_image(settings.dmName);
+    if (dm == nullptr)
+        return core::TriangleMesh::Ptr();
+
+    // color image
+    core::ByteImage::Ptr ci;
+    if (!settings.imageName.empty())
+        ci = view->get_byte_image(settings.imageName);
+
+    /* Triangulate depth map. */
+    core::TriangleMesh::Ptr mesh;
+    mesh = core::geom::depthmap_triangulate(dm, ci, cam);
+    dm.reset();
+    ci.reset();
+    view->cache_cleanup();
+
+    core::TriangleMesh::VertexList const& mverts(mesh->get_vertices());
+
+    if (settings.withNormals)
+        mesh->ensure_normals();
+
+    /* If confidence is requested, compute it. */
+    if (settings.withConf) {
+        /* Per-vertex confidence down-weighting boundaries. */
+        core::geom::depthmap_mesh_confidences(mesh, 4);
+    }
+
+    /* If scale is requested, compute it. */
+    if (settings.withScale) {
+        core::TriangleMesh::ValueList& mvscale(mesh->get_vertex_values());
+        mvscale.clear();
+        mvscale.resize(mverts.size(), 0.0f);
+        core::VertexInfoList::Ptr vinfo = core::VertexInfoList::create(mesh);
+        for (std::size_t j = 0; j < vinfo->size(); ++j)
+        {
+            core::MeshVertexInfo const& vinf = vinfo->at(j);
+            for (std::size_t k = 0; k < vinf.verts.size(); ++k)
+                mvscale[j] += (mverts[j] - mverts[vinf.verts[k]]).norm();
+            mvscale[j] /= static_cast<float>(vinf.verts.size());
+            mvscale[j] *= settings.scaleFactor;
+        }
+    }
+
+    /* Only the points are required. */
+    core::TriangleMesh::FaceList().swap(mesh->get_faces());
+    core::TriangleMesh::NormalList().swap(mesh->get_face_normals());
+    return mesh;
+}
+
+std::size_t
+DepthmapFusion::fuse(std::string const& filename)
+{
+    core::Scene::ViewList& views(scene->get_views());
+    std::vector<int> ids(settings.viewIDs);
+    if (ids.empty())
+        for (std::size_t i = 0; i < views.size(); ++i)
+            ids.push_back(i);
+
+    core::geom::SavePLYOptions opts;
+    opts.write_vertex_colors = !settings.imageName.empty();
+    opts.write_vertex_normals = settings.withNormals;
+    opts.write_vertex_values = settings.withScale;
+    opts.write_vertex_confidences = settings.withConf;
+    core::geom::PLYPointWriter writer(filename, opts);
+
+    VoxelHistory voxels;
+    voxels.limit = settings.maxVoxels;
+    std::vector<bool> mask;
+    std::atomic<bool> failed(false);
+    std::string error;
+
+    /* Views are processed in parallel but written in order. */
+#pragma omp parallel for ordered schedule(dynamic, 1)
+    for (std::size_t i = 0; i < ids.size(); ++i)
+    {
+        core::TriangleMesh::Ptr mesh;
+        core::View::Ptr view;
+        std::string view_error;
+        if (ids[i] >= 0 && ids[i] < static_cast<int>(views.size()))
+            view = views[ids[i]];
+
+        try
+        {
+            mesh = this->viewToPoints(view);
+        }
+        catch (std::exception& e)
+        {
+            view_error = e.what();
+        }
+
+        /* Error state is only touched in the ordered section. */
+#pragma omp ordered
+        {
+            if (!failed && !view_error.empty())
+            {
+                failed = true;
+                error = view_error;
+            }
+
+            if (!failed && mesh != nullptr)
+            {
+                std::size_t num_points = mesh->get_vertices().size();
+                try
+                {
+                    if (settings.voxelSize > 0.0f)
+                    {
+                        num_points = markUniquePoints(*mesh,
+                            settings.voxelSize, &voxels, &mask);
+                        writer.write(*mesh, &mask);
+                    }
+                    else
+                    {
+                        writer.write(*mesh);
+                    }
+                }
+                catch (std::exception& e)
+                {
+                    failed = true;
+                    error = e.what();
+                }
+
+                if (!settings.quiet)
+                    std::cout << "Processed view \"" << view->get_name()
+                        << "\", " << num_points << " points." << std::endl;
+            }
+        }
+    }
+
+    if (failed)
+        throw std::runtime_error(error);
+
+    writer.close();
+    return writer.get_num_written();
+}
+
+MVS_NAMESPACE_END
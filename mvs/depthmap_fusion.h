@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef DMRECON_DEPTHMAP_FUSION_H
+#define DMRECON_DEPTHMAP_FUSION_H
+
+#include <string>
+#include <vector>
+
+#include "core/mesh.h"
+#include "core/scene.h"
+#include "core/view.h"
+#include "mvs/defines.h"
+
+MVS_NAMESPACE_BEGIN
+
+struct FusionSettings
+{
+    /** Depth map and color image embeddings. */
+    std::string dmName = "depth-L0";
+    std::string imageName = "undistorted";
+
+    /** Views to fuse, all views if empty. */
+    std::vector<int> viewIDs;
+
+    bool withNormals = true;
+    bool withScale = true;
+    bool withConf = true;
+
+    /** "Radius" of MVS patch (usually 5x5). */
+    float scaleFactor = 2.5f;
+
+    /**
+     * Edge length of the voxel grid used to remove duplicate points, only
+     * the first point per voxel is kept. Zero disables de-duplication.
+     */
+    float voxelSize = 0.0f;
+
+    /**
+     * Upper bound on the amount of occupied voxels remembered for
+     * de-duplication. When exceeded, voxels of the oldest views are
+     * forgotten, and points of later views may duplicate them.
+     */
+    std::size_t maxVoxels = std::size_t(1) << 22;
+
+    bool quiet = false;
+};
+
+/**
+ * Streaming fusion of depth maps into a point set. Views are triangulated
+ * in parallel and written in view order to a chunked PLY writer as soon as
+ * they are processed, so that only the views in flight are kept in memory
+ * instead of the whole point set.
+ */
+class DepthmapFusion
+{
+public:
+    DepthmapFusion(core::Scene::Ptr scene, FusionSettings const& settings);
+
+    /** Fuses all depth maps into 'filename', returns the amount of points. */
+    std::size_t fuse(std::string const& filename);
+
+    /** Computes the points of a single view, or nullptr without depth map. */
+    core::TriangleMesh::Ptr viewToPoints(core::View::Ptr view) const;
+
+private:
+    core::Scene::Ptr scene;
+    FusionSettings settings;
+};
+
+MVS_NAMESPACE_END
+
+#endif
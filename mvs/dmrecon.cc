@@ -7,6 +7,8 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
@@ -21,16 +23,51 @@
 #include "math/octree_tools.h"
 #include "core/image.h"
 #include "core/image_tools.h"
+#include "util/exception.h"
 #include "util/file_system.h"
 #include "util/strings.h"
+#include "util/timer.h"
 #include "mvs/settings.h"
 #include "mvs/dmrecon.h"
 #include "mvs/global_view_selection.h"
+#include "mvs/image_pyramid.h"
 #include "mvs/progress.h"
 #include "mvs/single_view.h"
 
 MVS_NAMESPACE_BEGIN
 
+namespace
+{
+    /* Adds the wall clock time of its own lifetime to a stage. */
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(StageProfile& _stage)
+            : stage(_stage)
+        {
+        }
+
+        ~StageTimer()
+        {
+            stage.seconds += timer.get_elapsed_sec();
+            stage.runs += 1;
+        }
+
+    private:
+        StageProfile& stage;
+        util::WallTimer timer;
+    };
+
+    void
+    writeStageJSON(std::ostream& out, char const* name,
+        StageProfile const& stage, bool last)
+    {
+        out << "    \"" << name << "\": { \"seconds\": " << stage.seconds
+            << ", \"runs\": " << stage.runs << " }"
+            << (last ? "" : ",") << std::endl;
+    }
+}
+
 DMRecon::DMRecon(core::Scene::Ptr _scene, Settings const& _settings)
     : scene(_scene)
     , settings(_settings)
@@ -45,9 +82,17 @@ DMRecon::DMRecon(core::Scene::Ptr _scene, Settings const& _settings)
     if (settings.scale < 0.f)
         throw std::invalid_argument("Invalid scale factor");
 
+    /* Check for meaningful coarse-to-fine levels */
+    if (settings.coarseToFineLevels < 0)
+        throw std::invalid_argument("Invalid coarse-to-fine levels");
+
     /* Check if image embedding is set. */
     if (settings.imageEmbedding.empty())
         throw std::invalid_argument("Invalid image embedding");
+
+    /* The shared image pyramid cache is configured by the application. */
+    cacheStatsStart = ImagePyramidCache::getStats();
+
     /* Fetch bundle file. */
     try {
         this->bundle = this->scene->get_bundle();
@@ -102,12 +147,18 @@ DMRecon::start()
         // 全局视角选择
         globalViewSelection();
 
-        // 处理特征，对当前的三维点投影到图像上进行深度值估计
-        // 并且将重建的特征点添加到队列中，作为种子点
-        processFeatures();
+        if (settings.coarseToFineLevels > 0){
+            // 由粗到精的重建，粗尺度的结果作为细尺度的种子点
+            processCoarseToFine();
+        }
+        else{
+            // 处理特征，对当前的三维点投影到图像上进行深度值估计
+            // 并且将重建的特征点添加到队列中，作为种子点
+            processFeatures();
 
-        // 处理队列
-        processQueue();
+            // 处理队列
+            processQueue();
+        }
 
 
         // 保存图像
@@ -168,6 +219,32 @@ DMRecon::start()
         size_t mvs_time = std::time(nullptr) - progress.start_time;
         if (!settings.quiet)
             std::cout << "MVS took " << mvs_time << " seconds." << std::endl;
+
+        /* Cache counters are process-wide, keep the delta of this run. */
+        ImagePyramidCache::Stats cacheStats = ImagePyramidCache::getStats();
+        progress.profile.pyramidCacheHits
+            = cacheStats.hits - cacheStatsStart.hits;
+        progress.profile.pyramidCacheMisses
+            = cacheStats.misses - cacheStatsStart.misses;
+
+        /* Write profiling report, failing to do so keeps the depth map. */
+        if (!settings.profilePath.empty())
+        {
+            try
+            {
+                if (!util::fs::dir_exists(settings.profilePath.c_str())
+                    && !util::fs::mkdir(settings.profilePath.c_str()))
+                    throw util::FileException(settings.profilePath,
+                        "Cannot create profile directory");
+                writeProfile(util::fs::join_path(settings.profilePath,
+                    refV->createFileName(settings.scale) + "-profile.json"));
+            }
+            catch (util::FileException& e)
+            {
+                std::cerr << "Warning: Profile not written: " << e.filename
+                          << ": " << e.what() << std::endl;
+            }
+        }
     }
     catch (util::Exception e)
     {
@@ -186,6 +263,7 @@ DMRecon::start()
 void
 DMRecon::analyzeFeatures()
 {
+    StageTimer stageTimer(progress.profile.analyzeFeatures);
     progress.status = RECON_FEATURES;
 
     // 获取参考视角
@@ -229,14 +307,17 @@ DMRecon::analyzeFeatures()
 void
 DMRecon::globalViewSelection(){
 
+    StageTimer stageTimer(progress.profile.globalViewSelection);
     progress.status = RECON_GLOBALVS;
     if (progress.cancelled)
         return;
 
     //执行全局的视角选择
     /* Perform global view selection. */
-    GlobalViewSelection globalVS(views, bundle->get_features(), settings);
+    GlobalViewSelection globalVS(views, bundle->get_features(), settings,
+        covisIndex);
     globalVS.performVS();
+    covisIndex = globalVS.getCovisibilityIndex();
     neighViews = globalVS.getSelectedIDs();
 
     // 全局的视角选择失败
@@ -265,6 +346,7 @@ DMRecon::globalViewSelection(){
 void
 DMRecon::processFeatures(){
 
+    StageTimer stageTimer(progress.profile.processFeatures);
     progress.status = RECON_FEATURES;
     if (progress.cancelled)
         return;
@@ -314,14 +396,19 @@ DMRecon::processFeatures(){
             this->settings.aabbMin, this->settings.aabbMax))
             continue;
 
-        /* Start processing the feature. */
-        processed += 1;
-
         // 将三维特征点投影到对应尺度的参考图像上
         math::Vec2f pixPosF = refV->worldToScreenScaled(featPos);
         int const x = math::round(pixPosF[0]);
         int const y = math::round(pixPosF[1]);
 
+        /* Skip pixels already kept from a coarser level. */
+        if (settings.coarseToFineLevels > 0 && refV->confImg->at(
+            y * this->width + x) >= settings.coarseToFineKeepConf)
+            continue;
+
+        /* Start processing the feature. */
+        processed += 1;
+
         // 初始的深度设置为三维特征点到参考图像的距离
         float initDepth = (featPos - refV->camPos).norm();
 
@@ -330,6 +417,7 @@ DMRecon::processFeatures(){
             0.f, 0.f, neighViews, IndexSet());
         patch.doAutoOptimization();
         float conf = patch.computeConfidence();
+        recordPatch(patch, conf);
         if (conf <= 0.0f)
             continue;
 
@@ -375,6 +463,7 @@ DMRecon::processFeatures(){
 void
 DMRecon::processQueue()
 {
+    StageTimer stageTimer(progress.profile.processQueue);
     progress.status = RECON_QUEUE;
     if (progress.cancelled)  return;
 
@@ -399,6 +488,8 @@ DMRecon::processQueue()
     while (!prQueue.empty() && !progress.cancelled){
 
         progress.queueSize = prQueue.size();
+        progress.profile.maxQueueSize = std::max(
+            progress.profile.maxQueueSize, progress.queueSize);
 
         // 每填充1000个像素并且填充像素在增加，则打印输出填充结果
         if ((progress.filled % 1000 == 0) && (progress.filled != lastStatus)) {
@@ -421,6 +512,7 @@ DMRecon::processQueue()
 
         //此处应该是相等的
         if (refV->confImg->at(index) > tmpData.confidence) {
+            ++progress.profile.staleQueueEntries;
             continue ;
         }
 
@@ -429,6 +521,7 @@ DMRecon::processQueue()
             tmpData.dz_i, tmpData.dz_j, neighViews, tmpData.localViewIDs);
         patch.doAutoOptimization();
         tmpData.confidence = patch.computeConfidence();
+        recordPatch(patch, tmpData.confidence);
 
         /*优化后的confidence<0 则抛除*/
         if (tmpData.confidence == 0) {
@@ -493,4 +586,189 @@ DMRecon::processQueue()
     }
 }
 
+/*
+ * Reconstructs the reference view on 'coarseToFineLevels' coarser pyramid
+ * levels first. The result of every level is upsampled to the next finer
+ * level, where confident pixels are kept and only the remaining ones are
+ * re-optimized.
+ */
+void
+DMRecon::processCoarseToFine()
+{
+    SingleView::Ptr refV = views[settings.refViewNr];
+    int const coarsest = refV->clampLevel(settings.scale
+        + settings.coarseToFineLevels);
+
+    for (int level = coarsest; level >= settings.scale
+        && !progress.cancelled; --level){
+
+        core::FloatImage::ConstPtr lowDepth = refV->depthImg;
+        core::FloatImage::ConstPtr lowNormal = refV->normalImg;
+        core::FloatImage::ConstPtr lowDz = refV->dzImg;
+        core::FloatImage::ConstPtr lowConf = refV->confImg;
+
+        // 创建当前尺度的深度图、法向量图等
+        refV->prepareMasterView(level);
+        this->width = refV->getScaledImg()->width();
+        this->height = refV->getScaledImg()->height();
+        progress.filled = 0;
+
+        if (!settings.quiet)
+            std::cout << "Reconstructing level " << level << " ("
+                      << this->width << " x " << this->height << ")"
+                      << std::endl;
+
+        if (level != coarsest)
+            refillQueueFromLowRes(lowDepth, lowNormal, lowDz, lowConf);
+
+        processFeatures();
+        processQueue();
+    }
+}
+
+/*
+ * Seeds the current level from the reconstruction of the next coarser
+ * level. Pixels above 'coarseToFineKeepConf' are copied into the maps,
+ * all other upsampled pixels and the border of the copied regions are
+ * pushed to the queue for optimization.
+ */
+void
+DMRecon::refillQueueFromLowRes(core::FloatImage::ConstPtr lowDepth,
+    core::FloatImage::ConstPtr lowNormal,
+    core::FloatImage::ConstPtr lowDz,
+    core::FloatImage::ConstPtr lowConf)
+{
+    SingleView::Ptr refV = views[settings.refViewNr];
+    int const lowWidth = lowConf->width();
+    int const lowHeight = lowConf->height();
+
+    /* Index of the coarse pixel covering fine pixel (x, y), or -1. */
+    std::vector<int> lowIndex(this->width * this->height, -1);
+    for (int y = 0; y < this->height; ++y)
+        for (int x = 0; x < this->width; ++x){
+            int const lx = std::min(x / 2, lowWidth - 1);
+            int const ly = std::min(y / 2, lowHeight - 1);
+            int const lidx = ly * lowWidth + lx;
+            if (lowConf->at(lidx) > 0.f)
+                lowIndex[y * this->width + x] = lidx;
+        }
+
+    std::size_t kept = 0, queued = 0;
+    for (int y = 0; y < this->height && !progress.cancelled; ++y)
+        for (int x = 0; x < this->width; ++x){
+            int const index = y * this->width + x;
+            int const lidx = lowIndex[index];
+            if (lidx < 0)
+                continue;
+
+            // 像素尺寸减半，深度变化率也减半
+            QueueData tmpData;
+            tmpData.x = x;
+            tmpData.y = y;
+            tmpData.confidence = lowConf->at(lidx);
+            tmpData.dz_i = lowDz->at(lidx, 0) * 0.5f;
+            tmpData.dz_j = lowDz->at(lidx, 1) * 0.5f;
+
+            /*
+             * The coarse pixel center lies at (2 * lx + 0.5, 2 * ly + 0.5)
+             * in the current level. The depth is extrapolated from there
+             * to the pixel center along the depth slopes.
+             */
+            float const offsetX = x - 2 * (lidx % lowWidth) - 0.5f;
+            float const offsetY = y - 2 * (lidx / lowWidth) - 0.5f;
+            tmpData.depth = lowDepth->at(lidx) + offsetX * tmpData.dz_i
+                + offsetY * tmpData.dz_j;
+
+            if (tmpData.confidence < settings.coarseToFineKeepConf){
+                prQueue.push(tmpData);
+                ++queued;
+                continue;
+            }
+
+            refV->depthImg->at(index) = tmpData.depth;
+            refV->normalImg->at(index, 0) = lowNormal->at(lidx, 0);
+            refV->normalImg->at(index, 1) = lowNormal->at(lidx, 1);
+            refV->normalImg->at(index, 2) = lowNormal->at(lidx, 2);
+            refV->dzImg->at(index, 0) = tmpData.dz_i;
+            refV->dzImg->at(index, 1) = tmpData.dz_j;
+            refV->confImg->at(index) = tmpData.confidence;
+            ++progress.filled;
+            ++kept;
+
+            /* Let the border of confident regions grow into the rest. */
+            bool border = false;
+            if (x > 0 && lowIndex[index - 1] < 0)
+                border = true;
+            if (x < this->width - 1 && lowIndex[index + 1] < 0)
+                border = true;
+            if (y > 0 && lowIndex[index - this->width] < 0)
+                border = true;
+            if (y < this->height - 1 && lowIndex[index + this->width] < 0)
+                border = true;
+            if (border){
+                prQueue.push(tmpData);
+                ++queued;
+            }
+        }
+
+    if (!settings.quiet)
+        std::cout << "Upsampled " << kept << " confident pixels, queued "
+                  << queued << " seeds from coarser level." << std::endl;
+}
+
+void
+DMRecon::recordPatch(PatchOptimization const& patch, float conf)
+{
+    Profile& profile = progress.profile;
+    profile.patchOptimizations += 1;
+    profile.optiIterations += patch.getIterationCount();
+    profile.nccEvaluations += patch.getNumNCCEvaluations();
+    if (conf <= 0.0f)
+        profile.rejectedSeeds += 1;
+}
+
+void
+DMRecon::writeProfile(std::string const& filename) const
+{
+    std::ofstream out(filename.c_str());
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    Profile const& profile = progress.profile;
+
+    out << "{" << std::endl;
+    out << "  \"view\": " << settings.refViewNr << "," << std::endl;
+    out << "  \"scale\": " << settings.scale << "," << std::endl;
+    out << "  \"width\": " << this->width << "," << std::endl;
+    out << "  \"height\": " << this->height << "," << std::endl;
+    out << "  \"filled\": " << progress.filled << "," << std::endl;
+    out << "  \"stages\": {" << std::endl;
+    writeStageJSON(out, "analyze_features", profile.analyzeFeatures, false);
+    writeStageJSON(out, "global_view_selection",
+        profile.globalViewSelection, false);
+    writeStageJSON(out, "process_features", profile.processFeatures, false);
+    writeStageJSON(out, "process_queue", profile.processQueue, true);
+    out << "  }," << std::endl;
+    out << "  \"patch_optimizations\": " << profile.patchOptimizations
+        << "," << std::endl;
+    out << "  \"optimization_iterations\": " << profile.optiIterations
+        << "," << std::endl;
+    out << "  \"ncc_evaluations\": " << profile.nccEvaluations
+        << "," << std::endl;
+    out << "  \"rejected_seeds\": " << profile.rejectedSeeds
+        << "," << std::endl;
+    out << "  \"stale_queue_entries\": " << profile.staleQueueEntries
+        << "," << std::endl;
+    out << "  \"max_queue_size\": " << profile.maxQueueSize
+        << "," << std::endl;
+    out << "  \"pyramid_cache_hits\": " << profile.pyramidCacheHits
+        << "," << std::endl;
+    out << "  \"pyramid_cache_misses\": " << profile.pyramidCacheMisses
+        << std::endl;
+    out << "}" << std::endl;
+
+    if (!out.good())
+        throw util::FileException(filename, "Error writing profile");
+}
+
 MVS_NAMESPACE_END
@@ -19,6 +19,8 @@
 #include "core/image.h"
 #include "core/scene.h"
 #include "mvs/defines.h"
+#include "mvs/covisibility_index.h"
+#include "mvs/image_pyramid.h"
 #include "mvs/patch_optimization.h"
 #include "mvs/single_view.h"
 #include "mvs/progress.h"
@@ -52,12 +54,28 @@ public:
     std::size_t getRefViewNr() const;
     Progress const& getProgress() const;
     Progress& getProgress();
+
+    /**
+     * The covisibility index only depends on the scene and can be passed
+     * on to subsequent reconstructions of other reference views.
+     */
+    CovisibilityIndex::ConstPtr getCovisibilityIndex() const;
+    void setCovisibilityIndex(CovisibilityIndex::ConstPtr index);
+
     void start();
 
+    /**
+     * Writes the profiling counters of the last run as JSON. Throws
+     * util::FileException on error. Errors while writing the profile
+     * configured by 'profilePath' are reported by start() as warnings.
+     */
+    void writeProfile(std::string const& filename) const;
+
 private:
     core::Scene::Ptr scene;
     core::Bundle::ConstPtr bundle;
     std::vector<SingleView::Ptr> views;
+    CovisibilityIndex::ConstPtr covisIndex;
 
     Settings settings;
     std::priority_queue<QueueData> prQueue;
@@ -66,12 +84,18 @@ private:
     int width;
     int height;
     Progress progress;
+    ImagePyramidCache::Stats cacheStatsStart;
 
     void analyzeFeatures();
     void globalViewSelection();
     void processFeatures();
     void processQueue();
-    void refillQueueFromLowRes();
+    void processCoarseToFine();
+    void recordPatch(PatchOptimization const& patch, float conf);
+    void refillQueueFromLowRes(core::FloatImage::ConstPtr lowDepth,
+        core::FloatImage::ConstPtr lowNormal,
+        core::FloatImage::ConstPtr lowDz,
+        core::FloatImage::ConstPtr lowConf);
 };
 
 /* ------------------------- Implementation ----------------------- */
@@ -92,6 +116,18 @@ DMRecon::getProgress()
     return progress;
 }
 
+inline CovisibilityIndex::ConstPtr
+DMRecon::getCovisibilityIndex() const
+{
+    return covisIndex;
+}
+
+inline void
+DMRecon::setCovisibilityIndex(CovisibilityIndex::ConstPtr index)
+{
+    covisIndex = index;
+}
+
 inline std::size_t
 DMRecon::getRefViewNr() const
 {
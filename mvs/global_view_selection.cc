@@ -7,7 +7,11 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
+#include <cmath>
+
 #include "math/vector.h"
+#include "math/octree_tools.h"
 #include "mvs/global_view_selection.h"
 #include "mvs/mvs_tools.h"
 #include "mvs/settings.h"
@@ -17,10 +21,12 @@ MVS_NAMESPACE_BEGIN
 GlobalViewSelection::GlobalViewSelection(
     std::vector<SingleView::Ptr> const& views,
     core::Bundle::Features const& features,
-    Settings const& settings)
+    Settings const& settings,
+    CovisibilityIndex::ConstPtr index)
     : ViewSelection(settings)
     , views(views)
-    , features(features){
+    , features(features)
+    , index(index){
 
     /**初始化flag 设置成true**/
     available.clear();
@@ -33,88 +39,162 @@ GlobalViewSelection::GlobalViewSelection(
     for (std::size_t i = 0; i < views.size(); ++i)
         if (views[i] == nullptr)
             available[i] = false;
+
+    /**共视索引与场景无关，可以在多个参考视角之间共享**/
+    if (this->index == nullptr)
+        this->index = CovisibilityIndex::create(views, features);
 }
 
 void GlobalViewSelection::performVS(){
 
     selected.clear();
+    scores.clear();
+    scores.resize(views.size());
+    benefits.clear();
+    benefits.resize(views.size(), 0.f);
+
+    /*只有和参考视角有共视特征点的视角才需要计算score*/
+    std::vector<std::size_t> candidates;
+    CovisibilityIndex::Neighbors const& neighbors
+        = index->getNeighbors(settings.refViewNr);
+    for (std::size_t k = 0; k < neighbors.size(); ++k){
+        std::size_t i = neighbors[k].first;
+        if (i >= views.size() || !available[i])
+            continue;
+        candidates.push_back(i);
+        initFeatureScores(i);
+    }
+
     bool foundOne = true;
     while (foundOne && (selected.size() < settings.globalVSMax/*最多要选择的视角个数*/)){
         float maxBenefit = 0.f;
         std::size_t maxView = 0;
         foundOne = false;
         /*遍历所有的视角，找到score最大的一个视角，将该视角放入selected中，后续会抑制所有和该视角基线较小的视角被选择*/
-        for (std::size_t i = 0; i < views.size(); ++i){
+        for (std::size_t k = 0; k < candidates.size(); ++k){
+            std::size_t i = candidates[k];
 
             /*视角不可用则跳过*/
             if (!available[i])
                 continue;
 
-            /*计算参考视角和第i个视角之间的score*/
-            float benefit = benefitFromView(i);
-            if (benefit > maxBenefit) {
-                maxBenefit = benefit;
+            if (benefits[i] > maxBenefit) {
+                maxBenefit = benefits[i];
                 maxView = i;
                 foundOne = true;
             }
         }
-        if (foundOne) {
-            selected.insert(maxView);
-            available[maxView] = false;
-        }
+        if (!foundOne)
+            break;
+
+        selected.insert(maxView);
+        available[maxView] = false;
+
+        /*只需要根据新选择的视角更新其余视角的score*/
+        if (selected.size() < settings.globalVSMax)
+            for (std::size_t k = 0; k < candidates.size(); ++k)
+                if (available[candidates[k]])
+                    benefits[candidates[k]]
+                        = updateFeatureScores(candidates[k], maxView);
     }
+
+    scores.clear();
+    benefits.clear();
 }
 
-float
-GlobalViewSelection::benefitFromView(std::size_t i){
+void
+GlobalViewSelection::initFeatureScores(std::size_t i){
 
     // 参考视角
     SingleView::Ptr refV = views[settings.refViewNr];
 
-    // 需要计算的视角
-    SingleView::Ptr tmpV = views[i];
-
-    // 第 i 帧图像上的特征点，以及对应的3D点
-    std::vector<std::size_t> nFeatIDs = tmpV->getFeatureIndices();
+    // 参考视角和第i个视角中的特征点，按照特征点的索引排序
+    CovisibilityIndex::Observations const& refObs
+        = index->getObservations(settings.refViewNr);
+    CovisibilityIndex::Observations const& nObs = index->getObservations(i);
 
-    /**遍历第i帧图像上的所有的关键点**/
+    /**遍历第i帧图像和参考图像共同的关键点**/
     // Go over all features visible in view i and reference view
-    float benefit = 0;
-    for (std::size_t k = 0; k < nFeatIDs.size(); ++k) {
-        float score = 1.f;
-        // Parallax with reference view
+    std::vector<FeatureScore>& fScores = scores[i];
+    float benefit = 0.f;
+    std::size_t r = 0, n = 0;
+    while (r < refObs.size() && n < nObs.size()) {
+        if (refObs[r].feature < nObs[n].feature) {
+            ++r;
+            continue;
+        }
+        if (nObs[n].feature < refObs[r].feature) {
+            ++n;
+            continue;
+        }
+
+        std::size_t const featID = refObs[r].feature;
         // 特征点的三维坐标
-        math::Vec3f ftPos(features[nFeatIDs[k]].pos);
+        math::Vec3f ftPos(features[featID].pos);
 
-        // 1. 考虑特征点在两个视角间的视差(三维点与相机位置确定的射线间的夹角），如果视差小于一定阈值(10度）
-        float plx = parallax(ftPos, refV, tmpV);
-        if (plx < settings.minParallax)
-            score *= sqr(plx / 10.f);
-
-        // 2. 考虑两个视角间的分辨率 Resolution compared to reference view
-        float mfp = refV->footPrintScaled(ftPos);
-        float nfp = tmpV->footPrint(ftPos);
-        float ratio = mfp / nfp;
-        // reference view
-        if (ratio > 2.)
-            ratio = 2. / ratio;
-        else if (ratio > 1.)
-            ratio = 1.;
-        score *= ratio;
-
-        /**计算该特征点与已经选定的视角之间的视差，与任何一个视角的残差小于特定值，都会减少该特征点score
-         * 这样组哟的目的是避免选取图像内容相似的两帧图像
-         */
-        // Parallax with other selected views that see the same feature
-        IndexSet::const_iterator citV;
-        for (citV = selected.begin(); citV != selected.end(); ++citV) {
-            plx = parallax(ftPos, views[*citV], tmpV);
+        // 特征点需要在设定的空间范围内
+        if (math::geom::point_box_overlap(ftPos,
+            settings.aabbMin, settings.aabbMax)) {
+            float score = 1.f;
+
+            // 1. 考虑特征点在两个视角间的视差(三维点与相机位置确定的射线间的夹角），如果视差小于一定阈值(10度）
+            float dp = refObs[r].dir.dot(nObs[n].dir);
+            dp = std::max(std::min(dp, 1.f), -1.f);
+            float plx = std::acos(dp) * 180.f / pi;
             if (plx < settings.minParallax)
                 score *= sqr(plx / 10.f);
+
+            // 2. 考虑两个视角间的分辨率 Resolution compared to reference view
+            float mfp = refV->footPrintScaled(ftPos);
+            float nfp = nObs[n].footprint;
+            float ratio = mfp / nfp;
+            // reference view
+            if (ratio > 2.)
+                ratio = 2. / ratio;
+            else if (ratio > 1.)
+                ratio = 1.;
+            score *= ratio;
+
+            FeatureScore fs;
+            fs.feature = featID;
+            fs.score = score;
+            fScores.push_back(fs);
+            benefit += score;
         }
+        ++r;
+        ++n;
+    }
+    benefits[i] = benefit;
+}
+
+float
+GlobalViewSelection::updateFeatureScores(std::size_t i, std::size_t sel){
+
+    SingleView::Ptr selV = views[sel];
+
+    /**计算该特征点与新选定的视角之间的视差，与任何一个视角的残差小于特定值，都会减少该特征点score
+     * 这样组哟的目的是避免选取图像内容相似的两帧图像
+     */
+    // Parallax with the newly selected view
+    std::vector<FeatureScore>& fScores = scores[i];
+    CovisibilityIndex::Observations const& nObs = index->getObservations(i);
+    std::size_t n = 0;
+    float benefit = 0.f;
+    for (std::size_t k = 0; k < fScores.size(); ++k) {
+        while (nObs[n].feature != fScores[k].feature)
+            ++n;
+
+        /*已选择的视角不一定能看到该特征点，因此直接计算视线方向*/
+        math::Vec3f selDir = (math::Vec3f(features[fScores[k].feature].pos)
+            - selV->camPos).normalized();
+
+        float dp = std::max(std::min(selDir.dot(nObs[n].dir), 1.f), -1.f);
+        float plx = std::acos(dp) * 180.f / pi;
+        if (plx < settings.minParallax)
+            fScores[k].score *= sqr(plx / 10.f);
 
         /**所有关键点的score进行累加**/
-        benefit += score;
+        benefit += fScores[k].score;
     }
     return benefit;
 }
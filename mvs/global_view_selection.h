@@ -14,6 +14,7 @@
 
 #include <mvs/defines.h>
 #include "core/bundle.h"
+#include "mvs/covisibility_index.h"
 #include "mvs/single_view.h"
 #include "mvs/view_selection.h"
 #include "mvs/settings.h"
@@ -31,27 +32,55 @@ public:
      * @param views     -- 传入所有的视角
      * @param features  -- SFM生成的特征（Tracks)
      * @param settings  -- 参数设置，包含参考帧，以及要选取的候选帧的个数
+     * @param index     -- 场景的共视索引，为空时自动创建
      */
     GlobalViewSelection(std::vector<SingleView::Ptr> const& views,
         core::Bundle::Features const& features,
-        Settings const& settings);
+        Settings const& settings,
+        CovisibilityIndex::ConstPtr index = CovisibilityIndex::ConstPtr());
 
     /**进行全局视角选择**/
     void performVS();
 
+    CovisibilityIndex::ConstPtr getCovisibilityIndex() const;
+
 private:
+    /** Per-feature score of a candidate view, updated incrementally. */
+    struct FeatureScore
+    {
+        std::size_t feature;
+        float score;
+    };
 
     /**
-     * 计算参考帧和第i个视角之间的score
+     * 计算参考帧和第i个视角之间每个共视特征点的初始score
+     * (视差和分辨率），不考虑已经选择的视角
      * @param i
+     */
+    void initFeatureScores(std::size_t i);
+
+    /**
+     * 选择视角sel之后，更新第i个视角的score，并返回新的benefit
+     * @param i
+     * @param sel
      * @return
      */
-    float benefitFromView(std::size_t i);
+    float updateFeatureScores(std::size_t i, std::size_t sel);
 
     std::vector<SingleView::Ptr> const& views;
     core::Bundle::Features const& features;
+    CovisibilityIndex::ConstPtr index;
+
+    std::vector<std::vector<FeatureScore> > scores;
+    std::vector<float> benefits;
 };
 
+inline CovisibilityIndex::ConstPtr
+GlobalViewSelection::getCovisibilityIndex() const
+{
+    return this->index;
+}
+
 MVS_NAMESPACE_END
 
 #endif
@@ -9,8 +9,17 @@
 
 #include "mvs/image_pyramid.h"
 
-#include "core/image_tools.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
+
+#include "core/image_tools.h"
+#include "util/file_system.h"
+#include "util/strings.h"
 
 MVS_NAMESPACE_BEGIN
 
@@ -18,6 +27,21 @@ namespace
 {
     int const MIN_IMAGE_DIM = 30;
 
+    /* Header of spilled pyramid levels, followed by the raw pixel data. */
+    char const SPILL_MAGIC[8] = { 'M', 'V', 'S', 'P', 'Y', 'R', '0', '2' };
+    struct SpillHeader
+    {
+        char magic[8];
+        /* Identity of the source image, see sourceIdentity(). */
+        uint64_t source_id;
+        int32_t width;
+        int32_t height;
+        int32_t channels;
+        int32_t level;
+        int32_t source_width;
+        int32_t source_height;
+    };
+
     ImagePyramid::Ptr
     buildPyramid(core::View::Ptr view, std::string embeddingName)
     {
@@ -52,12 +76,177 @@ namespace
         return pyramid;
     }
 
-    void
+    std::size_t
+    pyramidByteSize(ImagePyramid const& levels)
+    {
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < levels.size(); ++i)
+            if (levels[i].image != nullptr)
+                bytes += levels[i].image->get_byte_size();
+        return bytes;
+    }
+
+    /*
+     * Returns a hash of the absolute path, modification time and size of
+     * the image file the pyramid is computed from, or zero if the image is
+     * not (or not unmodified) on disc. Spilled levels are only valid for
+     * the same identity, which rejects levels of other scenes sharing the
+     * spill directory as well as stale levels of changed images.
+     */
+    uint64_t
+    sourceIdentity(core::View::Ptr view, std::string const& embeddingName)
+    {
+        core::View::ImageProxy const* proxy = view->get_image_proxy(embeddingName);
+        if (proxy == nullptr || proxy->is_dirty || proxy->filename.empty())
+            return 0;
+
+        std::string path = proxy->filename;
+        if (!util::fs::is_absolute(path))
+            path = util::fs::join_path(view->get_directory(), path);
+        path = util::fs::abspath(path);
+
+        struct stat statbuf;
+        if (::stat(path.c_str(), &statbuf) < 0)
+            return 0;
+
+        /* FNV-1a over the path, modification time and size. */
+        uint64_t hash = 14695981039346656037ULL;
+        auto add = [&hash] (void const* data, std::size_t bytes)
+        {
+            unsigned char const* ptr = static_cast<unsigned char const*>(data);
+            for (std::size_t i = 0; i < bytes; ++i)
+                hash = (hash ^ ptr[i]) * 1099511628211ULL;
+        };
+        int64_t const mtime = statbuf.st_mtime;
+        int64_t const size = statbuf.st_size;
+        add(path.data(), path.size());
+        add(&mtime, sizeof(mtime));
+        add(&size, sizeof(size));
+        return hash == 0 ? 1 : hash;
+    }
+
+    std::string
+    spillFileName(std::string const& spillDir, core::View::Ptr view,
+        std::string const& embeddingName, uint64_t sourceID, int level)
+    {
+        char id[17];
+        std::snprintf(id, sizeof(id), "%016llx",
+            static_cast<unsigned long long>(sourceID));
+
+        std::string name = "pyramid-";
+        name += util::string::get_filled(view->get_id(), 4);
+        name += "-" + embeddingName + "-" + id;
+        name += "-L" + util::string::get(level) + ".raw";
+        return util::fs::join_path(spillDir, name);
+    }
+
+    core::ByteImage::Ptr
+    loadSpilledLevel(std::string const& filename, ImagePyramid const& levels,
+        uint64_t sourceID, int level)
+    {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        if (!in.good())
+            return core::ByteImage::Ptr();
+
+        SpillHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(SpillHeader));
+        if (!in.good()
+            || !std::equal(SPILL_MAGIC, SPILL_MAGIC + 8, header.magic)
+            || header.source_id != sourceID
+            || header.level != level
+            || header.width != levels[level].width
+            || header.height != levels[level].height
+            || header.source_width != levels[0].width
+            || header.source_height != levels[0].height
+            || header.channels != 3)
+            return core::ByteImage::Ptr();
+
+        core::ByteImage::Ptr img = core::ByteImage::create(header.width,
+            header.height, header.channels);
+        in.read(reinterpret_cast<char*>(img->get_data_pointer()),
+            img->get_byte_size());
+        if (!in.good())
+            return core::ByteImage::Ptr();
+
+        return img;
+    }
+
+    bool
+    writeSpilledLevel(std::string const& filename, ImagePyramid const& levels,
+        uint64_t sourceID, int level)
+    {
+        core::ByteImage::ConstPtr img = levels[level].image;
+
+        SpillHeader header;
+        std::copy(SPILL_MAGIC, SPILL_MAGIC + 8, header.magic);
+        header.source_id = sourceID;
+        header.width = img->width();
+        header.height = img->height();
+        header.channels = img->channels();
+        header.level = level;
+        header.source_width = levels[0].width;
+        header.source_height = levels[0].height;
+
+        /* Write to a temporary file first, concurrent runs may race. */
+        std::string tmpname = filename + ".tmp"
+            + util::string::get(std::this_thread::get_id());
+        {
+            std::ofstream out(tmpname.c_str(), std::ios::binary);
+            if (!out.good())
+                return false;
+            out.write(reinterpret_cast<char const*>(&header),
+                sizeof(SpillHeader));
+            out.write(reinterpret_cast<char const*>(img->get_data_pointer()),
+                img->get_byte_size());
+            if (!out.good())
+            {
+                out.close();
+                util::fs::unlink(tmpname.c_str());
+                return false;
+            }
+        }
+
+        if (!util::fs::rename(tmpname.c_str(), filename.c_str()))
+        {
+            util::fs::unlink(tmpname.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /* Returns the amount of levels loaded from the spill directory. */
+    std::size_t
+    loadSpilledImages(ImagePyramid& levels, core::View::Ptr view,
+        std::string const& embeddingName, int minLevel,
+        std::string const& spillDir, uint64_t sourceID)
+    {
+        std::vector<core::ByteImage::Ptr> loaded;
+        for (std::size_t i = minLevel; i < levels.size(); ++i)
+        {
+            if (levels[i].image != nullptr)
+                break;
+
+            core::ByteImage::Ptr img = loadSpilledLevel(spillFileName(
+                spillDir, view, embeddingName, sourceID, i), levels,
+                sourceID, i);
+            if (img == nullptr)
+                return 0;
+            loaded.push_back(img);
+        }
+
+        for (std::size_t i = 0; i < loaded.size(); ++i)
+            levels[minLevel + i].image = loaded[i];
+        return loaded.size();
+    }
+
+    /* Returns the amount of levels written to the spill directory. */
+    std::size_t
     ensureImages(ImagePyramid& levels, core::View::Ptr view,
-        std::string embeddingName, int minLevel)
+        std::string embeddingName, int minLevel, std::string const& spillDir,
+        uint64_t sourceID)
     {
         if (levels[minLevel].image != nullptr)
-            return;
+            return 0;
 
         core::ByteImage::Ptr img = view->get_byte_image(embeddingName);
         int channels = img->channels();
@@ -73,6 +262,8 @@ namespace
             throw std::invalid_argument("Image with invalid number of channels");
 
         /* Create image pyramid. */
+        int first_new = -1;
+        int last_new = -1;
         int curr_width = img->width();
         int curr_height = img->height();
         for (int i = 0; std::min(curr_width, curr_height) >= MIN_IMAGE_DIM; ++i)
@@ -88,10 +279,29 @@ namespace
             }
 
             if (minLevel <= i)
+            {
                 levels[i].image = img;
+                if (first_new < 0)
+                    first_new = i;
+                last_new = i;
+            }
         }
 
         view->cache_cleanup();
+
+        /* Spill the newly computed levels for subsequent runs. */
+        std::size_t written = 0;
+        if (spillDir.empty() || sourceID == 0 || first_new < 0)
+            return written;
+        for (int i = first_new; i <= last_new; ++i)
+        {
+            std::string fname = spillFileName(spillDir, view,
+                embeddingName, sourceID, i);
+            if (!util::fs::file_exists(fname.c_str())
+                && writeSpilledLevel(fname, levels, sourceID, i))
+                written += 1;
+        }
+        return written;
     }
 }
 
@@ -99,63 +309,197 @@ ImagePyramid::ConstPtr
 ImagePyramidCache::get(core::Scene::Ptr scene, core::View::Ptr view,
     std::string embeddingName, int minLevel)
 {
-    std::lock_guard<std::mutex> lock(ImagePyramidCache::metadataMutex);
+    std::string spillDir = ImagePyramidCache::getSpillDirectory();
 
-    /* Initialize on first access. */
-    if (ImagePyramidCache::cachedScene == nullptr) {
-        ImagePyramidCache::cachedScene = scene;
-        ImagePyramidCache::cachedEmbedding = embeddingName;
-    }
+    CacheKey key;
+    key.scene = scene.get();
+    key.embedding = embeddingName;
+    key.viewID = view->get_id();
+    Shard& shard = ImagePyramidCache::getShard(key.viewID);
 
     ImagePyramid::Ptr pyramid;
-
-    if (scene != ImagePyramidCache::cachedScene
-        || embeddingName != ImagePyramidCache::cachedEmbedding)
+    std::shared_ptr<std::mutex> loadMutex;
     {
-        /* create own pyramid because shared pyramid is incompatible. */
-        pyramid = buildPyramid(view, embeddingName);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        CacheEntry& entry = shard.entries[key];
+        if (entry.pyramid == nullptr)
+        {
+            entry.scene = scene;
+            entry.view = view;
+            entry.pyramid = buildPyramid(view, embeddingName);
+            entry.loadMutex = std::make_shared<std::mutex>();
+            entry.bytes = 0;
+        }
+        entry.lastAccess = ImagePyramidCache::accessCounter++;
+        pyramid = entry.pyramid;
+        loadMutex = entry.loadMutex;
     }
-    else
+
+    /*
+     * Decoding and downsampling only hold the lock of the entry, the shard
+     * stays available for other views. The entry cannot be evicted while
+     * 'pyramid' is referenced here.
+     */
     {
-        /* Either re-recreate or use cached entry. */
-        pyramid = ImagePyramidCache::entries[view->get_id()];
-        if (pyramid == nullptr)
+        std::lock_guard<std::mutex> lock(*loadMutex);
+
+        // 根据设定的尺度添加图像，从minLevel开始
+        if ((*pyramid)[minLevel].image != nullptr)
         {
-            pyramid = buildPyramid(view, embeddingName);
-            ImagePyramidCache::entries[view->get_id()] = pyramid;
+            ImagePyramidCache::numHits += 1;
+        }
+        else
+        {
+            ImagePyramidCache::numMisses += 1;
+            uint64_t sourceID = spillDir.empty()
+                ? 0 : sourceIdentity(view, embeddingName);
+            std::size_t loaded = 0;
+            if (sourceID != 0)
+                loaded = loadSpilledImages(*pyramid, view, embeddingName,
+                    minLevel, spillDir, sourceID);
+            ImagePyramidCache::numSpillLoads += loaded;
+            if (loaded == 0)
+                ImagePyramidCache::numSpillWrites += ensureImages(*pyramid,
+                    view, embeddingName, minLevel, spillDir, sourceID);
+
+            std::size_t bytes = pyramidByteSize(*pyramid);
+            std::lock_guard<std::mutex> shardLock(shard.mutex);
+            CacheEntry& entry = shard.entries[key];
+            ImagePyramidCache::cachedBytes += bytes - entry.bytes;
+            entry.bytes = bytes;
         }
     }
-    // 根据设定的尺度添加图像，从minLevel开始
-    ensureImages(*pyramid, view, embeddingName, minLevel);
+
+    /* Must not hold any shard lock here. */
+    ImagePyramidCache::evict(ImagePyramidCache::memoryBudget);
     return pyramid;
 }
 
 void
 ImagePyramidCache::cleanup()
 {
-    std::lock_guard<std::mutex> lock(ImagePyramidCache::metadataMutex);
+    ImagePyramidCache::evict(ImagePyramidCache::memoryBudget);
+}
+
+void
+ImagePyramidCache::clear()
+{
+    ImagePyramidCache::evict(0);
+}
+
+void
+ImagePyramidCache::setMemoryBudget(std::size_t bytes)
+{
+    ImagePyramidCache::memoryBudget = bytes;
+    ImagePyramidCache::evict(bytes);
+}
 
-    if (ImagePyramidCache::cachedScene == nullptr)
+std::size_t
+ImagePyramidCache::getMemoryBudget()
+{
+    return ImagePyramidCache::memoryBudget;
+}
+
+void
+ImagePyramidCache::setSpillDirectory(std::string const& path)
+{
+    if (!path.empty() && !util::fs::dir_exists(path.c_str())
+        && !util::fs::mkdir(path.c_str()))
+        throw std::runtime_error("Cannot create spill directory: " + path);
+
+    std::lock_guard<std::mutex> lock(ImagePyramidCache::configMutex);
+    ImagePyramidCache::spillDirectory = path;
+}
+
+std::string
+ImagePyramidCache::getSpillDirectory()
+{
+    std::lock_guard<std::mutex> lock(ImagePyramidCache::configMutex);
+    return ImagePyramidCache::spillDirectory;
+}
+
+ImagePyramidCache::Stats
+ImagePyramidCache::getStats()
+{
+    Stats stats;
+    stats.hits = ImagePyramidCache::numHits;
+    stats.misses = ImagePyramidCache::numMisses;
+    stats.spillLoads = ImagePyramidCache::numSpillLoads;
+    stats.spillWrites = ImagePyramidCache::numSpillWrites;
+    stats.evictions = ImagePyramidCache::numEvictions;
+    stats.bytes = ImagePyramidCache::cachedBytes;
+    return stats;
+}
+
+ImagePyramidCache::Shard&
+ImagePyramidCache::getShard(int viewID)
+{
+    return ImagePyramidCache::shards[static_cast<std::size_t>(viewID)
+        % NUM_SHARDS];
+}
+
+void
+ImagePyramidCache::evict(std::size_t budget)
+{
+    if (ImagePyramidCache::cachedBytes <= budget)
         return;
 
-    for (std::map<int, ImagePyramid::Ptr>::iterator it = ImagePyramidCache::entries.begin();
-         it != ImagePyramidCache::entries.end(); ++it)
+    /* Collect unreferenced entries of all shards, oldest first. */
+    typedef std::pair<std::size_t, std::pair<std::size_t, CacheKey> > Candidate;
+    std::vector<Candidate> candidates;
+    for (std::size_t i = 0; i < NUM_SHARDS; ++i)
     {
-        if (it->second == nullptr)
-            continue;
+        Shard& shard = ImagePyramidCache::shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (std::map<CacheKey, CacheEntry>::iterator it = shard.entries.begin();
+             it != shard.entries.end(); ++it)
+        {
+            if (it->second.pyramid.use_count() == 1)
+                candidates.push_back(std::make_pair(it->second.lastAccess,
+                    std::make_pair(i, it->first)));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](Candidate const& a, Candidate const& b)
+        { return a.first < b.first; });
 
-        if (it->second.use_count() == 1)
+    for (std::size_t i = 0; i < candidates.size()
+        && ImagePyramidCache::cachedBytes > budget; ++i)
+    {
         {
-            it->second.reset();
-            ImagePyramidCache::cachedScene->get_view_by_id(it->first)->cache_cleanup();
+            Shard& shard = ImagePyramidCache::shards[candidates[i].second.first];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::map<CacheKey, CacheEntry>::iterator it
+                = shard.entries.find(candidates[i].second.second);
+
+            /* The entry may have been accessed in the meantime. */
+            if (it == shard.entries.end()
+                || it->second.lastAccess != candidates[i].first
+                || it->second.pyramid.use_count() != 1)
+                continue;
+
+            core::View::Ptr view = it->second.view;
+            ImagePyramidCache::cachedBytes -= it->second.bytes;
+            ImagePyramidCache::numEvictions += 1;
+            shard.entries.erase(it);
+            view->cache_cleanup();
         }
     }
 }
 
 /* static fields of ImgPyramidCache: */
-std::mutex ImagePyramidCache::metadataMutex;
-core::Scene::Ptr ImagePyramidCache::cachedScene;
-std::string ImagePyramidCache::cachedEmbedding = "";
-std::map<int, ImagePyramid::Ptr> ImagePyramidCache::entries;
+ImagePyramidCache::Shard ImagePyramidCache::shards[ImagePyramidCache::NUM_SHARDS];
+std::mutex ImagePyramidCache::configMutex;
+std::string ImagePyramidCache::spillDirectory = "";
+std::atomic<std::size_t> ImagePyramidCache::memoryBudget(
+    std::size_t(1) << 30);
+std::atomic<std::size_t> ImagePyramidCache::accessCounter(0);
+std::atomic<std::size_t> ImagePyramidCache::cachedBytes(0);
+std::atomic<std::size_t> ImagePyramidCache::numHits(0);
+std::atomic<std::size_t> ImagePyramidCache::numMisses(0);
+std::atomic<std::size_t> ImagePyramidCache::numSpillLoads(0);
+std::atomic<std::size_t> ImagePyramidCache::numSpillWrites(0);
+std::atomic<std::size_t> ImagePyramidCache::numEvictions(0);
 
 MVS_NAMESPACE_END
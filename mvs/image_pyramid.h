@@ -14,6 +14,9 @@
 #include <memory>
 #include <map>
 #include <mutex>
+#include <atomic>
+#include <functional>
+#include <string>
 
 #include "core/scene.h"
 #include "core/view.h"
@@ -69,21 +72,118 @@ public:
     typedef std::shared_ptr<ImagePyramid const> ConstPtr;
 };
 
+/**
+  * Process-wide cache of image pyramids, keyed by scene, embedding and view.
+  *
+  * The cache accounts the byte size of every loaded pyramid level and keeps
+  * unreferenced pyramids around until the memory budget is exceeded, at
+  * which point the least recently used ones are evicted. Pyramids that are
+  * still referenced outside the cache are never evicted. Entries are spread
+  * over independently locked shards, so lookups of different views do not
+  * contend for a single mutex.
+  *
+  * Optionally, computed pyramid levels are spilled to raw files in a spill
+  * directory. Subsequent runs load these files instead of decoding and
+  * downsampling the original image again. Spill files are tied to the path,
+  * modification time and size of the source image.
+  *
+  * The cache is shared by all reconstructions of the process and configured
+  * once by the application, not per DMRecon instance.
+  */
 class ImagePyramidCache
 {
+public:
+    struct Stats
+    {
+        std::size_t hits;       ///< Lookups served from memory
+        std::size_t misses;     ///< Lookups that built a new pyramid
+        std::size_t spillLoads; ///< Levels loaded from the spill directory
+        std::size_t spillWrites;///< Levels written to the spill directory
+        std::size_t evictions;  ///< Pyramids evicted due to the budget
+        std::size_t bytes;      ///< Bytes of image data currently cached
+    };
+
 public:
     static ImagePyramid::ConstPtr get(core::Scene::Ptr scene,
         core::View::Ptr view, std::string embeddingName, int minLevel);
+
+    /** Evicts unreferenced pyramids until the memory budget is met. */
     static void cleanup();
 
+    /** Evicts all unreferenced pyramids regardless of the budget. */
+    static void clear();
+
+    /** Sets the memory budget in bytes for unreferenced pyramids. */
+    static void setMemoryBudget(std::size_t bytes);
+    static std::size_t getMemoryBudget();
+
+    /** Enables spilling of pyramid levels to 'path', empty to disable. */
+    static void setSpillDirectory(std::string const& path);
+    static std::string getSpillDirectory();
+
+    static Stats getStats();
+
 private:
-    static std::mutex metadataMutex;
-    static core::Scene::Ptr cachedScene;
-    static std::string cachedEmbedding;
+    struct CacheKey
+    {
+        core::Scene const* scene;
+        std::string embedding;
+        int viewID;
+
+        bool operator< (CacheKey const& rhs) const;
+    };
+
+    struct CacheEntry
+    {
+        /* Keeps the scene alive so the key pointer cannot be reused. */
+        core::Scene::Ptr scene;
+        core::View::Ptr view;
+        ImagePyramid::Ptr pyramid;
+        /* Held while images of the pyramid are decoded or loaded. */
+        std::shared_ptr<std::mutex> loadMutex;
+        std::size_t bytes;
+        std::size_t lastAccess;
+
+        CacheEntry() : bytes(0), lastAccess(0) {}
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::map<CacheKey, CacheEntry> entries;
+    };
+
+    static std::size_t const NUM_SHARDS = 16;
+
+    static Shard& getShard(int viewID);
+    static void evict(std::size_t budget);
 
-    static std::map<int, ImagePyramid::Ptr> entries;
+private:
+    static Shard shards[NUM_SHARDS];
+    static std::mutex configMutex;
+    static std::string spillDirectory;
+    static std::atomic<std::size_t> memoryBudget;
+    static std::atomic<std::size_t> accessCounter;
+    static std::atomic<std::size_t> cachedBytes;
+    static std::atomic<std::size_t> numHits;
+    static std::atomic<std::size_t> numMisses;
+    static std::atomic<std::size_t> numSpillLoads;
+    static std::atomic<std::size_t> numSpillWrites;
+    static std::atomic<std::size_t> numEvictions;
 };
 
+/* ------------------------ Implementation ------------------------ */
+
+inline bool
+ImagePyramidCache::CacheKey::operator< (CacheKey const& rhs) const
+{
+    if (this->viewID != rhs.viewID)
+        return this->viewID < rhs.viewID;
+    if (this->scene != rhs.scene)
+        return std::less<core::Scene const*>()(this->scene, rhs.scene);
+    return this->embedding < rhs.embedding;
+}
+
 MVS_NAMESPACE_END
 
 #endif
@@ -105,6 +105,18 @@ public:
      * @return
      */
     math::Vec3f getNormal() const;
+
+    /**
+     * 获取优化的迭代次数
+     * @return
+     */
+    std::size_t getIterationCount() const;
+
+    /**
+     * 获取NCC的计算次数
+     * @return
+     */
+    std::size_t getNumNCCEvaluations() const;
     float objFunValue();
 
     /**
@@ -176,6 +188,16 @@ PatchOptimization::getNormal() const{
     return sampler->getPatchNormal();
 }
 
+inline std::size_t
+PatchOptimization::getIterationCount() const{
+    return status.iterationCount;
+}
+
+inline std::size_t
+PatchOptimization::getNumNCCEvaluations() const{
+    return sampler->getNumNCCEvaluations();
+}
+
 MVS_NAMESPACE_END
 
 #endif
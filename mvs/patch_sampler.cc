@@ -23,6 +23,7 @@ PatchSampler::PatchSampler(std::vector<SingleView::Ptr> const& _views,
     , settings(_settings)
     , midPix(_x,_y)
     , masterMeanCol(0.f)
+    , nccEvaluations(0)
     , depth(_depth)
     , dzI(_dzI)
     , dzJ(_dzJ)
@@ -158,6 +159,8 @@ void PatchSampler::fastColAndDeriv(std::size_t v, Samples& color, Samples& deriv
  */
 float PatchSampler::getFastNCC(std::size_t v){
 
+    ++nccEvaluations;
+
     /**计算第v个视角上patch点的颜色向量**/
     if (neighColorSamples[v].empty())
         computeNeighColorSamples(v);
@@ -191,6 +194,8 @@ float PatchSampler::getFastNCC(std::size_t v){
 
 float PatchSampler::getNCC(std::size_t u, std::size_t v){
 
+    ++nccEvaluations;
+
     if (neighColorSamples[u].empty())
         computeNeighColorSamples(u);
     if (neighColorSamples[v].empty())
@@ -79,6 +79,9 @@ public:
     /**获取样本点的个数*/
     std::size_t getNrSamples() const;
 
+    /**NCC的计算次数*/
+    std::size_t getNumNCCEvaluations() const;
+
     /**获取patch的法向量*/
     math::Vec3f getPatchNormal() const;
 
@@ -115,6 +118,9 @@ private:
     /** mean patch color in master image before normalization */
     float masterMeanCol;
 
+    /** number of NCC evaluations, for profiling */
+    std::size_t nccEvaluations;
+
     /** filter width = 2 * offset + 1 */
     std::size_t offset;
 
@@ -199,6 +205,11 @@ PatchSampler::getNrSamples() const{
     return nrSamples;
 }
 
+inline std::size_t
+PatchSampler::getNumNCCEvaluations() const{
+    return nccEvaluations;
+}
+
 inline float
 PatchSampler::varInMasterPatch(){
     return sqrDevX / (3.f * (float) nrSamples);
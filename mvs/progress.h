@@ -10,6 +10,8 @@
 #ifndef DMRECON_PROGRESS_H
 #define DMRECON_PROGRESS_H
 
+#include <cstddef>
+
 #include "mvs/defines.h"
 
 MVS_NAMESPACE_BEGIN
@@ -23,12 +25,51 @@ enum ReconStatus{
     RECON_CANCELLED
 };
 
+/** Wall clock time and number of runs of one reconstruction stage. */
+struct StageProfile{
+    float seconds; ///< accumulated wall clock time in seconds
+    std::size_t runs; ///< number of times the stage was run
+
+    StageProfile()
+        : seconds(0.f)
+        , runs(0){
+    }
+};
+
+/** Counters collected during the reconstruction of one view. */
+struct Profile{
+    StageProfile analyzeFeatures;
+    StageProfile globalViewSelection;
+    StageProfile processFeatures;
+    StageProfile processQueue;
+    std::size_t patchOptimizations; ///< number of PatchOptimization runs
+    std::size_t optiIterations; ///< accumulated optimization iterations
+    std::size_t nccEvaluations; ///< accumulated NCC evaluations
+    std::size_t rejectedSeeds; ///< optimizations with zero confidence
+    std::size_t staleQueueEntries; ///< entries superseded before processing
+    std::size_t maxQueueSize; ///< peak size of the MVS pixel queue
+    std::size_t pyramidCacheHits; ///< image pyramid cache hits
+    std::size_t pyramidCacheMisses; ///< image pyramid cache misses
+
+    Profile()
+        : patchOptimizations(0)
+        , optiIterations(0)
+        , nccEvaluations(0)
+        , rejectedSeeds(0)
+        , staleQueueEntries(0)
+        , maxQueueSize(0)
+        , pyramidCacheHits(0)
+        , pyramidCacheMisses(0){
+    }
+};
+
 struct Progress{
     ReconStatus status; ///< current status of MVS algorithm
     std::size_t filled; ///< amount of pixels with reconstructed depth value
     std::size_t queueSize; ///< current size of MVS pixel queue
     std::size_t start_time; ///< start time of MVS reconstruction, or 0
     bool cancelled; ///< set from extern to true to cancel reconstruction
+    Profile profile; ///< per-stage timings and counters
 
     Progress()
         : status(RECON_IDLE)
@@ -53,6 +53,19 @@ struct Settings
     /**图像的尺度**/
     int scale = 0;
 
+    /**
+     * Number of coarser pyramid levels reconstructed before 'scale'.
+     * Each level seeds the next finer one with its upsampled depth,
+     * normal and dz maps. Zero disables coarse-to-fine reconstruction.
+     */
+    int coarseToFineLevels = 0;
+
+    /**
+     * Upsampled pixels with at least this confidence are accepted without
+     * re-optimization, only the remaining pixels are re-optimized.
+     */
+    float coarseToFineKeepConf = 0.5f;
+
     /**是否采用颜色空间的尺度对图像**/
     bool useColorScale = true;
     bool writePlyFile = false;
@@ -63,6 +76,9 @@ struct Settings
 
     std::string plyPath;
 
+    /** Directory for per-view JSON profiling reports, empty to disable. */
+    std::string profilePath;
+
     bool keepDzMap = false;
     bool keepConfidenceMap = false;
     bool quiet = false;
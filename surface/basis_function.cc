@@ -8,6 +8,7 @@
  */
 
 #include <algorithm>
+#include <cmath>
 
 #include "math/vector.h"
 #include "math/matrix.h"
@@ -43,6 +44,85 @@ evaluate (math::Vec3f const& pos, Sample const& sample,
         *weight_deriv = irot.mult(*weight_deriv);
 }
 
+void
+evaluate_batch (math::Vec3f const& pos, SampleBatch const& batch,
+    SampleBatchResult* result)
+{
+    /* Rotate voxel position into the LCS of every sample. */
+    float tx[FSSR_BATCH_SIZE];
+    float ty[FSSR_BATCH_SIZE];
+    float tz[FSSR_BATCH_SIZE];
+    for (int i = 0; i < FSSR_BATCH_SIZE; ++i)
+    {
+        float const dx = pos[0] - batch.pos[0][i];
+        float const dy = pos[1] - batch.pos[1][i];
+        float const dz = pos[2] - batch.pos[2][i];
+        tx[i] = batch.frame[0][i] * dx + batch.frame[1][i] * dy
+            + batch.frame[2][i] * dz;
+        ty[i] = batch.frame[3][i] * dx + batch.frame[4][i] * dy
+            + batch.frame[5][i] * dz;
+        tz[i] = batch.frame[6][i] * dx + batch.frame[7][i] * dy
+            + batch.frame[8][i] * dz;
+    }
+
+    /* Evaluate basis, weight and color weight, see fssr_basis() etc. */
+    for (int i = 0; i < FSSR_BATCH_SIZE; ++i)
+    {
+        double const x = tx[i];
+        double const y = ty[i];
+        double const z = tz[i];
+        double const scale = batch.scale[i];
+        double const square_scale = MATH_POW2(scale);
+        double const square_norm = x * x + y * y + z * z;
+
+        double const gaussian_value
+            = std::exp(-square_norm / (2.0 * square_scale));
+        double const value_norm = 2.0 * MATH_PI * MATH_POW2(square_scale);
+        result->value[i] = x * gaussian_value / value_norm;
+
+#if FSSR_NEW_WEIGHT_FUNCTION
+        double const square_radius = square_norm / square_scale;
+        double const radius = std::sqrt(square_radius);
+        double const weight = 1.0 - 2.0 / 3.0 * square_radius
+            + 8.0 / 27.0 * square_radius * radius
+            - 1.0 / 27.0 * MATH_POW2(square_radius);
+        result->weight[i] = square_radius < 9.0 ? weight : 0.0;
+#else
+        result->weight[i] = fssr_weight<double>(scale,
+            math::Vector<double, 3>(x, y, z));
+#endif // FSSR_NEW_WEIGHT_FUNCTION
+
+        double const color_sigma = static_cast<float>(batch.scale[i] / 5.0f);
+        result->color_weight[i] = std::exp(-square_norm
+            / (2.0 * MATH_POW2(color_sigma))) / (color_sigma * MATH_SQRT_2PI);
+
+#if FSSR_USE_DERIVATIVES
+        /* Derivatives in the LCS, FSSR_USE_DERIVATIVES implies new weight. */
+        double const deriv_norm = value_norm * 2.0 * square_scale;
+        double const value_deriv[3] = {
+            2.0 * (square_scale - x * x) * gaussian_value / deriv_norm,
+            -2.0 * x * y * gaussian_value / deriv_norm,
+            -2.0 * x * z * gaussian_value / deriv_norm };
+        double const deriv_factor = square_radius < 9.0
+            ? (-4.0 / 3.0 + 48.0 / 54.0 * radius - 4.0 / 27.0 * square_radius)
+            / scale : 0.0;
+        double const weight_deriv[3] = {
+            deriv_factor * x, deriv_factor * y, deriv_factor * z };
+
+        /* Rotate back with the transposed frame. */
+        for (int j = 0; j < 3; ++j)
+        {
+            result->value_deriv[j][i] = batch.frame[j][i] * value_deriv[0]
+                + batch.frame[3 + j][i] * value_deriv[1]
+                + batch.frame[6 + j][i] * value_deriv[2];
+            result->weight_deriv[j][i] = batch.frame[j][i] * weight_deriv[0]
+                + batch.frame[3 + j][i] * weight_deriv[1]
+                + batch.frame[6 + j][i] * weight_deriv[2];
+        }
+#endif // FSSR_USE_DERIVATIVES
+    }
+}
+
 /*
  * Rotation from normal in 3D using two axis orthogonal to the normal.
  */
@@ -57,6 +57,48 @@ T
 fssr_weight (T const& scale, math::Vector<T, 3> const& pos,
     math::Vector<T, 3>* deriv = nullptr);
 
+/* ------------------------ Batched evaluation -------------------------- */
+
+/**
+ * A batch of FSSR_BATCH_SIZE samples in SoA layout. The rotation frames
+ * are the row-major entries of the matrix from rotation_from_normal() and
+ * are computed per sample. Unused entries must be padded with valid
+ * data (e.g. unit scale), their results are undefined.
+ */
+struct SampleBatch
+{
+    float pos[3][FSSR_BATCH_SIZE];
+    float frame[9][FSSR_BATCH_SIZE];
+    float scale[FSSR_BATCH_SIZE];
+};
+
+/**
+ * Results of evaluate_batch(): Basis function value, weight (without
+ * sample confidence) and the weight of the sample color, which is the
+ * normalized Gaussian with sigma = scale / 5. If derivatives are enabled,
+ * also the derivatives in the global coordinate system.
+ */
+struct SampleBatchResult
+{
+    double value[FSSR_BATCH_SIZE];
+    double weight[FSSR_BATCH_SIZE];
+    double color_weight[FSSR_BATCH_SIZE];
+#if FSSR_USE_DERIVATIVES
+    double value_deriv[3][FSSR_BATCH_SIZE];
+    double weight_deriv[3][FSSR_BATCH_SIZE];
+#endif // FSSR_USE_DERIVATIVES
+};
+
+/**
+ * Evaluates basis, weight and color weight functions (and derivatives if
+ * enabled) for all samples of the batch. This is equivalent to evaluate()
+ * and transform_position() for every sample, but written as branch-free
+ * loops over the batch which the compiler can vectorize.
+ */
+void
+evaluate_batch (math::Vec3f const& pos, SampleBatch const& batch,
+    SampleBatchResult* result);
+
 /* -------------------------- Helper functions --------------------------- */
 
 /**
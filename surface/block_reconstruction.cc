@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+
+#if defined(_WIN32)
+#   include <process.h>
+#else
+#   include <unistd.h>
+#endif
+
+#include "util/timer.h"
+#include "surface/octree.h"
+#include "surface/iso_octree.h"
+#include "surface/block_reconstruction.h"
+
+/* Number of buffered samples per block before writing to disk. */
+#define BLOCK_BUFFER_SIZE 4096
+/* Voxel index bits per axis, see VoxelIndex. */
+#define BLOCK_VOXEL_BITS 20
+/* Maximum block level, limits the number of temporary files. */
+#define BLOCK_MAX_LEVEL 6
+
+FSSR_NAMESPACE_BEGIN
+
+namespace
+{
+    /*
+     * The halo consists of half a block for the octree nodes adjacent to
+     * the block and the influence radius (three times the scale) of the
+     * sample, which is at least a quarter block.
+     */
+    double const HALO_NODE_FACTOR = 0.5;
+    double const HALO_INFLUENCE_FACTOR = 0.25;
+
+    /* Distinguishes the block files of several instances in a process. */
+    std::atomic<unsigned int> instance_counter(0);
+
+    std::string
+    create_file_prefix (std::string const& temp_dir)
+    {
+#if defined(_WIN32)
+        int const pid = _getpid();
+#else
+        int const pid = static_cast<int>(::getpid());
+#endif
+        std::stringstream ss;
+        ss << temp_dir << "/fssr-" << pid << "-" << instance_counter++;
+        return ss.str();
+    }
+
+    /*
+     * Vertices are on the boundary of a block if both edge voxels are on
+     * the same block face, i.e. share a coordinate that is a multiple of
+     * the block size. Octree edges never cross block boundaries.
+     */
+    bool
+    is_block_boundary_edge (IsoSurface::EdgeIndex const& edge, int block_level)
+    {
+        VoxelIndex v1, v2;
+        v1.index = edge.first;
+        v2.index = edge.second;
+        int32_t const mask = (int32_t(1) << (BLOCK_VOXEL_BITS - block_level)) - 1;
+        return ((v1.get_offset_x() | v2.get_offset_x()) & mask) == 0
+            || ((v1.get_offset_y() | v2.get_offset_y()) & mask) == 0
+            || ((v1.get_offset_z() | v2.get_offset_z()) & mask) == 0;
+    }
+
+    /* Converts block coordinates to the octree path of the block. */
+    uint64_t
+    block_path_from_coords (int level, int const* coords)
+    {
+        uint64_t path = 0;
+        for (int i = level - 1; i >= 0; --i)
+        {
+            int octant = 0;
+            for (int j = 0; j < 3; ++j)
+                octant |= ((coords[j] >> i) & 1) << j;
+            path = (path << 3) | octant;
+        }
+        return path;
+    }
+
+    /* Converts the octree path of a block to block coordinates. */
+    void
+    block_coords_from_path (int level, uint64_t path, int* coords)
+    {
+        coords[0] = coords[1] = coords[2] = 0;
+        for (int i = 0; i < level; ++i)
+        {
+            int const octant = (path >> (3 * i)) & 7;
+            for (int j = 0; j < 3; ++j)
+                coords[j] |= ((octant >> j) & 1) << i;
+        }
+    }
+
+    /*
+     * Appends a block mesh, merging vertices on the same octree edge. Only
+     * block boundary vertices can be shared and are stored in the map.
+     */
+    void
+    append_block_mesh (BlockReconstruction::BlockMesh const& block,
+        int block_level,
+        std::map<IsoSurface::EdgeIndex, std::size_t>* vertex_map,
+        core::TriangleMesh::Ptr mesh)
+    {
+        core::TriangleMesh::VertexList const& in_verts
+            = block.mesh->get_vertices();
+        core::TriangleMesh::ColorList const& in_colors
+            = block.mesh->get_vertex_colors();
+        core::TriangleMesh::ValueList const& in_values
+            = block.mesh->get_vertex_values();
+        core::TriangleMesh::ConfidenceList const& in_confs
+            = block.mesh->get_vertex_confidences();
+        core::TriangleMesh::FaceList const& in_faces
+            = block.mesh->get_faces();
+
+        if (block.vertex_edges.size() != in_verts.size())
+            throw std::invalid_argument("Vertex edges mismatch");
+
+        core::TriangleMesh::VertexList& verts = mesh->get_vertices();
+        core::TriangleMesh::ColorList& colors = mesh->get_vertex_colors();
+        core::TriangleMesh::ValueList& values = mesh->get_vertex_values();
+        core::TriangleMesh::ConfidenceList& confs
+            = mesh->get_vertex_confidences();
+        core::TriangleMesh::FaceList& faces = mesh->get_faces();
+
+        std::vector<std::size_t> vertex_ids(in_verts.size());
+        for (std::size_t i = 0; i < in_verts.size(); ++i)
+        {
+            vertex_ids[i] = verts.size();
+            if (is_block_boundary_edge(block.vertex_edges[i], block_level))
+            {
+                std::pair<std::map<IsoSurface::EdgeIndex,
+                    std::size_t>::iterator, bool> result = vertex_map->insert(
+                    std::make_pair(block.vertex_edges[i], verts.size()));
+                vertex_ids[i] = result.first->second;
+                if (!result.second)
+                    continue;
+            }
+
+            verts.push_back(in_verts[i]);
+            if (!in_colors.empty())
+                colors.push_back(in_colors[i]);
+            if (!in_values.empty())
+                values.push_back(in_values[i]);
+            if (!in_confs.empty())
+                confs.push_back(in_confs[i]);
+        }
+
+        faces.reserve(faces.size() + in_faces.size());
+        for (std::size_t i = 0; i < in_faces.size(); ++i)
+            faces.push_back(vertex_ids[in_faces[i]]);
+    }
+}
+
+void
+BlockReconstruction::partition (std::vector<std::string> const& files,
+    SampleIO::Options const& sample_opts)
+{
+    this->clear();
+
+    int const block_level = this->opts.block_level;
+    if (block_level < 1 || block_level > BLOCK_MAX_LEVEL)
+        throw std::invalid_argument("Invalid block level");
+    if (block_level >= this->opts.max_level)
+        throw std::invalid_argument("Block level must be below max level");
+
+    /*
+     * First pass: Compute the octree root for all samples. The root is
+     * expanded exactly as for a complete reconstruction.
+     */
+    std::cout << "Computing octree root..." << std::endl;
+    util::WallTimer timer;
+    Octree frame;
+    frame.set_max_level(this->opts.max_level);
+    uint64_t num_samples = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        SampleIO loader(sample_opts);
+        loader.open_file(files[i]);
+        Sample sample;
+        while (loader.next_sample(&sample))
+        {
+            frame.expand_root_for_sample(sample);
+            num_samples += 1;
+        }
+    }
+    if (num_samples == 0)
+        throw std::runtime_error("No samples to reconstruct");
+
+    this->root_center = frame.get_root_node_center();
+    this->root_size = frame.get_root_node_size();
+    std::cout << "Octree root of size " << this->root_size
+        << " for " << num_samples << " samples, took "
+        << timer.get_elapsed() << "ms." << std::endl;
+
+    /*
+     * Second pass: Distribute samples to the blocks. Samples are appended
+     * to every block whose halo region contains the sample. If the buffered
+     * samples exceed the memory budget, all buffers are flushed to disk.
+     */
+    std::cout << "Distributing samples to " << this->get_num_blocks()
+        << " blocks..." << std::endl;
+    timer.reset();
+    std::size_t const num_blocks = this->get_num_blocks();
+    int const blocks_per_axis = 1 << block_level;
+    double const block_size = this->root_size / blocks_per_axis;
+    double const min_influence = block_size * HALO_INFLUENCE_FACTOR;
+    math::Vec3d const root_min = this->root_center
+        - math::Vec3d(this->root_size / 2.0);
+    std::size_t const max_buffered = std::max<std::size_t>(BLOCK_BUFFER_SIZE,
+        this->opts.buffer_memory / sizeof(Sample));
+
+    this->file_prefix = create_file_prefix(this->opts.temp_dir);
+    this->block_num_samples.resize(num_blocks, 0);
+    this->block_refined.resize(num_blocks, false);
+    std::vector<SampleList> buffers(num_blocks);
+    std::size_t num_buffered = 0;
+    std::size_t num_flushes = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        SampleIO loader(sample_opts);
+        loader.open_file(files[i]);
+        Sample sample;
+        while (loader.next_sample(&sample))
+        {
+            /* Blocks with samples finer than the block level are refined. */
+            uint8_t level;
+            uint64_t path;
+            frame.find_sample_path(sample, &level, &path);
+            if (level > block_level)
+                this->block_refined[path >> (3 * (level - block_level))]
+                    = true;
+
+            /* Samples with large scale may be appended to many blocks. */
+            double const halo = block_size * HALO_NODE_FACTOR
+                + std::max(min_influence, 3.0 * sample.scale);
+            int coords_min[3], coords_max[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                double const pos = sample.pos[j] - root_min[j];
+                coords_min[j] = static_cast<int>
+                    (std::floor((pos - halo) / block_size));
+                coords_max[j] = static_cast<int>
+                    (std::floor((pos + halo) / block_size));
+                coords_min[j] = std::max(0, coords_min[j]);
+                coords_max[j] = std::min(blocks_per_axis - 1, coords_max[j]);
+            }
+
+            int coords[3];
+            for (coords[2] = coords_min[2]; coords[2] <= coords_max[2]; ++coords[2])
+                for (coords[1] = coords_min[1]; coords[1] <= coords_max[1]; ++coords[1])
+                    for (coords[0] = coords_min[0]; coords[0] <= coords_max[0]; ++coords[0])
+                    {
+                        std::size_t const block_id
+                            = block_path_from_coords(block_level, coords);
+                        buffers[block_id].push_back(sample);
+                        this->block_num_samples[block_id] += 1;
+                        num_buffered += 1;
+                        if (buffers[block_id].size() < BLOCK_BUFFER_SIZE)
+                            continue;
+                        num_buffered -= buffers[block_id].size();
+                        this->write_block_samples(block_id,
+                            &buffers[block_id]);
+                    }
+
+            if (num_buffered < max_buffered)
+                continue;
+            for (std::size_t j = 0; j < num_blocks; ++j)
+                this->write_block_samples(j, &buffers[j]);
+            num_buffered = 0;
+            num_flushes += 1;
+        }
+    }
+
+    std::size_t num_non_empty = 0;
+    for (std::size_t i = 0; i < num_blocks; ++i)
+    {
+        this->write_block_samples(i, &buffers[i]);
+        if (!this->is_block_empty(i))
+            num_non_empty += 1;
+    }
+
+    std::cout << "Distributed samples to " << num_non_empty
+        << " non-empty blocks, " << num_flushes << " buffer flushes, took "
+        << timer.get_elapsed() << "ms." << std::endl;
+}
+
+bool
+BlockReconstruction::is_block_empty (std::size_t block_id) const
+{
+    if (block_id >= this->block_num_samples.size())
+        throw std::invalid_argument("Invalid block ID");
+    return this->block_num_samples[block_id] == 0;
+}
+
+void
+BlockReconstruction::reconstruct_block (std::size_t block_id,
+    BlockMesh* result) const
+{
+    result->mesh = core::TriangleMesh::create();
+    result->vertex_edges.clear();
+    if (this->is_block_empty(block_id))
+        return;
+
+    /* The block file contains the samples in input order. */
+    SampleList samples;
+    this->read_block_samples(block_id, &samples);
+
+    /*
+     * Build the octree in the common frame. The top levels are refined
+     * uniformly to the block level, and the neighboring blocks are refined
+     * if they contain finer samples. This makes the octree around the
+     * block independent of samples outside the halo.
+     */
+    int const block_level = this->opts.block_level;
+    IsoOctree octree;
+    octree.set_max_level(this->opts.max_level);
+    octree.set_compact_voxels(this->opts.compact_voxels,
+        this->opts.interp_type != INTERPOLATION_LINEAR);
+    octree.set_confidence_threshold(this->opts.confidence_threshold);
+    octree.create_root(this->root_center, this->root_size);
+    for (std::size_t i = 0; i < this->get_num_blocks(); ++i)
+        octree.insert_node(block_level, i);
+
+    int const blocks_per_axis = 1 << block_level;
+    int block_coords[3];
+    block_coords_from_path(block_level, block_id, block_coords);
+    int coords[3];
+    for (coords[2] = block_coords[2] - 1; coords[2] <= block_coords[2] + 1; ++coords[2])
+        for (coords[1] = block_coords[1] - 1; coords[1] <= block_coords[1] + 1; ++coords[1])
+            for (coords[0] = block_coords[0] - 1; coords[0] <= block_coords[0] + 1; ++coords[0])
+            {
+                if (coords[0] < 0 || coords[0] >= blocks_per_axis
+                    || coords[1] < 0 || coords[1] >= blocks_per_axis
+                    || coords[2] < 0 || coords[2] >= blocks_per_axis)
+                    continue;
+                uint64_t const path = block_path_from_coords(block_level, coords);
+                if (this->block_refined[path])
+                    octree.insert_node(block_level + 1, path << 3);
+            }
+
+    octree.insert_samples(samples);
+    SampleList().swap(samples);
+    for (int i = 0; i < this->opts.refine_octree; ++i)
+        octree.refine_octree();
+    octree.limit_octree_level();
+
+    /* Compute voxels of the leaves touching the block. */
+    math::Vec3d aabb_min, aabb_max;
+    this->get_block_aabb(block_id, &aabb_min, &aabb_max);
+    octree.compute_voxels(aabb_min, aabb_max);
+    octree.clear_samples();
+
+    /* Extract the isosurface for the leaves inside the block. */
+    IsoSurface iso_surface(&octree, this->opts.interp_type);
+    iso_surface.set_extraction_node(block_level, block_id);
+    result->mesh = iso_surface.extract_mesh(&result->vertex_edges);
+}
+
+core::TriangleMesh::Ptr
+BlockReconstruction::reconstruct (void)
+{
+    core::TriangleMesh::Ptr mesh = core::TriangleMesh::create();
+    std::map<IsoSurface::EdgeIndex, std::size_t> vertex_map;
+    for (std::size_t i = 0; i < this->get_num_blocks(); ++i)
+    {
+        if (this->is_block_empty(i))
+            continue;
+
+        std::cout << "Reconstructing block " << i << " ("
+            << this->block_num_samples[i] << " samples)..." << std::endl;
+        util::WallTimer timer;
+        BlockMesh block;
+        this->reconstruct_block(i, &block);
+        append_block_mesh(block, this->opts.block_level, &vertex_map, mesh);
+        std::cout << "Block " << i << " has "
+            << block.mesh->get_vertices().size() << " vertices, took "
+            << timer.get_elapsed() << "ms." << std::endl;
+    }
+
+    return mesh;
+}
+
+core::TriangleMesh::Ptr
+BlockReconstruction::stitch (std::vector<BlockMesh> const& blocks,
+    int block_level)
+{
+    core::TriangleMesh::Ptr mesh = core::TriangleMesh::create();
+    std::map<IsoSurface::EdgeIndex, std::size_t> vertex_map;
+    for (std::size_t i = 0; i < blocks.size(); ++i)
+        append_block_mesh(blocks[i], block_level, &vertex_map, mesh);
+    return mesh;
+}
+
+void
+BlockReconstruction::clear (void)
+{
+    for (std::size_t i = 0; i < this->block_num_samples.size(); ++i)
+        if (this->block_num_samples[i] > 0)
+            std::remove(this->get_block_filename(i).c_str());
+
+    this->block_num_samples.clear();
+    this->block_refined.clear();
+    this->file_prefix.clear();
+}
+
+std::string
+BlockReconstruction::get_block_filename (std::size_t block_id) const
+{
+    std::stringstream ss;
+    ss << this->file_prefix << "-block-" << block_id << ".bin";
+    return ss.str();
+}
+
+void
+BlockReconstruction::get_block_aabb (std::size_t block_id,
+    math::Vec3d* aabb_min, math::Vec3d* aabb_max) const
+{
+    int coords[3];
+    block_coords_from_path(this->opts.block_level, block_id, coords);
+    double const block_size = this->root_size / (1 << this->opts.block_level);
+    for (int i = 0; i < 3; ++i)
+    {
+        (*aabb_min)[i] = this->root_center[i] - this->root_size / 2.0
+            + coords[i] * block_size;
+        (*aabb_max)[i] = (*aabb_min)[i] + block_size;
+    }
+}
+
+void
+BlockReconstruction::write_block_samples (std::size_t block_id,
+    SampleList* buffer)
+{
+    if (buffer->empty())
+        return;
+
+    /* The file is created with the first buffer of the block. */
+    bool const append = this->block_num_samples[block_id] > buffer->size();
+    std::string const filename = this->get_block_filename(block_id);
+    std::ofstream out(filename.c_str(), std::ios::binary
+        | (append ? std::ios::app : std::ios::trunc));
+    if (!out.good())
+        throw std::runtime_error("Cannot open block file: " + filename);
+    out.write(reinterpret_cast<char const*>(&(*buffer)[0]),
+        buffer->size() * sizeof(Sample));
+    if (!out.good())
+        throw std::runtime_error("Cannot write block file: " + filename);
+    out.close();
+
+    /* Release the memory, it is accounted for buffered samples only. */
+    SampleList().swap(*buffer);
+}
+
+void
+BlockReconstruction::read_block_samples (std::size_t block_id,
+    SampleList* samples) const
+{
+    samples->clear();
+    std::size_t const num_samples = this->block_num_samples[block_id];
+    if (num_samples == 0)
+        return;
+
+    std::string const filename = this->get_block_filename(block_id);
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
+        throw std::runtime_error("Cannot open block file: " + filename);
+    samples->resize(num_samples);
+    in.read(reinterpret_cast<char*>(&(*samples)[0]),
+        num_samples * sizeof(Sample));
+    if (!in.good())
+        throw std::runtime_error("Cannot read block file: " + filename);
+    in.close();
+}
+
+FSSR_NAMESPACE_END
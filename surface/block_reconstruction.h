@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef FSSR_BLOCK_RECONSTRUCTION_HEADER
+#define FSSR_BLOCK_RECONSTRUCTION_HEADER
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "math/vector.h"
+#include "core/mesh.h"
+#include "surface/defines.h"
+#include "surface/hermite.h"
+#include "surface/sample.h"
+#include "surface/sample_io.h"
+#include "surface/iso_surface.h"
+
+FSSR_NAMESPACE_BEGIN
+
+/**
+ * Out-of-core surface reconstruction which partitions space into blocks.
+ *
+ * All samples are streamed once to compute the octree root, which defines
+ * a common coordinate frame for all blocks. The blocks are the nodes of the
+ * octree on the block level. In a second pass, samples are distributed to
+ * temporary per-block files. Every block receives the samples in the block
+ * and a halo around it, which covers half a block (the largest octree node
+ * adjacent to the block that is finer than the block level) plus the
+ * influence radius (three times the scale) of the samples. Buffered samples
+ * are limited by a memory budget and flushed to the block files on demand,
+ * thus no per-sample state is kept in memory.
+ *
+ * Every block is reconstructed independently with its own octree in the
+ * common frame. Voxels are only evaluated for leaves touching the block, and
+ * polygons are only extracted for leaves inside the block. Since the octree
+ * and the implicit function around the block equal the ones of a complete
+ * reconstruction, vertices on the block boundary are computed identically by
+ * neighboring blocks. The meshes are stitched by merging vertices on the
+ * same octree edge, which yields a crack-free mesh. Only vertices on block
+ * boundaries are looked up for merging.
+ *
+ * In order to make the octree around a block independent of distant samples,
+ * the top levels of the octree are refined uniformly to the block level.
+ * Twin vertices (see IsoSurface) which are located outside the halo of a
+ * block are rare; if their voxels are missing, the polygon is skipped.
+ */
+class BlockReconstruction
+{
+public:
+    struct Options
+    {
+        Options (void);
+
+        /* Octree level of the blocks, space is split into 8^level blocks. */
+        int block_level;
+        /* Maximum octree level, see Octree::set_max_level(). */
+        int max_level;
+        /* Refines the octree of every block with N levels. */
+        int refine_octree;
+        /* Interpolation type used for isosurface extraction. */
+        InterpolationType interp_type;
+        /* Stores voxels in the compact representation, see VoxelStorage. */
+        bool compact_voxels;
+        /* Confidence threshold, see IsoOctree::set_confidence_threshold(). */
+        float confidence_threshold;
+        /* Directory for the temporary per-block sample files. */
+        std::string temp_dir;
+        /* Memory budget in bytes for buffered samples while partitioning. */
+        std::size_t buffer_memory;
+    };
+
+    /** The mesh of a block with the octree edge of every vertex. */
+    struct BlockMesh
+    {
+        core::TriangleMesh::Ptr mesh;
+        std::vector<IsoSurface::EdgeIndex> vertex_edges;
+    };
+
+public:
+    BlockReconstruction (Options const& opts);
+    ~BlockReconstruction (void);
+
+    /**
+     * Streams the samples from all input files twice to compute the octree
+     * root and to distribute the samples to the temporary block files.
+     */
+    void partition (std::vector<std::string> const& files,
+        SampleIO::Options const& sample_opts);
+
+    /** Returns the number of blocks, which is 8^block_level. */
+    std::size_t get_num_blocks (void) const;
+
+    /** Returns whether there are no samples that influence the block. */
+    bool is_block_empty (std::size_t block_id) const;
+
+    /** Reconstructs the block with the given ID (the octree path). */
+    void reconstruct_block (std::size_t block_id, BlockMesh* result) const;
+
+    /** Reconstructs all non-empty blocks and stitches the meshes. */
+    core::TriangleMesh::Ptr reconstruct (void);
+
+    /**
+     * Stitches block meshes by merging vertices on the same octree edge.
+     * Only vertices on the boundary of blocks on the given level are merged.
+     */
+    static core::TriangleMesh::Ptr stitch (std::vector<BlockMesh> const& blocks,
+        int block_level);
+
+    /** Removes the temporary block files. */
+    void clear (void);
+
+private:
+    std::string get_block_filename (std::size_t block_id) const;
+    void get_block_aabb (std::size_t block_id,
+        math::Vec3d* aabb_min, math::Vec3d* aabb_max) const;
+    void write_block_samples (std::size_t block_id, SampleList* buffer);
+    void read_block_samples (std::size_t block_id, SampleList* samples) const;
+
+private:
+    Options opts;
+
+    /* Root of the octree, which is the common frame of all blocks. */
+    math::Vec3d root_center;
+    double root_size;
+
+    /* Prefix of the temporary block files, unique per process and instance. */
+    std::string file_prefix;
+    /* Number of samples in the halo region of every block. */
+    std::vector<std::size_t> block_num_samples;
+    /* Blocks that contain samples finer than the block level. */
+    std::vector<bool> block_refined;
+};
+
+/* ------------------------- Implementation ---------------------------- */
+
+inline
+BlockReconstruction::Options::Options (void)
+    : block_level(3)
+    , max_level(20)
+    , refine_octree(0)
+    , interp_type(INTERPOLATION_CUBIC)
+    , compact_voxels(false)
+    , confidence_threshold(0.0f)
+    , temp_dir(".")
+    , buffer_memory(std::size_t(256) << 20)
+{
+}
+
+inline
+BlockReconstruction::BlockReconstruction (Options const& opts)
+    : opts(opts)
+    , root_size(0.0)
+{
+}
+
+inline
+BlockReconstruction::~BlockReconstruction (void)
+{
+    this->clear();
+}
+
+inline std::size_t
+BlockReconstruction::get_num_blocks (void) const
+{
+    return std::size_t(1) << (3 * this->opts.block_level);
+}
+
+FSSR_NAMESPACE_END
+
+#endif // FSSR_BLOCK_RECONSTRUCTION_HEADER
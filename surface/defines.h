@@ -19,6 +19,9 @@
 /* Use derivatives for more precise isovertex interpolation. */
 #define FSSR_USE_DERIVATIVES 0
 
+/* Number of samples evaluated at once by the batched basis functions. */
+#define FSSR_BATCH_SIZE 8
+
 /*
  * Using the new weighting function is strongly recommended when using
  * derivatives, as the old weighting function derivative is discontinuous.
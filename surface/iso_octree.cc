@@ -13,7 +13,7 @@
 #include <fstream>
 #include <vector>
 #include <list>
-#include <set>
+#include <algorithm>
 #include <stdexcept>
 #include <limits>
 
@@ -22,73 +22,313 @@
 #include "surface/basis_function.h"
 #include "surface/sample.h"
 #include "surface/iso_octree.h"
+#include "surface/radix_sort.h"
 
 FSSR_NAMESPACE_BEGIN
 
+namespace
+{
+    /* Orders sample indices according to the scale of the samples. */
+    struct SampleIndexScaleCompare
+    {
+        SampleIndexScaleCompare (SampleList const& samples)
+            : samples(&samples) {}
+
+        bool operator() (std::size_t s1, std::size_t s2) const
+        {
+            return (*this->samples)[s1].scale < (*this->samples)[s2].scale;
+        }
+
+        SampleList const* samples;
+    };
+
+    /* Orders positions in a query result according to the sample scale. */
+    struct SampleOrderScaleCompare
+    {
+        SampleOrderScaleCompare (SampleList const& samples,
+            std::vector<std::size_t> const& query)
+            : samples(&samples), query(&query) {}
+
+        bool operator() (std::size_t p1, std::size_t p2) const
+        {
+            return (*this->samples)[(*this->query)[p1]].scale
+                < (*this->samples)[(*this->query)[p2]].scale;
+        }
+
+        SampleList const* samples;
+        std::vector<std::size_t> const* query;
+    };
+
+    /* Evaluation of the basis and weight functions for one sample. */
+    struct SampleEval
+    {
+        double value;
+        double weight;
+        double color_weight;
+#if FSSR_USE_DERIVATIVES
+        math::Vector<double, 3> value_deriv;
+        math::Vector<double, 3> weight_deriv;
+#endif // FSSR_USE_DERIVATIVES
+    };
+
+    void
+    get_sample_eval (SampleBatchResult const& result, std::size_t index,
+        SampleEval* eval)
+    {
+        eval->value = result.value[index];
+        eval->weight = result.weight[index];
+        eval->color_weight = result.color_weight[index];
+#if FSSR_USE_DERIVATIVES
+        for (int i = 0; i < 3; ++i)
+        {
+            eval->value_deriv[i] = result.value_deriv[i][index];
+            eval->weight_deriv[i] = result.weight_deriv[i][index];
+        }
+#endif // FSSR_USE_DERIVATIVES
+    }
+
+    /* Sums up the sample evaluations to the implicit function value. */
+    class VoxelAccumulator
+    {
+    public:
+        VoxelAccumulator (void);
+        void add (Sample const& sample, SampleEval const& eval);
+        VoxelData get_voxel_data (void) const;
+
+    private:
+        double total_value;
+        double total_weight;
+        double total_scale;
+        double total_color_weight;
+        math::Vector<double, 3> total_color;
+#if FSSR_USE_DERIVATIVES
+        math::Vector<double, 3> total_value_deriv;
+        math::Vector<double, 3> total_weight_deriv;
+#endif // FSSR_USE_DERIVATIVES
+    };
+
+    VoxelAccumulator::VoxelAccumulator (void)
+        : total_value(0.0)
+        , total_weight(0.0)
+        , total_scale(0.0)
+        , total_color_weight(0.0)
+        , total_color(0.0)
+#if FSSR_USE_DERIVATIVES
+        , total_value_deriv(0.0)
+        , total_weight_deriv(0.0)
+#endif // FSSR_USE_DERIVATIVES
+    {
+    }
+
+#if FSSR_USE_DERIVATIVES
+
+    /*
+     *         sum_i f_i(x) w_i(x) c_i     g(x)
+     * F(x) = ------------------------- = ------
+     *            sum_i w_i(x) c_i         h(x)
+     *
+     *  d           d/dx_i g(x) * h(x) - g(x) * d/dx_i h(x)
+     * ---- F(x) = -----------------------------------------
+     * dx_i                          h(x)^2
+     */
+
+    void
+    VoxelAccumulator::add (Sample const& sample, SampleEval const& eval)
+    {
+        /* Incrementally update basis and weight. */
+        this->total_value += eval.value * eval.weight * sample.confidence;
+        this->total_weight += eval.weight * sample.confidence;
+        this->total_value_deriv += (eval.value_deriv * eval.weight
+            + eval.weight_deriv * eval.value) * sample.confidence;
+        this->total_weight_deriv += eval.weight_deriv * sample.confidence;
+
+        /* Incrementally update color. */
+        double const color_weight = eval.color_weight * sample.confidence;
+        this->total_scale += sample.scale * color_weight;
+        this->total_color += sample.color * color_weight;
+        this->total_color_weight += color_weight;
+    }
+
+    VoxelData
+    VoxelAccumulator::get_voxel_data (void) const
+    {
+        VoxelData voxel;
+        voxel.value = this->total_value / this->total_weight;
+        voxel.conf = this->total_weight;
+        voxel.deriv = (this->total_value_deriv * this->total_weight
+            - this->total_weight_deriv * this->total_value)
+            / MATH_POW2(this->total_weight);
+        voxel.scale = this->total_scale / this->total_color_weight;
+        voxel.color = this->total_color / this->total_color_weight;
+        return voxel;
+    }
+
+#else // FSSR_USE_DERIVATIVES
+
+    void
+    VoxelAccumulator::add (Sample const& sample, SampleEval const& eval)
+    {
+        /* Evaluate implicit function as the sum of basis functions. */
+        double const weight = eval.weight * sample.confidence;
+        this->total_value += eval.value * weight;
+        this->total_weight += weight;
+
+        double const color_weight = eval.color_weight * sample.confidence;
+        this->total_scale += sample.scale * color_weight;
+        this->total_color += sample.color * color_weight;
+        this->total_color_weight += color_weight;
+    }
+
+    VoxelData
+    VoxelAccumulator::get_voxel_data (void) const
+    {
+        VoxelData voxel;
+        voxel.value = this->total_value / this->total_weight; // sdf value
+        voxel.conf = this->total_weight; // total weight
+        voxel.scale = this->total_scale / this->total_color_weight;
+        voxel.color = this->total_color / this->total_color_weight;
+        return voxel;
+    }
+
+#endif // FSSR_USE_DERIVATIVES
+}
+
 void
 IsoOctree::compute_voxels (void)
+{
+    this->compute_voxels_internal(nullptr);
+}
+
+void
+IsoOctree::compute_voxels (math::Vec3d const& aabb_min,
+    math::Vec3d const& aabb_max)
+{
+    math::Vec3d const aabb[2] = { aabb_min, aabb_max };
+    this->compute_voxels_internal(aabb);
+}
+
+void
+IsoOctree::compute_voxels_internal (math::Vec3d const* aabb)
 {
     util::WallTimer timer;
     this->voxels.clear();
-    this->compute_all_voxels();
+    this->linear_octree.build(this);
+    std::cout << "Linearized octree with " << this->linear_octree.get_num_nodes()
+        << " nodes, took " << timer.get_elapsed() << "ms." << std::endl;
+    try
+    {
+        this->compute_all_voxels(aabb);
+    }
+    catch (...)
+    {
+        this->linear_octree.restore(this);
+        throw;
+    }
+    this->linear_octree.restore(this);
     std::cout << "Generated " << this->voxels.size()
         << " voxels, took " << timer.get_elapsed() << "ms." << std::endl;
 }
 
 void
-IsoOctree::compute_all_voxels (void)
+IsoOctree::compute_all_voxels (math::Vec3d const* aabb)
 {
     /* Locate all leafs and store voxels in a vector. */
     std::cout << "Computing sampling of the implicit function..." << std::endl;
     {
-        /* Make voxels unique by storing them in a set first. */
-        typedef std::set<VoxelIndex> VoxelIndexSet;
-        VoxelIndexSet voxel_set;
-
-        /* Add voxels for all leaf nodes. */
+        /* Collect level and path of all leaf nodes. */
+        std::vector<std::pair<uint8_t, uint64_t> > leaves;
         Octree::Iterator iter = this->get_iterator_for_root();
         for (iter.first_leaf();
              iter.current != nullptr; iter.next_leaf()) {
+            leaves.push_back(std::make_pair(iter.level, iter.path));
+        }
 
-            // 8 vertices of the leaf node
-            for (int i = 0; i < 8; ++i) {
-                VoxelIndex index;
-                index.from_path_and_corner(iter.level, iter.path, i);
-                voxel_set.insert(index);
+        /* Restrict to leaf nodes intersecting the box, if given. */
+        if (aabb != nullptr) {
+            std::vector<char> inside(leaves.size(), 1);
+#pragma omp parallel for schedule(static)
+            for (std::size_t i = 0; i < leaves.size(); ++i) {
+                Octree::Iterator leaf;
+                leaf.level = leaves[i].first;
+                leaf.path = leaves[i].second;
+                math::Vec3d center;
+                double size;
+                this->node_center_and_size(leaf, &center, &size);
+                for (int j = 0; j < 3; ++j)
+                    if (center[j] - size / 2.0 > aabb[1][j]
+                        || center[j] + size / 2.0 < aabb[0][j])
+                        inside[i] = 0;
             }
+            std::size_t num_inside = 0;
+            for (std::size_t i = 0; i < leaves.size(); ++i)
+                if (inside[i])
+                    leaves[num_inside++] = leaves[i];
+            leaves.resize(num_inside);
         }
 
-        /* Copy voxels over to a vector. */
-        this->voxels.clear();
-        this->voxels.reserve(voxel_set.size());
-        for (VoxelIndexSet::const_iterator i = voxel_set.begin();
-            i != voxel_set.end(); ++i)
-            this->voxels.push_back(std::make_pair(*i, VoxelData()));
+        /* Compute the 8 corner voxels of all leaf nodes in parallel. */
+        std::vector<uint64_t> corners(leaves.size() * 8);
+#pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < leaves.size(); ++i) {
+            for (int j = 0; j < 8; ++j) {
+                VoxelIndex index;
+                index.from_path_and_corner(leaves[i].first,
+                    leaves[i].second, j);
+                corners[i * 8 + j] = index.index;
+            }
+        }
+        std::vector<std::pair<uint8_t, uint64_t> >().swap(leaves);
+
+        /*
+         * Make voxels unique by sorting the 63 bit indices and removing
+         * duplicates. This yields the same ascending order as std::set.
+         */
+        radix_sort(&corners, nullptr, 63);
+        corners.erase(std::unique(corners.begin(), corners.end()),
+            corners.end());
+
+        /* Move voxel indices to the voxel storage. */
+        this->voxels.set_indices(&corners);
     }
 
     std::cout << "Sampling the implicit function at " << this->voxels.size()
         << " positions, fetch a beer..." << std::endl;
 
-    /* Sample the implicit function for every voxel. */
+    /*
+     * Sample the implicit function for every voxel. Progress is reported
+     * in batches per thread to avoid synchronization for every voxel.
+     */
     std::size_t num_processed = 0;
-#pragma omp parallel for schedule(dynamic)
-    for (std::size_t i = 0; i < voxels.size(); ++i) {
+#pragma omp parallel
+    {
+        std::size_t num_local = 0;
+#pragma omp for schedule(dynamic, 64)
+        for (std::size_t i = 0; i < voxels.size(); ++i) {
 
-        // index of the voxel
-        VoxelIndex index = this->voxels[i].first;
+            // index of the voxel
+            VoxelIndex index = this->voxels.get_index(i);
 
-        // calculate voxel position
-        math::Vec3d voxel_pos = index.compute_position(
-            this->get_root_node_center(), this->get_root_node_size());
+            // calculate voxel position
+            math::Vec3d voxel_pos = index.compute_position(
+                this->get_root_node_center(), this->get_root_node_size());
 
-        // calculate the voxeldata
-        this->voxels[i].second = this->sample_ifn(voxel_pos);
+            // calculate the voxeldata
+            this->voxels.set_data(i, this->sample_ifn(voxel_pos));
+
+            num_local += 1;
+            if (num_local < 1024)
+                continue;
 
 #pragma omp critical
-        {
-            num_processed += 1;
-            this->print_progress(num_processed, this->voxels.size());
+            {
+                num_processed += num_local;
+                this->print_progress(num_processed, this->voxels.size());
+            }
+            num_local = 0;
         }
+
+#pragma omp atomic
+        num_processed += num_local;
     }
 
     /* Print progress one last time to get the 100% progress output. */
@@ -99,12 +339,13 @@ IsoOctree::compute_all_voxels (void)
 VoxelData
 IsoOctree::sample_ifn (math::Vec3d const& voxel_pos)
 {
+    if (this->confidence_threshold > 0.0f)
+        return this->sample_ifn_progressive(voxel_pos);
+
     // Query samples that influence the voxel.
-    std::vector<Sample const*> samples;
+    std::vector<std::size_t> samples;
     samples.reserve(2048);
-
-    // fix me????
-    this->influence_query(voxel_pos, 3.0, &samples);
+    this->linear_octree.influence_query(voxel_pos, 3.0, &samples);
 
     if (samples.empty())
         return VoxelData();
@@ -114,110 +355,170 @@ IsoOctree::sample_ifn (math::Vec3d const& voxel_pos)
      * samples first. If the confidence of the voxel is high enough, no
      * more samples are necessary.
      */
+    SampleList const& sample_list = this->linear_octree.get_samples();
     std::size_t num_samples = samples.size() / 10;
     std::nth_element(samples.begin(), samples.begin() + num_samples,
-        samples.end(), sample_scale_compare);
-    float const sample_max_scale = samples[num_samples]->scale * 2.0f;
-
-#if FSSR_USE_DERIVATIVES
-
-    /*
-     *         sum_i f_i(x) w_i(x) c_i     g(x)
-     * F(x) = ------------------------- = ------
-     *            sum_i w_i(x) c_i         h(x)
-     *
-     *  d           d/dx_i g(x) * h(x) - g(x) * d/dx_i h(x)
-     * ---- F(x) = -----------------------------------------
-     * dx_i                          h(x)^2
-     */
-
-    double total_value = 0.0;
-    double total_weight = 0.0;
-    double total_scale = 0.0;
-    double total_color_weight = 0.0;
-    math::Vector<double, 3> total_value_deriv(0.0);
-    math::Vector<double, 3> total_weight_deriv(0.0);
-    math::Vector<double, 3> total_color(0.0);
+        samples.end(), SampleIndexScaleCompare(sample_list));
+    float const sample_max_scale
+        = sample_list[samples[num_samples]].scale * 2.0f;
 
+    /* Remove samples with too large scale, keeping the order. */
+    std::size_t num_valid = 0;
     for (std::size_t i = 0; i < samples.size(); ++i)
+        if (sample_list[samples[i]].scale <= sample_max_scale)
+            samples[num_valid++] = samples[i];
+    samples.resize(num_valid);
+
+    /* Evaluate basis and weight functions in batches. */
+    VoxelAccumulator accum;
+    SampleBatch batch;
+    SampleBatchResult result;
+    for (std::size_t i = 0; i < samples.size(); i += FSSR_BATCH_SIZE)
     {
-        Sample const& sample = *samples[i];
-        if (sample.scale > sample_max_scale)
-            continue;
-
-        /* Evaluate basis and weight function. */
-        double value, weight;
-        math::Vector<double, 3> value_deriv, weight_deriv;
-        evaluate(voxel_pos, sample, &value, &weight,
-            &value_deriv, &weight_deriv);
-
-        /* Incrementally update basis and weight. */
-        total_value += value * weight * sample.confidence;
-        total_weight += weight * sample.confidence;
-        total_value_deriv += (value_deriv * weight + weight_deriv * value)
-            * sample.confidence;
-        total_weight_deriv += weight_deriv * sample.confidence;
+        std::size_t const batch_size = std::min<std::size_t>
+            (FSSR_BATCH_SIZE, samples.size() - i);
+        this->linear_octree.fill_batch(&samples[i], batch_size, &batch);
+        evaluate_batch(voxel_pos, batch, &result);
 
-        /* Incrementally update color. */
-        double const color_weight = gaussian_normalized<double>
-            (sample.scale / 5.0f, voxel_pos - sample.pos) * sample.confidence;
-        total_scale += sample.scale * color_weight;
-        total_color += sample.color * color_weight;
-        total_color_weight += color_weight;
+        for (std::size_t j = 0; j < batch_size; ++j)
+        {
+            SampleEval eval;
+            get_sample_eval(result, j, &eval);
+            accum.add(sample_list[samples[i + j]], eval);
+        }
     }
 
-    /* Compute final voxel data. */
-    VoxelData voxel;
-    voxel.value = total_value / total_weight;
-    voxel.conf = total_weight;
-    voxel.deriv = (total_value_deriv * total_weight
-        - total_weight_deriv * total_value) / MATH_POW2(total_weight);
-    voxel.scale = total_scale / total_color_weight;
-    voxel.color = total_color / total_color_weight;
-
-#else // FSSR_USE_DERIVATIVES
-
-    /* Evaluate implicit function as the sum of basis functions. */
-    double total_ifn = 0.0;
-    double total_weight = 0.0;
-    double total_scale = 0.0;
-    math::Vec3d total_color(0.0);
-    double total_color_weight = 0.0;
+    return accum.get_voxel_data();
+}
 
-    for (std::size_t i = 0; i < samples.size(); ++i) {
+VoxelData
+IsoOctree::sample_ifn_progressive (math::Vec3d const& voxel_pos)
+{
+    /* Query samples that influence the voxel in index order. */
+    std::vector<std::size_t> samples;
+    std::vector<uint8_t> levels;
+    samples.reserve(2048);
+    levels.reserve(2048);
+    this->linear_octree.influence_query(voxel_pos, 3.0, &samples, &levels);
 
-        Sample const& sample = *samples[i];
-        if (sample.scale > sample_max_scale)
-            continue;
+    if (samples.empty())
+        return VoxelData();
 
-        /* Evaluate basis and weight function. */
-        // fixme?? transformed position?
-        math::Vec3f const tpos = transform_position(voxel_pos, sample);
+    /* Group the query positions by level from fine to coarse. */
+    std::size_t level_offsets[LINEAR_OCTREE_MAX_LEVEL + 2] = { 0 };
+    for (std::size_t i = 0; i < levels.size(); ++i)
+        level_offsets[levels[i]] += 1;
+    std::size_t offset = 0;
+    for (int i = LINEAR_OCTREE_MAX_LEVEL + 1; i >= 0; --i)
+    {
+        std::size_t const level_size = level_offsets[i];
+        level_offsets[i] = offset;
+        offset += level_size;
+    }
+    std::vector<std::size_t> positions(samples.size());
+    for (std::size_t i = 0; i < levels.size(); ++i)
+        positions[level_offsets[levels[i]]++] = i;
 
-        double const value = fssr_basis<double>(sample.scale, tpos);
-        double const weight = fssr_weight<double>(sample.scale, tpos)* sample.confidence;
+    /*
+     * Visit the samples level by level from fine to coarse scale. After
+     * each level, the scale cutoff of sample_ifn() is applied to the
+     * samples visited so far, and only samples within the cutoff are
+     * evaluated, each one once. Coarser levels are skipped once the
+     * confidence of these samples exceeds the threshold. Scales and
+     * weighted confidences are kept in visiting order for fast scans.
+     */
+    SampleList const& sample_list = this->linear_octree.get_samples();
+    std::vector<float> visit_scales(samples.size());
+    for (std::size_t i = 0; i < positions.size(); ++i)
+        visit_scales[i] = sample_list[samples[positions[i]]].scale;
+    std::vector<double> visit_weights(samples.size(), -1.0);
+    std::vector<SampleEval> evals(samples.size());
+    std::vector<float> scales;
+    scales.reserve(samples.size());
+    std::vector<std::size_t> pending;
+    std::size_t batch_ids[FSSR_BATCH_SIZE];
+    SampleBatch batch;
+    SampleBatchResult result;
+    int min_level = 0;
+    for (std::size_t num_visited = 0; num_visited < positions.size();)
+    {
+        /* Positions are grouped, the level ends where it changes. */
+        min_level = levels[positions[num_visited]];
+        std::size_t const level_begin = num_visited;
+        while (num_visited < positions.size()
+            && levels[positions[num_visited]] == min_level)
+            num_visited += 1;
+        scales.insert(scales.end(), visit_scales.begin() + level_begin,
+            visit_scales.begin() + num_visited);
+
+        std::nth_element(scales.begin(), scales.begin() + scales.size() / 10,
+            scales.end());
+        float const sample_max_scale = scales[scales.size() / 10] * 2.0f;
+
+        /* Sum up evaluated samples, collect the others within the cutoff. */
+        double total_weight = 0.0;
+        pending.clear();
+        for (std::size_t i = 0; i < num_visited; ++i)
+        {
+            if (visit_scales[i] > sample_max_scale)
+                continue;
+            if (visit_weights[i] < 0.0)
+                pending.push_back(i);
+            else
+                total_weight += visit_weights[i];
+        }
 
-        /* Incrementally update. */
-        total_ifn += value * weight;
-        total_weight += weight;
+        for (std::size_t i = 0; i < pending.size(); i += FSSR_BATCH_SIZE)
+        {
+            std::size_t const batch_size = std::min<std::size_t>
+                (FSSR_BATCH_SIZE, pending.size() - i);
+            for (std::size_t j = 0; j < batch_size; ++j)
+                batch_ids[j] = samples[positions[pending[i + j]]];
+            this->linear_octree.fill_batch(batch_ids, batch_size, &batch);
+            evaluate_batch(voxel_pos, batch, &result);
+            for (std::size_t j = 0; j < batch_size; ++j)
+            {
+                std::size_t const visit = pending[i + j];
+                SampleEval& eval = evals[positions[visit]];
+                get_sample_eval(result, j, &eval);
+                visit_weights[visit] = eval.weight
+                    * sample_list[batch_ids[j]].confidence;
+                total_weight += visit_weights[visit];
+            }
+        }
 
-        double const color_weight = gaussian_normalized<double>
-            (sample.scale / 5.0f, tpos) * sample.confidence;
-        total_scale += sample.scale * color_weight;
-        total_color += sample.color * color_weight;
-        total_color_weight += color_weight;
+        if (total_weight >= this->confidence_threshold)
+            break;
     }
 
-    /* Compute final voxel data. */
-    VoxelData voxel;
-    voxel.value = total_ifn / total_weight; // sdf value
-    voxel.conf = total_weight; // total weight
-    voxel.scale = total_scale / total_color_weight;
-    voxel.color = total_color / total_color_weight;
-
-#endif // FSSR_USE_DERIVATIVES
+    /*
+     * Accumulate the visited samples within the final cutoff, which have
+     * all been evaluated. They are visited in the order of sample_ifn(),
+     * i.e. the index order permuted by the scale selection, such that an
+     * unreachable threshold yields exactly the exhaustive result.
+     */
+    std::vector<std::size_t> order;
+    order.reserve(samples.size());
+    for (std::size_t i = 0; i < samples.size(); ++i)
+        if (levels[i] >= min_level)
+            order.push_back(i);
+
+    SampleOrderScaleCompare const scale_compare(sample_list, samples);
+    std::size_t num_samples = order.size() / 10;
+    std::nth_element(order.begin(), order.begin() + num_samples,
+        order.end(), scale_compare);
+    float const sample_max_scale
+        = sample_list[samples[order[num_samples]]].scale * 2.0f;
+
+    VoxelAccumulator accum;
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        Sample const& sample = sample_list[samples[order[i]]];
+        if (sample.scale <= sample_max_scale)
+            accum.add(sample, evals[order[i]]);
+    }
 
-    return voxel;
+    return accum.get_voxel_data();
 }
 
 void
@@ -15,6 +15,7 @@
 #include "surface/defines.h"
 #include "surface/voxel.h"
 #include "surface/octree.h"
+#include "surface/linear_octree.h"
 
 FSSR_NAMESPACE_BEGIN
 
@@ -25,9 +26,6 @@ FSSR_NAMESPACE_BEGIN
  // primal vertices of the leaf nodes are called voxels
 class IsoOctree : public Octree
 {
-public:
-    typedef std::vector<std::pair<VoxelIndex, VoxelData> > VoxelVector;
-
 public:
     IsoOctree (void);
 
@@ -37,21 +35,51 @@ public:
     // Clears the voxel data, keeps samples and hierarchy.
     void clear_voxel_data (void);
 
+    /**
+     * Selects the compact voxel representation, see VoxelStorage.
+     * Derivatives are only required for non-linear interpolation.
+     * This clears the voxel data.
+     */
+    void set_compact_voxels (bool compact, bool store_derivatives);
+
+    /**
+     * Sets the confidence threshold for progressive evaluation of the
+     * implicit function. The samples influencing a voxel are evaluated from
+     * fine to coarse octree level until the accumulated confidence of the
+     * samples within the scale cutoff exceeds the threshold, coarser
+     * samples are skipped. Larger thresholds yield higher quality at lower
+     * speed. Zero (the default) uses all samples.
+     */
+    void set_confidence_threshold (float threshold);
+
     // Evaluate the implicit function for all voxels on all leaf nodes.
     void compute_voxels (void);
 
-    // Returns the map of computed voxels.
-    VoxelVector const& get_voxels (void) const;
+    /**
+     * Evaluates the implicit function only for the voxels of leaf nodes
+     * which intersect the given axis-aligned box (boundary included).
+     */
+    void compute_voxels (math::Vec3d const& aabb_min,
+        math::Vec3d const& aabb_max);
+
+    // Returns the computed voxels.
+    VoxelStorage const& get_voxels (void) const;
 
 
 
 private:
-    void compute_all_voxels (void);
+    void compute_voxels_internal (math::Vec3d const* aabb);
+    void compute_all_voxels (math::Vec3d const* aabb);
     VoxelData sample_ifn (math::Vec3d const& voxel_pos);
+    VoxelData sample_ifn_progressive (math::Vec3d const& voxel_pos);
     void print_progress (std::size_t voxels_done, std::size_t voxels_total);
 
 private:
-    VoxelVector voxels;
+    VoxelStorage voxels;
+    /* Linearized copy of the octree used for the influence queries. */
+    LinearOctree linear_octree;
+    /* Confidence threshold for progressive evaluation, zero to disable. */
+    float confidence_threshold;
 };
 
 FSSR_NAMESPACE_END
@@ -62,6 +90,7 @@ FSSR_NAMESPACE_BEGIN
 
 inline
 IsoOctree::IsoOctree (void)
+    : confidence_threshold(0.0f)
 {
 }
 
@@ -69,6 +98,7 @@ inline void
 IsoOctree::clear (void)
 {
     this->clear_voxel_data();
+    this->linear_octree.clear();
     this->Octree::clear();
 }
 
@@ -78,7 +108,19 @@ IsoOctree::clear_voxel_data (void)
     this->voxels.clear();
 }
 
-inline IsoOctree::VoxelVector const&
+inline void
+IsoOctree::set_compact_voxels (bool compact, bool store_derivatives)
+{
+    this->voxels.set_compact(compact, store_derivatives);
+}
+
+inline void
+IsoOctree::set_confidence_threshold (float threshold)
+{
+    this->confidence_threshold = threshold;
+}
+
+inline VoxelStorage const&
 IsoOctree::get_voxels (void) const
 {
     return this->voxels;
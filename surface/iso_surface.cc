@@ -18,8 +18,11 @@
  *   Vertex Order    Edge Order 1    Edge Order 2
  */
 
+#include <algorithm>
 #include <iostream>
 #include <bitset>
+#include <stdexcept>
+#include <string>
 
 #include "util/timer.h"
 #include "surface/octree.h"
@@ -31,6 +34,15 @@
 #define CUBE_EDGES 12
 #define CUBE_FACES 6
 
+/* Parameters for parallel extraction. */
+#define MC_INDEX_SUBTREE_LEVEL 3
+#define EDGE_MAP_SHARDS 256
+#define LEAF_CHUNK_SIZE 1024
+#define POLYGON_CHUNK_SIZE 4096
+#define NO_VERTEX static_cast<std::size_t>(-1)
+#define EXTRA_VERTEX_FLAG (static_cast<std::size_t>(1) \
+    << (sizeof(std::size_t) * 8 - 1))
+
 FSSR_NAMESPACE_BEGIN
 
 /** Helper types and functions. */
@@ -435,10 +447,25 @@ namespace
             return Octree::Iterator();
         return iter.descend(iter.level, path);
     }
+
+    /** List of vertex valences, vertices are given by cube edges. */
+    typedef std::vector<std::pair<std::pair<uint64_t, uint64_t>, int> >
+        ValenceList;
+
+    /** Returns the valence of an edge vertex, inserts it if missing. */
+    int*
+    get_valence (ValenceList* valences, std::pair<uint64_t, uint64_t> const& edge)
+    {
+        for (std::size_t i = 0; i < valences->size(); ++i)
+            if (valences->at(i).first == edge)
+                return &valences->at(i).second;
+        valences->push_back(std::make_pair(edge, 0));
+        return &valences->back().second;
+    }
 }
 
 core::TriangleMesh::Ptr
-IsoSurface::extract_mesh (void)
+IsoSurface::extract_mesh (std::vector<EdgeIndex>* vertex_edges)
 {
     std::cout << "  Sanity-checking input data..." << std::flush;
     util::WallTimer timer;
@@ -452,11 +479,17 @@ IsoSurface::extract_mesh (void)
      * Strategy (1) is implemented, it is simpler but slightly more expensive.
      */
     std::cout << "  Computing Marching Cubes indices..." << std::flush;
-    Octree::Iterator iter = this->octree->get_iterator_for_root();
-    for (iter.first_node(); iter.current != nullptr; iter.next_node())
-        this->compute_mc_index(iter);
+    timer.reset();
+    this->compute_all_mc_index();
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
+    /* Collect the leaves in traversal order for parallel processing. */
+    IteratorList leaves;
+    Octree::Iterator iter = this->octree->get_iterator_for_root();
+    for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
+        if (this->is_extraction_leaf(iter))
+            leaves.push_back(iter);
+
     /*
      * Compute isovertices on the octree edges for every leaf node.
      * This locates for every leaf edge the finest unique edge which
@@ -467,8 +500,7 @@ IsoSurface::extract_mesh (void)
     timer.reset();
     EdgeVertexMap edgemap;
     IsoVertexVector isovertices;
-    for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
-        this->compute_isovertices(iter, &edgemap, &isovertices);
+    this->compute_all_isovertices(leaves, &edgemap, &isovertices);
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
     /*
@@ -480,9 +512,10 @@ IsoSurface::extract_mesh (void)
     std::cout << "  Computing isopolygons..." << std::flush;
     timer.reset();
     PolygonList polygons;
-    for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
-        this->compute_isopolygons(iter, edgemap, &polygons);
+    this->compute_all_isopolygons(leaves, &edgemap, &isovertices, &polygons);
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
+    IteratorList().swap(leaves);
+    EdgeVertexMap().swap(edgemap);
 
     /*
      * The vertices are transferred to a mesh and the polygons are
@@ -494,6 +527,13 @@ IsoSurface::extract_mesh (void)
     this->compute_triangulation(isovertices, polygons, mesh);
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
+    if (vertex_edges != nullptr)
+    {
+        vertex_edges->resize(isovertices.size());
+        for (std::size_t i = 0; i < isovertices.size(); ++i)
+            vertex_edges->at(i) = isovertices[i].edge;
+    }
+
     return mesh;
 }
 
@@ -503,7 +543,7 @@ IsoSurface::sanity_checks (void)
     if (this->voxels == nullptr || this->octree == nullptr)
         throw std::runtime_error("sanity_checks(): Null octree/voxels");
     for (std::size_t i = 1; i < this->voxels->size(); ++i)
-        if (this->voxels->at(i).first < this->voxels->at(i - 1).first)
+        if (this->voxels->get_index(i) < this->voxels->get_index(i - 1))
             throw std::runtime_error("sanity_checks(): Voxels unsorted");
 
     Octree::Iterator iter = this->octree->get_iterator_for_root();
@@ -528,41 +568,214 @@ IsoSurface::compute_mc_index (Octree::Iterator const& iter)
     {
         VoxelIndex vi;
         vi.from_path_and_corner(iter.level, iter.path, i);
-        VoxelData const* vd = this->get_voxel_data(vi);
-        if (vd->value < ISO_VALUE)
+        VoxelData vd;
+        /* Voxels are missing outside the extraction node only. */
+        if (this->get_voxel_data(vi, &vd) && vd.value < ISO_VALUE)
             iter.current->mc_index |= (1 << i);
     }
 }
 
 void
-IsoSurface::compute_isovertices (Octree::Iterator const& iter,
-    EdgeVertexMap* edgemap, IsoVertexVector* isovertices)
+IsoSurface::compute_subtree_mc_index (Octree::Iterator const& iter)
 {
-    /* This should always be a leaf node. */
-    if (iter.current == nullptr || iter.current->children != nullptr)
-        throw std::runtime_error("compute_isovertices(): Invalid node");
-
-    /* Check if cube contains an isosurface. */
-    if (iter.current->mc_index == 0x00 || iter.current->mc_index == 0xff)
+    this->compute_mc_index(iter);
+    if (iter.current->children == nullptr)
         return;
+    for (int i = 0; i < CUBE_CORNERS; ++i)
+        this->compute_subtree_mc_index(iter.descend(i));
+}
 
-    for (int i = 0; i < CUBE_EDGES; ++i)
+void
+IsoSurface::compute_all_mc_index (void)
+{
+    /* The top levels are processed serially, subtrees in parallel. */
+    IteratorList subtrees;
+    IteratorList stack(1, this->octree->get_iterator_for_root());
+    while (!stack.empty())
     {
-        /* Check if edge contains an isovertex. */
-        if (!this->is_isovertex_on_edge(iter.current->mc_index, i))
+        Octree::Iterator iter = stack.back();
+        stack.pop_back();
+        if (iter.level >= MC_INDEX_SUBTREE_LEVEL
+            || iter.current->children == nullptr)
+        {
+            subtrees.push_back(iter);
             continue;
+        }
+
+        this->compute_mc_index(iter);
+        for (int i = 0; i < CUBE_CORNERS; ++i)
+            stack.push_back(iter.descend(i));
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < subtrees.size(); ++i)
+        this->compute_subtree_mc_index(subtrees[i]);
+}
+
+void
+IsoSurface::compute_all_isovertices (IteratorList const& leaves,
+    EdgeVertexMap* edgemap, IsoVertexVector* isovertices)
+{
+    /* Count the cube edges with an isovertex for every leaf. */
+    std::vector<std::size_t> offsets(leaves.size() + 1, 0);
+#pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+    {
+        int const mc_index = leaves[i].current->mc_index;
+        for (int j = 0; j < CUBE_EDGES; ++j)
+            if (this->is_isovertex_on_edge(mc_index, j))
+                offsets[i + 1] += 1;
+    }
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+        offsets[i + 1] += offsets[i];
+
+    /*
+     * Get the finest edge that contains an isovertex for every cube edge.
+     * When extracting a subtree, edges near missing voxels are skipped,
+     * the vertices are computed on demand with the polygons, if at all.
+     */
+    std::size_t const num_edges = offsets.back();
+    std::vector<EdgeIndex> edges(num_edges);
+    std::vector<int> edge_ids(num_edges, -1);
+    std::string error;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+    {
+        std::size_t edge = offsets[i];
+        for (int j = 0; j < CUBE_EDGES; ++j)
+        {
+            if (!this->is_isovertex_on_edge(leaves[i].current->mc_index, j))
+                continue;
+
+            try
+            {
+                this->get_finest_cube_edge(leaves[i], j, &edges[edge],
+                    nullptr);
+                edge_ids[edge] = j;
+            }
+            catch (std::exception& e)
+            {
+                if (this->extraction_level < 0)
+                {
+#pragma omp critical
+                    error = e.what();
+                }
+            }
+            edge += 1;
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+    std::vector<std::size_t>().swap(offsets);
+
+    /*
+     * Remove duplicate edges. Edges are distributed to shards by hash,
+     * keeping their order. Each shard is deduplicated independently, such
+     * that the first occurrence of every edge is found. Vertex IDs are
+     * assigned in order of first occurrence, which is deterministic and
+     * yields the same numbering as serial extraction.
+     */
+    std::vector<std::size_t> shard_offsets(EDGE_MAP_SHARDS + 1, 0);
+    std::vector<std::size_t> shard_edges(num_edges);
+    {
+        std::vector<uint16_t> edge_shards(num_edges);
+        EdgeIndexHash hash;
+#pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < num_edges; ++i)
+            edge_shards[i] = (hash(edges[i]) >> 24) % EDGE_MAP_SHARDS;
+        for (std::size_t i = 0; i < num_edges; ++i)
+            shard_offsets[edge_shards[i] + 1] += 1;
+        for (std::size_t i = 0; i < EDGE_MAP_SHARDS; ++i)
+            shard_offsets[i + 1] += shard_offsets[i];
+        std::vector<std::size_t> positions(shard_offsets.begin(),
+            shard_offsets.end() - 1);
+        for (std::size_t i = 0; i < num_edges; ++i)
+            shard_edges[positions[edge_shards[i]]++] = i;
+    }
+
+    edgemap->clear();
+    edgemap->resize(EDGE_MAP_SHARDS);
+    std::vector<char> is_first(num_edges, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < EDGE_MAP_SHARDS; ++i)
+    {
+        EdgeVertexShard& shard = edgemap->at(i);
+        shard.reserve(shard_offsets[i + 1] - shard_offsets[i]);
+        for (std::size_t j = shard_offsets[i]; j < shard_offsets[i + 1]; ++j)
+        {
+            std::size_t const edge = shard_edges[j];
+            if (edge_ids[edge] < 0)
+                continue;
+            if (shard.insert(std::make_pair(edges[edge], edge)).second)
+                is_first[edge] = 1;
+        }
+    }
+    std::vector<std::size_t>().swap(shard_edges);
+
+    /* Assign vertex IDs to first occurrences and compute the vertices. */
+    std::vector<std::size_t> vertex_ids(num_edges, 0);
+    std::size_t num_vertices = 0;
+    for (std::size_t i = 0; i < num_edges; ++i)
+    {
+        vertex_ids[i] = num_vertices;
+        num_vertices += is_first[i];
+    }
 
-        /* Get the finest edge that contains an isovertex. */
-        EdgeIndex edge_index;
-        this->get_finest_cube_edge(iter, i, &edge_index, nullptr);
-        if (edgemap->find(edge_index) != edgemap->end())
+    isovertices->clear();
+    isovertices->resize(num_vertices);
+    std::vector<char> is_valid(num_vertices, 1);
+#pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t i = 0; i < num_edges; ++i)
+    {
+        if (!is_first[i])
             continue;
 
-        /* Interpolate isovertex and add index to map. */
-        IsoVertex isovertex;
-        this->get_isovertex(edge_index, i, &isovertex);
-        edgemap->insert(std::make_pair(edge_index, isovertices->size()));
-        isovertices->push_back(isovertex);
+        try
+        {
+            this->get_isovertex(edges[i], edge_ids[i],
+                &isovertices->at(vertex_ids[i]));
+        }
+        catch (std::exception& e)
+        {
+            is_valid[vertex_ids[i]] = 0;
+            if (this->extraction_level < 0)
+            {
+#pragma omp critical
+                error = e.what();
+            }
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    /* Remove vertices that could not be computed. */
+    std::vector<std::size_t> valid_ids(num_vertices);
+    std::size_t num_valid = 0;
+    for (std::size_t i = 0; i < num_vertices; ++i)
+    {
+        valid_ids[i] = is_valid[i] ? num_valid : NO_VERTEX;
+        if (is_valid[i])
+            isovertices->at(num_valid++) = isovertices->at(i);
+    }
+    isovertices->resize(num_valid);
+
+    /* Map edges to the final vertex IDs. */
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < EDGE_MAP_SHARDS; ++i)
+    {
+        EdgeVertexShard& shard = edgemap->at(i);
+        for (EdgeVertexShard::iterator iter = shard.begin();
+            iter != shard.end();)
+        {
+            std::size_t const id = valid_ids[vertex_ids[iter->second]];
+            if (id == NO_VERTEX)
+            {
+                iter = shard.erase(iter);
+                continue;
+            }
+            iter->second = id;
+            ++iter;
+        }
     }
 }
 
@@ -672,8 +885,10 @@ IsoSurface::get_isovertex (EdgeIndex const& edge_index,
 
 #endif // FSSR_USE_DERIVATIVES
 
-    VoxelData const* vd1 = this->get_voxel_data(vi1);
-    VoxelData const* vd2 = this->get_voxel_data(vi2);
+    VoxelData vd1, vd2;
+    if (!this->get_voxel_data(vi1, &vd1) || !this->get_voxel_data(vi2, &vd2))
+        throw std::runtime_error("get_isovertex(): Missing voxel data");
+
     /* Get voxel positions. */
     math::Vec3d pos1 = vi1.compute_position(
         this->octree->get_root_node_center(),
@@ -687,19 +902,20 @@ IsoSurface::get_isovertex (EdgeIndex const& edge_index,
     /* Interpolate voxel data and position. */
     double const norm = pos2[edge_axis] - pos1[edge_axis];
     double const weight = interpolate_root(
-        vd1->value - ISO_VALUE, vd2->value - ISO_VALUE,
-        vd1->deriv[edge_axis] * norm, vd2->deriv[edge_axis] * norm,
+        vd1.value - ISO_VALUE, vd2.value - ISO_VALUE,
+        vd1.deriv[edge_axis] * norm, vd2.deriv[edge_axis] * norm,
         this->interpolation_type);
 
 #else // FSSR_USE_DERIVATIVES
 
     /* Interpolate voxel data and position. */
-    double const weight = (vd1->value - ISO_VALUE) / (vd1->value - vd2->value);
+    double const weight = (vd1.value - ISO_VALUE) / (vd1.value - vd2.value);
 
 #endif // FSSR_USE_DERIVATIVES
 
-    iso_vertex->data = interpolate_voxel(*vd1, (1.0 - weight), *vd2,  weight);
+    iso_vertex->data = interpolate_voxel(vd1, (1.0 - weight), vd2,  weight);
     iso_vertex->pos = pos1 * (1.0 - weight) + pos2 * weight;
+    iso_vertex->edge = edge_index;
 }
 
 bool
@@ -709,9 +925,163 @@ IsoSurface::is_isovertex_on_edge (int mc_index, int edge_id)
     return ((mc_index >> bit[0]) & 1) ^ ((mc_index >> bit[1]) & 1);
 }
 
+void
+IsoSurface::compute_all_isopolygons (IteratorList const& leaves,
+    EdgeVertexMap* edgemap, IsoVertexVector* isovertices,
+    PolygonList* polygons)
+{
+    /*
+     * Leaves are processed in chunks in parallel, and the polygons of the
+     * chunks are concatenated in order. Vertices which are missing in the
+     * edge map (only when extracting a subtree) are computed on demand per
+     * chunk and merged afterwards.
+     */
+    std::size_t const num_chunks
+        = (leaves.size() + LEAF_CHUNK_SIZE - 1) / LEAF_CHUNK_SIZE;
+    std::vector<PolygonList> chunk_polygons(num_chunks);
+    std::vector<IsoVertexVector> chunk_vertices(num_chunks);
+    std::size_t num_skipped = 0;
+    std::string error;
+#pragma omp parallel
+    {
+        PolygonEdgeList poly_edges;
+        std::vector<std::size_t> poly_sizes;
+#pragma omp for schedule(dynamic, 1) reduction(+:num_skipped)
+        for (std::size_t i = 0; i < num_chunks; ++i)
+        {
+            PolygonList& chunk = chunk_polygons[i];
+            IsoVertexVector& extra_vertices = chunk_vertices[i];
+            EdgeVertexShard extra_map;
+            chunk.offsets.push_back(0);
+
+            std::size_t const end
+                = std::min(leaves.size(), (i + 1) * LEAF_CHUNK_SIZE);
+            for (std::size_t j = i * LEAF_CHUNK_SIZE; j < end; ++j)
+            {
+                std::size_t const num_vertices = chunk.vertices.size();
+                std::size_t const num_polygons = chunk.offsets.size();
+                try
+                {
+                    poly_edges.clear();
+                    poly_sizes.clear();
+                    this->compute_isopolygons(leaves[j],
+                        &poly_edges, &poly_sizes);
+
+                    for (std::size_t k = 0; k < poly_edges.size(); ++k)
+                    {
+                        EdgeIndex const& edge = poly_edges[k].edge;
+                        std::size_t id = this->lookup_edge_vertex(*edgemap,
+                            edge);
+                        if (id == NO_VERTEX)
+                        {
+                            EdgeVertexShard::const_iterator extra
+                                = extra_map.find(edge);
+                            if (extra != extra_map.end())
+                                id = extra->second;
+                        }
+                        if (id == NO_VERTEX && this->extraction_level < 0)
+                        {
+                            throw std::runtime_error("lookup_edge_vertex(): "
+                                "No such edge vertex");
+                        }
+                        if (id == NO_VERTEX)
+                        {
+                            /*
+                             * When extracting a subtree, twin vertices can
+                             * be located on edges of leaves outside the
+                             * subtree. Compute these vertices on demand.
+                             */
+                            IsoVertex isovertex;
+                            this->get_isovertex(edge, poly_edges[k].edge_id,
+                                &isovertex);
+                            id = extra_vertices.size() | EXTRA_VERTEX_FLAG;
+                            extra_map.insert(std::make_pair(edge, id));
+                            extra_vertices.push_back(isovertex);
+                        }
+                        chunk.vertices.push_back(id);
+                    }
+                    for (std::size_t k = 0; k < poly_sizes.size(); ++k)
+                        chunk.offsets.push_back(chunk.offsets.back()
+                            + poly_sizes[k]);
+                }
+                catch (std::exception& e)
+                {
+                    /* Skip all polygons of the leaf if voxels are missing. */
+                    chunk.vertices.resize(num_vertices);
+                    chunk.offsets.resize(num_polygons);
+                    num_skipped += 1;
+                    if (this->extraction_level < 0)
+                    {
+#pragma omp critical
+                        error = e.what();
+                    }
+                }
+            }
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+    if (num_skipped > 0)
+        std::cout << " skipped polygons of " << num_skipped
+            << " leaves due to missing voxels," << std::flush;
+
+    /* Merge vertices computed on demand in chunk order. */
+    EdgeIndexHash hash;
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        if (chunk_vertices[i].empty())
+            continue;
+
+        std::vector<std::size_t> vertex_ids(chunk_vertices[i].size());
+        for (std::size_t j = 0; j < chunk_vertices[i].size(); ++j)
+        {
+            IsoVertex const& vertex = chunk_vertices[i][j];
+            EdgeVertexShard& shard = edgemap->at((hash(vertex.edge) >> 24)
+                % EDGE_MAP_SHARDS);
+            std::pair<EdgeVertexShard::iterator, bool> result
+                = shard.insert(std::make_pair(vertex.edge,
+                isovertices->size()));
+            if (result.second)
+                isovertices->push_back(vertex);
+            vertex_ids[j] = result.first->second;
+        }
+
+        std::vector<std::size_t>& vertices = chunk_polygons[i].vertices;
+        for (std::size_t j = 0; j < vertices.size(); ++j)
+            if (vertices[j] & EXTRA_VERTEX_FLAG)
+                vertices[j] = vertex_ids[vertices[j] & ~EXTRA_VERTEX_FLAG];
+        IsoVertexVector().swap(chunk_vertices[i]);
+    }
+
+    /* Concatenate the polygons of all chunks. */
+    std::vector<std::size_t> vertex_offsets(num_chunks + 1, 0);
+    std::vector<std::size_t> polygon_offsets(num_chunks + 1, 0);
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        vertex_offsets[i + 1] = vertex_offsets[i]
+            + chunk_polygons[i].vertices.size();
+        polygon_offsets[i + 1] = polygon_offsets[i]
+            + chunk_polygons[i].offsets.size() - 1;
+    }
+
+    polygons->vertices.resize(vertex_offsets.back());
+    polygons->offsets.resize(polygon_offsets.back() + 1);
+    polygons->offsets.back() = vertex_offsets.back();
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        PolygonList const& chunk = chunk_polygons[i];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+            polygons->vertices.begin() + vertex_offsets[i]);
+        for (std::size_t j = 0; j + 1 < chunk.offsets.size(); ++j)
+            polygons->offsets[polygon_offsets[i] + j]
+                = vertex_offsets[i] + chunk.offsets[j];
+    }
+}
+
 void
 IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
-    EdgeVertexMap const& edgemap, PolygonList* polygons)
+    PolygonEdgeList* poly_edges, std::vector<std::size_t>* poly_sizes)
 {
     /*
      * Step 1: Collect iso edges for all faces of this node.
@@ -725,22 +1095,14 @@ IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
         return;
 
     /*
-     * Step 2: Find open vertices by computing vertex valences.
+     * Step 2: Find open vertices by computing vertex valences. Leaves have
+     * few isoedges, thus a list is faster than a map.
      */
-    std::map<EdgeIndex, int> vertex_valence;
+    ValenceList vertex_valence;
     for (std::size_t i = 0; i < isoedges.size(); ++i)
     {
-        std::map<EdgeIndex, int>::iterator valence_iter;
-        valence_iter = vertex_valence.find(isoedges[i].first);
-        if (valence_iter == vertex_valence.end())
-            vertex_valence[isoedges[i].first] = 1;
-        else
-            valence_iter->second += 1;
-        valence_iter = vertex_valence.find(isoedges[i].second);
-        if (valence_iter == vertex_valence.end())
-            vertex_valence[isoedges[i].second] = -1;
-        else
-            valence_iter->second -= 1;
+        *get_valence(&vertex_valence, isoedges[i].first) += 1;
+        *get_valence(&vertex_valence, isoedges[i].second) -= 1;
     }
 
     /*
@@ -748,8 +1110,9 @@ IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
      */
     for (std::size_t i = 0; i < isoedges.size(); ++i)
     {
-        IsoEdge const& isoedge = isoedges[i];
-        if (vertex_valence[isoedge.first] != 0)
+        /* Copy the edge, the list grows while iterating. */
+        IsoEdge const isoedge = isoedges[i];
+        if (*get_valence(&vertex_valence, isoedge.first) != 0)
         {
             EdgeIndex twin;
             EdgeInfo twin_info;
@@ -762,25 +1125,25 @@ IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
             new_edge.second_info = isoedge.first_info;
             isoedges.push_back(new_edge);
 
-            vertex_valence[new_edge.first] += 1;
-            vertex_valence[new_edge.second] -= 1;
+            *get_valence(&vertex_valence, new_edge.first) += 1;
+            *get_valence(&vertex_valence, new_edge.second) -= 1;
         }
 
-        if (vertex_valence[isoedge.second] != 0)
+        if (*get_valence(&vertex_valence, isoedge.second) != 0)
         {
             EdgeIndex twin;
             EdgeInfo twin_info;
             this->find_twin_vertex(isoedge.second_info, &twin, &twin_info);
 
             IsoEdge new_edge;
-            new_edge.first = isoedges[i].second;
-            new_edge.first_info = isoedges[i].second_info;
+            new_edge.first = isoedge.second;
+            new_edge.first_info = isoedge.second_info;
             new_edge.second = twin;
             new_edge.second_info = twin_info;
             isoedges.push_back(new_edge);
 
-            vertex_valence[new_edge.first] += 1;
-            vertex_valence[new_edge.second] -= 1;
+            *get_valence(&vertex_valence, new_edge.first) += 1;
+            *get_valence(&vertex_valence, new_edge.second) -= 1;
         }
     }
 
@@ -793,13 +1156,14 @@ IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
         /* Once joined edges close, issue a new polygon. */
         if (isoedges[i].second == isoedges[poly_start].first)
         {
-            polygons->push_back(std::vector<std::size_t>());
-            std::vector<std::size_t>& poly = polygons->back();
             for (std::size_t j = poly_start; j <= i; ++j)
             {
-                poly.push_back(this->lookup_edge_vertex(edgemap,
-                    isoedges[j].first));
+                PolygonEdge poly_edge;
+                poly_edge.edge = isoedges[j].first;
+                poly_edge.edge_id = isoedges[j].first_info.edge_id;
+                poly_edges->push_back(poly_edge);
             }
+            poly_sizes->push_back(i + 1 - poly_start);
             poly_start = i + 1;
             continue;
         }
@@ -824,9 +1188,11 @@ std::size_t
 IsoSurface::lookup_edge_vertex (EdgeVertexMap const& edgemap,
     EdgeIndex const& edge)
 {
-    EdgeVertexMap::const_iterator iter = edgemap.find(edge);
-    if (iter == edgemap.end())
-        throw std::runtime_error("lookup_edge_vertex(): No such edge vertex");
+    EdgeVertexShard const& shard
+        = edgemap[(EdgeIndexHash()(edge) >> 24) % EDGE_MAP_SHARDS];
+    EdgeVertexShard::const_iterator iter = shard.find(edge);
+    if (iter == shard.end())
+        return NO_VERTEX;
     return iter->second;
 }
 
@@ -954,34 +1320,62 @@ IsoSurface::compute_triangulation(IsoVertexVector const& isovertices,
     core::TriangleMesh::ColorList& colors = mesh->get_vertex_colors();
     core::TriangleMesh::ValueList& values = mesh->get_vertex_values();
     core::TriangleMesh::ConfidenceList& cfs = mesh->get_vertex_confidences();
-    verts.reserve(isovertices.size());
-    colors.reserve(isovertices.size());
-    values.reserve(isovertices.size());
-    cfs.reserve(isovertices.size());
+    verts.resize(isovertices.size());
+    colors.resize(isovertices.size());
+    values.resize(isovertices.size());
+    cfs.resize(isovertices.size());
 
+#pragma omp parallel for schedule(static)
     for (std::size_t i = 0; i < isovertices.size(); ++i)
     {
         IsoVertex const& vertex = isovertices[i];
-        verts.push_back(vertex.pos);
-        colors.push_back(math::Vec4f(vertex.data.color, 1.0f));
-        values.push_back(vertex.data.scale);
-        cfs.push_back(vertex.data.conf);
+        verts[i] = vertex.pos;
+        colors[i] = math::Vec4f(vertex.data.color, 1.0f);
+        values[i] = vertex.data.scale;
+        cfs[i] = vertex.data.conf;
     }
 
-    /* Triangulate isopolygons. */
-    core::TriangleMesh::FaceList& triangles = mesh->get_faces();
-    fssr::MinAreaTriangulation tri;
-    for (std::size_t i = 0; i < polygons.size(); i++)
+    /* Triangulate isopolygons in chunks, concatenate the results in order. */
+    std::size_t const num_polygons = polygons.offsets.empty()
+        ? 0 : polygons.offsets.size() - 1;
+    std::size_t const num_chunks
+        = (num_polygons + POLYGON_CHUNK_SIZE - 1) / POLYGON_CHUNK_SIZE;
+    std::vector<core::TriangleMesh::FaceList> chunk_triangles(num_chunks);
+#pragma omp parallel
     {
+        fssr::MinAreaTriangulation tri;
         std::vector<math::Vector<float, 3> > loop;
-        loop.resize(polygons[i].size());
-        for (std::size_t j = 0; j < polygons[i].size(); ++j)
-            loop[j] = verts[polygons[i][j]];
         std::vector<unsigned int> result;
-        tri.triangulate(loop, &result);
-        for (std::size_t j = 0; j < result.size(); ++j)
-            triangles.push_back(polygons[i][result[j]]);
+#pragma omp for schedule(dynamic, 1)
+        for (std::size_t i = 0; i < num_chunks; ++i)
+        {
+            std::size_t const end
+                = std::min(num_polygons, (i + 1) * POLYGON_CHUNK_SIZE);
+            for (std::size_t j = i * POLYGON_CHUNK_SIZE; j < end; ++j)
+            {
+                std::size_t const* poly = &polygons.vertices[0]
+                    + polygons.offsets[j];
+                std::size_t const poly_size
+                    = polygons.offsets[j + 1] - polygons.offsets[j];
+                loop.resize(poly_size);
+                for (std::size_t k = 0; k < poly_size; ++k)
+                    loop[k] = verts[poly[k]];
+                result.clear();
+                tri.triangulate(loop, &result);
+                for (std::size_t k = 0; k < result.size(); ++k)
+                    chunk_triangles[i].push_back(poly[result[k]]);
+            }
+        }
     }
+
+    core::TriangleMesh::FaceList& triangles = mesh->get_faces();
+    std::size_t num_indices = 0;
+    for (std::size_t i = 0; i < num_chunks; ++i)
+        num_indices += chunk_triangles[i].size();
+    triangles.reserve(num_indices);
+    for (std::size_t i = 0; i < num_chunks; ++i)
+        triangles.insert(triangles.end(), chunk_triangles[i].begin(),
+            chunk_triangles[i].end());
 }
 
 FSSR_NAMESPACE_END
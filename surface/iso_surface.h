@@ -17,10 +17,9 @@
 #define FSSR_ISO_SURFACE_HEADER
 
 #include <vector>
-#include <map>
+#include <unordered_map>
 #include <cstdint>
 
-#include "math/algo.h"
 #include "surface/defines.h"
 #include "surface/hermite.h"
 #include "surface/iso_octree.h"
@@ -36,10 +35,30 @@ FSSR_NAMESPACE_BEGIN
  */
 class IsoSurface
 {
+public:
+    /** The edge index identifies an octree edge using two voxel indices. */
+    typedef std::pair<uint64_t, uint64_t> EdgeIndex;
+
 public:
     IsoSurface (IsoOctree* octree,
         InterpolationType interpolation_type = INTERPOLATION_CUBIC);
+
+    /**
+     * Restricts polygon extraction to the leaves in the subtree of the
+     * given node. Voxels are only required for the leaves touching the
+     * node, missing voxels elsewhere are ignored. Polygons which reference
+     * missing voxels are skipped. This is used for block-wise
+     * reconstruction where neighboring blocks extract the other leaves.
+     */
+    void set_extraction_node (uint8_t level, uint64_t path);
+
+    /**
+     * Extracts the isosurface. If 'vertex_edges' is not null, the octree
+     * edge of every mesh vertex is stored, which identifies vertices
+     * independently of the order of extraction.
+     */
     core::TriangleMesh::Ptr extract_mesh (void);
+    core::TriangleMesh::Ptr extract_mesh (std::vector<EdgeIndex>* vertex_edges);
 
 private:
     /** The isovertex contains interpolated position and voxel data. */
@@ -47,11 +66,9 @@ private:
     {
         math::Vec3f pos;
         VoxelData data;
+        EdgeIndex edge;
     };
 
-    /** The edge index identifies an octree edge using two voxel indices. */
-    typedef std::pair<uint64_t, uint64_t> EdgeIndex;
-
     /** Additional information for an edge. */
     struct EdgeInfo
     {
@@ -68,20 +85,55 @@ private:
         EdgeInfo second_info;
     };
 
+    /** A polygon vertex given by the cube edge it is located on. */
+    struct PolygonEdge
+    {
+        EdgeIndex edge;
+        int edge_id;
+    };
+
+    /** Flat list of polygons, each indexing vertices. */
+    struct PolygonList
+    {
+        /* Vertex IDs of all polygons in sequence. */
+        std::vector<std::size_t> vertices;
+        /* Polygon i has vertices [offsets[i], offsets[i + 1]). */
+        std::vector<std::size_t> offsets;
+    };
+
+    /** Hash function for edge indices. */
+    struct EdgeIndexHash
+    {
+        std::size_t operator() (EdgeIndex const& edge) const;
+    };
+
     /** Vector of IsoVertex elements. */
     typedef std::vector<IsoVertex> IsoVertexVector;
-    /** Maps and edge to an isovertex ID. */
-    typedef std::map<EdgeIndex, std::size_t> EdgeVertexMap;
-    /** List of polygons, each indexing vertices. */
-    typedef std::vector<std::vector<std::size_t> > PolygonList;
+    /** Maps an edge to an isovertex ID. */
+    typedef std::unordered_map<EdgeIndex, std::size_t, EdgeIndexHash>
+        EdgeVertexShard;
+    /**
+     * The edge to isovertex map is split into shards by edge hash. Shards
+     * are built in parallel and only read concurrently afterwards.
+     */
+    typedef std::vector<EdgeVertexShard> EdgeVertexMap;
+    /** List of polygon vertices given by cube edges. */
+    typedef std::vector<PolygonEdge> PolygonEdgeList;
     /** List of iso edges connecting vertices on cube edges. */
     typedef std::vector<IsoEdge> IsoEdgeList;
+    /** List of octree nodes. */
+    typedef std::vector<Octree::Iterator> IteratorList;
 
 private:
     void sanity_checks (void);
     void compute_mc_index (Octree::Iterator const& iter);
-    void compute_isovertices (Octree::Iterator const& iter,
+    void compute_subtree_mc_index (Octree::Iterator const& iter);
+    void compute_all_mc_index (void);
+    void compute_all_isovertices (IteratorList const& leaves,
         EdgeVertexMap* edgemap, IsoVertexVector* isovertices);
+    void compute_all_isopolygons (IteratorList const& leaves,
+        EdgeVertexMap* edgemap, IsoVertexVector* isovertices,
+        PolygonList* polygons);
     bool is_isovertex_on_edge (int mc_index, int edge_id);
     void get_finest_cube_edge (Octree::Iterator const& iter,
         int edge_id, EdgeIndex* edge_index, EdgeInfo* edge_info);
@@ -89,20 +141,24 @@ private:
         int face_id, IsoEdgeList* isoedges, bool descend_only);
     void get_isovertex (EdgeIndex const& edge_index,
         int edge_id, IsoVertex* iso_vertex);
-    void compute_isopolygons(Octree::Iterator const& iter,
-        EdgeVertexMap const& edgemap, PolygonList* polygons);
+    void compute_isopolygons (Octree::Iterator const& iter,
+        PolygonEdgeList* poly_edges, std::vector<std::size_t>* poly_sizes);
     void compute_triangulation(IsoVertexVector const& isovertices,
         PolygonList const& polygons, core::TriangleMesh::Ptr mesh);
-    VoxelData const* get_voxel_data (VoxelIndex const& index);
+    bool get_voxel_data (VoxelIndex const& index, VoxelData* data);
     std::size_t lookup_edge_vertex (EdgeVertexMap const& edgemap,
         EdgeIndex const& edge);
+    bool is_extraction_leaf (Octree::Iterator const& iter) const;
     void find_twin_vertex(EdgeInfo const& edge_info,
         EdgeIndex* twin, EdgeInfo* twin_info);
 
 private:
     Octree* octree;
-    IsoOctree::VoxelVector const* voxels;
+    VoxelStorage const* voxels;
     InterpolationType interpolation_type;
+    /* Root of the extracted subtree, level is negative for all leaves. */
+    int extraction_level;
+    uint64_t extraction_path;
 };
 
 /* --------------------------------------------------------------------- */
@@ -112,13 +168,47 @@ IsoSurface::IsoSurface (IsoOctree* octree, InterpolationType interpolation_type)
     : octree(octree)
     , voxels(&octree->get_voxels())
     , interpolation_type(interpolation_type)
+    , extraction_level(-1)
+    , extraction_path(0)
+{
+}
+
+inline void
+IsoSurface::set_extraction_node (uint8_t level, uint64_t path)
+{
+    this->extraction_level = level;
+    this->extraction_path = path;
+}
+
+inline core::TriangleMesh::Ptr
+IsoSurface::extract_mesh (void)
+{
+    return this->extract_mesh(nullptr);
+}
+
+inline bool
+IsoSurface::is_extraction_leaf (Octree::Iterator const& iter) const
+{
+    if (this->extraction_level < 0)
+        return true;
+    if (iter.level < this->extraction_level)
+        return false;
+    return (iter.path >> (3 * (iter.level - this->extraction_level)))
+        == this->extraction_path;
+}
+
+inline std::size_t
+IsoSurface::EdgeIndexHash::operator() (EdgeIndex const& edge) const
 {
+    uint64_t const hash = edge.first * 0x9e3779b97f4a7c15ull
+        ^ (edge.second + 0x7f4a7c159e3779b9ull + (edge.first << 6));
+    return static_cast<std::size_t>(hash ^ (hash >> 29));
 }
 
-inline VoxelData const*
-IsoSurface::get_voxel_data (VoxelIndex const& index)
+inline bool
+IsoSurface::get_voxel_data (VoxelIndex const& index, VoxelData* data)
 {
-    return math::algo::binary_search(*this->voxels, index);
+    return this->voxels->find(index, data);
 }
 
 FSSR_NAMESPACE_END
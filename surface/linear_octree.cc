@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+
+#include "surface/linear_octree.h"
+
+FSSR_NAMESPACE_BEGIN
+
+namespace
+{
+    /* Traversal stack entry, shared by build() and restore(). */
+    struct StackEntry
+    {
+        Octree::Node* node;
+        std::size_t index;
+        int level;
+    };
+}
+
+void
+LinearOctree::build (Octree* octree)
+{
+    this->clear();
+
+    Octree::Node* root = octree->get_root_node();
+    if (root == nullptr)
+        return;
+
+    this->nodes.reserve(octree->get_num_nodes());
+    this->samples.reserve(octree->get_num_samples());
+
+    Node root_node;
+    root_node.center = octree->get_root_node_center();
+    root_node.size = octree->get_root_node_size();
+    root_node.max_scale = 0.0f;
+    root_node.first_child = 0;
+    root_node.first_sample = 0;
+    root_node.num_samples = 0;
+    this->nodes.push_back(root_node);
+
+    /*
+     * Depth-first traversal of the octree. Children are pushed in reverse
+     * order such that samples are appended in pre-order, which is also the
+     * order in which influence queries visit the samples.
+     */
+    std::vector<StackEntry> stack;
+    stack.push_back(StackEntry{ root, 0, 0 });
+    while (!stack.empty())
+    {
+        StackEntry entry = stack.back();
+        stack.pop_back();
+
+        if (entry.level > LINEAR_OCTREE_MAX_LEVEL)
+            throw std::runtime_error("LinearOctree: Octree too deep");
+
+        this->nodes[entry.index].first_sample = this->samples.size();
+        this->nodes[entry.index].num_samples = entry.node->samples.size();
+        this->samples.insert(this->samples.end(),
+            std::make_move_iterator(entry.node->samples.begin()),
+            std::make_move_iterator(entry.node->samples.end()));
+        SampleList().swap(entry.node->samples);
+
+        if (entry.node->children == nullptr)
+            continue;
+
+        if (this->nodes.size() + 8 > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("LinearOctree: Too many nodes");
+
+        /* Child centers are computed exactly as in the pointer octree. */
+        std::size_t const first_child = this->nodes.size();
+        Node const parent = this->nodes[entry.index];
+        this->nodes[entry.index].first_child
+            = static_cast<uint32_t>(first_child);
+        double const node_size = parent.size / 2.0;
+        double const offset = node_size / 2.0;
+        for (int i = 0; i < 8; ++i)
+        {
+            Node child;
+            for (int j = 0; j < 3; ++j)
+                child.center[j] = parent.center[j] - offset
+                    + ((i >> j) & 1) * node_size;
+            child.size = node_size;
+            child.max_scale = 0.0f;
+            child.first_child = 0;
+            child.first_sample = 0;
+            child.num_samples = 0;
+            this->nodes.push_back(child);
+        }
+
+        for (int i = 7; i >= 0; --i)
+            stack.push_back(StackEntry{ entry.node->children + i,
+                first_child + i, entry.level + 1 });
+    }
+
+    /* Propagate the largest scale bottom-up, children follow parents. */
+    for (std::size_t i = this->nodes.size(); i > 0; --i)
+    {
+        Node& node = this->nodes[i - 1];
+        for (std::size_t j = 0; j < node.num_samples; ++j)
+            node.max_scale = std::max(node.max_scale,
+                this->samples[node.first_sample + j].scale);
+        if (node.first_child == 0)
+            continue;
+        for (int j = 0; j < 8; ++j)
+            node.max_scale = std::max(node.max_scale,
+                this->nodes[node.first_child + j].max_scale);
+    }
+
+    /* Copy sample positions and scales to separate arrays. */
+    std::size_t const num_samples = this->samples.size();
+    this->pos_x.resize(num_samples);
+    this->pos_y.resize(num_samples);
+    this->pos_z.resize(num_samples);
+    this->scale.resize(num_samples);
+#pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < num_samples; ++i)
+    {
+        this->pos_x[i] = this->samples[i].pos[0];
+        this->pos_y[i] = this->samples[i].pos[1];
+        this->pos_z[i] = this->samples[i].pos[2];
+        this->scale[i] = this->samples[i].scale;
+    }
+}
+
+void
+LinearOctree::restore (Octree* octree)
+{
+    Octree::Node* root = octree->get_root_node();
+    if (root != nullptr && !this->nodes.empty())
+    {
+        /* Same traversal as in build(), node indices match. */
+        std::vector<StackEntry> stack;
+        stack.push_back(StackEntry{ root, 0, 0 });
+        while (!stack.empty())
+        {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+
+            Node const& node = this->nodes[entry.index];
+            SampleList::iterator begin = this->samples.begin()
+                + node.first_sample;
+            entry.node->samples.assign(std::make_move_iterator(begin),
+                std::make_move_iterator(begin + node.num_samples));
+
+            if (entry.node->children == nullptr)
+                continue;
+            if (node.first_child == 0)
+                throw std::runtime_error("LinearOctree: Octree changed");
+            for (int i = 7; i >= 0; --i)
+                stack.push_back(StackEntry{ entry.node->children + i,
+                    node.first_child + i, entry.level + 1 });
+        }
+    }
+    this->clear();
+}
+
+void
+LinearOctree::clear (void)
+{
+    NodeList().swap(this->nodes);
+    SampleList().swap(this->samples);
+    std::vector<float>().swap(this->pos_x);
+    std::vector<float>().swap(this->pos_y);
+    std::vector<float>().swap(this->pos_z);
+    std::vector<float>().swap(this->scale);
+}
+
+void
+LinearOctree::influence_query (math::Vec3d const& pos, double factor,
+    std::vector<std::size_t>* result, std::vector<uint8_t>* levels) const
+{
+    result->resize(0);
+    if (levels != nullptr)
+        levels->resize(0);
+    if (this->nodes.empty())
+        return;
+
+    /*
+     * Each level pushes at most eight children of which one is popped
+     * immediately, thus the stack size is bounded by the octree depth.
+     */
+    uint32_t stack[8 * (LINEAR_OCTREE_MAX_LEVEL + 2)];
+    uint8_t stack_levels[8 * (LINEAR_OCTREE_MAX_LEVEL + 2)];
+    int stack_size = 0;
+    stack[stack_size] = 0;
+    stack_levels[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        --stack_size;
+        uint32_t const node_id = stack[stack_size];
+        uint8_t const level = stack_levels[stack_size];
+        Node const& node = this->nodes[node_id];
+
+        /*
+         * See Octree::influence_query() for the node culling strategy.
+         * The node size bound is replaced with the largest actual scale.
+         */
+        if (node.max_scale <= 0.0f)
+            continue;
+        double const min_distance = (pos - node.center).norm()
+            - MATH_SQRT3 * node.size / 2.0;
+        if (min_distance > node.max_scale * factor)
+            continue;
+
+        this->node_influence_query(node_id, pos, factor, result);
+        if (levels != nullptr)
+            levels->resize(result->size(), level);
+
+        if (node.first_child == 0)
+            continue;
+        for (int i = 7; i >= 0; --i)
+        {
+            stack[stack_size] = node.first_child + i;
+            stack_levels[stack_size++] = level + 1;
+        }
+    }
+}
+
+void
+LinearOctree::fill_batch (std::size_t const* ids, std::size_t num_ids,
+    SampleBatch* batch) const
+{
+    for (std::size_t i = 0; i < FSSR_BATCH_SIZE; ++i)
+    {
+        if (i >= num_ids)
+        {
+            /* Pad with the identity frame and unit scale. */
+            for (int j = 0; j < 3; ++j)
+                batch->pos[j][i] = 0.0f;
+            for (int j = 0; j < 9; ++j)
+                batch->frame[j][i] = (j % 4 == 0) ? 1.0f : 0.0f;
+            batch->scale[i] = 1.0f;
+            continue;
+        }
+
+        /* Frames are computed on the fly instead of stored per sample. */
+        std::size_t const id = ids[i];
+        math::Matrix3f frame;
+        rotation_from_normal(this->samples[id].normal, &frame);
+        batch->pos[0][i] = this->pos_x[id];
+        batch->pos[1][i] = this->pos_y[id];
+        batch->pos[2][i] = this->pos_z[id];
+        for (int j = 0; j < 9; ++j)
+            batch->frame[j][i] = frame[j];
+        batch->scale[i] = this->scale[id];
+    }
+}
+
+FSSR_NAMESPACE_END
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef FSSR_LINEAR_OCTREE_HEADER
+#define FSSR_LINEAR_OCTREE_HEADER
+
+#include <vector>
+#include <cstdint>
+
+#include "math/vector.h"
+#include "math/matrix.h"
+#include "surface/defines.h"
+#include "surface/basis_function.h"
+#include "surface/sample.h"
+#include "surface/octree.h"
+
+/* Maximum depth supported by the fixed size traversal stack. */
+#define LINEAR_OCTREE_MAX_LEVEL 30
+
+FSSR_NAMESPACE_BEGIN
+
+/**
+ * A pointerless, read-only form of an octree for fast influence queries.
+ *
+ * Nodes are stored in a contiguous array where the eight children of a node
+ * are consecutive. Samples are stored in depth-first (Morton) order, i.e.
+ * the samples of a node are directly followed by the samples of its
+ * children, and each node references a range of samples. The positions and
+ * scales of the samples are additionally stored as separate arrays (SoA)
+ * which are used for the distance tests during traversal. The traversal is
+ * iterative with an explicit stack and visits nodes and samples in the
+ * same order as Octree::influence_query(), thus results are identical.
+ * In addition, subtrees are culled using the largest sample scale in the
+ * subtree instead of the node size, which also skips empty subtrees.
+ *
+ * The samples are moved out of the octree on build() and moved back on
+ * restore(), such that samples are not held twice in memory.
+ */
+class LinearOctree
+{
+public:
+    struct Node
+    {
+        /* Center and side length of the node. */
+        math::Vec3d center;
+        double size;
+        /* Largest sample scale in the subtree, zero if it is empty. */
+        float max_scale;
+        /* Index of the first of eight children, zero for leaf nodes. */
+        uint32_t first_child;
+        /* Range of samples [first_sample, first_sample + num_samples). */
+        std::size_t first_sample;
+        std::size_t num_samples;
+    };
+
+    typedef std::vector<Node> NodeList;
+
+public:
+    LinearOctree (void);
+
+    /**
+     * Builds the linear octree from the given octree. The samples are
+     * moved out of the octree nodes, which keep the hierarchy but are
+     * empty until restore() is called.
+     */
+    void build (Octree* octree);
+
+    /**
+     * Moves the samples back into the nodes of the octree the linear octree
+     * was built from, and clears the linear octree. The octree hierarchy
+     * must not have been changed in the meantime.
+     */
+    void restore (Octree* octree);
+
+    /** Releases all nodes and samples. */
+    void clear (void);
+
+    /**
+     * Queries all samples that influence the given point. The result
+     * is the same as Octree::influence_query(), but contains indices
+     * of the samples in the linear octree, which are ascending. If
+     * 'levels' is given, it receives the octree level of every sample.
+     */
+    void influence_query (math::Vec3d const& pos, double factor,
+        std::vector<std::size_t>* result,
+        std::vector<uint8_t>* levels = nullptr) const;
+
+    /** Appends the samples of a node that influence the given point. */
+    void node_influence_query (uint32_t node_id, math::Vec3d const& pos,
+        double factor, std::vector<std::size_t>* result) const;
+
+    /**
+     * Gathers the samples with the given indices into a batch for
+     * evaluate_batch(). At most FSSR_BATCH_SIZE indices are used, the
+     * remaining batch entries are padded.
+     */
+    void fill_batch (std::size_t const* ids, std::size_t num_ids,
+        SampleBatch* batch) const;
+
+    /** Returns the nodes, the root node being the first. */
+    NodeList const& get_nodes (void) const;
+
+    /** Returns the samples in depth-first order. */
+    SampleList const& get_samples (void) const;
+
+    std::size_t get_num_nodes (void) const;
+    std::size_t get_num_samples (void) const;
+
+private:
+    NodeList nodes;
+    SampleList samples;
+
+    /* Sample positions and scales as separate arrays. */
+    std::vector<float> pos_x;
+    std::vector<float> pos_y;
+    std::vector<float> pos_z;
+    std::vector<float> scale;
+};
+
+/* ------------------------- Implementation ---------------------------- */
+
+inline
+LinearOctree::LinearOctree (void)
+{
+}
+
+inline void
+LinearOctree::node_influence_query (uint32_t node_id, math::Vec3d const& pos,
+    double factor, std::vector<std::size_t>* result) const
+{
+    Node const& node = this->nodes[node_id];
+    std::size_t const end = node.first_sample + node.num_samples;
+    for (std::size_t i = node.first_sample; i < end; ++i)
+    {
+        double const dx = pos[0] - static_cast<double>(this->pos_x[i]);
+        double const dy = pos[1] - static_cast<double>(this->pos_y[i]);
+        double const dz = pos[2] - static_cast<double>(this->pos_z[i]);
+        double const dist2 = dx * dx + dy * dy + dz * dz;
+        if (dist2 > MATH_POW2(factor * this->scale[i]))
+            continue;
+        result->push_back(i);
+    }
+}
+
+inline LinearOctree::NodeList const&
+LinearOctree::get_nodes (void) const
+{
+    return this->nodes;
+}
+
+inline SampleList const&
+LinearOctree::get_samples (void) const
+{
+    return this->samples;
+}
+
+inline std::size_t
+LinearOctree::get_num_nodes (void) const
+{
+    return this->nodes.size();
+}
+
+inline std::size_t
+LinearOctree::get_num_samples (void) const
+{
+    return this->samples.size();
+}
+
+FSSR_NAMESPACE_END
+
+#endif // FSSR_LINEAR_OCTREE_HEADER
@@ -7,6 +7,9 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include "math/defines.h"
 #include "core/mesh.h"
 #include "core/mesh_tools.h"
@@ -145,56 +148,163 @@ namespace
 
         return square_ratio;
     }
-}
-
-std::size_t
-clean_needles (core::TriangleMesh::Ptr mesh, float needle_ratio_thres)
-{
-    float const square_needle_ratio_thres = MATH_POW2(needle_ratio_thres);
-    core::VertexInfoList vinfos(mesh);
 
     /*
-     * Algorithm to remove slivers with a two long and a very short edge.
-     * The sliver is identified using the ratio of the shortest by the second
-     * shortest edge. An edge collapse of the short edge is performed if it
-     * does not modify the geometry in a negative way, e.g. flips triangles.
+     * Fills the given vector with the faces containing the edge. This is
+     * equivalent to VertexInfoList::get_faces_for_edge() but avoids
+     * allocations for the short adjacency lists.
      */
-    core::TriangleMesh::FaceList& faces = mesh->get_faces();
-    core::TriangleMesh::VertexList& verts = mesh->get_vertices();
-    std::size_t num_collapses = 0;
+    void
+    get_edge_faces (core::VertexInfoList const& vinfos,
+        std::size_t v1, std::size_t v2, std::vector<std::size_t>* afaces)
+    {
+        core::MeshVertexInfo::FaceRefList const& faces1 = vinfos[v1].faces;
+        core::MeshVertexInfo::FaceRefList const& faces2 = vinfos[v2].faces;
+        afaces->clear();
+        for (std::size_t i = 0; i < faces1.size(); ++i)
+            if (std::find(faces2.begin(), faces2.end(), faces1[i])
+                != faces2.end())
+                afaces->push_back(faces1[i]);
+    }
 
-    for (std::size_t i = 0; i < faces.size(); i += 3)
+    std::size_t
+    clean_needles_intern (core::TriangleMesh::Ptr mesh,
+        core::VertexInfoList& vinfos, float needle_ratio_thres)
     {
-        /* Skip invalid faces. */
-        if (faces[i] == faces[i + 1] && faces[i] == faces[i + 2])
-            continue;
+        float const square_needle_ratio_thres = MATH_POW2(needle_ratio_thres);
+
+        /*
+         * Algorithm to remove slivers with a two long and a very short edge.
+         * The sliver is identified using the ratio of the shortest by the
+         * second shortest edge. An edge collapse of the short edge is
+         * performed if it does not modify the geometry in a negative way,
+         * e.g. flips triangles.
+         */
+        core::TriangleMesh::FaceList& faces = mesh->get_faces();
+        core::TriangleMesh::VertexList& verts = mesh->get_vertices();
+        std::size_t const num_faces = faces.size() / 3;
+
+        /*
+         * The needle test is evaluated for all faces in parallel. Faces
+         * around a collapse change and are tested again when the sweep
+         * reaches them, thus the result equals a sequential sweep.
+         */
+        std::vector<char> is_needle(num_faces, 0);
+#pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < num_faces; ++i)
+        {
+            unsigned int const* face = &faces[i * 3];
+            if (face[0] != face[1] || face[0] != face[2])
+                is_needle[i] = get_needle_ratio_squared(verts, face,
+                    nullptr, nullptr) <= square_needle_ratio_thres;
+        }
 
-        /* Skip faces that are no needles. */
-        std::size_t v1, v2;
-        float const needle_ratio_squared
-            = get_needle_ratio_squared(verts, &faces[i], &v1, &v2);
-        if (needle_ratio_squared > square_needle_ratio_thres)
-            continue;
+        std::size_t num_collapses = 0;
+        std::vector<std::size_t> afaces;
+        for (std::size_t i = 0; i < faces.size(); i += 3)
+        {
+            if (!is_needle[i / 3])
+                continue;
+
+            /* Skip invalid faces. */
+            if (faces[i] == faces[i + 1] && faces[i] == faces[i + 2])
+                continue;
+
+            /* Skip faces that are no needles. */
+            std::size_t v1, v2;
+            float const needle_ratio_squared
+                = get_needle_ratio_squared(verts, &faces[i], &v1, &v2);
+            if (needle_ratio_squared > square_needle_ratio_thres)
+                continue;
+
+            /* Skip edges between non-simple vertices. */
+            if (vinfos[v1].vclass != core::VERTEX_CLASS_SIMPLE
+                || vinfos[v2].vclass != core::VERTEX_CLASS_SIMPLE)
+                continue;
+
+            /* Find triangle adjecent to the edge, skip non-simple edges. */
+            get_edge_faces(vinfos, v1, v2, &afaces);
+            if (afaces.size() != 2)
+                continue;
+
+            /* Collapse the edge. */
+            math::Vec3f new_v = (verts[v1] + verts[v2]) / 2.0f;
+            if (!edge_collapse(mesh, vinfos, v1, v2, new_v, afaces))
+                continue;
 
-        /* Skip edges between non-simple vertices. */
-        if (vinfos[v1].vclass != core::VERTEX_CLASS_SIMPLE
-            || vinfos[v2].vclass != core::VERTEX_CLASS_SIMPLE)
-            continue;
+            num_collapses += 1;
+            core::MeshVertexInfo::FaceRefList const& v1_faces
+                = vinfos[v1].faces;
+            for (std::size_t j = 0; j < v1_faces.size(); ++j)
+                is_needle[v1_faces[j]] = 1;
+        }
+
+        return num_collapses;
+    }
 
-        /* Find triangle adjecent to the edge, skip non-simple edges. */
+    std::size_t
+    clean_caps_intern (core::TriangleMesh::Ptr mesh,
+        core::VertexInfoList& vinfos)
+    {
+        core::TriangleMesh::VertexList& verts = mesh->get_vertices();
+        std::size_t num_collapses = 0;
         std::vector<std::size_t> afaces;
-        vinfos.get_faces_for_edge(v1, v2, &afaces);
-        if (afaces.size() != 2)
-            continue;
+        for (std::size_t v1 = 0; v1 < verts.size(); ++v1)
+        {
+            core::MeshVertexInfo& vinfo = vinfos[v1];
+
+            if (vinfo.vclass != core::VERTEX_CLASS_SIMPLE)
+                continue;
+
+            if (vinfo.verts.size() != 3)
+                continue;
+
+            std::pair<float, std::size_t> edge_len[3];
+            for (std::size_t j = 0; j < vinfo.verts.size(); ++j)
+                edge_len[j] = std::make_pair(
+                    (verts[vinfo.verts[j]] - verts[v1]).square_norm(),
+                    vinfo.verts[j]);
+            math::algo::sort_values(edge_len + 0, edge_len + 1, edge_len + 2);
+            std::size_t v2 = edge_len[0].second;
+
+            get_edge_faces(vinfos, v1, v2, &afaces);
+            if (afaces.size() != 2)
+                continue;
+
+            /* Edge collapse fails if (v2 - v1) is not coplanar to triangle. */
+            if (!edge_collapse(mesh, vinfos, v1, v2, verts[v2], afaces))
+                continue;
 
-        /* Collapse the edge. */
-        math::Vec3f new_v = (verts[v1] + verts[v2]) / 2.0f;
-        if (edge_collapse(mesh, vinfos, v1, v2, new_v, afaces))
             num_collapses += 1;
+        }
+
+        return num_collapses;
     }
 
+    /*
+     * Deletes collapsed faces and vertices without adjacent faces. The
+     * vertex info is maintained during the collapses and not recomputed.
+     */
+    void
+    delete_unreferenced (core::TriangleMesh::Ptr mesh,
+        core::VertexInfoList const& vinfos)
+    {
+        core::TriangleMesh::DeleteList dlist(vinfos.size(), false);
+        for (std::size_t i = 0; i < vinfos.size(); ++i)
+            dlist[i] = vinfos[i].faces.empty();
+        mesh->delete_vertices_fix_faces(dlist);
+    }
+}
+
+std::size_t
+clean_needles (core::TriangleMesh::Ptr mesh, float needle_ratio_thres)
+{
+    core::VertexInfoList vinfos(mesh);
+    std::size_t const num_collapses
+        = clean_needles_intern(mesh, vinfos, needle_ratio_thres);
+
     /* Cleanup invalid triangles and unreferenced vertices. */
-    core::geom::mesh_delete_unreferenced(mesh);
+    delete_unreferenced(mesh, vinfos);
 
     return num_collapses;
 }
@@ -205,38 +315,10 @@ std::size_t
 clean_caps (core::TriangleMesh::Ptr mesh)
 {
     core::VertexInfoList vinfos(mesh);
-    core::TriangleMesh::VertexList& verts = mesh->get_vertices();
-    std::size_t num_collapses = 0;
-    for (std::size_t v1 = 0; v1 < verts.size(); ++v1)
-    {
-        core::MeshVertexInfo& vinfo = vinfos[v1];
-
-        if (vinfo.vclass != core::VERTEX_CLASS_SIMPLE)
-            continue;
-
-        if (vinfo.verts.size() != 3)
-            continue;
-
-        std::pair<float, std::size_t> edge_len[3];
-        for (std::size_t j = 0; j < vinfo.verts.size(); ++j)
-            edge_len[j] = std::make_pair(
-                (verts[vinfo.verts[j]] - verts[v1]).square_norm(),
-                vinfo.verts[j]);
-        math::algo::sort_values(edge_len + 0, edge_len + 1, edge_len + 2);
-        std::size_t v2 = edge_len[0].second;
-
-        std::vector<std::size_t> afaces;
-        vinfos.get_faces_for_edge(v1, v2, &afaces);
-        if (afaces.size() != 2)
-            continue;
-
-        /* Edge collapse fails if (v2 - v1) is not coplanar to triangle. */
-        if (edge_collapse(mesh, vinfos, v1, v2, verts[v2], afaces))
-            num_collapses += 1;
-    }
+    std::size_t const num_collapses = clean_caps_intern(mesh, vinfos);
 
     /* Cleanup invalid triangles and unreferenced vertices. */
-    core::geom::mesh_delete_unreferenced(mesh);
+    delete_unreferenced(mesh, vinfos);
 
     return num_collapses;
 }
@@ -246,6 +328,10 @@ clean_caps (core::TriangleMesh::Ptr mesh)
 std::size_t
 clean_mc_mesh (core::TriangleMesh::Ptr mesh, float needle_ratio_thres)
 {
+    /*
+     * Every pass compacts the mesh, since the compacted face order
+     * determines the sweep order and thus the result of the next pass.
+     */
     std::size_t num_collapsed = 0;
     num_collapsed += clean_needles(mesh, needle_ratio_thres);
     num_collapsed += clean_caps(mesh);
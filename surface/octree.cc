@@ -15,6 +15,7 @@
 #include "util/timer.h"
 #include "core/mesh_io.h"
 #include "surface/octree.h"
+#include "surface/radix_sort.h"
 
 FSSR_NAMESPACE_BEGIN
 
@@ -176,12 +177,75 @@ Octree::Iterator::ascend (void) const
 /* -------------------------------------------------------------------- */
 
 void
-Octree::insert_samples (SampleList const& samples) {
+Octree::insert_samples (SampleList const& samples)
+{
+    if (samples.empty())
+        return;
 
-    // for each sample
-    for (std::size_t i = 0; i < samples.size(); i++) {
-        this->insert_sample(samples[i]);
+    /*
+     * Expand the root exactly as sequential insertion would do. This only
+     * touches the root and is cheap compared to descending the octree.
+     */
+    for (std::size_t i = 0; i < samples.size(); ++i)
+        this->expand_root_for_sample(samples[i]);
+
+    /*
+     * Compute the level and path of every sample using the same rules as
+     * find_node_descend(). The path is aligned to the maximum level, which
+     * yields the Morton code of the node used as sorting key.
+     */
+    std::vector<uint64_t> keys(samples.size());
+    std::vector<std::size_t> indices(samples.size());
+    std::vector<uint8_t> levels(samples.size());
+#pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        uint8_t level;
+        uint64_t path;
+        this->find_sample_path(samples[i], &level, &path);
+        keys[i] = path << (3 * (this->max_level - level));
+        indices[i] = i;
+        levels[i] = level;
     }
+
+    /* Stable sort keeps the input order of samples within a node. */
+    radix_sort(&keys, &indices, 3 * this->max_level);
+
+    /*
+     * Create nodes and insert samples in Morton order. Consecutive samples
+     * share most of their path, thus the nodes along the path of the
+     * previous sample are reused and only the differing part is descended.
+     */
+    std::vector<Node*> node_path(this->max_level + 1, nullptr);
+    node_path[0] = this->root;
+    int path_level = 0;
+    uint64_t last_key = 0;
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        std::size_t const sample_id = indices[i];
+        uint64_t const key = keys[i];
+        int const level = levels[sample_id];
+
+        int common = 0;
+        while (common < path_level && common < level) {
+            int const shift = 3 * (this->max_level - common - 1);
+            if (((key >> shift) & 7) != ((last_key >> shift) & 7))
+                break;
+            common += 1;
+        }
+
+        Node* node = node_path[common];
+        for (int l = common; l < level; ++l) {
+            if (node->children == nullptr)
+                this->create_children(node);
+            int const shift = 3 * (this->max_level - l - 1);
+            node = node->children + ((key >> shift) & 7);
+            node_path[l + 1] = node;
+        }
+        path_level = level;
+        last_key = key;
+
+        node->samples.push_back(samples[sample_id]);
+    }
+    this->num_samples += samples.size();
 }
 
 void
@@ -217,6 +281,77 @@ Octree::insert_sample (Sample const& sample)
     this->num_samples += 1;
 }
 
+void
+Octree::create_root (math::Vec3d const& center, double size)
+{
+    if (this->root != nullptr)
+        throw std::logic_error("create_root(): Root exists");
+    if (size <= 0.0)
+        throw std::invalid_argument("create_root(): Invalid size");
+
+    this->root = new Node();
+    this->root_center = center;
+    this->root_size = size;
+    this->num_nodes = 1;
+}
+
+void
+Octree::expand_root_for_sample (Sample const& sample)
+{
+    /* Create the root node as for sequential insertion. */
+    if (this->root == nullptr) {
+        this->root = new Node();
+        this->root_center = sample.pos;
+        this->root_size = sample.scale;
+        this->num_nodes = 1;
+    }
+
+    while (!this->is_inside_octree(sample.pos))
+        this->expand_root_for_point(sample.pos);
+    while (sample.scale >= this->root_size * 2.0)
+        this->expand_root_for_point(sample.pos);
+}
+
+void
+Octree::find_sample_path (Sample const& sample,
+    uint8_t* level, uint64_t* path) const
+{
+    math::Vec3d center = this->root_center;
+    double size = this->root_size;
+    *level = 0;
+    *path = 0;
+    while (size > sample.scale && *level < this->max_level) {
+        int octant = 0;
+        double const offset = size / 4.0;
+        for (int j = 0; j < 3; ++j) {
+            if (sample.pos[j] > center[j]) {
+                octant |= (1 << j);
+                center[j] += offset;
+            } else {
+                center[j] -= offset;
+            }
+        }
+        size /= 2.0;
+        *level += 1;
+        *path = (*path << 3) | octant;
+    }
+}
+
+void
+Octree::insert_node (uint8_t level, uint64_t path)
+{
+    if (this->root == nullptr)
+        throw std::logic_error("insert_node(): Empty octree");
+
+    Node* node = this->root;
+    for (int i = 0; i < level; ++i) {
+        if (node->children == nullptr)
+            this->create_children(node);
+        int const octant = (path >> ((level - i - 1) * 3)) & 7;
+        node = node->children + octant;
+    }
+}
+
 void
 Octree::create_children (Node* node)
 {
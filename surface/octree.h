@@ -118,8 +118,15 @@ public:
     void clear_samples (void);
 
 
-    //Inserts all samples from the point set into the octree. How to
-    //construct an octree
+    /**
+     * Inserts all samples from the point set into the octree. This is a
+     * bulk operation: the root is expanded for all samples first, then the
+     * target level and octree path of every sample is computed in parallel
+     * from its scale, samples are radix-sorted by Morton code, and nodes are
+     * created in a single pass over the sorted samples. The resulting octree
+     * equals inserting the samples one by one, up to the order of samples
+     * within nodes after limit_octree_level().
+     */
     void insert_samples (SampleList const& samples);
 
     /**
@@ -132,6 +139,34 @@ public:
      */
     void insert_sample (Sample const& s);
 
+    /**
+     * Creates the root node with the given center and size. The octree
+     * must be empty. This is used to reconstruct parts of a scene in a
+     * common coordinate frame, see BlockReconstruction.
+     */
+    void create_root (math::Vec3d const& center, double size);
+
+    /**
+     * Expands the root (or creates it for an empty octree) exactly as
+     * insert_sample() would, without inserting the sample. After expanding
+     * for all samples, the root center and size are final.
+     */
+    void expand_root_for_sample (Sample const& sample);
+
+    /**
+     * Computes the level and path of the node a sample is inserted into,
+     * without modifying the octree. The root must be expanded for the
+     * sample, see expand_root_for_sample().
+     */
+    void find_sample_path (Sample const& sample,
+        uint8_t* level, uint64_t* path) const;
+
+    /**
+     * Creates the node with the given level and path, including all
+     * ancestors and their siblings. Existing nodes are not modified.
+     */
+    void insert_node (uint8_t level, uint64_t path);
+
     // Returns the number of samples in the octree.
     std::size_t get_num_samples (void) const;
 
@@ -159,6 +194,9 @@ public:
     // Returns the root node (read-only).
     Node const* get_root_node (void) const;
 
+    // Returns the root node.
+    Node* get_root_node (void);
+
     // Returns the center of the root node.
     math::Vec3d const& get_root_node_center (void) const;
 
@@ -337,6 +375,11 @@ Octree::get_root_node (void) const {
     return this->root;
 }
 
+inline Octree::Node*
+Octree::get_root_node (void) {
+    return this->root;
+}
+
 inline math::Vec3d const&
 Octree::get_root_node_center (void) const {
     return this->root_center;
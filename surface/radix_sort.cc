@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "surface/radix_sort.h"
+
+FSSR_NAMESPACE_BEGIN
+
+namespace
+{
+    int const RADIX_BITS = 8;
+    std::size_t const RADIX_SIZE = 1 << RADIX_BITS;
+    std::size_t const RADIX_MASK = RADIX_SIZE - 1;
+
+    /* Elements per chunk, chunks are processed in parallel. */
+    std::size_t const CHUNK_SIZE = 1 << 16;
+}
+
+void
+radix_sort (std::vector<uint64_t>* keys, std::vector<std::size_t>* values,
+    int key_bits)
+{
+    std::size_t const num_keys = keys->size();
+    if (values != nullptr && values->size() != num_keys)
+        throw std::invalid_argument("radix_sort(): Size mismatch");
+    if (num_keys < 2)
+        return;
+
+    std::size_t const num_chunks = (num_keys + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<uint64_t> tmp_keys(num_keys);
+    std::vector<std::size_t> tmp_values(values != nullptr ? num_keys : 0);
+    std::vector<std::size_t> offsets(num_chunks * RADIX_SIZE);
+
+    key_bits = std::max(0, std::min(64, key_bits));
+    for (int shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        /* Count digit occurrences per chunk. */
+#pragma omp parallel for schedule(static)
+        for (std::size_t c = 0; c < num_chunks; ++c)
+        {
+            std::size_t* hist = &offsets[c * RADIX_SIZE];
+            std::fill(hist, hist + RADIX_SIZE, 0);
+            std::size_t const end = std::min(num_keys, (c + 1) * CHUNK_SIZE);
+            for (std::size_t i = c * CHUNK_SIZE; i < end; ++i)
+                hist[((*keys)[i] >> shift) & RADIX_MASK] += 1;
+        }
+
+        /*
+         * Convert counts to output offsets, ordered by digit first and chunk
+         * second, which keeps the sort stable. Skip the pass if all keys
+         * share the same digit.
+         */
+        bool skip_pass = false;
+        std::size_t sum = 0;
+        for (std::size_t d = 0; d < RADIX_SIZE; ++d)
+        {
+            std::size_t const digit_start = sum;
+            for (std::size_t c = 0; c < num_chunks; ++c)
+            {
+                std::size_t const count = offsets[c * RADIX_SIZE + d];
+                offsets[c * RADIX_SIZE + d] = sum;
+                sum += count;
+            }
+            if (sum - digit_start == num_keys)
+                skip_pass = true;
+        }
+        if (skip_pass)
+            continue;
+
+        /* Scatter keys and values to their new positions. */
+#pragma omp parallel for schedule(static)
+        for (std::size_t c = 0; c < num_chunks; ++c)
+        {
+            std::size_t* hist = &offsets[c * RADIX_SIZE];
+            std::size_t const end = std::min(num_keys, (c + 1) * CHUNK_SIZE);
+            for (std::size_t i = c * CHUNK_SIZE; i < end; ++i)
+            {
+                std::size_t const pos
+                    = hist[((*keys)[i] >> shift) & RADIX_MASK]++;
+                tmp_keys[pos] = (*keys)[i];
+                if (values != nullptr)
+                    tmp_values[pos] = (*values)[i];
+            }
+        }
+
+        keys->swap(tmp_keys);
+        if (values != nullptr)
+            values->swap(tmp_values);
+    }
+}
+
+FSSR_NAMESPACE_END
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef FSSR_RADIX_SORT_HEADER
+#define FSSR_RADIX_SORT_HEADER
+
+#include <vector>
+#include <cstdint>
+
+#include "surface/defines.h"
+
+FSSR_NAMESPACE_BEGIN
+
+/**
+ * Stable parallel LSD radix sort of 64-bit keys. Only the lower 'key_bits'
+ * bits of the keys are considered. If 'values' is not null, the values are
+ * permuted along with the keys and must have the same size.
+ */
+void
+radix_sort (std::vector<uint64_t>* keys, std::vector<std::size_t>* values,
+    int key_bits = 64);
+
+FSSR_NAMESPACE_END
+
+#endif // FSSR_RADIX_SORT_HEADER
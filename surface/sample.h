@@ -30,6 +30,22 @@ struct Sample
 /** Representation of a list of samples. */
 typedef std::vector<Sample> SampleList;
 
+/** Representation of samples with one array per attribute (SoA). */
+struct SampleArrays
+{
+    std::vector<math::Vec3f> positions;
+    std::vector<math::Vec3f> normals;
+    std::vector<math::Vec3f> colors;
+    std::vector<float> scales;
+    std::vector<float> confidences;
+
+    std::size_t size (void) const;
+    void resize (std::size_t size);
+    void clear (void);
+    Sample get_sample (std::size_t index) const;
+    void set_sample (std::size_t index, Sample const& sample);
+};
+
 /** Comparator that orders samples according to scale. */
 bool
 sample_scale_compare (Sample const* s1, Sample const* s2);
@@ -40,6 +56,54 @@ FSSR_NAMESPACE_END
 
 FSSR_NAMESPACE_BEGIN
 
+inline std::size_t
+SampleArrays::size (void) const
+{
+    return this->positions.size();
+}
+
+inline void
+SampleArrays::resize (std::size_t size)
+{
+    this->positions.resize(size);
+    this->normals.resize(size);
+    this->colors.resize(size);
+    this->scales.resize(size);
+    this->confidences.resize(size);
+}
+
+inline void
+SampleArrays::clear (void)
+{
+    this->positions.clear();
+    this->normals.clear();
+    this->colors.clear();
+    this->scales.clear();
+    this->confidences.clear();
+}
+
+inline Sample
+SampleArrays::get_sample (std::size_t index) const
+{
+    Sample sample;
+    sample.pos = this->positions[index];
+    sample.normal = this->normals[index];
+    sample.color = this->colors[index];
+    sample.scale = this->scales[index];
+    sample.confidence = this->confidences[index];
+    return sample;
+}
+
+inline void
+SampleArrays::set_sample (std::size_t index, Sample const& sample)
+{
+    this->positions[index] = sample.pos;
+    this->normals[index] = sample.normal;
+    this->colors[index] = sample.color;
+    this->scales[index] = sample.scale;
+    this->confidences[index] = sample.confidence;
+}
+
 inline bool
 sample_scale_compare (Sample const* s1, Sample const* s2)
 {
@@ -7,65 +7,146 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <cerrno>
 
 #include "util/exception.h"
+#include "util/mapped_file.h"
+#include "util/system.h"
 #include "util/tokenizer.h"
 #include "core/mesh_io_ply.h"
 #include "surface/sample_io.h"
 
+/* Number of vertex records decoded per parallel work item. */
+#define SAMPLE_CHUNK_SIZE 65536
+
 FSSR_NAMESPACE_BEGIN
 
-void
-SampleIO::read_file (std::string const& filename,  SampleList* samples)
+namespace
 {
-    /* Load point set from PLY file. */
-    core::TriangleMesh::Ptr mesh = core::geom::load_ply_mesh(filename);
-    core::TriangleMesh::VertexList const& verts = mesh->get_vertices();
-    if (verts.empty())
+    /** Reads a little-endian value from unaligned memory. */
+    template <typename T>
+    inline T
+    read_le_value (char const* data)
     {
-        std::cout << "WARNING: No samples in file, skipping." << std::endl;
-        return;
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return util::system::letoh(value);
+    }
+
+    /** Returns the size of a vertex property in binary files. */
+    std::size_t
+    get_property_size (core::geom::PLYVertexProperty prop)
+    {
+        switch (prop)
+        {
+            case core::geom::PLY_V_UINT8_R:
+            case core::geom::PLY_V_UINT8_G:
+            case core::geom::PLY_V_UINT8_B:
+            case core::geom::PLY_V_IGNORE_UINT8:
+                return 1;
+            case core::geom::PLY_V_DOUBLE_X:
+            case core::geom::PLY_V_DOUBLE_Y:
+            case core::geom::PLY_V_DOUBLE_Z:
+            case core::geom::PLY_V_IGNORE_DOUBLE:
+                return 8;
+            default:
+                return 4;
+        }
+    }
+
+    void
+    resize_samples (SampleList* samples, std::size_t size)
+    {
+        samples->resize(size);
     }
 
-    /* Check if the points have the required attributes. */
-    core::TriangleMesh::NormalList const& vnormals = mesh->get_vertex_normals();
-    if (!mesh->has_vertex_normals())
-        throw std::invalid_argument("Vertex normals missing!");
+    void
+    resize_samples (SampleArrays* samples, std::size_t size)
+    {
+        samples->resize(size);
+    }
 
-    core::TriangleMesh::ValueList const& vvalues = mesh->get_vertex_values();
-    if (!mesh->has_vertex_values())
-        throw std::invalid_argument("Vertex scale missing!");
+    void
+    set_sample (SampleList* samples, std::size_t index, Sample const& sample)
+    {
+        samples->at(index) = sample;
+    }
 
-    core::TriangleMesh::ConfidenceList& vconfs = mesh->get_vertex_confidences();
-    if (!mesh->has_vertex_confidences())
+    void
+    move_sample (SampleList* samples, std::size_t from, std::size_t to)
     {
-        std::cout << "INFO: No confidences given, setting to 1." << std::endl;
-        vconfs.resize(verts.size(), 1.0f);
+        (*samples)[to] = (*samples)[from];
     }
-    core::TriangleMesh::ColorList& vcolors = mesh->get_vertex_colors();
-    if (!mesh->has_vertex_colors())
-        vcolors.resize(verts.size(), math::Vec4f(-1.0f));
 
-    /* Add samples to the list. */
-    SamplesState state;
-    this->reset_samples_state(&state);
-    samples->reserve(verts.size());
-    for (std::size_t i = 0; i < verts.size(); i += 1)
+    void
+    move_sample (SampleArrays* samples, std::size_t from, std::size_t to)
     {
-        Sample sample;
-        sample.pos = verts[i];
-        sample.normal = vnormals[i];
-        sample.scale = vvalues[i];
-        sample.confidence = vconfs[i];
-        sample.color = math::Vec3f(*vcolors[i]);
+        samples->set_sample(to, samples->get_sample(from));
+    }
 
-        if (this->process_sample(&sample, &state))
-            samples->push_back(sample);
+    void
+    set_sample (SampleArrays* samples, std::size_t index, Sample const& sample)
+    {
+        samples->set_sample(index, sample);
     }
-    this->print_samples_state(&state);
+
+    void
+    append_sample (SampleList* samples, Sample const& sample)
+    {
+        samples->push_back(sample);
+    }
+
+    void
+    append_sample (SampleArrays* samples, Sample const& sample)
+    {
+        std::size_t const index = samples->size();
+        samples->resize(index + 1);
+        samples->set_sample(index, sample);
+    }
+}
+
+void
+SampleIO::read_file (std::string const& filename, SampleArrays* samples)
+{
+    this->read_samples(filename, samples);
+}
+
+void
+SampleIO::read_file (std::string const& filename, SampleList* samples)
+{
+    this->read_samples(filename, samples);
+}
+
+template <typename T>
+void
+SampleIO::read_samples (std::string const& filename, T* samples)
+{
+    /* The header is parsed once and decides about the reader. */
+    this->open_file(filename);
+    if (this->is_binary_readable())
+    {
+        this->read_binary_file(samples);
+        return;
+    }
+
+    /* Other files are read with the streaming reader. */
+    if (this->stream.num_vertices > 0 && !this->stream.vertices_first)
+    {
+        this->reset_stream_state();
+        throw util::FileException(filename, "Vertex element is not first");
+    }
+    if (this->stream.num_vertices == 0)
+        std::cout << "WARNING: No samples in file, skipping." << std::endl;
+    else if (std::find(this->stream.props.begin(), this->stream.props.end(),
+        core::geom::PLY_V_FLOAT_CONF) == this->stream.props.end())
+        std::cout << "INFO: No confidences given, setting to 1." << std::endl;
+
+    Sample sample;
+    while (this->next_sample(&sample))
+        append_sample(samples, sample);
 }
 
 void
@@ -89,6 +170,7 @@ SampleIO::open_file (std::string const& filename)
 
     /* Parse PLY headers. */
     bool parsing_vertex_props = false;
+    bool parsed_elements = false;
     this->stream.format = core::geom::PLY_UNKNOWN;
     while (true)
     {
@@ -132,6 +214,8 @@ SampleIO::open_file (std::string const& filename)
             if (tokens[1] == "vertex")
             {
                 parsing_vertex_props = true;
+                this->stream.vertices_first = !parsed_elements;
+                parsed_elements = true;
                 this->stream.num_vertices
                     = util::string::convert<unsigned int>(tokens[2]);
                 continue;
@@ -139,6 +223,7 @@ SampleIO::open_file (std::string const& filename)
             else
             {
                 parsing_vertex_props = false;
+                parsed_elements = true;
                 continue;
             }
         }
@@ -209,6 +294,7 @@ SampleIO::open_file (std::string const& filename)
         this->reset_stream_state();
         throw util::Exception("Unknown PLY file format");
     }
+    this->stream.data_offset = this->stream.stream.tellg();
 
     /* If the PLY does not contain vertices, ignore properties. */
     if (this->stream.num_vertices == 0)
@@ -242,6 +328,8 @@ SampleIO::open_file (std::string const& filename)
         this->reset_stream_state();
         throw util::Exception("Missing sample scale");
     }
+
+    this->compute_record_layout();
 }
 
 bool
@@ -274,6 +362,23 @@ SampleIO::next_sample_intern (Sample* sample)
         return false;
     }
 
+    /* Binary little-endian records are read and decoded at once. */
+    if (this->stream.format == core::geom::PLY_BINARY_LE)
+    {
+        std::vector<char>& record = this->stream.record;
+        this->stream.stream.read(&record[0], record.size());
+        if (!this->stream.stream.good())
+        {
+            std::string const filename = this->stream.filename;
+            this->reset_stream_state();
+            throw util::FileException(filename, "Unexpected EOF");
+        }
+
+        this->decode_record(&record[0], sample);
+        this->stream.current_vertex += 1;
+        return true;
+    }
+
     for (std::size_t i = 0; i < this->stream.props.size(); ++i)
     {
         core::geom::PLYVertexProperty property = this->stream.props[i];
@@ -380,6 +485,163 @@ SampleIO::reset_stream_state (void)
     this->stream.format = core::geom::PLY_UNKNOWN;
     this->stream.num_vertices = 0;
     this->stream.current_vertex = 0;
+    this->stream.vertices_first = false;
+    this->stream.data_offset = 0;
+    this->stream.record.clear();
+}
+
+bool
+SampleIO::is_binary_readable (void) const
+{
+    return !this->stream.filename.empty()
+        && this->stream.format == core::geom::PLY_BINARY_LE
+        && this->stream.vertices_first
+        && this->stream.num_vertices > 0;
+}
+
+void
+SampleIO::compute_record_layout (void)
+{
+    RecordLayout& layout = this->stream.layout;
+    layout.size = 0;
+    std::fill(layout.pos, layout.pos + 3, -1);
+    std::fill(layout.normal, layout.normal + 3, -1);
+    std::fill(layout.color, layout.color + 3, -1);
+    layout.scale = -1;
+    layout.confidence = -1;
+    layout.color_uint8 = false;
+
+    for (std::size_t i = 0; i < this->stream.props.size(); ++i)
+    {
+        int const offset = static_cast<int>(layout.size);
+        core::geom::PLYVertexProperty prop = this->stream.props[i];
+        switch (prop)
+        {
+            case core::geom::PLY_V_FLOAT_X: layout.pos[0] = offset; break;
+            case core::geom::PLY_V_FLOAT_Y: layout.pos[1] = offset; break;
+            case core::geom::PLY_V_FLOAT_Z: layout.pos[2] = offset; break;
+            case core::geom::PLY_V_FLOAT_NX: layout.normal[0] = offset; break;
+            case core::geom::PLY_V_FLOAT_NY: layout.normal[1] = offset; break;
+            case core::geom::PLY_V_FLOAT_NZ: layout.normal[2] = offset; break;
+            case core::geom::PLY_V_FLOAT_R: layout.color[0] = offset; break;
+            case core::geom::PLY_V_FLOAT_G: layout.color[1] = offset; break;
+            case core::geom::PLY_V_FLOAT_B: layout.color[2] = offset; break;
+            case core::geom::PLY_V_UINT8_R:
+                layout.color[0] = offset;
+                layout.color_uint8 = true;
+                break;
+            case core::geom::PLY_V_UINT8_G: layout.color[1] = offset; break;
+            case core::geom::PLY_V_UINT8_B: layout.color[2] = offset; break;
+            case core::geom::PLY_V_FLOAT_VALUE: layout.scale = offset; break;
+            case core::geom::PLY_V_FLOAT_CONF:
+                layout.confidence = offset;
+                break;
+            default:
+                break;
+        }
+        layout.size += get_property_size(prop);
+    }
+
+    this->stream.record.resize(layout.size);
+}
+
+void
+SampleIO::decode_record (char const* record, Sample* sample) const
+{
+    RecordLayout const& layout = this->stream.layout;
+    for (int i = 0; i < 3; ++i)
+    {
+        sample->pos[i] = read_le_value<float>(record + layout.pos[i]);
+        sample->normal[i] = read_le_value<float>(record + layout.normal[i]);
+        if (layout.color[i] < 0)
+            sample->color[i] = -1.0f;
+        else if (layout.color_uint8)
+            sample->color[i] = static_cast<float>(static_cast<uint8_t>(
+                record[layout.color[i]])) / 255.0f;
+        else
+            sample->color[i] = read_le_value<float>(record + layout.color[i]);
+    }
+    sample->scale = read_le_value<float>(record + layout.scale);
+    sample->confidence = layout.confidence < 0 ? 1.0f
+        : read_le_value<float>(record + layout.confidence);
+}
+
+template <typename T>
+void
+SampleIO::read_binary_file (T* samples)
+{
+    std::string const filename = this->stream.filename;
+    std::size_t const num_vertices = this->stream.num_vertices;
+    std::size_t const record_size = this->stream.layout.size;
+    this->stream.stream.close();
+
+    util::MappedFile file(filename);
+    if (file.size() < this->stream.data_offset + num_vertices * record_size)
+    {
+        this->reset_stream_state();
+        throw util::FileException(filename, "Unexpected EOF");
+    }
+    if (this->stream.layout.confidence < 0)
+        std::cout << "INFO: No confidences given, setting to 1." << std::endl;
+
+    /*
+     * The vertex records are decoded once in parallel chunks. Every chunk
+     * writes its valid samples to the start of its slot range in the output,
+     * then the chunks are moved together in order. Without invalid samples,
+     * nothing is moved.
+     */
+    char const* data = file.data() + this->stream.data_offset;
+    std::size_t const num_chunks
+        = (num_vertices + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+    std::size_t const offset = samples->size();
+    resize_samples(samples, offset + num_vertices);
+    std::vector<SamplesState> chunk_states(num_chunks);
+    std::vector<std::size_t> chunk_sizes(num_chunks, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        this->reset_samples_state(&chunk_states[i]);
+        std::size_t index = offset + i * SAMPLE_CHUNK_SIZE;
+        std::size_t const end
+            = std::min(num_vertices, (i + 1) * SAMPLE_CHUNK_SIZE);
+        for (std::size_t j = i * SAMPLE_CHUNK_SIZE; j < end; ++j)
+        {
+            Sample sample;
+            this->decode_record(data + j * record_size, &sample);
+            if (this->process_sample(&sample, &chunk_states[i]))
+                set_sample(samples, index++, sample);
+        }
+        chunk_sizes[i] = index - (offset + i * SAMPLE_CHUNK_SIZE);
+    }
+
+    std::size_t num_valid = offset;
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        std::size_t const chunk_begin = offset + i * SAMPLE_CHUNK_SIZE;
+        if (num_valid != chunk_begin)
+            for (std::size_t j = 0; j < chunk_sizes[i]; ++j)
+                move_sample(samples, chunk_begin + j, num_valid + j);
+        num_valid += chunk_sizes[i];
+    }
+    resize_samples(samples, num_valid);
+
+    /* Sum up and print the statistics of all chunks. */
+    SamplesState state;
+    this->reset_samples_state(&state);
+    for (std::size_t i = 0; i < num_chunks; ++i)
+    {
+        state.num_skipped_zero_normal += chunk_states[i].num_skipped_zero_normal;
+        state.num_skipped_invalid_confidence
+            += chunk_states[i].num_skipped_invalid_confidence;
+        state.num_skipped_invalid_scale
+            += chunk_states[i].num_skipped_invalid_scale;
+        state.num_skipped_large_scale
+            += chunk_states[i].num_skipped_large_scale;
+        state.num_unnormalized_normals
+            += chunk_states[i].num_unnormalized_normals;
+    }
+    this->print_samples_state(&state);
+    this->reset_stream_state();
 }
 
 void
@@ -21,8 +21,14 @@ FSSR_NAMESPACE_BEGIN
 
 /**
  * Reads samples from a PLY file. Two input types are supported:
- * Reading the whole file at once using the MVE PLY file reader, and a
- * streaming reader which reads one sample at at time.
+ * Reading the whole file at once, and a streaming reader which reads one
+ * sample at at time.
+ *
+ * Binary little-endian files are read at once by memory-mapping the file.
+ * The header is parsed once and the vertex records are decoded in parallel
+ * chunks directly into the output, filtering and scaling the samples in the
+ * same pass. Other files are read with the streaming reader, reusing the
+ * parsed header.
  */
 class SampleIO
 {
@@ -40,8 +46,10 @@ public:
     /** Default constructor setting options. */
     SampleIO (Options const& opts);
 
-    /** Reads all input samples in memory. */
+    /** Reads all input samples in memory, appending them to the list. */
     void read_file (std::string const& filename, SampleList* samples);
+    /** Reads all input samples in memory, appending them to the arrays. */
+    void read_file (std::string const& filename, SampleArrays* samples);
 
     /** Opens the input file for stream reading. */
     void open_file (std::string const& filename);
@@ -49,6 +57,18 @@ public:
     bool next_sample (Sample* sample);
 
 private:
+    /** Byte offsets of the sample attributes in a binary vertex record. */
+    struct RecordLayout
+    {
+        std::size_t size;
+        int pos[3];
+        int normal[3];
+        int color[3];
+        int scale;
+        int confidence;
+        bool color_uint8;
+    };
+
     struct StreamState
     {
         std::string filename;
@@ -57,6 +77,12 @@ private:
         core::geom::PLYFormat format;
         unsigned int num_vertices;
         unsigned int current_vertex;
+        /* Whether the vertex data directly follows the header. */
+        bool vertices_first;
+        /* Offset of the vertex data in the file. */
+        std::size_t data_offset;
+        RecordLayout layout;
+        std::vector<char> record;
     };
 
     struct SamplesState
@@ -79,6 +105,14 @@ private:
     bool next_sample_intern (Sample* sample);
     void reset_stream_state (void);
 
+    bool is_binary_readable (void) const;
+    void compute_record_layout (void);
+    void decode_record (char const* record, Sample* sample) const;
+    template <typename T>
+    void read_samples (std::string const& filename, T* samples);
+    template <typename T>
+    void read_binary_file (T* samples);
+
 private:
     Options opts;
     StreamState stream;
@@ -8,12 +8,96 @@
  */
 
 #include <algorithm>
+#include <cstring>
 
 #include "math/vector.h"
 #include "surface/voxel.h"
 
 FSSR_NAMESPACE_BEGIN
 
+namespace
+{
+    /**
+     * Converts a float to half precision with rounding to nearest even.
+     * Finite values which are too large for half precision saturate.
+     */
+    uint16_t
+    float_to_half (float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(float));
+        uint32_t const sign = (bits >> 16) & 0x8000;
+        uint32_t const abs = bits & 0x7fffffff;
+
+        /* Infinity and NaN. */
+        if (abs >= 0x7f800000)
+            return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+        /* Saturate to the largest half value. */
+        if (abs >= 0x477ff000)
+            return sign | 0x7bff;
+        /* Too small for half precision. */
+        if (abs < 0x33000000)
+            return sign;
+
+        uint32_t half, rest, halfway;
+        if (abs < 0x38800000)
+        {
+            /* Subnormal half values. */
+            uint32_t const shift = 126 - (abs >> 23);
+            uint32_t const mantissa = (abs & 0x7fffff) | 0x800000;
+            half = mantissa >> shift;
+            rest = mantissa & ((1u << shift) - 1);
+            halfway = 1u << (shift - 1);
+        }
+        else
+        {
+            /* Normal half values, rebias the exponent from 127 to 15. */
+            half = (abs - 0x38000000) >> 13;
+            rest = abs & 0x1fff;
+            halfway = 0x1000;
+        }
+
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half += 1;
+        return sign | half;
+    }
+
+    /** Converts a half precision value to float. */
+    float
+    half_to_float (uint16_t half)
+    {
+        uint32_t const sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        uint32_t const exponent = (half >> 10) & 0x1f;
+        uint32_t const mantissa = half & 0x3ff;
+
+        if (exponent == 0)
+        {
+            /* Zero and subnormal values. */
+            float const value = static_cast<float>(mantissa) / 16777216.0f;
+            return sign ? -value : value;
+        }
+
+        uint32_t bits;
+        if (exponent == 0x1f)
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(float));
+        return value;
+    }
+
+    /** Quantizes a color channel in [0, 1] to 8 bits. */
+    uint8_t
+    quantize_color (float value)
+    {
+        float const quantized = std::min(255.0f,
+            std::max(0.0f, value * 255.0f + 0.5f));
+        return static_cast<uint8_t>(quantized);
+    }
+}
+
 void
 VoxelIndex::from_path_and_corner (uint8_t level, uint64_t path, int corner)
 {
@@ -68,6 +152,107 @@ VoxelIndex::get_offset_z (void) const
 
 /* ---------------------------------------------------------------- */
 
+void
+VoxelStorage::set_compact (bool compact, bool store_derivatives)
+{
+    this->clear();
+    this->compact = compact;
+    this->store_derivatives = store_derivatives;
+}
+
+void
+VoxelStorage::clear (void)
+{
+    std::vector<uint64_t>().swap(this->indices);
+    std::vector<VoxelData>().swap(this->data);
+    std::vector<CompactVoxelData>().swap(this->compact_data);
+#if FSSR_USE_DERIVATIVES
+    std::vector<math::Vector<uint16_t, 3> >().swap(this->compact_derivs);
+#endif // FSSR_USE_DERIVATIVES
+}
+
+void
+VoxelStorage::set_indices (std::vector<uint64_t>* indices)
+{
+    this->clear();
+    std::swap(this->indices, *indices);
+
+    if (!this->compact)
+    {
+        this->data.resize(this->indices.size());
+        return;
+    }
+
+    CompactVoxelData empty;
+    std::memset(&empty, 0, sizeof(CompactVoxelData));
+    this->compact_data.resize(this->indices.size(), empty);
+#if FSSR_USE_DERIVATIVES
+    if (this->store_derivatives)
+        this->compact_derivs.resize(this->indices.size(),
+            math::Vector<uint16_t, 3>(0, 0, 0));
+#endif // FSSR_USE_DERIVATIVES
+}
+
+VoxelData
+VoxelStorage::get_data (std::size_t id) const
+{
+    if (!this->compact)
+        return this->data[id];
+
+    CompactVoxelData const& compact = this->compact_data[id];
+    VoxelData data;
+    data.value = compact.value;
+    data.conf = half_to_float(compact.conf);
+    data.scale = half_to_float(compact.scale);
+    for (int i = 0; i < 3; ++i)
+        data.color[i] = compact.color[3] == 0 ? -1.0f
+            : static_cast<float>(compact.color[i]) / 255.0f;
+#if FSSR_USE_DERIVATIVES
+    for (int i = 0; i < 3; ++i)
+        data.deriv[i] = this->store_derivatives
+            ? half_to_float(this->compact_derivs[id][i]) : 0.0f;
+#endif // FSSR_USE_DERIVATIVES
+    return data;
+}
+
+void
+VoxelStorage::set_data (std::size_t id, VoxelData const& data)
+{
+    if (!this->compact)
+    {
+        this->data[id] = data;
+        return;
+    }
+
+    /* Colors of samples without color are negative. */
+    CompactVoxelData& compact = this->compact_data[id];
+    compact.value = data.value;
+    compact.conf = float_to_half(data.conf);
+    compact.scale = float_to_half(data.scale);
+    bool const has_color = data.color.minimum() >= 0.0f;
+    for (int i = 0; i < 3; ++i)
+        compact.color[i] = has_color ? quantize_color(data.color[i]) : 0;
+    compact.color[3] = has_color ? 255 : 0;
+#if FSSR_USE_DERIVATIVES
+    if (this->store_derivatives)
+        for (int i = 0; i < 3; ++i)
+            this->compact_derivs[id][i] = float_to_half(data.deriv[i]);
+#endif // FSSR_USE_DERIVATIVES
+}
+
+bool
+VoxelStorage::find (VoxelIndex const& index, VoxelData* data) const
+{
+    std::vector<uint64_t>::const_iterator iter = std::lower_bound(
+        this->indices.begin(), this->indices.end(), index.index);
+    if (iter == this->indices.end() || *iter != index.index)
+        return false;
+    *data = this->get_data(iter - this->indices.begin());
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
 VoxelData
 interpolate_voxel (VoxelData const& d1, float w1
         , VoxelData const& d2, float w2) {
@@ -11,7 +11,9 @@
 #define FSSR_VOXEL_HEADER
 
 #include <cstdint>
+#include <vector>
 
+#include "math/vector.h"
 #include "surface/defines.h"
 #include "surface/octree.h"
 
@@ -83,6 +85,68 @@ public:
 
 /* --------------------------------------------------------------------- */
 
+/**
+ * Stores voxels sorted by voxel index. The indices are stored in a separate
+ * array for fast lookup. The voxel data is either stored at full precision,
+ * or in a compact representation which stores the value at full precision,
+ * confidence and scale at half precision and the color with 8 bits per
+ * channel. This reduces the memory per voxel from 32 to 20 bytes. In the
+ * compact representation derivatives are stored at half precision, and are
+ * dropped if they are not required for interpolation.
+ */
+class VoxelStorage
+{
+public:
+    VoxelStorage (void);
+
+    /** Selects the compact representation. This clears all voxels. */
+    void set_compact (bool compact, bool store_derivatives);
+    bool is_compact (void) const;
+
+    /** Removes all voxels. */
+    void clear (void);
+
+    /**
+     * Sets the sorted and unique voxel indices by swapping with the given
+     * vector, and initializes the voxel data.
+     */
+    void set_indices (std::vector<uint64_t>* indices);
+
+    /** Returns the number of voxels. */
+    std::size_t size (void) const;
+
+    /** Returns the voxel index and data for the given voxel ID. */
+    VoxelIndex get_index (std::size_t id) const;
+    VoxelData get_data (std::size_t id) const;
+    /** Sets voxel data, this is thread-safe for different voxel IDs. */
+    void set_data (std::size_t id, VoxelData const& data);
+
+    /** Looks up voxel data by index, returns false if the voxel is missing. */
+    bool find (VoxelIndex const& index, VoxelData* data) const;
+
+private:
+    struct CompactVoxelData
+    {
+        float value;
+        uint16_t conf;
+        uint16_t scale;
+        /* Color in [0, 255], the last byte is zero if there is no color. */
+        uint8_t color[4];
+    };
+
+private:
+    bool compact;
+    bool store_derivatives;
+    std::vector<uint64_t> indices;
+    std::vector<VoxelData> data;
+    std::vector<CompactVoxelData> compact_data;
+#if FSSR_USE_DERIVATIVES
+    std::vector<math::Vector<uint16_t, 3> > compact_derivs;
+#endif // FSSR_USE_DERIVATIVES
+};
+
+/* --------------------------------------------------------------------- */
+
 /**
  * Interpolates between two VoxelData objects for Marching Cubes.
  * The specified weights 'w1' and 'w2' are used for interpolation of value,
@@ -112,6 +176,33 @@ VoxelData::VoxelData (void)
 {
 }
 
+inline
+VoxelStorage::VoxelStorage (void)
+    : compact(false)
+    , store_derivatives(true)
+{
+}
+
+inline bool
+VoxelStorage::is_compact (void) const
+{
+    return this->compact;
+}
+
+inline std::size_t
+VoxelStorage::size (void) const
+{
+    return this->indices.size();
+}
+
+inline VoxelIndex
+VoxelStorage::get_index (std::size_t id) const
+{
+    VoxelIndex index;
+    index.index = this->indices[id];
+    return index;
+}
+
 FSSR_NAMESPACE_END
 
 #endif /* FSSR_VOXEL_HEADER */
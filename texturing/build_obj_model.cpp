@@ -32,28 +32,45 @@ build_model(core::TriangleMesh::ConstPtr mesh,
     ObjModel::Groups & groups = obj_model->get_groups();
     MaterialLib & material_lib = obj_model->get_material_lib();
 
-    for (TextureAtlas::Ptr texture_atlas : texture_atlases) {
-        groups.push_back(ObjModel::Group());
-        ObjModel::Group & group = groups.back();
+    /* The texture coordinates of each atlas start at the prefix sum of its predecessors. */
+    std::vector<std::size_t> texcoord_id_offsets(texture_atlases.size() + 1, texcoords.size());
+    for (std::size_t i = 0; i < texture_atlases.size(); ++i) {
+        texcoord_id_offsets[i + 1] = texcoord_id_offsets[i]
+            + texture_atlases[i]->get_texcoords().size();
+    }
+    texcoords.resize(texcoord_id_offsets.back());
+
+    std::size_t const group_offset = groups.size();
+    groups.resize(group_offset + texture_atlases.size());
+    for (std::size_t i = 0; i < texture_atlases.size(); ++i) {
+        ObjModel::Group & group = groups[group_offset + i];
 
         const std::size_t n = material_lib.size();
         group.material_name = std::string("material") + util::string::get_filled(n, 4);
 
         Material material;
-        material.diffuse_map = texture_atlas->get_filename();
+        material.diffuse_map = texture_atlases[i]->get_filename();
         material_lib.add_material(group.material_name, material);
 
+        group.faces.resize(texture_atlases[i]->get_faces().size());
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < texture_atlases.size(); ++i) {
+        TextureAtlas::Ptr texture_atlas = texture_atlases[i];
+        ObjModel::Group & group = groups[group_offset + i];
+
         TextureAtlas::Faces const & atlas_faces = texture_atlas->get_faces();
         TextureAtlas::Texcoords const & atlas_texcoords = texture_atlas->get_texcoords();
         TextureAtlas::TexcoordIds const & atlas_texcoord_ids = texture_atlas->get_texcoord_ids();
 
-        std::size_t texcoord_id_offset = texcoords.size();
+        std::size_t texcoord_id_offset = texcoord_id_offsets[i];
 
-        texcoords.insert(texcoords.end(), atlas_texcoords.begin(),
-            atlas_texcoords.end());
+        std::copy(atlas_texcoords.begin(), atlas_texcoords.end(),
+            texcoords.begin() + texcoord_id_offset);
 
-        for (std::size_t i = 0; i < atlas_faces.size(); ++i) {
-            std::size_t mesh_face_pos = atlas_faces[i] * 3;
+        for (std::size_t j = 0; j < atlas_faces.size(); ++j) {
+            std::size_t mesh_face_pos = atlas_faces[j] * 3;
 
             std::size_t vertex_ids[] = {
                 mesh_faces[mesh_face_pos],
@@ -63,13 +80,12 @@ build_model(core::TriangleMesh::ConstPtr mesh,
             std::size_t * normal_ids = vertex_ids;
 
             std::size_t texcoord_ids[] = {
-                texcoord_id_offset + atlas_texcoord_ids[i * 3],
-                texcoord_id_offset + atlas_texcoord_ids[i * 3 + 1],
-                texcoord_id_offset + atlas_texcoord_ids[i * 3 + 2]
+                texcoord_id_offset + atlas_texcoord_ids[j * 3],
+                texcoord_id_offset + atlas_texcoord_ids[j * 3 + 1],
+                texcoord_id_offset + atlas_texcoord_ids[j * 3 + 2]
             };
 
-            group.faces.push_back(ObjModel::Face());
-            ObjModel::Face & face = group.faces.back();
+            ObjModel::Face & face = group.faces[j];
             std::copy(vertex_ids, vertex_ids + 3, face.vertex_ids);
             std::copy(texcoord_ids, texcoord_ids + 3, face.texcoord_ids);
             std::copy(normal_ids, normal_ids + 3, face.normal_ids);
@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "bvh_tree.h"
+
+#define ENABLE_SSE_BVH_TRAVERSAL 1
+
+#if ENABLE_SSE_BVH_TRAVERSAL && defined(__SSE__)
+#   include <xmmintrin.h>
+#endif
+
+/* Number of bins for the surface area heuristic. */
+#define BVH_NUM_BINS 16
+#define BVH_MAX_LEAF_SIZE 8
+/* Below this depth splits are chosen by the SAH, then by the median. */
+#define BVH_MAX_SAH_DEPTH 48
+#define BVH_STACK_SIZE 128
+/* Relative cost of a node traversal and a triangle intersection. */
+#define BVH_TRAVERSAL_COST 1.0f
+#define BVH_INTERSECTION_COST 1.0f
+
+namespace {
+    struct AABB {
+        math::Vec3f min;
+        math::Vec3f max;
+
+        AABB()
+            : min(std::numeric_limits<float>::max()),
+            max(-std::numeric_limits<float>::max()) {}
+
+        void grow(math::Vec3f const & v) {
+            for (int i = 0; i < 3; ++i) {
+                min[i] = std::min(min[i], v[i]);
+                max[i] = std::max(max[i], v[i]);
+            }
+        }
+
+        void grow(math::Vec3f const & vmin, math::Vec3f const & vmax) {
+            for (int i = 0; i < 3; ++i) {
+                min[i] = std::min(min[i], vmin[i]);
+                max[i] = std::max(max[i], vmax[i]);
+            }
+        }
+
+        float surface_area() const {
+            if (min[0] > max[0]) return 0.0f;
+            math::Vec3f const ext = max - min;
+            return 2.0f * (ext[0] * ext[1] + ext[1] * ext[2] + ext[2] * ext[0]);
+        }
+    };
+
+    struct Bin {
+        AABB aabb;
+        std::size_t num_tris = 0;
+    };
+
+    /** Returns the reciprocal direction, avoiding infinities for the slab test. */
+    float
+    safe_inverse(float d) {
+        if (std::abs(d) < 1e-20f)
+            d = d < 0.0f ? -1e-20f : 1e-20f;
+        return 1.0f / d;
+    }
+
+    /** Rays in structure of arrays layout for the packet traversal. */
+    struct RayPacket {
+#if ENABLE_SSE_BVH_TRAVERSAL && defined(__SSE__)
+        __m128 origin[3];
+        __m128 dir[3];
+        __m128 inv_dir[3];
+        __m128 tmin;
+        __m128 tmax;
+#else
+        float origin[3][BVH_RAY_PACKET_SIZE];
+        float dir[3][BVH_RAY_PACKET_SIZE];
+        float inv_dir[3][BVH_RAY_PACKET_SIZE];
+        float tmin[BVH_RAY_PACKET_SIZE];
+        float tmax[BVH_RAY_PACKET_SIZE];
+#endif
+    };
+}
+
+BVHTree::BVHTree(std::vector<unsigned int> const & faces,
+    std::vector<math::Vec3f> const & vertices) {
+
+    std::size_t const num_tris = faces.size() / 3;
+    std::vector<Triangle> input_tris(num_tris);
+    std::vector<BuildTriangle> build_tris(num_tris);
+    std::vector<std::uint32_t> indices(num_tris);
+    for (std::size_t i = 0; i < num_tris; ++i) {
+        math::Vec3f const & v0 = vertices[faces[i * 3 + 0]];
+        math::Vec3f const & v1 = vertices[faces[i * 3 + 1]];
+        math::Vec3f const & v2 = vertices[faces[i * 3 + 2]];
+        input_tris[i].v0 = v0;
+        input_tris[i].e1 = v1 - v0;
+        input_tris[i].e2 = v2 - v0;
+
+        AABB aabb;
+        aabb.grow(v0);
+        aabb.grow(v1);
+        aabb.grow(v2);
+        build_tris[i].aabb_min = aabb.min;
+        build_tris[i].aabb_max = aabb.max;
+        build_tris[i].centroid = (aabb.min + aabb.max) / 2.0f;
+        indices[i] = static_cast<std::uint32_t>(i);
+    }
+
+    tris.reserve(num_tris);
+    if (num_tris > 0)
+        build(build_tris, input_tris, &indices, 0, num_tris, 0);
+}
+
+std::uint32_t
+BVHTree::build(std::vector<BuildTriangle> const & build_tris,
+    std::vector<Triangle> const & input_tris, std::vector<std::uint32_t> * indices,
+    std::size_t begin, std::size_t end, std::size_t depth) {
+
+    /* Determine bounds of the triangles and of their centroids. */
+    AABB aabb, centroid_aabb;
+    for (std::size_t i = begin; i < end; ++i) {
+        BuildTriangle const & tri = build_tris[indices->at(i)];
+        aabb.grow(tri.aabb_min, tri.aabb_max);
+        centroid_aabb.grow(tri.centroid);
+    }
+
+    std::uint32_t const node_id = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back(Node());
+    for (int i = 0; i < 3; ++i) {
+        nodes[node_id].aabb_min[i] = aabb.min[i];
+        nodes[node_id].aabb_max[i] = aabb.max[i];
+    }
+
+    std::size_t const num_tris = end - begin;
+    math::Vec3f const extent = centroid_aabb.max - centroid_aabb.min;
+    int const axis = std::max_element(*extent, *extent + 3) - *extent;
+    float const axis_min = centroid_aabb.min[axis];
+    float const bin_scale = extent[axis] > 0.0f ? BVH_NUM_BINS / extent[axis] : 0.0f;
+    auto get_bin = [&] (std::uint32_t idx) -> int {
+        int const bin = static_cast<int>((build_tris[idx].centroid[axis] - axis_min) * bin_scale);
+        return std::min(bin, BVH_NUM_BINS - 1);
+    };
+
+    /* Find the split with the smallest SAH cost along the largest axis. */
+    float best_cost = std::numeric_limits<float>::max();
+    int best_split = -1;
+    if (num_tris > 2 && bin_scale > 0.0f && depth < BVH_MAX_SAH_DEPTH) {
+        Bin bins[BVH_NUM_BINS];
+        for (std::size_t i = begin; i < end; ++i) {
+            std::uint32_t const idx = indices->at(i);
+            Bin & bin = bins[get_bin(idx)];
+            bin.aabb.grow(build_tris[idx].aabb_min, build_tris[idx].aabb_max);
+            bin.num_tris += 1;
+        }
+
+        /* Sweep from the right to get the areas and counts of the right sides. */
+        float right_area[BVH_NUM_BINS];
+        std::size_t right_count[BVH_NUM_BINS];
+        AABB right;
+        std::size_t count = 0;
+        for (int i = BVH_NUM_BINS - 1; i > 0; --i) {
+            right.grow(bins[i].aabb.min, bins[i].aabb.max);
+            count += bins[i].num_tris;
+            right_area[i] = right.surface_area();
+            right_count[i] = count;
+        }
+
+        AABB left;
+        count = 0;
+        for (int i = 0; i < BVH_NUM_BINS - 1; ++i) {
+            left.grow(bins[i].aabb.min, bins[i].aabb.max);
+            count += bins[i].num_tris;
+            if (count == 0 || right_count[i + 1] == 0)
+                continue;
+            float const cost = left.surface_area() * count
+                + right_area[i + 1] * right_count[i + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = i;
+            }
+        }
+
+        float const area = aabb.surface_area();
+        if (best_split >= 0 && area > 0.0f)
+            best_cost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * best_cost / area;
+    }
+
+    /* Create a leaf if splitting does not pay off. */
+    float const leaf_cost = BVH_INTERSECTION_COST * num_tris;
+    if (num_tris <= 2 || (num_tris <= BVH_MAX_LEAF_SIZE && leaf_cost <= best_cost)) {
+        nodes[node_id].offset = static_cast<std::uint32_t>(tris.size());
+        nodes[node_id].num_tris = static_cast<std::uint16_t>(num_tris);
+        nodes[node_id].axis = 0;
+        for (std::size_t i = begin; i < end; ++i)
+            tris.push_back(input_tris[indices->at(i)]);
+        return node_id;
+    }
+
+    std::size_t mid;
+    if (best_split >= 0) {
+        mid = std::partition(indices->begin() + begin, indices->begin() + end,
+            [&] (std::uint32_t idx) -> bool { return get_bin(idx) <= best_split; })
+            - indices->begin();
+    } else {
+        /* Deep subtrees or equal centroids, split at the median. */
+        mid = begin + num_tris / 2;
+        std::nth_element(indices->begin() + begin, indices->begin() + mid,
+            indices->begin() + end,
+            [&] (std::uint32_t a, std::uint32_t b) -> bool {
+                return build_tris[a].centroid[axis] < build_tris[b].centroid[axis];
+            });
+    }
+
+    nodes[node_id].num_tris = 0;
+    nodes[node_id].axis = static_cast<std::uint16_t>(axis);
+    build(build_tris, input_tris, indices, begin, mid, depth + 1);
+    std::uint32_t const right_id = build(build_tris, input_tris, indices, mid, end, depth + 1);
+    nodes[node_id].offset = right_id;
+    return node_id;
+}
+
+namespace {
+    /** Single ray slab test against the node's bounding box. */
+    bool
+    intersect_aabb(float const * aabb_min, float const * aabb_max,
+        math::Vec3f const & origin, math::Vec3f const & inv_dir,
+        float tmin, float tmax) {
+        for (int i = 0; i < 3; ++i) {
+            float const t1 = (aabb_min[i] - origin[i]) * inv_dir[i];
+            float const t2 = (aabb_max[i] - origin[i]) * inv_dir[i];
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        return tmin <= tmax;
+    }
+
+    /** Single ray Moeller-Trumbore test, returns whether t is within [tmin, tmax]. */
+    bool
+    intersect_triangle(math::Vec3f const & v0, math::Vec3f const & e1,
+        math::Vec3f const & e2, math::Vec3f const & origin,
+        math::Vec3f const & dir, float tmin, float tmax) {
+        float const px = dir[1] * e2[2] - dir[2] * e2[1];
+        float const py = dir[2] * e2[0] - dir[0] * e2[2];
+        float const pz = dir[0] * e2[1] - dir[1] * e2[0];
+        float const det = e1[0] * px + e1[1] * py + e1[2] * pz;
+        if (det == 0.0f)
+            return false;
+        float const inv_det = 1.0f / det;
+
+        float const sx = origin[0] - v0[0];
+        float const sy = origin[1] - v0[1];
+        float const sz = origin[2] - v0[2];
+        float const u = (sx * px + sy * py + sz * pz) * inv_det;
+        if (!(u >= 0.0f && u <= 1.0f))
+            return false;
+
+        float const qx = sy * e1[2] - sz * e1[1];
+        float const qy = sz * e1[0] - sx * e1[2];
+        float const qz = sx * e1[1] - sy * e1[0];
+        float const v = (dir[0] * qx + dir[1] * qy + dir[2] * qz) * inv_det;
+        if (!(v >= 0.0f && u + v <= 1.0f))
+            return false;
+
+        float const t = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv_det;
+        return t >= tmin && t <= tmax;
+    }
+
+#if ENABLE_SSE_BVH_TRAVERSAL && defined(__SSE__)
+    /** Slab test of all rays in the packet, returns a mask of hits. */
+    int
+    intersect_aabb(float const * aabb_min, float const * aabb_max,
+        RayPacket const & packet) {
+        __m128 tmin = packet.tmin;
+        __m128 tmax = packet.tmax;
+        for (int i = 0; i < 3; ++i) {
+            __m128 const t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb_min[i]),
+                packet.origin[i]), packet.inv_dir[i]);
+            __m128 const t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aabb_max[i]),
+                packet.origin[i]), packet.inv_dir[i]);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+    }
+
+    /** Moeller-Trumbore test of all rays in the packet, returns a mask of hits. */
+    int
+    intersect_triangle(math::Vec3f const & v0, math::Vec3f const & e1,
+        math::Vec3f const & e2, RayPacket const & packet) {
+        __m128 const zero = _mm_setzero_ps();
+        __m128 const one = _mm_set1_ps(1.0f);
+        __m128 const e1x = _mm_set1_ps(e1[0]);
+        __m128 const e1y = _mm_set1_ps(e1[1]);
+        __m128 const e1z = _mm_set1_ps(e1[2]);
+        __m128 const e2x = _mm_set1_ps(e2[0]);
+        __m128 const e2y = _mm_set1_ps(e2[1]);
+        __m128 const e2z = _mm_set1_ps(e2[2]);
+        __m128 const* dir = packet.dir;
+
+        __m128 const px = _mm_sub_ps(_mm_mul_ps(dir[1], e2z), _mm_mul_ps(dir[2], e2y));
+        __m128 const py = _mm_sub_ps(_mm_mul_ps(dir[2], e2x), _mm_mul_ps(dir[0], e2z));
+        __m128 const pz = _mm_sub_ps(_mm_mul_ps(dir[0], e2y), _mm_mul_ps(dir[1], e2x));
+        __m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px),
+            _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 mask = _mm_cmpneq_ps(det, zero);
+        if (_mm_movemask_ps(mask) == 0)
+            return 0;
+        __m128 const inv_det = _mm_div_ps(one, det);
+
+        __m128 const sx = _mm_sub_ps(packet.origin[0], _mm_set1_ps(v0[0]));
+        __m128 const sy = _mm_sub_ps(packet.origin[1], _mm_set1_ps(v0[1]));
+        __m128 const sz = _mm_sub_ps(packet.origin[2], _mm_set1_ps(v0[2]));
+        __m128 const u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px),
+            _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+        mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        if (_mm_movemask_ps(mask) == 0)
+            return 0;
+
+        __m128 const qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 const qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 const qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 const v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], qx),
+            _mm_mul_ps(dir[1], qy)), _mm_mul_ps(dir[2], qz)), inv_det);
+        mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero),
+            _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        if (_mm_movemask_ps(mask) == 0)
+            return 0;
+
+        __m128 const t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx),
+            _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+        mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, packet.tmin),
+            _mm_cmple_ps(t, packet.tmax)));
+        return _mm_movemask_ps(mask);
+    }
+
+    void
+    fill_packet(BVHTree::Ray const * rays, std::size_t num_rays, RayPacket * packet) {
+        float values[11][BVH_RAY_PACKET_SIZE];
+        for (std::size_t i = 0; i < BVH_RAY_PACKET_SIZE; ++i) {
+            BVHTree::Ray const & ray = rays[std::min(i, num_rays - 1)];
+            for (int j = 0; j < 3; ++j) {
+                values[j][i] = ray.origin[j];
+                values[3 + j][i] = ray.dir[j];
+                values[6 + j][i] = safe_inverse(ray.dir[j]);
+            }
+            values[9][i] = ray.tmin;
+            values[10][i] = ray.tmax;
+        }
+        for (int j = 0; j < 3; ++j) {
+            packet->origin[j] = _mm_loadu_ps(values[j]);
+            packet->dir[j] = _mm_loadu_ps(values[3 + j]);
+            packet->inv_dir[j] = _mm_loadu_ps(values[6 + j]);
+        }
+        packet->tmin = _mm_loadu_ps(values[9]);
+        packet->tmax = _mm_loadu_ps(values[10]);
+    }
+#else
+    int
+    intersect_aabb(float const * aabb_min, float const * aabb_max,
+        RayPacket const & packet) {
+        int mask = 0;
+        for (int k = 0; k < BVH_RAY_PACKET_SIZE; ++k) {
+            float tmin = packet.tmin[k];
+            float tmax = packet.tmax[k];
+            for (int i = 0; i < 3; ++i) {
+                float const t1 = (aabb_min[i] - packet.origin[i][k]) * packet.inv_dir[i][k];
+                float const t2 = (aabb_max[i] - packet.origin[i][k]) * packet.inv_dir[i][k];
+                tmin = std::max(tmin, std::min(t1, t2));
+                tmax = std::min(tmax, std::max(t1, t2));
+            }
+            if (tmin <= tmax)
+                mask |= 1 << k;
+        }
+        return mask;
+    }
+
+    int
+    intersect_triangle(math::Vec3f const & v0, math::Vec3f const & e1,
+        math::Vec3f const & e2, RayPacket const & packet) {
+        int mask = 0;
+        for (int k = 0; k < BVH_RAY_PACKET_SIZE; ++k) {
+            math::Vec3f const origin(packet.origin[0][k],
+                packet.origin[1][k], packet.origin[2][k]);
+            math::Vec3f const dir(packet.dir[0][k],
+                packet.dir[1][k], packet.dir[2][k]);
+            if (intersect_triangle(v0, e1, e2, origin, dir,
+                    packet.tmin[k], packet.tmax[k]))
+                mask |= 1 << k;
+        }
+        return mask;
+    }
+
+    void
+    fill_packet(BVHTree::Ray const * rays, std::size_t num_rays, RayPacket * packet) {
+        for (std::size_t i = 0; i < BVH_RAY_PACKET_SIZE; ++i) {
+            BVHTree::Ray const & ray = rays[std::min(i, num_rays - 1)];
+            for (int j = 0; j < 3; ++j) {
+                packet->origin[j][i] = ray.origin[j];
+                packet->dir[j][i] = ray.dir[j];
+                packet->inv_dir[j][i] = safe_inverse(ray.dir[j]);
+            }
+            packet->tmin[i] = ray.tmin;
+            packet->tmax[i] = ray.tmax;
+        }
+    }
+#endif
+}
+
+bool
+BVHTree::intersects(Ray const & ray) const {
+    if (nodes.empty()) return false;
+
+    math::Vec3f inv_dir;
+    for (int i = 0; i < 3; ++i)
+        inv_dir[i] = safe_inverse(ray.dir[i]);
+
+    std::uint32_t stack[BVH_STACK_SIZE];
+    std::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        std::uint32_t const node_id = stack[--stack_size];
+        Node const & node = nodes[node_id];
+        if (!intersect_aabb(node.aabb_min, node.aabb_max, ray.origin,
+                inv_dir, ray.tmin, ray.tmax))
+            continue;
+
+        if (node.num_tris > 0) {
+            for (std::size_t i = 0; i < node.num_tris; ++i) {
+                Triangle const & tri = tris[node.offset + i];
+                if (intersect_triangle(tri.v0, tri.e1, tri.e2, ray.origin,
+                        ray.dir, ray.tmin, ray.tmax))
+                    return true;
+            }
+            continue;
+        }
+
+        /* Visit the child closer to the ray origin first. */
+        if (ray.dir[node.axis] < 0.0f) {
+            stack[stack_size++] = node_id + 1;
+            stack[stack_size++] = node.offset;
+        } else {
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = node_id + 1;
+        }
+    }
+    return false;
+}
+
+void
+BVHTree::intersects(Ray const * rays, std::size_t num_rays, bool * hits) const {
+    for (std::size_t first = 0; first < num_rays; first += BVH_RAY_PACKET_SIZE) {
+        std::size_t const packet_size = std::min<std::size_t>(BVH_RAY_PACKET_SIZE,
+            num_rays - first);
+
+        /* Any-hit traversal, rays leave the packet once they hit. */
+        int active = (1 << packet_size) - 1;
+        if (!nodes.empty()) {
+            RayPacket packet;
+            fill_packet(rays + first, packet_size, &packet);
+
+            std::uint32_t stack[BVH_STACK_SIZE];
+            std::size_t stack_size = 0;
+            stack[stack_size++] = 0;
+            while (stack_size > 0 && active != 0) {
+                std::uint32_t const node_id = stack[--stack_size];
+                Node const & node = nodes[node_id];
+                if ((intersect_aabb(node.aabb_min, node.aabb_max, packet) & active) == 0)
+                    continue;
+
+                if (node.num_tris > 0) {
+                    for (std::size_t i = 0; i < node.num_tris && active != 0; ++i) {
+                        Triangle const & tri = tris[node.offset + i];
+                        active &= ~intersect_triangle(tri.v0, tri.e1, tri.e2, packet);
+                    }
+                    continue;
+                }
+
+                /* Visit the child closer to the ray origins first. */
+                if (rays[first].dir[node.axis] < 0.0f) {
+                    stack[stack_size++] = node_id + 1;
+                    stack[stack_size++] = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    stack[stack_size++] = node_id + 1;
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < packet_size; ++i)
+            hits[first + i] = !nodes.empty() && (active & (1 << i)) == 0;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef TEX_BVH_TREE_HEADER
+#define TEX_BVH_TREE_HEADER
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "math/vector.h"
+
+/* Number of rays traversed together, matches the SSE register width. */
+#define BVH_RAY_PACKET_SIZE 4
+
+/**
+  * Bounding volume hierarchy over the triangles of a mesh built with the
+  * surface area heuristic. The tree answers occlusion queries (any-hit),
+  * i.e. whether a ray segment intersects any triangle, for single rays and
+  * for packets of coherent rays, which are traversed together.
+  */
+class BVHTree {
+    public:
+        typedef std::shared_ptr<BVHTree> Ptr;
+        typedef std::shared_ptr<const BVHTree> ConstPtr;
+
+        /** Ray segment origin + t * dir with t in [tmin, tmax]. */
+        struct Ray {
+            math::Vec3f origin;
+            math::Vec3f dir;
+            float tmin;
+            float tmax;
+        };
+
+    private:
+        /**
+          * Node in depth-first order: the left child of an inner node
+          * directly follows the node, offset is the right child.
+          * For leaves offset is the first triangle.
+          */
+        struct Node {
+            float aabb_min[3];
+            std::uint32_t offset;
+            float aabb_max[3];
+            /* Number of triangles, zero for inner nodes. */
+            std::uint16_t num_tris;
+            /* Split axis of inner nodes. */
+            std::uint16_t axis;
+        };
+
+        /** Triangle prepared for the ray intersection test. */
+        struct Triangle {
+            math::Vec3f v0;
+            math::Vec3f e1;
+            math::Vec3f e2;
+        };
+
+        struct BuildTriangle {
+            math::Vec3f aabb_min;
+            math::Vec3f aabb_max;
+            math::Vec3f centroid;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<Triangle> tris;
+
+        /** Recursively builds the subtree for indices [begin, end). */
+        std::uint32_t build(std::vector<BuildTriangle> const & build_tris,
+            std::vector<Triangle> const & input_tris, std::vector<std::uint32_t> * indices,
+            std::size_t begin, std::size_t end, std::size_t depth);
+
+    public:
+        /**
+          * Builds the tree for the given triangles, faces contains three
+          * vertex indices per triangle.
+          */
+        BVHTree(std::vector<unsigned int> const & faces,
+            std::vector<math::Vec3f> const & vertices);
+
+        static BVHTree::Ptr create(std::vector<unsigned int> const & faces,
+            std::vector<math::Vec3f> const & vertices);
+
+        /** Returns true if the ray segment intersects any triangle. */
+        bool intersects(Ray const & ray) const;
+
+        /**
+          * Sets hits[i] to whether rays[i] intersects any triangle. The rays
+          * are traversed in packets, which is efficient for coherent rays
+          * such as rays towards a common camera center.
+          */
+        void intersects(Ray const * rays, std::size_t num_rays, bool * hits) const;
+
+        /** Returns the number of nodes. */
+        std::size_t num_nodes() const;
+};
+
+inline BVHTree::Ptr
+BVHTree::create(std::vector<unsigned int> const & faces,
+    std::vector<math::Vec3f> const & vertices) {
+    return Ptr(new BVHTree(faces, vertices));
+}
+
+inline std::size_t
+BVHTree::num_nodes() const {
+    return nodes.size();
+}
+
+#endif /* TEX_BVH_TREE_HEADER */
@@ -10,18 +10,30 @@
 #include <numeric>
 
 #include <core/image_color.h>
-#include <coldet.h>
+#include <util/timer.h>
 #include <Eigen/Core>
 #include <Eigen/LU>
 
 #include "util.h"
+#include "bvh_tree.h"
+#include "z_buffer.h"
 #include "histogram.h"
 #include "texturing.h"
 #include "sparse_table.h"
 #include "progress_counter.h"
 
+/* Number of faces per block of the count-then-fill passes. */
+#define FACE_BLOCK_SIZE 16384
+
 TEX_NAMESPACE_BEGIN
 
+/* Visibility state of a vertex within the current view. */
+enum VertexVisibility {
+    VERTEX_UNTESTED = 0,
+    VERTEX_VISIBLE = 1,
+    VERTEX_OCCLUDED = 2
+};
+
 /**
  * Dampens the quality of all views in which the face's projection
  * has a much different color than in the majority of views.
@@ -138,32 +150,45 @@ calculate_data_costs(core::TriangleMesh::ConstPtr mesh, std::vector<TextureView>
     std::size_t const num_faces = faces.size() / 3;
     std::size_t const num_views = texture_views->size();
 
-    CollisionModel3D* model = newCollisionModel3D(true);
+    bool const ray_casting = settings.geometric_visibility_test
+        && settings.visibility_test == RAY_CASTING;
+    bool const z_buffering = settings.geometric_visibility_test
+        && settings.visibility_test == Z_BUFFER;
+
+    /* Decode the view images in processing order while building the BVH. */
+    std::vector<std::string> image_files(num_views);
+    for (std::size_t j = 0; j < num_views; ++j)
+        image_files[j] = texture_views->at(j).get_image_file();
+    ImageCache::prefetch(image_files);
 
-    if (settings.geometric_visibility_test) {
+    BVHTree::Ptr bvh_tree;
+    if (ray_casting) {
         /* Build up acceleration structure for the visibility test. */
-        ProgressCounter face_counter("\tBuilding collision model", num_faces);
-        model->setTriangleNumber(num_faces);
-        for (std::size_t i = 0; i < faces.size(); i += 3) {
-            face_counter.progress<SIMPLE>();
-            math::Vec3f v1 = vertices[faces[i]];
-            math::Vec3f v2 = vertices[faces[i + 1]];
-            math::Vec3f v3 = vertices[faces[i + 2]];
-            model->addTriangle(*v1, *v2, *v3);
-            face_counter.inc();
-        }
-        model->finalize();
+        std::cout << "\tBuilding BVH from " << num_faces << " faces... " << std::flush;
+        util::WallTimer timer;
+        bvh_tree = BVHTree::create(faces, vertices);
+        std::cout << "done. (Took: " << timer.get_elapsed() << " ms)" << std::endl;
     }
-    std::vector<std::vector<ProjectedFaceInfo> > projected_face_infos(num_faces);
+
+    /* Infos of the faces seen by each view, ordered by face. */
+    typedef std::pair<std::uint32_t, ProjectedFaceInfo> FaceViewInfo;
+    std::vector<std::vector<FaceViewInfo> > view_face_infos(num_views);
 
     ProgressCounter view_counter("\tCalculating face qualities", num_views);
     #pragma omp parallel
     {
-        std::vector<std::pair<std::size_t, ProjectedFaceInfo> > projected_face_view_infos;
+        /* Faces passing the culling tests and per vertex visibility of a view. */
+        std::vector<std::size_t> candidate_faces;
+        std::vector<std::uint8_t> vertex_visibility;
+        std::vector<std::size_t> ray_vertices;
+        std::vector<BVHTree::Ray> rays;
+        ZBuffer zbuffer;
+        if (settings.geometric_visibility_test)
+            vertex_visibility.resize(vertices.size(), VERTEX_UNTESTED);
 
         // for each view
         #pragma omp for schedule(dynamic)
-        for (std::uint16_t j = 0; j < texture_views->size(); ++j) {
+        for (std::size_t j = 0; j < num_views; ++j) {
             view_counter.progress<SIMPLE>();
 
             TextureView * texture_view = &texture_views->at(j);
@@ -181,6 +206,7 @@ calculate_data_costs(core::TriangleMesh::ConstPtr mesh, std::vector<TextureView>
             math::Vec3f const & viewing_direction = texture_view->get_viewing_direction();
 
             // for each face
+            candidate_faces.clear();
             for (std::size_t i = 0; i < faces.size(); i += 3) {
                 std::size_t face_id = i / 3;
 
@@ -209,28 +235,68 @@ calculate_data_costs(core::TriangleMesh::ConstPtr mesh, std::vector<TextureView>
                 if (!texture_view->inside(v1, v2, v3))
                     continue;
 
+                candidate_faces.push_back(face_id);
+            }
 
-                if (settings.geometric_visibility_test) {
-                    /* Viewing rays do not collide? */
-                    bool visible = true;
-                    math::Vec3f const * samples[] = {&v1, &v2, &v3};
-                    // TODO: random monte carlo samples...
-
-                    for (std::size_t k = 0; k < sizeof(samples) / sizeof(samples[0]); ++k) {
-                        math::Vec3f vertex = *samples[k];
-                        math::Vec3f dir = view_pos - vertex;
-                        float const dir_length = dir.norm();
-                        dir.normalize();
+            if (z_buffering) {
+                /* Render the mesh into the view, occluded vertices
+                 * lie behind the depth buffer. */
+                zbuffer.rasterize(*texture_view, faces, vertices);
+            }
 
-                        if (model->rayCollision(*vertex, *dir,  false, dir_length * 0.0001f, dir_length)) {
-                            visible = false;
-                            break;
+            if (settings.geometric_visibility_test) {
+                /* Viewing rays do not collide? Every vertex is tested once
+                 * per view, the rays to the view are traced in packets
+                 * or looked up in the depth buffer. */
+                // TODO: random monte carlo samples...
+                ray_vertices.clear();
+                rays.clear();
+                for (std::size_t face_id : candidate_faces) {
+                    for (std::size_t k = 0; k < 3; ++k) {
+                        std::size_t const vertex_id = faces[face_id * 3 + k];
+                        if (vertex_visibility[vertex_id] != VERTEX_UNTESTED)
+                            continue;
+                        vertex_visibility[vertex_id] = VERTEX_VISIBLE;
+                        ray_vertices.push_back(vertex_id);
+
+                        if (z_buffering) {
+                            if (!zbuffer.is_visible(vertex_id))
+                                vertex_visibility[vertex_id] = VERTEX_OCCLUDED;
+                            continue;
                         }
+
+                        BVHTree::Ray ray;
+                        ray.origin = vertices[vertex_id];
+                        ray.dir = view_pos - ray.origin;
+                        ray.tmin = 0.0001f;
+                        ray.tmax = 1.0f;
+                        rays.push_back(ray);
+                    }
+                }
+
+                if (ray_casting) {
+                    std::unique_ptr<bool[]> hits(new bool[rays.size()]);
+                    bvh_tree->intersects(rays.data(), rays.size(), hits.get());
+                    for (std::size_t k = 0; k < ray_vertices.size(); ++k) {
+                        if (hits[k])
+                            vertex_visibility[ray_vertices[k]] = VERTEX_OCCLUDED;
                     }
-                    if (!visible) continue;
                 }
+            }
+
+            for (std::size_t face_id : candidate_faces) {
+                std::size_t const i = face_id * 3;
+                if (settings.geometric_visibility_test
+                    && (vertex_visibility[faces[i]] == VERTEX_OCCLUDED
+                    || vertex_visibility[faces[i + 1]] == VERTEX_OCCLUDED
+                    || vertex_visibility[faces[i + 2]] == VERTEX_OCCLUDED))
+                    continue;
 
-                ProjectedFaceInfo info = {j, 0.0f, math::Vec3f(0.0f, 0.0f, 0.0f)};
+                math::Vec3f const & v1 = vertices[faces[i]];
+                math::Vec3f const & v2 = vertices[faces[i + 1]];
+                math::Vec3f const & v3 = vertices[faces[i + 2]];
+
+                ProjectedFaceInfo info = {static_cast<std::uint16_t>(j), 0.0f, math::Vec3f(0.0f, 0.0f, 0.0f)};
 
                 /* Calculate quality. */
                 texture_view->get_face_info(v1, v2, v3, &info, settings);
@@ -240,10 +306,13 @@ calculate_data_costs(core::TriangleMesh::ConstPtr mesh, std::vector<TextureView>
                 /* Change color space. */
                 core::image::color_rgb_to_ycbcr(*(info.mean_color));
 
-                std::pair<std::size_t, ProjectedFaceInfo> pair(face_id, info);
-                projected_face_view_infos.push_back(pair);
+                view_face_infos[j].push_back(FaceViewInfo(face_id, info));
             }
 
+            /* Reset the vertex visibility for the next view. */
+            for (std::size_t vertex_id : ray_vertices)
+                vertex_visibility[vertex_id] = VERTEX_UNTESTED;
+
             texture_view->release_image();
             texture_view->release_validity_mask();
             if (settings.data_term == GMI) {
@@ -251,73 +320,130 @@ calculate_data_costs(core::TriangleMesh::ConstPtr mesh, std::vector<TextureView>
             }
             view_counter.inc();
         }
+    }
+    ImageCache::stop_prefetch();
+
+    /*
+     * Transpose the infos to face major order (compressed rows) with a count
+     * and a fill pass over blocks of faces. Each block owns its faces and
+     * finds their infos in the view lists by binary search, so the passes
+     * need no synchronization and the infos of a face are ordered by view.
+     */
+    std::size_t const num_blocks = (num_faces + FACE_BLOCK_SIZE - 1) / FACE_BLOCK_SIZE;
+    auto view_range = [&view_face_infos] (std::size_t view_id, std::size_t begin, std::size_t end) {
+        std::vector<FaceViewInfo> const & infos = view_face_infos[view_id];
+        auto less = [] (FaceViewInfo const & info, std::size_t face_id) -> bool {
+            return info.first < face_id;
+        };
+        return std::make_pair(
+            std::lower_bound(infos.begin(), infos.end(), begin, less),
+            std::lower_bound(infos.begin(), infos.end(), end, less));
+    };
+
+    std::vector<std::size_t> info_offsets(num_faces + 1, 0);
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t block = 0; block < num_blocks; ++block) {
+        std::size_t const begin = block * FACE_BLOCK_SIZE;
+        std::size_t const end = std::min(num_faces, begin + FACE_BLOCK_SIZE);
+        for (std::size_t j = 0; j < num_views; ++j) {
+            auto range = view_range(j, begin, end);
+            for (auto it = range.first; it != range.second; ++it) {
+                info_offsets[it->first + 1] += 1;
+            }
+        }
+    }
+    std::partial_sum(info_offsets.begin(), info_offsets.end(), info_offsets.begin());
 
-        //std::sort(projected_face_view_infos.begin(), projected_face_view_infos.end());
-
-        #pragma omp critical
-        {
-            for (std::size_t i = projected_face_view_infos.size(); 0 < i; --i) {
-                std::size_t face_id = projected_face_view_infos[i - 1].first;
-                ProjectedFaceInfo const & info = projected_face_view_infos[i - 1].second;
-                projected_face_infos[face_id].push_back(info);
+    std::vector<ProjectedFaceInfo> face_infos(info_offsets[num_faces]);
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t block = 0; block < num_blocks; ++block) {
+        std::size_t const begin = block * FACE_BLOCK_SIZE;
+        std::size_t const end = std::min(num_faces, begin + FACE_BLOCK_SIZE);
+        std::vector<std::size_t> fill(info_offsets.begin() + begin, info_offsets.begin() + end);
+        for (std::size_t j = 0; j < num_views; ++j) {
+            auto range = view_range(j, begin, end);
+            for (auto it = range.first; it != range.second; ++it) {
+                face_infos[fill[it->first - begin]++] = it->second;
             }
-            projected_face_view_infos.clear();
         }
     }
 
-    delete model;
-    model = NULL;
+    /* Ensure that all memory is freeed. */
+    view_face_infos.clear();
+    view_face_infos.shrink_to_fit();
 
-    ProgressCounter face_counter("\tPostprocessing face infos", num_faces);
-    #pragma omp parallel for schedule(dynamic)
-    for (std::size_t i = 0; i < projected_face_infos.size(); ++i) {
-        face_counter.progress<SIMPLE>();
+    if (settings.outlier_removal != NONE) {
+        ProgressCounter face_counter("\tPostprocessing face infos", num_faces);
+        #pragma omp parallel
+        {
+            std::vector<ProjectedFaceInfo> infos;
 
-        std::vector<ProjectedFaceInfo> & infos = projected_face_infos[i];
-        if (settings.outlier_removal != NONE) {
-            photometric_outlier_detection(&infos, settings);
+            #pragma omp for schedule(dynamic)
+            for (std::size_t i = 0; i < num_faces; ++i) {
+                face_counter.progress<SIMPLE>();
 
-            infos.erase(std::remove_if(infos.begin(), infos.end(),
-                [](ProjectedFaceInfo const & info) -> bool {return info.quality == 0.0f;}),
-                infos.end());
-        }
-        std::sort(infos.begin(), infos.end());
+                /* Outliers get quality zero and are skipped below. */
+                infos.assign(face_infos.begin() + info_offsets[i],
+                    face_infos.begin() + info_offsets[i + 1]);
+                photometric_outlier_detection(&infos, settings);
+                std::copy(infos.begin(), infos.end(), face_infos.begin() + info_offsets[i]);
 
-        face_counter.inc();
+                face_counter.inc();
+            }
+        }
     }
 
     /* Determine the function for the normlization. */
     float max_quality = 0.0f;
-    for (std::size_t i = 0; i < projected_face_infos.size(); ++i)
-        for (std::size_t j = 0; j < projected_face_infos[i].size(); ++j)
-            max_quality = std::max(max_quality, projected_face_infos[i][j].quality);
+    for (std::size_t i = 0; i < face_infos.size(); ++i)
+        max_quality = std::max(max_quality, face_infos[i].quality);
+
+    /* Infos with quality zero are outliers if the outlier removal ran,
+     * otherwise they are kept with the maximal cost. */
+    bool const skip_zero_quality = settings.outlier_removal != NONE;
+    auto is_outlier = [skip_zero_quality] (ProjectedFaceInfo const & info) -> bool {
+        return skip_zero_quality && info.quality == 0.0f;
+    };
 
     Histogram hist_qualities(0.0f, max_quality, 10000);
-    for (std::size_t i = 0; i < projected_face_infos.size(); ++i)
-        for (std::size_t j = 0; j < projected_face_infos[i].size(); ++j)
-            hist_qualities.add_value(projected_face_infos[i][j].quality);
+    for (std::size_t i = 0; i < face_infos.size(); ++i)
+        if (!is_outlier(face_infos[i]))
+            hist_qualities.add_value(face_infos[i].quality);
 
     float percentile = hist_qualities.get_approx_percentile(0.995f);
 
-    /* Calculate the costs. */
+    /* Calculate the costs, again with a count and a fill pass. */
     assert(num_faces < std::numeric_limits<std::uint32_t>::max());
     assert(num_views < std::numeric_limits<std::uint16_t>::max());
     assert(MRF_MAX_ENERGYTERM < std::numeric_limits<float>::max());
-    for (std::uint32_t i = 0; i < static_cast<std::uint32_t>(projected_face_infos.size()); ++i) {
-        for (std::size_t j = 0; j < projected_face_infos[i].size(); ++j) {
-            ProjectedFaceInfo const & info = projected_face_infos[i][j];
+    std::vector<std::size_t> cost_offsets(num_faces + 1, 0);
+    #pragma omp parallel for schedule(dynamic, FACE_BLOCK_SIZE)
+    for (std::size_t i = 0; i < num_faces; ++i) {
+        for (std::size_t k = info_offsets[i]; k < info_offsets[i + 1]; ++k) {
+            if (!is_outlier(face_infos[k])) cost_offsets[i + 1] += 1;
+        }
+    }
+    std::partial_sum(cost_offsets.begin(), cost_offsets.end(), cost_offsets.begin());
+
+    std::vector<ST::ColumnEntry> costs(cost_offsets[num_faces]);
+    #pragma omp parallel for schedule(dynamic, FACE_BLOCK_SIZE)
+    for (std::size_t i = 0; i < num_faces; ++i) {
+        std::size_t fill = cost_offsets[i];
+        for (std::size_t k = info_offsets[i]; k < info_offsets[i + 1]; ++k) {
+            ProjectedFaceInfo const & info = face_infos[k];
+            if (is_outlier(info)) continue;
 
             /* Clamp to percentile and normalize. */
             float normalized_quality = std::min(1.0f, info.quality / percentile);
             float data_cost = (1.0f - normalized_quality) * MRF_MAX_ENERGYTERM;
-            data_costs->set_value(i, info.view_id, data_cost);
+            costs[fill++] = ST::ColumnEntry(info.view_id, data_cost);
         }
-
-        /* Ensure that all memory is freeed. */
-        projected_face_infos[i].clear();
-        projected_face_infos[i].shrink_to_fit();
     }
 
+    face_infos.clear();
+    face_infos.shrink_to_fit();
+    data_costs->set_columns(&cost_offsets, &costs);
+
     std::cout << "\tMaximum quality of a face within an image: " << max_quality << std::endl;
     std::cout << "\tClamping qualities to " << percentile << " within normalization." << std::endl;
 }
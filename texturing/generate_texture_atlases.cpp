@@ -130,15 +130,20 @@ generate_texture_atlases(std::vector<TexturePatch::Ptr> * orig_texture_patches,
 
     std::cout << "\tSorting texture patches... " << std::flush;
     /* Improve the bin-packing algorithm efficiency by sorting texture patches
-     * in descending order of size. */
-    texture_patches.sort();
-    texture_patches.reverse();
+     * in descending order of height, the skyline then rises evenly. */
+    texture_patches.sort([] (TexturePatch::ConstPtr lhs, TexturePatch::ConstPtr rhs) {
+        return lhs->get_height() > rhs->get_height()
+            || (lhs->get_height() == rhs->get_height() && lhs->get_width() > rhs->get_width());
+    });
     std::cout << "done." << std::endl;
 
     std::size_t const total_num_patches = texture_patches.size();
     std::size_t remaining_patches = texture_patches.size();
     std::ofstream tty("/dev/tty", std::ios_base::out);
 
+    util::WallTimer pack_timer;
+    double pack_seconds = 0.0;
+
     #pragma omp parallel
     {
     #pragma omp single
@@ -150,7 +155,7 @@ generate_texture_atlases(std::vector<TexturePatch::Ptr> * orig_texture_patches,
         texture_atlases->push_back(TextureAtlas::create(texture_size));
         TextureAtlas::Ptr texture_atlas = texture_atlases->back();
 
-        /* Try to insert each of the texture patches into the texture atlas. */
+        /* Try to place each of the texture patches into the texture atlas. */
         std::list<TexturePatch::ConstPtr>::iterator it = texture_patches.begin();
         for (; it != texture_patches.end();) {
             std::size_t done_patches = total_num_patches - remaining_patches;
@@ -163,7 +168,7 @@ generate_texture_atlases(std::vector<TexturePatch::Ptr> * orig_texture_patches,
                  << precent << "%... " << std::flush;
             }
 
-            if (texture_atlas->insert(*it, vmin, vmax)) {
+            if (texture_atlas->place(*it)) {
                 it = texture_patches.erase(it);
                 remaining_patches -= 1;
             } else {
@@ -171,9 +176,14 @@ generate_texture_atlases(std::vector<TexturePatch::Ptr> * orig_texture_patches,
             }
         }
 
+        /* The patches are copied while the next atlas is packed. */
         #pragma omp task
-        texture_atlas->finalize();
+        {
+            texture_atlas->copy_placed(vmin, vmax);
+            texture_atlas->finalize();
+        }
     }
+    pack_seconds = pack_timer.get_elapsed_sec();
 
     std::cout << "\r\tWorking on atlas " << texture_atlases->size()
         << " 100%... done." << std::endl;
@@ -186,6 +196,14 @@ generate_texture_atlases(std::vector<TexturePatch::Ptr> * orig_texture_patches,
     }
     /* End of parallel region. */
     }
+
+    float fill_rate = 0.0f;
+    for (TextureAtlas::Ptr texture_atlas : *texture_atlases)
+        fill_rate += texture_atlas->get_fill_rate();
+    if (!texture_atlases->empty()) fill_rate /= texture_atlases->size();
+    std::cout << "\tPacked " << total_num_patches << " texture patches into "
+        << texture_atlases->size() << " atlases (Took: " << pack_seconds
+        << "s, mean fill rate: " << fill_rate * 100.0f << "%)" << std::endl;
 }
 
 TEX_NAMESPACE_END
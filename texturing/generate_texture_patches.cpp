@@ -132,6 +132,18 @@ generate_texture_patches(UniGraph const & graph, core::TriangleMesh::ConstPtr me
     // Projection Infomation
     vertex_projection_infos->resize(vertices.size());
 
+    /* Decode the images of the views used by the labeling in label order. */
+    std::vector<bool> used_views(texture_views->size(), false);
+    for (std::size_t i = 0; i < graph.num_nodes(); ++i) {
+        std::size_t const label = graph.get_label(i);
+        if (label != 0) used_views[label - 1] = true;
+    }
+    std::vector<std::string> image_files;
+    for (std::size_t i = 0; i < texture_views->size(); ++i) {
+        if (used_views[i]) image_files.push_back(texture_views->at(i).get_image_file());
+    }
+    ImageCache::prefetch(image_files);
+
     //==============================generate patches ================================================//
     std::size_t num_patches = 0;
     std::cout << "\tRunning... " << std::flush;
@@ -142,6 +154,7 @@ generate_texture_patches(UniGraph const & graph, core::TriangleMesh::ConstPtr me
         std::vector<std::vector<std::size_t> > subgraphs;
         int const label = i + 1;
         graph.get_subgraphs(label, &subgraphs);
+        if (subgraphs.empty()) continue;
 
         // get the texture view and related image
         TextureView * texture_view = &texture_views->at(i);
@@ -208,6 +221,7 @@ generate_texture_patches(UniGraph const & graph, core::TriangleMesh::ConstPtr me
             }
         } // for each candidata
     }  // for each texture view
+    ImageCache::stop_prefetch();
 
     //  merge vertex projection information
     merge_vertex_projection_infos(vertex_projection_infos);
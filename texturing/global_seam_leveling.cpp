@@ -17,6 +17,7 @@
 
 #include "texturing.h"
 #include "seam_leveling.h"
+#include "multigrid_preconditioner.h"
 #include "progress_counter.h"
 
 TEX_NAMESPACE_BEGIN
@@ -145,7 +146,8 @@ global_seam_leveling(UniGraph const & graph,
                      core::TriangleMesh::ConstPtr mesh,
                      core::VertexInfoList::ConstPtr vertex_infos,
                      std::vector<std::vector<VertexProjectionInfo> > const & vertex_projection_infos,
-                     std::vector<TexturePatch::Ptr> * texture_patches) {
+                     std::vector<TexturePatch::Ptr> * texture_patches,
+                     Settings const & settings) {
 
     // get all the vertices
     core::TriangleMesh::VertexList const & vertices = mesh->get_vertices();
@@ -265,40 +267,68 @@ global_seam_leveling(UniGraph const & graph,
     std::cout << " done." << std::endl;
     std::cout << "\tLhs dimensionality: " << Lhs.rows() << " x " << Lhs.cols() << std::endl;
 
-    util::WallTimer timer;
-    std::cout << "\tCalculating adjustments:"<< std::endl;
-    #pragma omp parallel for
-    for (std::size_t channel = 0; channel < 3; ++channel) {
-        /* Prepare solver. */
-        Eigen::ConjugateGradient<SpMat, Eigen::Lower> cg;
-        cg.setMaxIterations(1000);
-        cg.setTolerance(0.0001);
-        cg.compute(Lhs);
-
-        /* Prepare right hand side. */
+    SpMat const At = A.transpose();
+    auto channel_rhs = [&] (std::size_t channel) -> Eigen::VectorXf {
         Eigen::VectorXf b(A_rows);
         for (std::size_t i = 0; i < coefficients_b.size(); ++i) {
             b[i] = coefficients_b[i][channel];
         }
-        Eigen::VectorXf Rhs = SpMat(A.transpose()) * b;
-
-        /* Solve for x. */
-        Eigen::VectorXf x(x_rows);
-        x = cg.solve(Rhs);
+        return At * b;
+    };
 
-        /* Subtract mean because system is underconstrained and we seek the solution with minimal adjustments. */
-        x = x.array() - x.mean();
+    Eigen::MatrixXf x(x_rows, 3);
+    util::WallTimer timer;
+    std::cout << "\tCalculating adjustments:"<< std::endl;
+    if (settings.seam_leveling_solver == MULTIGRID_CG) {
+        /* The multigrid hierarchy is built once and shared by all channels. */
+        typedef MultigridPreconditioner::Matrix RowMajorMat;
+        RowMajorMat const full_Lhs = Lhs.selfadjointView<Eigen::Lower>();
+        Eigen::ConjugateGradient<RowMajorMat, Eigen::Lower | Eigen::Upper, MultigridPreconditioner> cg;
+        cg.setMaxIterations(1000);
+        cg.setTolerance(0.0001);
+        cg.compute(full_Lhs);
+
+        std::vector<std::size_t> const level_sizes = cg.preconditioner().get_level_sizes();
+        std::cout << "\t\tMultigrid levels:";
+        for (std::size_t size : level_sizes) std::cout << " " << size;
+        std::cout << " (setup took " << timer.get_elapsed_sec() << " seconds)" << std::endl;
+
+        for (std::size_t channel = 0; channel < 3; ++channel) {
+            util::WallTimer channel_timer;
+            x.col(channel) = cg.solve(channel_rhs(channel));
+            std::cout << "\t\tColor channel " << channel << ": CG took "
+                << cg.iterations() << " iterations. Residual is " << cg.error()
+                << " (" << channel_timer.get_elapsed_sec() << " seconds)" << std::endl;
+        }
+    } else {
+        #pragma omp parallel for
+        for (std::size_t channel = 0; channel < 3; ++channel) {
+            util::WallTimer channel_timer;
+
+            /* Prepare solver. */
+            Eigen::ConjugateGradient<SpMat, Eigen::Lower> cg;
+            cg.setMaxIterations(1000);
+            cg.setTolerance(0.0001);
+            cg.compute(Lhs);
+
+            /* Solve for x. */
+            x.col(channel) = cg.solve(channel_rhs(channel));
+
+            #pragma omp critical
+            std::cout << "\t\tColor channel " << channel << ": CG took "
+                << cg.iterations() << " iterations. Residual is " << cg.error()
+                << " (" << channel_timer.get_elapsed_sec() << " seconds)" << std::endl;
+        }
+    }
 
-        #pragma omp critical
-        std::cout << "\t\tColor channel " << channel << ": CG took "
-            << cg.iterations() << " iterations. Residual is " << cg.error() << std::endl;
+    /* Subtract mean because system is underconstrained and we seek the solution with minimal adjustments. */
+    x.rowwise() -= x.colwise().mean();
 
-        #pragma omp critical
-        for (std::size_t i = 0; i < num_vertices; ++i) {
-            for (std::size_t j = 0; j < labels[i].size(); ++j) {
-                std::size_t label = labels[i][j];
-                adjust_values[i][label][channel] = x[vertlabel2row[i][label]];
-            }
+    for (std::size_t i = 0; i < num_vertices; ++i) {
+        for (std::size_t j = 0; j < labels[i].size(); ++j) {
+            std::size_t label = labels[i][j];
+            std::size_t const row = vertlabel2row[i][label];
+            adjust_values[i][label] = math::Vec3f(x(row, 0), x(row, 1), x(row, 2));
         }
     }
     std::cout << "\t\tTook " << timer.get_elapsed_sec() << " seconds" << std::endl;
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+
+#include <core/image_io.h>
+#include <util/timer.h>
+
+#include "image_cache.h"
+
+std::mutex ImageCache::mutex;
+std::map<ImageCache::Key, std::shared_ptr<ImageCache::Entry> > ImageCache::entries;
+std::atomic<std::size_t> ImageCache::memory_budget(0);
+std::atomic<std::size_t> ImageCache::access_counter(0);
+std::atomic<std::size_t> ImageCache::cached_bytes(0);
+std::atomic<std::size_t> ImageCache::peak_bytes(0);
+std::atomic<std::size_t> ImageCache::num_hits(0);
+std::atomic<std::size_t> ImageCache::num_misses(0);
+std::atomic<std::size_t> ImageCache::num_prefetches(0);
+std::atomic<std::size_t> ImageCache::num_evictions(0);
+std::atomic<std::size_t> ImageCache::decode_milliseconds(0);
+/* Defined last to be destroyed first, the thread uses the members above. */
+ImageCache::Prefetcher ImageCache::prefetcher;
+
+ImageCache::Prefetcher::~Prefetcher() {
+    cancel = true;
+    if (thread.joinable()) thread.join();
+}
+
+std::shared_ptr<ImageCache::Entry>
+ImageCache::get_entry(Key const & key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<Entry> & entry = entries[key];
+    if (entry == NULL) entry = std::make_shared<Entry>();
+    return entry;
+}
+
+void
+ImageCache::account(Entry * entry, core::ByteImage::Ptr image) {
+    entry->image = image;
+    entry->bytes = image->get_byte_size();
+
+    std::size_t const bytes = cached_bytes += entry->bytes;
+    std::size_t peak = peak_bytes;
+    while (peak < bytes && !peak_bytes.compare_exchange_weak(peak, bytes));
+}
+
+core::ByteImage::Ptr
+ImageCache::load(std::string const & image_file, bool prefetch) {
+    core::ByteImage::Ptr image;
+    if (memory_budget == 0) {
+        util::WallTimer timer;
+        image = core::image::load_file(image_file);
+        decode_milliseconds += timer.get_elapsed();
+        num_misses += 1;
+        return image;
+    }
+
+    std::shared_ptr<Entry> entry = get_entry(Key(image_file, IMAGE));
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->last_access = access_counter++;
+        if (entry->image != NULL) {
+            if (!prefetch) num_hits += 1;
+            image = entry->image;
+        } else {
+            util::WallTimer timer;
+            image = core::image::load_file(image_file);
+            decode_milliseconds += timer.get_elapsed();
+            account(entry.get(), image);
+            if (prefetch) num_prefetches += 1;
+            else num_misses += 1;
+        }
+    }
+    entry.reset();
+
+    evict(memory_budget);
+    return image;
+}
+
+core::ByteImage::Ptr
+ImageCache::load_image(std::string const & image_file) {
+    return load(image_file, false);
+}
+
+core::ByteImage::Ptr
+ImageCache::find(std::string const & image_file, Kind kind) {
+    if (memory_budget == 0) return core::ByteImage::Ptr();
+
+    core::ByteImage::Ptr image;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<Key, std::shared_ptr<Entry> >::iterator it = entries.find(Key(image_file, kind));
+        if (it != entries.end()) {
+            std::lock_guard<std::mutex> entry_lock(it->second->mutex);
+            it->second->last_access = access_counter++;
+            image = it->second->image;
+        }
+    }
+
+    if (image != NULL) num_hits += 1;
+    else num_misses += 1;
+    return image;
+}
+
+void
+ImageCache::insert(std::string const & image_file, Kind kind, core::ByteImage::Ptr image) {
+    if (memory_budget == 0) return;
+
+    std::shared_ptr<Entry> entry = get_entry(Key(image_file, kind));
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->last_access = access_counter++;
+        if (entry->image == NULL) account(entry.get(), image);
+    }
+    entry.reset();
+
+    evict(memory_budget);
+}
+
+void
+ImageCache::run_prefetch(std::vector<std::string> image_files) {
+    for (std::string const & image_file : image_files) {
+        if (prefetcher.cancel) return;
+
+        /* Errors surface when the image is used. */
+        core::ByteImage::Ptr image;
+        try {
+            image = load(image_file, true);
+        } catch (...) {
+            return;
+        }
+
+        /*
+         * Stop if another image of this size would exceed the budget,
+         * it would evict the prefetched images before they are used.
+         */
+        if (cached_bytes + image->get_byte_size() > memory_budget) return;
+    }
+}
+
+void
+ImageCache::prefetch(std::vector<std::string> const & image_files) {
+    stop_prefetch();
+    if (memory_budget == 0) return;
+    prefetcher.thread = std::thread(run_prefetch, image_files);
+}
+
+void
+ImageCache::stop_prefetch(void) {
+    prefetcher.cancel = true;
+    if (prefetcher.thread.joinable()) prefetcher.thread.join();
+    prefetcher.cancel = false;
+}
+
+void
+ImageCache::evict(std::size_t budget) {
+    if (cached_bytes <= budget) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* Entries only referenced by the cache, least recently used first. */
+    typedef std::pair<std::size_t, std::map<Key, std::shared_ptr<Entry> >::iterator> Candidate;
+    std::vector<Candidate> candidates;
+    std::map<Key, std::shared_ptr<Entry> >::iterator it;
+    for (it = entries.begin(); it != entries.end(); ++it) {
+        Entry const & entry = *it->second;
+        if (it->second.use_count() == 1 && entry.image != NULL && entry.image.use_count() == 1)
+            candidates.push_back(Candidate(entry.last_access, it));
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [] (Candidate const & a, Candidate const & b) -> bool {return a.first < b.first;});
+
+    for (std::size_t i = 0; i < candidates.size() && cached_bytes > budget; ++i) {
+        cached_bytes -= candidates[i].second->second->bytes;
+        num_evictions += 1;
+        entries.erase(candidates[i].second);
+    }
+}
+
+void
+ImageCache::cleanup(void) {
+    evict(memory_budget);
+}
+
+void
+ImageCache::set_memory_budget(std::size_t bytes) {
+    memory_budget = bytes;
+    evict(bytes);
+}
+
+std::size_t
+ImageCache::get_memory_budget(void) {
+    return memory_budget;
+}
+
+ImageCache::Statistics
+ImageCache::get_statistics(void) {
+    Statistics statistics;
+    statistics.hits = num_hits;
+    statistics.misses = num_misses;
+    statistics.prefetches = num_prefetches;
+    statistics.evictions = num_evictions;
+    statistics.bytes = cached_bytes;
+    statistics.peak_bytes = peak_bytes;
+    statistics.decode_seconds = decode_milliseconds / 1000.0;
+    return statistics;
+}
+
+void
+ImageCache::clear(void) {
+    stop_prefetch();
+    evict(0);
+}
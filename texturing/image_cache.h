@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef TEX_IMAGECACHE_HEADER
+#define TEX_IMAGECACHE_HEADER
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <core/image.h>
+
+/**
+  * Process-wide cache of the images of TextureViews and of the images derived
+  * from them, shared by all texturing stages, so that a view is decoded only
+  * once as long as it fits into the memory budget.
+  *
+  * Entries are keyed by image file and kind. Entries which are referenced
+  * outside of the cache are never evicted, unreferenced entries are kept
+  * until the budget is exceeded and then evicted least recently used first.
+  * A background thread decodes images ahead of their use (prefetch) and
+  * stops when the budget is reached. The default budget of zero retains
+  * nothing, i.e. every image is decoded on every use as without the cache.
+  */
+class ImageCache {
+    public:
+        enum Kind {
+            IMAGE = 0,
+            GRADIENT_MAGNITUDE = 1,
+            /* Stored as single channel image with values 0 and 255. */
+            VALIDITY_MASK = 2
+        };
+
+        struct Statistics {
+            std::size_t hits;
+            std::size_t misses;
+            std::size_t prefetches;
+            std::size_t evictions;
+            /* Bytes currently cached and maximum over the run. */
+            std::size_t bytes;
+            std::size_t peak_bytes;
+            /* Accumulated decoding time of all threads. */
+            double decode_seconds;
+        };
+
+    private:
+        typedef std::pair<std::string, Kind> Key;
+
+        struct Entry {
+            /* Held while the image is decoded, concurrent loads wait. */
+            std::mutex mutex;
+            core::ByteImage::Ptr image;
+            std::size_t bytes;
+            std::size_t last_access;
+
+            Entry() : bytes(0), last_access(0) {}
+        };
+
+        /* Joins the prefetch thread on destruction. */
+        struct Prefetcher {
+            std::thread thread;
+            std::atomic<bool> cancel;
+
+            Prefetcher() : cancel(false) {}
+            ~Prefetcher();
+        };
+
+        static std::mutex mutex;
+        static std::map<Key, std::shared_ptr<Entry> > entries;
+        static std::atomic<std::size_t> memory_budget;
+        static std::atomic<std::size_t> access_counter;
+        static std::atomic<std::size_t> cached_bytes;
+        static std::atomic<std::size_t> peak_bytes;
+        static std::atomic<std::size_t> num_hits;
+        static std::atomic<std::size_t> num_misses;
+        static std::atomic<std::size_t> num_prefetches;
+        static std::atomic<std::size_t> num_evictions;
+        static std::atomic<std::size_t> decode_milliseconds;
+        static Prefetcher prefetcher;
+
+        static std::shared_ptr<Entry> get_entry(Key const & key);
+        static void account(Entry * entry, core::ByteImage::Ptr image);
+        static core::ByteImage::Ptr load(std::string const & image_file, bool prefetch);
+        static void run_prefetch(std::vector<std::string> image_files);
+        static void evict(std::size_t budget);
+
+    public:
+        /** Returns the image of the file, which is decoded on a miss. */
+        static core::ByteImage::Ptr load_image(std::string const & image_file);
+
+        /** Returns the cached derived image of the given kind or null on a miss. */
+        static core::ByteImage::Ptr find(std::string const & image_file, Kind kind);
+
+        /** Caches a derived image of the given kind. */
+        static void insert(std::string const & image_file, Kind kind, core::ByteImage::Ptr image);
+
+        /**
+          * Starts decoding the images in the given order in the background
+          * until the budget is reached, replacing a previous prefetch.
+          */
+        static void prefetch(std::vector<std::string> const & image_files);
+        /** Cancels and waits for the prefetch. */
+        static void stop_prefetch(void);
+
+        /** Evicts unreferenced entries until the budget is met. */
+        static void cleanup(void);
+
+        /** Sets the memory budget in bytes. */
+        static void set_memory_budget(std::size_t bytes);
+        static std::size_t get_memory_budget(void);
+
+        static Statistics get_statistics(void);
+
+        /** Evicts all unreferenced entries. */
+        static void clear(void);
+};
+
+#endif /* TEX_IMAGECACHE_HEADER */
@@ -8,6 +8,7 @@
  */
 
 #include <fstream>
+#include <exception>
 #include <cstring>
 #include <cerrno>
 
@@ -38,7 +39,7 @@ MaterialLib::save_to_files(std::string const & prefix) const {
 
     for (std::size_t i = 0; i < materials.size(); ++i) {
         //TODO read the material parameter
-        std::string diffuse_map_postfix = "_" + material_names[i] + "_map_Kd.png";
+        std::string diffuse_map_postfix = get_diffuse_map_postfix(material_names[i]);
         out << "newmtl " << material_names[i] << std::endl
             << "Ka 1.000000 1.000000 1.000000" << std::endl
             << "Kd 1.000000 1.000000 1.000000" << std::endl
@@ -50,8 +51,21 @@ MaterialLib::save_to_files(std::string const & prefix) const {
     }
     out.close();
 
+    /*
+     * The textures are already encoded by the texture atlases and copied
+     * concurrently, exceptions must not leave the parallel region.
+     */
+    std::vector<std::exception_ptr> errors(materials.size());
+    #pragma omp parallel for schedule(dynamic)
     for (std::size_t i = 0; i < materials.size(); ++i) {
-        std::string filename = prefix + "_" + material_names[i] + "_map_Kd.png";
-        util::fs::copy_file(materials[i].diffuse_map.c_str(), filename.c_str());
+        std::string filename = prefix + get_diffuse_map_postfix(material_names[i]);
+        try {
+            util::fs::copy_file(materials[i].diffuse_map.c_str(), filename.c_str());
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+    for (std::exception_ptr const & error : errors) {
+        if (error) std::rethrow_exception(error);
     }
 }
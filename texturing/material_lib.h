@@ -10,6 +10,7 @@
 #ifndef TEX_MATERIALLIB_HEADER
 #define TEX_MATERIALLIB_HEADER
 
+#include <string>
 #include <vector>
 
 struct Material {
@@ -29,6 +30,9 @@ class MaterialLib {
         void add_material(std::string const & name, Material material);
         std::size_t size();
 
+        /** Returns the postfix of the file name of the diffuse map of the material. */
+        static std::string get_diffuse_map_postfix(std::string const & material_name);
+
         /** Saves the material lib to an .mtl file and all textures of its
           * materials with the given prefix.
           */
@@ -40,4 +44,9 @@ MaterialLib::size() {
     return materials.size();
 }
 
+inline std::string
+MaterialLib::get_diffuse_map_postfix(std::string const & material_name) {
+    return "_" + material_name + "_map_Kd.png";
+}
+
 #endif /* TEX_MATERIALLIB_HEADER */
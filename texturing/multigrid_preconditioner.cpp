@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <cmath>
+
+#include "multigrid_preconditioner.h"
+
+namespace {
+
+/**
+  * Groups the unknowns of A into aggregates of strongly connected unknowns
+  * and returns the number of aggregates.
+  */
+std::size_t
+aggregate(MultigridPreconditioner::Matrix const & A, Eigen::VectorXf const & diag,
+    std::vector<int> * aggregates) {
+    typedef MultigridPreconditioner::Matrix::InnerIterator Iterator;
+
+    int const n = static_cast<int>(A.rows());
+    auto is_strong = [&diag] (int i, int j, float value) -> bool {
+        return i != j && value != 0.0f && std::abs(value)
+            >= MULTIGRID_STRENGTH_THRESHOLD * std::sqrt(std::abs(diag[i] * diag[j]));
+    };
+
+    aggregates->assign(n, -1);
+    int num_aggregates = 0;
+
+    /* Unknowns whose strong neighbors are all free form new aggregates. */
+    for (int i = 0; i < n; ++i) {
+        if (aggregates->at(i) != -1) continue;
+
+        bool free = true;
+        bool connected = false;
+        for (Iterator it(A, i); it; ++it) {
+            if (!is_strong(i, it.col(), it.value())) continue;
+            connected = true;
+            free = free && aggregates->at(it.col()) == -1;
+        }
+        if (!free || !connected) continue;
+
+        aggregates->at(i) = num_aggregates;
+        for (Iterator it(A, i); it; ++it) {
+            if (is_strong(i, it.col(), it.value()))
+                aggregates->at(it.col()) = num_aggregates;
+        }
+        num_aggregates += 1;
+    }
+
+    /* Remaining unknowns join the aggregate of their strongest neighbor. */
+    std::vector<int> joined(*aggregates);
+    for (int i = 0; i < n; ++i) {
+        if (aggregates->at(i) != -1) continue;
+
+        float max_value = 0.0f;
+        for (Iterator it(A, i); it; ++it) {
+            if (!is_strong(i, it.col(), it.value())) continue;
+            if (aggregates->at(it.col()) == -1) continue;
+            if (std::abs(it.value()) > max_value) {
+                max_value = std::abs(it.value());
+                joined[i] = aggregates->at(it.col());
+            }
+        }
+    }
+    aggregates->swap(joined);
+
+    /* Unknowns without aggregated strong neighbors stay alone. */
+    for (int i = 0; i < n; ++i) {
+        if (aggregates->at(i) == -1)
+            aggregates->at(i) = num_aggregates++;
+    }
+
+    return num_aggregates;
+}
+
+/**
+  * Applies damped Jacobi sweeps to A x = b starting from zero. Sweeps
+  * starting from zero are a symmetric operator on b.
+  */
+MultigridPreconditioner::Vector
+jacobi(MultigridPreconditioner::Matrix const & A, MultigridPreconditioner::Vector const & inv_diag,
+    MultigridPreconditioner::Vector const & b, int sweeps) {
+    float const weight = MULTIGRID_JACOBI_WEIGHT;
+    MultigridPreconditioner::Vector x = weight * inv_diag.cwiseProduct(b);
+    MultigridPreconditioner::Vector r(b.size());
+    for (int i = 1; i < sweeps; ++i) {
+        r.noalias() = b - A * x;
+        x += weight * inv_diag.cwiseProduct(r);
+    }
+    return x;
+}
+
+}
+
+void
+MultigridPreconditioner::build_hierarchy(Matrix const & A) {
+    levels.clear();
+    levels.push_back(Level());
+    levels.back().A = A;
+
+    while (true) {
+        Level & level = levels.back();
+        std::size_t const n = level.A.rows();
+
+        Vector diag = level.A.diagonal();
+        level.inv_diag.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+            level.inv_diag[i] = diag[i] > 0.0f ? 1.0f / diag[i] : 0.0f;
+
+        if (n <= MULTIGRID_COARSEST_SIZE || levels.size() == MULTIGRID_MAX_LEVELS) break;
+
+        std::vector<int> aggregates;
+        std::size_t const num_aggregates = aggregate(level.A, diag, &aggregates);
+        /* Levels which barely shrink cost a level without helping convergence. */
+        if (num_aggregates * MULTIGRID_MIN_COARSENING_RATIO > n) break;
+
+        std::vector<Eigen::Triplet<float, int> > coefficients(n);
+        for (std::size_t i = 0; i < n; ++i)
+            coefficients[i] = Eigen::Triplet<float, int>(i, aggregates[i], 1.0f);
+        level.P.resize(n, num_aggregates);
+        level.P.setFromTriplets(coefficients.begin(), coefficients.end());
+        level.R = level.P.transpose();
+
+        Matrix coarse_A = level.R * level.A * level.P;
+        coarse_A.prune(0.0f);
+
+        levels.push_back(Level());
+        levels.back().A.swap(coarse_A);
+    }
+
+    /* Densifying a large coarsest level would take quadratic memory. */
+    direct_coarsest = levels.back().A.rows() <= MULTIGRID_COARSEST_SIZE;
+    if (direct_coarsest) {
+        coarsest_solver.compute(Eigen::MatrixXf(levels.back().A));
+        status = coarsest_solver.info();
+    } else {
+        status = Eigen::Success;
+    }
+}
+
+MultigridPreconditioner::Vector
+MultigridPreconditioner::cycle(std::size_t l, Vector const & b) const {
+    Level const & level = levels[l];
+    if (l + 1 == levels.size() && !direct_coarsest)
+        return jacobi(level.A, level.inv_diag, b, MULTIGRID_COARSEST_SWEEPS);
+
+    if (l + 1 == levels.size()) {
+        /*
+         * Pseudo inverse: unknowns of the null space, whose pivots vanish up
+         * to rounding errors, are set to zero instead of being amplified.
+         */
+        Vector const & d = coarsest_solver.vectorD();
+        float const tolerance = 1e-4f * d.cwiseAbs().maxCoeff();
+        Vector x = coarsest_solver.transpositionsP() * b;
+        coarsest_solver.matrixL().solveInPlace(x);
+        for (int i = 0; i < x.size(); ++i)
+            x[i] = std::abs(d[i]) > tolerance ? x[i] / d[i] : 0.0f;
+        coarsest_solver.matrixU().solveInPlace(x);
+        return coarsest_solver.transpositionsP().transpose() * x;
+    }
+
+    float const weight = MULTIGRID_JACOBI_WEIGHT;
+    Vector x = jacobi(level.A, level.inv_diag, b, MULTIGRID_SMOOTHING_SWEEPS);
+    Vector r(b.size());
+
+    r.noalias() = b - level.A * x;
+    Vector coarse_b = level.R * r;
+    x.noalias() += level.P * cycle(l + 1, coarse_b);
+
+    for (int i = 0; i < MULTIGRID_SMOOTHING_SWEEPS; ++i) {
+        r.noalias() = b - level.A * x;
+        x += weight * level.inv_diag.cwiseProduct(r);
+    }
+
+    return x;
+}
+
+std::vector<std::size_t>
+MultigridPreconditioner::get_level_sizes(void) const {
+    std::vector<std::size_t> sizes;
+    for (Level const & level : levels)
+        sizes.push_back(level.A.rows());
+    return sizes;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef TEX_MULTIGRIDPRECONDITIONER_HEADER
+#define TEX_MULTIGRIDPRECONDITIONER_HEADER
+
+#include <vector>
+
+#include <Eigen/SparseCore>
+#include <Eigen/Dense>
+
+/* Levels with at most this many unknowns are solved directly. */
+#define MULTIGRID_COARSEST_SIZE 1024
+#define MULTIGRID_MAX_LEVELS 20
+/* Minimal ratio of the unknowns of a level to the unknowns of the next coarser one. */
+#define MULTIGRID_MIN_COARSENING_RATIO 1.5f
+/* Relative magnitude of an off-diagonal entry to be a strong connection. */
+#define MULTIGRID_STRENGTH_THRESHOLD 0.08f
+/* Weight and number of the damped Jacobi smoothing sweeps. */
+#define MULTIGRID_JACOBI_WEIGHT 0.6667f
+#define MULTIGRID_SMOOTHING_SWEEPS 2
+/* Number of Jacobi sweeps on a coarsest level too large to be solved directly. */
+#define MULTIGRID_COARSEST_SWEEPS 8
+
+/**
+  * Algebraic multigrid preconditioner for symmetric positive (semi-)definite
+  * sparse matrices with the interface of Eigen's preconditioners, e.g. for
+  * Eigen::ConjugateGradient<Matrix, Eigen::Lower | Eigen::Upper, MultigridPreconditioner>.
+  *
+  * The hierarchy is built by plain aggregation: unknowns are grouped with their
+  * strongly connected neighbors and every aggregate becomes one unknown of the
+  * next coarser level, whose matrix is the Galerkin product P^T A P with the
+  * piecewise constant prolongation P. solve applies one V-cycle with damped
+  * Jacobi smoothing, which is symmetric and can be applied concurrently.
+  * Coarsening stops when a level shrinks by less than
+  * MULTIGRID_MIN_COARSENING_RATIO. The coarsest level is solved by a dense
+  * LDLT which tolerates the constant null space of Laplacian-like matrices,
+  * or, if it is larger than MULTIGRID_COARSEST_SIZE, only smoothed.
+  */
+class MultigridPreconditioner {
+    public:
+        typedef float Scalar;
+        typedef Eigen::SparseMatrix<float, Eigen::RowMajor> Matrix;
+        typedef Eigen::VectorXf Vector;
+
+    private:
+        struct Level {
+            Matrix A;
+            Vector inv_diag;
+            /* Prolongation to this level from the next coarser one and its transpose. */
+            Matrix P;
+            Matrix R;
+        };
+
+        std::vector<Level> levels;
+        /* Whether the coarsest level is solved by coarsest_solver or smoothed. */
+        bool direct_coarsest;
+        Eigen::LDLT<Eigen::MatrixXf> coarsest_solver;
+        Eigen::ComputationInfo status;
+
+        void build_hierarchy(Matrix const & A);
+        Vector cycle(std::size_t level, Vector const & b) const;
+
+    public:
+        MultigridPreconditioner(void);
+
+        template <typename MatType>
+        MultigridPreconditioner & analyzePattern(MatType const &);
+
+        template <typename MatType>
+        MultigridPreconditioner & factorize(MatType const & mat);
+
+        template <typename MatType>
+        MultigridPreconditioner & compute(MatType const & mat);
+
+        /** Applies one V-cycle to b. */
+        template <typename Rhs>
+        Vector solve(Eigen::MatrixBase<Rhs> const & b) const;
+
+        Eigen::ComputationInfo info(void) const;
+
+        /** Returns the number of unknowns of each level, finest first. */
+        std::vector<std::size_t> get_level_sizes(void) const;
+};
+
+inline
+MultigridPreconditioner::MultigridPreconditioner(void)
+    : direct_coarsest(false), status(Eigen::Success) {}
+
+template <typename MatType> inline MultigridPreconditioner &
+MultigridPreconditioner::analyzePattern(MatType const &) {
+    return *this;
+}
+
+template <typename MatType> inline MultigridPreconditioner &
+MultigridPreconditioner::factorize(MatType const & mat) {
+    build_hierarchy(Matrix(mat));
+    return *this;
+}
+
+template <typename MatType> inline MultigridPreconditioner &
+MultigridPreconditioner::compute(MatType const & mat) {
+    return factorize(mat);
+}
+
+template <typename Rhs> inline MultigridPreconditioner::Vector
+MultigridPreconditioner::solve(Eigen::MatrixBase<Rhs> const & b) const {
+    return cycle(0, b);
+}
+
+inline Eigen::ComputationInfo
+MultigridPreconditioner::info(void) const {
+    return status;
+}
+
+#endif /* TEX_MULTIGRIDPRECONDITIONER_HEADER */
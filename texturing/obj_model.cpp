@@ -7,10 +7,16 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
-#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstdint>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <cstring>
 #include <cerrno>
+#include <algorithm>
 
 #include <core/mesh.h>
 #include <util/exception.h>
@@ -19,6 +25,139 @@
 #include "obj_model.h"
 
 #define OBJ_INDEX_OFFSET 1
+/* Number of elements formatted as one block and blocks formatted concurrently. */
+#define OBJ_CHUNK_SIZE (64 * 1024)
+#define OBJ_CHUNKS_PER_BATCH 64
+
+#define GLB_MAGIC 0x46546C67u
+#define GLB_VERSION 2u
+#define GLB_CHUNK_JSON 0x4E4F534Au
+#define GLB_CHUNK_BIN 0x004E4942u
+
+namespace {
+
+/**
+  * Appends the value with six decimals as std::fixed with std::setprecision(6).
+  * The scaled value is exact in double precision, so rounding half to even
+  * reproduces the correctly rounded decimal; huge and non-finite values
+  * fall back to snprintf.
+  */
+void
+append_float(float value, std::string * buffer) {
+    double const scaled = std::abs(static_cast<double>(value)) * 1e6;
+    if (!(scaled < 9e18)) {
+        char tmp[64];
+        int const length = std::snprintf(tmp, sizeof(tmp), "%f", value);
+        buffer->append(tmp, length);
+        return;
+    }
+
+    std::uint64_t digits = static_cast<std::uint64_t>(std::nearbyint(scaled));
+    char tmp[32];
+    char * end = tmp + sizeof(tmp);
+    char * begin = end;
+    for (int i = 0; i < 6; ++i, digits /= 10) *--begin = '0' + digits % 10;
+    *--begin = '.';
+    do {
+        *--begin = '0' + digits % 10;
+        digits /= 10;
+    } while (digits != 0);
+    if (std::signbit(value)) *--begin = '-';
+    buffer->append(begin, end);
+}
+
+void
+append_uint(std::size_t value, std::string * buffer) {
+    char tmp[32];
+    char * end = tmp + sizeof(tmp);
+    char * begin = end;
+    do {
+        *--begin = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    buffer->append(begin, end);
+}
+
+/** Appends the data to the binary buffer, aligned to four bytes, and returns its offset. */
+std::size_t
+append_binary(void const * data, std::size_t bytes, std::vector<char> * buffer) {
+    std::size_t const offset = buffer->size();
+    buffer->resize(offset + ((bytes + 3) & ~std::size_t(3)), 0);
+    std::memcpy(buffer->data() + offset, data, bytes);
+    return offset;
+}
+
+void
+write_uint32(std::uint32_t value, std::ofstream * out) {
+    /* glTF is little endian. */
+    unsigned char const bytes[4] = {
+        static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8),
+        static_cast<unsigned char>(value >> 16), static_cast<unsigned char>(value >> 24)
+    };
+    out->write(reinterpret_cast<char const *>(bytes), 4);
+}
+
+std::string
+json_escape(std::string const & str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+/** Corner of a face, i.e. a unique combination of vertex, texture coordinate and normal. */
+struct Corner {
+    std::size_t vertex_id;
+    std::size_t texcoord_id;
+    std::size_t normal_id;
+
+    bool operator==(Corner const & other) const {
+        return vertex_id == other.vertex_id && texcoord_id == other.texcoord_id
+            && normal_id == other.normal_id;
+    }
+};
+
+struct CornerHash {
+    std::size_t operator()(Corner const & corner) const {
+        std::size_t h = corner.vertex_id;
+        h = h * 0x9E3779B97F4A7C15ULL + corner.texcoord_id;
+        h = h * 0x9E3779B97F4A7C15ULL + corner.normal_id;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        return h ^ (h >> 33);
+    }
+};
+
+/**
+  * Formats the elements [0, num) with format(begin, end, buffer) in chunks,
+  * which are formatted concurrently and written in order.
+  */
+template <typename Func> void
+write_chunked(std::size_t num, Func const & format, std::ofstream * out) {
+    std::size_t const num_chunks = (num + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE;
+    std::vector<std::string> buffers(std::min<std::size_t>(num_chunks, OBJ_CHUNKS_PER_BATCH));
+
+    for (std::size_t batch = 0; batch < num_chunks; batch += OBJ_CHUNKS_PER_BATCH) {
+        std::size_t const batch_end = std::min<std::size_t>(num_chunks, batch + OBJ_CHUNKS_PER_BATCH);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t chunk = batch; chunk < batch_end; ++chunk) {
+            std::string & buffer = buffers[chunk - batch];
+            buffer.clear();
+            format(chunk * OBJ_CHUNK_SIZE,
+                std::min<std::size_t>(num, (chunk + 1) * OBJ_CHUNK_SIZE), &buffer);
+        }
+
+        for (std::size_t chunk = batch; chunk < batch_end; ++chunk) {
+            std::string const & buffer = buffers[chunk - batch];
+            out->write(buffer.data(), buffer.size());
+        }
+    }
+}
+
+}
 
 ObjModel::ObjModel() {}
 
@@ -32,42 +171,217 @@ ObjModel::save_to_files(std::string const & prefix) const {
     material_lib.save_to_files(prefix);
 
     std::string name = util::fs::basename(prefix);
-    std::ofstream out((prefix + ".obj").c_str());
+    std::ofstream out((prefix + ".obj").c_str(), std::ios::binary);
     if (!out.good())
         throw util::FileException(prefix + ".obj", std::strerror(errno));
 
     out << "mtllib " << name << ".mtl" << std::endl;
 
-    out << std::fixed << std::setprecision(6);
-    for (std::size_t i = 0; i < vertices.size(); ++i) {
-        out << "v " << vertices[i][0] << " "
-            << vertices[i][1] << " "
-            << vertices[i][2] << std::endl;
-    }
+    write_chunked(vertices.size(), [this] (std::size_t begin, std::size_t end,
+        std::string * buffer) {
+        for (std::size_t i = begin; i < end; ++i) {
+            buffer->append("v ");
+            append_float(vertices[i][0], buffer);
+            buffer->push_back(' ');
+            append_float(vertices[i][1], buffer);
+            buffer->push_back(' ');
+            append_float(vertices[i][2], buffer);
+            buffer->push_back('\n');
+        }
+    }, &out);
 
-    for (std::size_t i = 0; i < texcoords.size(); ++i) {
-        out << "vt " << texcoords[i][0] << " "
-            << 1.0f - texcoords[i][1] << std::endl;
-    }
+    write_chunked(texcoords.size(), [this] (std::size_t begin, std::size_t end,
+        std::string * buffer) {
+        for (std::size_t i = begin; i < end; ++i) {
+            buffer->append("vt ");
+            append_float(texcoords[i][0], buffer);
+            buffer->push_back(' ');
+            append_float(1.0f - texcoords[i][1], buffer);
+            buffer->push_back('\n');
+        }
+    }, &out);
+
+    write_chunked(normals.size(), [this] (std::size_t begin, std::size_t end,
+        std::string * buffer) {
+        for (std::size_t i = begin; i < end; ++i) {
+            buffer->append("vn ");
+            append_float(normals[i][0], buffer);
+            buffer->push_back(' ');
+            append_float(normals[i][1], buffer);
+            buffer->push_back(' ');
+            append_float(normals[i][2], buffer);
+            buffer->push_back('\n');
+        }
+    }, &out);
 
-    for (std::size_t i = 0; i < normals.size(); ++i) {
-        out << "vn " << normals[i][0] << " "
-            << normals[i][1] << " "
-            << normals[i][2] << std::endl;
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        out << "usemtl " << groups[i].material_name << '\n';
+        std::vector<Face> const & faces = groups[i].faces;
+        write_chunked(faces.size(), [&faces] (std::size_t begin, std::size_t end,
+            std::string * buffer) {
+            for (std::size_t j = begin; j < end; ++j) {
+                Face const & face = faces[j];
+                buffer->push_back('f');
+                for (std::size_t k = 0; k < 3; ++k) {
+                    buffer->push_back(' ');
+                    append_uint(face.vertex_ids[k] + OBJ_INDEX_OFFSET, buffer);
+                    buffer->push_back('/');
+                    append_uint(face.texcoord_ids[k] + OBJ_INDEX_OFFSET, buffer);
+                    buffer->push_back('/');
+                    append_uint(face.normal_ids[k] + OBJ_INDEX_OFFSET, buffer);
+                }
+                buffer->push_back('\n');
+            }
+        }, &out);
     }
+    out.close();
+    if (out.fail())
+        throw util::FileException(prefix + ".obj", std::strerror(errno));
+}
+
+void
+ObjModel::save_to_glb_file(std::string const & prefix) const {
+    std::string const name = util::fs::basename(prefix);
+    bool const has_normals = !normals.empty();
 
+    std::vector<char> bin;
+    std::ostringstream buffer_views;
+    std::ostringstream accessors;
+    std::ostringstream primitives;
+    std::ostringstream materials;
+    std::ostringstream textures;
+    std::ostringstream images;
+    std::size_t num_views = 0;
+    std::size_t num_primitives = 0;
+
+    auto add_view = [&] (void const * data, std::size_t bytes, int target) -> std::size_t {
+        std::size_t const offset = append_binary(data, bytes, &bin);
+        buffer_views << (num_views ? "," : "") << "{\"buffer\":0,\"byteOffset\":"
+            << offset << ",\"byteLength\":" << bytes << ",\"target\":" << target << "}";
+        return num_views++;
+    };
+
+    accessors << std::setprecision(9);
     for (std::size_t i = 0; i < groups.size(); ++i) {
-        out << "usemtl " << groups[i].material_name << std::endl;
-        for (std::size_t j = 0; j < groups[i].faces.size(); ++j) {
-            Face const & face =  groups[i].faces[j];
-            out << "f";
-            for (std::size_t k = 0; k < 3; ++k) {
-                out << " " << face.vertex_ids[k]  + OBJ_INDEX_OFFSET
-                    << "/" << face.texcoord_ids[k]  + OBJ_INDEX_OFFSET
-                    << "/" << face.normal_ids[k]  + OBJ_INDEX_OFFSET;
+        std::vector<Face> const & faces = groups[i].faces;
+        if (faces.empty()) continue;
+
+        /*
+         * glTF indexes all attributes with one index per corner, corners are
+         * deduplicated with an open addressing hash table which is at most half full.
+         */
+        std::size_t capacity = 16;
+        while (capacity < 6 * faces.size()) capacity *= 2;
+        std::vector<std::uint32_t> table(capacity, std::numeric_limits<std::uint32_t>::max());
+        std::vector<Corner> corners;
+        std::vector<float> positions;
+        std::vector<float> corner_normals;
+        std::vector<float> uvs;
+        std::vector<std::uint32_t> indices(3 * faces.size());
+        math::Vec3f min(std::numeric_limits<float>::max());
+        math::Vec3f max(std::numeric_limits<float>::lowest());
+        for (std::size_t j = 0; j < faces.size(); ++j) {
+            for (int k = 0; k < 3; ++k) {
+                Corner corner = {faces[j].vertex_ids[k], faces[j].texcoord_ids[k],
+                    faces[j].normal_ids[k]};
+                std::size_t slot = CornerHash()(corner) & (capacity - 1);
+                while (table[slot] != std::numeric_limits<std::uint32_t>::max()
+                    && !(corners[table[slot]] == corner)) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                if (table[slot] != std::numeric_limits<std::uint32_t>::max()) {
+                    indices[3 * j + k] = table[slot];
+                    continue;
+                }
+
+                table[slot] = indices[3 * j + k] = corners.size();
+                corners.push_back(corner);
+
+                math::Vec3f const & vertex = vertices[corner.vertex_id];
+                positions.insert(positions.end(), vertex.begin(), vertex.end());
+                for (int d = 0; d < 3; ++d) {
+                    min[d] = std::min(min[d], vertex[d]);
+                    max[d] = std::max(max[d], vertex[d]);
+                }
+                if (has_normals) {
+                    math::Vec3f const & normal = normals[corner.normal_id];
+                    corner_normals.insert(corner_normals.end(), normal.begin(), normal.end());
+                }
+                /* Unlike obj, glTF has the origin of texture coordinates at the top. */
+                uvs.push_back(texcoords[corner.texcoord_id][0]);
+                uvs.push_back(texcoords[corner.texcoord_id][1]);
             }
-            out << std::endl;
         }
+
+        std::size_t const num_corners = corners.size();
+        std::size_t const accessor = 4 * num_primitives;
+        std::size_t const position_view = add_view(positions.data(),
+            positions.size() * sizeof(float), 34962);
+        std::size_t const normal_view = has_normals ? add_view(corner_normals.data(),
+            corner_normals.size() * sizeof(float), 34962) : 0;
+        std::size_t const uv_view = add_view(uvs.data(), uvs.size() * sizeof(float), 34962);
+        std::size_t const index_view = add_view(indices.data(),
+            indices.size() * sizeof(std::uint32_t), 34963);
+
+        /* Accessors of primitives without normals keep their slot to simplify the numbering. */
+        accessors << (num_primitives ? "," : "")
+            << "{\"bufferView\":" << position_view << ",\"componentType\":5126,\"count\":"
+            << num_corners << ",\"type\":\"VEC3\",\"min\":[" << min[0] << "," << min[1]
+            << "," << min[2] << "],\"max\":[" << max[0] << "," << max[1] << "," << max[2] << "]},"
+            << "{\"bufferView\":" << (has_normals ? normal_view : position_view)
+            << ",\"componentType\":5126,\"count\":" << num_corners << ",\"type\":\"VEC3\"},"
+            << "{\"bufferView\":" << uv_view << ",\"componentType\":5126,\"count\":"
+            << num_corners << ",\"type\":\"VEC2\"},"
+            << "{\"bufferView\":" << index_view << ",\"componentType\":5125,\"count\":"
+            << indices.size() << ",\"type\":\"SCALAR\"}";
+
+        primitives << (num_primitives ? "," : "") << "{\"attributes\":{\"POSITION\":" << accessor;
+        if (has_normals) primitives << ",\"NORMAL\":" << accessor + 1;
+        primitives << ",\"TEXCOORD_0\":" << accessor + 2 << "},\"indices\":" << accessor + 3
+            << ",\"material\":" << num_primitives << "}";
+
+        materials << (num_primitives ? "," : "") << "{\"name\":\"" << json_escape(groups[i].material_name)
+            << "\",\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":" << num_primitives
+            << "},\"metallicFactor\":0.0,\"roughnessFactor\":1.0}}";
+        textures << (num_primitives ? "," : "") << "{\"source\":" << num_primitives << "}";
+        images << (num_primitives ? "," : "") << "{\"uri\":\"" << json_escape(name
+            + MaterialLib::get_diffuse_map_postfix(groups[i].material_name)) << "\"}";
+
+        num_primitives += 1;
     }
+
+    /* glTF requires at least one primitive per mesh. */
+    if (num_primitives == 0)
+        throw util::Exception("Model has no faces, cannot write an empty glb file");
+
+    std::ostringstream json;
+    json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+        << "\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[" << primitives.str() << "]}],"
+        << "\"materials\":[" << materials.str() << "],\"textures\":[" << textures.str() << "],"
+        << "\"images\":[" << images.str() << "],\"buffers\":[{\"byteLength\":" << bin.size() << "}],"
+        << "\"bufferViews\":[" << buffer_views.str() << "],\"accessors\":[" << accessors.str() << "]}";
+    std::string json_chunk = json.str();
+    json_chunk.resize((json_chunk.size() + 3) & ~std::size_t(3), ' ');
+
+    std::size_t const length = 12 + 8 + json_chunk.size() + 8 + bin.size();
+    if (length > std::numeric_limits<std::uint32_t>::max())
+        throw util::Exception("Model exceeds the maximal size of a glb file");
+
+    std::string const filename = prefix + ".glb";
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    write_uint32(GLB_MAGIC, &out);
+    write_uint32(GLB_VERSION, &out);
+    write_uint32(length, &out);
+    write_uint32(json_chunk.size(), &out);
+    write_uint32(GLB_CHUNK_JSON, &out);
+    out.write(json_chunk.data(), json_chunk.size());
+    write_uint32(bin.size(), &out);
+    write_uint32(GLB_CHUNK_BIN, &out);
+    out.write(bin.data(), bin.size());
     out.close();
+    if (out.fail())
+        throw util::FileException(filename, std::strerror(errno));
 }
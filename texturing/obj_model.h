@@ -43,6 +43,12 @@ private:
 public:
     /** Saves the obj model to an .obj file, its material lib and the materials with the given prefix. */
     void save_to_files(std::string const & prefix) const;
+    /**
+      * Saves the model as binary glTF (.glb) with the given prefix, which
+      * references the textures written by save_to_files.
+      * @throws util::Exception if the model has no faces.
+      */
+    void save_to_glb_file(std::string const & prefix) const;
     ObjModel();
 
     MaterialLib & get_material_lib(void);
@@ -7,19 +7,16 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <cmath>
+#include <cassert>
+#include <algorithm>
 #include <cstdint>
-#include <iostream>
+#include <vector>
 
 #include <math/vector.h>
-#include <Eigen/SparseCore>
-#include <Eigen/SparseLU>
-#include <core/image_io.h>
-#include <core/image_tools.h>
 
 #include "poisson_blending.h"
 
-typedef Eigen::SparseMatrix<float> SpMat;
-
 math::Vec3f simple_laplacian(int i, core::FloatImage::ConstPtr img){
     const int width = img->width();
     assert(i > width + 1 && i < img->get_pixel_amount() - width -1);
@@ -48,98 +45,235 @@ bool valid_mask(core::ByteImage::ConstPtr mask){
     return true;
 }
 
-void
-poisson_blend(core::FloatImage::ConstPtr src, core::ByteImage::ConstPtr mask,
-    core::FloatImage::Ptr dest, float alpha) {
+namespace {
+
+/**
+  * Masked grid of one multigrid level with three interleaved channels.
+  * The operator is a symmetric positive definite 5-point stencil given by
+  * the diagonal and the couplings of each cell to its right and lower
+  * neighbor, which vanish for cells that are no unknowns. Unknowns are
+  * never at the border of the grid and are split into red and black
+  * cells, whose stencils only contain cells of the other color.
+  */
+struct Level {
+    int width;
+    int height;
+    std::vector<int> unknowns[2];
+    std::vector<float> diag;
+    std::vector<float> right;
+    std::vector<float> down;
+    /* Solution of the coarse levels, the finest level is solved in dest. */
+    std::vector<float> x;
+    std::vector<float> b;
+
+    Level(int width, int height);
+
+    std::size_t num_unknowns(void) const {
+        return unknowns[0].size() + unknowns[1].size();
+    }
 
-    assert(src->width() == mask->width() && mask->width() == dest->width());
-    assert(src->height() == mask->height() && mask->height() == dest->height());
-    assert(src->channels() == 3 && dest->channels() == 3);
-    assert(mask->channels() == 1);
-    assert(valid_mask(mask));
+    /* Returns the stencil of cell i without its diagonal applied to x. */
+    float neighbor_sum(float const * x, int i, int c) const {
+        return right[i - 1] * x[3 * (i - 1) + c] + right[i] * x[3 * (i + 1) + c]
+            + down[i - width] * x[3 * (i - width) + c] + down[i] * x[3 * (i + width) + c];
+    }
+};
 
-    // number of pixels
-    const int n = dest->get_pixel_amount();
-    // number of image width
-    const int width = dest->width();
-    // number of image height
-    const int height = dest->height();
-    // number of channels
-    const int channels = dest->channels();
-
-    core::Image<int>::Ptr indices = core::Image<int>::create(width, height, 1);
-    indices->fill(-1);
-    int index = 0;
-    for (int i = 0; i < n; ++i) {
-        if (mask->at(i) != 0) {
-            indices->at(i) = index;
-            index++;
+Level::Level(int width, int height)
+    : width(width), height(height), diag(width * height, 0.0f),
+    right(width * height, 0.0f), down(width * height, 0.0f),
+    b(3 * width * height, 0.0f) {}
+
+/** Returns the cell of the next coarser level containing the cell i. */
+inline int
+parent(Level const & fine, Level const & coarse, int i) {
+    return ((i / fine.width + 1) / 2) * coarse.width + (i % fine.width + 1) / 2;
+}
+
+/**
+  * Creates the level of 2x2 cells containing every cell with an unknown.
+  * The operator is the Galerkin product P^T A P with the piecewise
+  * constant prolongation P, which keeps the boundary conditions exact.
+  */
+Level
+coarsen(Level const & fine) {
+    Level coarse((fine.width - 1) / 2 + 2, (fine.height - 1) / 2 + 2);
+    std::vector<std::uint8_t> is_unknown(coarse.width * coarse.height, 0);
+    for (int color = 0; color < 2; ++color) {
+        for (int i : fine.unknowns[color]) {
+            int const p = parent(fine, coarse, i);
+            if (!is_unknown[p]) {
+                int const x = p % coarse.width;
+                int const y = p / coarse.width;
+                coarse.unknowns[(x + y) % 2].push_back(p);
+                is_unknown[p] = 1;
+            }
+            coarse.diag[p] += fine.diag[i];
+
+            int const pr = parent(fine, coarse, i + 1);
+            if (pr == p) coarse.diag[p] -= 2.0f * fine.right[i];
+            else coarse.right[p] += fine.right[i];
+
+            int const pd = parent(fine, coarse, i + fine.width);
+            if (pd == p) coarse.diag[p] -= 2.0f * fine.down[i];
+            else coarse.down[p] += fine.down[i];
         }
     }
-    const int nnz = index;
+    coarse.x.resize(3 * coarse.width * coarse.height, 0.0f);
+    return coarse;
+}
 
-    std::vector<math::Vec3f> coefficients_b;
-    coefficients_b.resize(nnz);
+void
+smooth(Level const & level, float * x, int sweeps) {
+    for (int sweep = 0; sweep < sweeps; ++sweep) {
+        for (int color = 0; color < 2; ++color) {
+            for (int i : level.unknowns[color]) {
+                for (int c = 0; c < 3; ++c) {
+                    x[3 * i + c] = (level.b[3 * i + c]
+                        + level.neighbor_sum(x, i, c)) / level.diag[i];
+                }
+            }
+        }
+    }
+}
 
-    std::vector<Eigen::Triplet<float, int> > coefficients_A;
-    coefficients_A.reserve(nnz); //TODO better estimate...
+/** Calls func(index, channel, residual) for every unknown and channel. */
+template <typename Func> inline void
+for_each_residual(Level const & level, float const * x, Func const & func) {
+    for (int color = 0; color < 2; ++color) {
+        for (int i : level.unknowns[color]) {
+            for (int c = 0; c < 3; ++c) {
+                func(i, c, level.b[3 * i + c] + level.neighbor_sum(x, i, c)
+                    - level.diag[i] * x[3 * i + c]);
+            }
+        }
+    }
+}
 
-    for (int i = 0; i < n; ++i) {
-        const int row = indices->at(i);
-        if (mask->at(i) == 126 || mask->at(i) == 128) {
-            Eigen::Triplet<float, int> t(row, row, 1.0f);
-            coefficients_A.push_back(t);
+double
+residual_norm(Level const & level, float const * x) {
+    double norm = 0.0;
+    for_each_residual(level, x, [&norm] (int, int, float r) {
+        norm += static_cast<double>(r) * r;
+    });
+    return std::sqrt(norm);
+}
 
-            coefficients_b[row] = math::Vec3f(&dest->at(i, 0));
-        }
+/**
+  * Applies one V-cycle to the level. The coarse levels solve for the
+  * correction with homogeneous boundary conditions.
+  */
+void
+cycle(std::vector<Level> * levels, std::size_t l, float * x) {
+    Level const & level = levels->at(l);
+    if (l + 1 == levels->size()) {
+        smooth(level, x, POISSON_COARSEST_SWEEPS);
+        return;
+    }
 
-        if (mask->at(i) == 255) {
-            const int i01 = indices->at(i - width);
-            const int i10 = indices->at(i - 1);
-            const int i11 = indices->at(i);
-            const int i12 = indices->at(i + 1);
-            const int i21 = indices->at(i + width);
+    smooth(level, x, POISSON_SMOOTHING_SWEEPS);
+
+    Level & coarse = levels->at(l + 1);
+    std::fill(coarse.b.begin(), coarse.b.end(), 0.0f);
+    std::fill(coarse.x.begin(), coarse.x.end(), 0.0f);
+    for_each_residual(level, x, [&] (int i, int c, float r) {
+        coarse.b[3 * parent(level, coarse, i) + c] += r;
+    });
+
+    cycle(levels, l + 1, coarse.x.data());
+
+    /*
+     * The piecewise constant correction e = P e_c underestimates smooth
+     * errors and is scaled to minimize the energy along it, the scalar
+     * products e^T r = e_c^T P^T r and e^T A e = e_c^T A_c e_c are
+     * evaluated on the coarse level.
+     */
+    double er[3] = {0.0, 0.0, 0.0};
+    double eAe[3] = {0.0, 0.0, 0.0};
+    for (int color = 0; color < 2; ++color) {
+        for (int i : coarse.unknowns[color]) {
+            for (int c = 0; c < 3; ++c) {
+                float const e = coarse.x[3 * i + c];
+                er[c] += e * coarse.b[3 * i + c];
+                eAe[c] += e * (coarse.diag[i] * e - coarse.neighbor_sum(coarse.x.data(), i, c));
+            }
+        }
+    }
+    float step[3];
+    for (int c = 0; c < 3; ++c)
+        step[c] = eAe[c] > 0.0 ? static_cast<float>(er[c] / eAe[c]) : 0.0f;
+
+    for (int color = 0; color < 2; ++color) {
+        for (int i : level.unknowns[color]) {
+            int const p = parent(level, coarse, i);
+            for (int c = 0; c < 3; ++c)
+                x[3 * i + c] += step[c] * coarse.x[3 * p + c];
+        }
+    }
 
-            /* All neighbours should be eighter border conditions or part of the optimization. */
-            assert(i01 != -1 && i10 != -1 && i11 != -1 && i12 != -1 && i21 != -1);
+    smooth(level, x, POISSON_SMOOTHING_SWEEPS);
+}
 
-            Eigen::Triplet<float, int> t01(row, i01, 1.0f);
+}
 
-            Eigen::Triplet<float, int> t10(row, i10, 1.0f);
-            Eigen::Triplet<float, int> t11(row, i11, -4.0f);
-            Eigen::Triplet<float, int> t12(row, i12, 1.0f);
+void
+poisson_blend(core::FloatImage::ConstPtr src, core::ByteImage::ConstPtr mask,
+    core::FloatImage::Ptr dest, float alpha) {
 
-            Eigen::Triplet<float, int> t21(row, i21, 1.0f);
+    assert(src->width() == mask->width() && mask->width() == dest->width());
+    assert(src->height() == mask->height() && mask->height() == dest->height());
+    assert(src->channels() == 3 && dest->channels() == 3);
+    assert(mask->channels() == 1);
+    assert(valid_mask(mask));
 
-            Eigen::Triplet<float, int> triplets[] = {t01, t10, t11, t12, t21};
+    const int width = dest->width();
+    const int height = dest->height();
 
-            coefficients_A.insert(coefficients_A.end(), triplets, triplets + 5);
+    std::vector<Level> levels;
+    levels.push_back(Level(width, height));
+    Level & finest = levels.back();
+    for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+            const int i = y * width + x;
+            if (mask->at(i) != 255) continue;
+            finest.unknowns[(x + y) % 2].push_back(i);
+            finest.diag[i] = 4.0f;
+            finest.right[i] = mask->at(i + 1) == 255 ? 1.0f : 0.0f;
+            finest.down[i] = mask->at(i + width) == 255 ? 1.0f : 0.0f;
 
             math::Vec3f l_d = simple_laplacian(i, dest);
             math::Vec3f l_s = simple_laplacian(i, src);
 
             // mixture of gradients
-            coefficients_b[row] = (alpha * l_s + (1.0f - alpha) * l_d);
+            math::Vec3f b = -(alpha * l_s + (1.0f - alpha) * l_d);
+
+            /* All other neighbours are boundary conditions and keep their values. */
+            const int neighbours[] = {i - width, i - 1, i + 1, i + width};
+            for (int j : neighbours) {
+                if (mask->at(j) != 255) b += math::Vec3f(&dest->at(j, 0));
+            }
+            std::copy(b.begin(), b.end(), &finest.b[3 * i]);
         }
     }
+    if (finest.num_unknowns() == 0) return;
 
-    SpMat A(nnz, nnz);
-    A.setFromTriplets(coefficients_A.begin(), coefficients_A.end());
-
-    Eigen::SparseLU<SpMat, Eigen::COLAMDOrdering<int> > solver;
-    solver.compute(A);
-
-    for (int channel = 0; channel < channels; ++channel) {
-        Eigen::VectorXf b(nnz);
-        for (std::size_t i = 0; i < coefficients_b.size(); ++i)
-            b[i] = coefficients_b[i][channel];
-
-        Eigen::VectorXf x(n);
-        x = solver.solve(b);
+    while (levels.size() < POISSON_MAX_LEVELS
+        && levels.back().num_unknowns() > POISSON_COARSEST_SIZE) {
+        Level coarse = coarsen(levels.back());
+        if (coarse.num_unknowns() == levels.back().num_unknowns()) break;
+        levels.push_back(coarse);
+    }
 
-        for (int i = 0; i < n; ++i) {
-            int index = indices->at(i);
-            if (index != -1) dest->at(i, channel) = x[index];
-        }
+    float * x = &dest->at(0);
+    double const initial_residual = residual_norm(levels.front(), x);
+    double residual = initial_residual;
+    for (int i = 0; i < POISSON_MAX_CYCLES; ++i) {
+        cycle(&levels, 0, x);
+
+        /* Stop at the tolerance or once rounding errors prevent progress. */
+        double const previous_residual = residual;
+        residual = residual_norm(levels.front(), x);
+        if (residual <= POISSON_TOLERANCE * initial_residual
+            || residual >= previous_residual) break;
     }
 }
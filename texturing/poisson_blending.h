@@ -12,6 +12,28 @@
 
 #include "core/image.h"
 
+/* Levels with at most this many unknowns are solved by smoothing only. */
+#define POISSON_COARSEST_SIZE 64
+#define POISSON_MAX_LEVELS 16
+/* Red-black Gauss-Seidel sweeps before and after the coarse grid correction. */
+#define POISSON_SMOOTHING_SWEEPS 2
+#define POISSON_COARSEST_SWEEPS 32
+/* V-cycles stop once the residual is reduced by this factor. */
+#define POISSON_TOLERANCE 1e-5f
+#define POISSON_MAX_CYCLES 50
+
+/**
+  * Solves the Poisson equation for the pixels of dest with mask value 255,
+  * whose Laplacian is the alpha weighted mix of the Laplacians of src and dest.
+  * Pixels with mask value 126 or 128 are Dirichlet boundary conditions and
+  * keep their value in dest.
+  *
+  * The 5-point Laplacian is solved in place on dest by geometric multigrid
+  * V-cycles with red-black Gauss-Seidel smoothing. The coarse grids merge
+  * 2x2 pixels, contain every cell with at least one unknown pixel and are
+  * coupled by piecewise constant prolongation (every pixel takes the
+  * correction of its cell) and the Galerkin coarse operators.
+  */
 void
 poisson_blend(core::FloatImage::ConstPtr src, core::ByteImage::ConstPtr mask,
     core::FloatImage::Ptr dest, float alpha);
@@ -7,64 +7,120 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
-#include <cmath>
+#include <limits>
+#include <algorithm>
 
 #include "rectangular_bin.h"
 
 RectangularBin::RectangularBin(unsigned int width, unsigned int height)
-    : width(width), height(height) {
-    rects.push_back(Rect<int>(0, 0, width, height));
+    : width(width), height(height), free_area(width * height), min_y(0) {
+    Segment segment = {0, 0, static_cast<int>(width)};
+    skyline.push_back(segment);
 }
 
-bool RectangularBin::insert(Rect<int> * rect) {
-    /* The best score is 0 so we initialize with the worst. */
-    unsigned int best_score = width * height;
-    std::list<Rect<int> >::iterator best_rect_it = rects.end();
-    std::list<Rect<int> >::iterator it = rects.begin();
-    for (; it != rects.end(); ++it) {
-        Rect<int> free_rect = *it;
-        if (rect->width() <= free_rect.width()
-            && rect->height() <= free_rect.height() ) {
-            unsigned int score = free_rect.size() - rect->size();
-            if (score < best_score){
-                best_score = score;
-                best_rect_it = it;
-            }
+int
+RectangularBin::fit(std::size_t segment, int rect_width, int rect_height) const {
+    if (skyline[segment].x + rect_width > static_cast<int>(width)) return -1;
+
+    int y = 0;
+    int remaining = rect_width;
+    for (std::size_t i = segment; remaining > 0; ++i) {
+        y = std::max(y, skyline[i].y);
+        if (y + rect_height > static_cast<int>(height)) return -1;
+        remaining -= skyline[i].width;
+    }
+    return y;
+}
+
+bool
+RectangularBin::is_rejected(int rect_width, int rect_height) const {
+    for (std::pair<int, int> const & size : rejected) {
+        if (rect_width >= size.first && rect_height >= size.second) return true;
+    }
+    return false;
+}
+
+void
+RectangularBin::reject(int rect_width, int rect_height) {
+    rejected.erase(std::remove_if(rejected.begin(), rejected.end(),
+        [rect_width, rect_height] (std::pair<int, int> const & size) {
+            return size.first >= rect_width && size.second >= rect_height;
+        }), rejected.end());
+    rejected.push_back(std::make_pair(rect_width, rect_height));
+}
+
+void
+RectangularBin::update_skyline(std::size_t segment, Rect<int> const & rect) {
+    Segment top = {rect.min_x, rect.max_y, rect.width()};
+    skyline.insert(skyline.begin() + segment, top);
+
+    /* Cut the segments below the rect. */
+    std::size_t i = segment + 1;
+    while (i < skyline.size() && skyline[i].x < rect.max_x) {
+        int const overlap = rect.max_x - skyline[i].x;
+        if (overlap < skyline[i].width) {
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
         }
+        skyline.erase(skyline.begin() + i);
     }
 
-    /* Fits? */
-    if (best_rect_it != rects.end()) {
-        Rect<int> best_rect(&(*best_rect_it));
-        rects.erase(best_rect_it);
-
-        /* Update the rect. */
-        rect->move(best_rect.min_x, best_rect.min_y);
-
-        /* Decide split axis. */
-        Rect<int> hsplit_top(best_rect.min_x, rect->max_y, best_rect.max_x, best_rect.max_y);
-        Rect<int> hsplit_bottom(rect->max_x, best_rect.min_y, best_rect.max_x, rect->max_y);
-        Rect<int> vsplit_left(best_rect.min_x, rect->max_y, rect->max_x, best_rect.max_y);
-        Rect<int> vsplit_right(rect->max_x, best_rect.min_y, best_rect.max_x, best_rect.max_y);
-
-        float hsplit_ratio = 1.0f;
-        float vsplit_ratio = 1.0f;
-
-        if (hsplit_top.size() != 0 && hsplit_bottom.size() != 0)
-            hsplit_ratio = static_cast<float>(hsplit_top.size()) / hsplit_bottom.size();
-        if (vsplit_left.size() != 0 && vsplit_right.size() != 0)
-            vsplit_ratio = static_cast<float>(vsplit_left.size()) / vsplit_right.size();
-
-        if (std::abs(1.0f - hsplit_ratio) < std::abs(1.0f - vsplit_ratio)){
-            if (vsplit_left.size() != 0) rects.push_back(vsplit_left);
-            if (vsplit_right.size() != 0) rects.push_back(vsplit_right);
+    /* Merge neighboring segments of equal height. */
+    for (std::size_t i = 1; i < skyline.size();) {
+        if (skyline[i - 1].y == skyline[i].y) {
+            skyline[i - 1].width += skyline[i].width;
+            skyline.erase(skyline.begin() + i);
         } else {
-            if (hsplit_top.size() != 0) rects.push_back(hsplit_top);
-            if (hsplit_bottom.size() != 0) rects.push_back(hsplit_bottom);
+            ++i;
         }
+    }
 
-        return true;
-    } else {
+    free_area = 0;
+    min_y = std::numeric_limits<int>::max();
+    for (Segment const & s : skyline) {
+        free_area += static_cast<std::size_t>(height - s.y) * s.width;
+        min_y = std::min(min_y, s.y);
+    }
+}
+
+bool
+RectangularBin::insert(Rect<int> * rect) {
+    int const rect_width = rect->width();
+    int const rect_height = rect->height();
+    if (rect_width > static_cast<int>(width)
+        || rect_height > static_cast<int>(height) - min_y
+        || static_cast<std::size_t>(rect->size()) > free_area
+        || is_rejected(rect_width, rect_height)) {
+        return false;
+    }
+
+    /* Bottom-left rule: lowest top edge, ties are broken by the narrower segment. */
+    std::size_t best_segment = skyline.size();
+    int best_y = 0;
+    int best_top = std::numeric_limits<int>::max();
+    int best_width = std::numeric_limits<int>::max();
+    for (std::size_t i = 0; i < skyline.size(); ++i) {
+        int const y = fit(i, rect_width, rect_height);
+        if (y < 0) continue;
+
+        int const top = y + rect_height;
+        if (top < best_top || (top == best_top && skyline[i].width < best_width)) {
+            best_segment = i;
+            best_y = y;
+            best_top = top;
+            best_width = skyline[i].width;
+        }
+    }
+
+    /* Fits? */
+    if (best_segment == skyline.size()) {
+        reject(rect_width, rect_height);
         return false;
     }
+
+    rect->move(skyline[best_segment].x, best_y);
+    update_skyline(best_segment, *rect);
+
+    return true;
 }
@@ -10,26 +10,49 @@
 #ifndef TEX_RECTANGULARBIN_HEADER
 #define TEX_RECTANGULARBIN_HEADER
 
-#include <list>
+#include <vector>
 #include <memory>
 
 #include "rect.h"
 
 /**
-  * Implementation of the binpacking algorithm GUILLUTINE from
+  * Implementation of the binpacking algorithm SKYLINE-BL from
   * <a href="http://clb.demon.fi/files/RectangleBinPack.pdf">
   * A Thousand Ways to Pack the Bin -
   * A Practical Approach to Two-Dimensional Rectangle Bin Packing
   * </a>
+  *
+  * The bin is described by its skyline, the upper contour of the packed
+  * rectangles, and rectangles are placed where their top edge is lowest.
+  * The skyline only rises, so sizes which did not fit once never fit again;
+  * these are kept to reject repeated attempts without searching the skyline.
   */
 class RectangularBin {
     public:
         typedef std::shared_ptr<RectangularBin> Ptr;
 
     private:
+        /** Horizontal segment of the skyline. */
+        struct Segment {
+            int x;
+            int y;
+            int width;
+        };
+
         unsigned int width;
         unsigned int height;
-        std::list<Rect<int> > rects;
+        std::vector<Segment> skyline;
+        /* Pareto front of the sizes which did not fit. */
+        std::vector<std::pair<int, int> > rejected;
+        /* Area above the skyline, which bounds the area that can be packed. */
+        std::size_t free_area;
+        int min_y;
+
+        /** Returns the lowest y at which a rect of the given size fits at the segment or -1. */
+        int fit(std::size_t segment, int rect_width, int rect_height) const;
+        bool is_rejected(int rect_width, int rect_height) const;
+        void reject(int rect_width, int rect_height);
+        void update_skyline(std::size_t segment, Rect<int> const & rect);
 
     public:
         /**
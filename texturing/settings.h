@@ -47,6 +47,37 @@ const std::vector<std::string> choice_strings<OutlierRemoval>() {
     return {"none", "gauss_damping", "gauss_clamping"};
 }
 
+/** Enum representing the method of the geometric visibility test. */
+enum VisibilityTest {
+    RAY_CASTING = 0,
+    Z_BUFFER = 1
+};
+template <> inline
+const std::vector<std::string> choice_strings<VisibilityTest>() {
+    return {"ray_casting", "z_buffer"};
+}
+
+/** Enum representing the solver of the view selection MRF. */
+enum ViewSelectionSolver {
+    GRAPH_CUTS = 0,
+    BELIEF_PROPAGATION = 1,
+    MULTILEVEL = 2
+};
+template <> inline
+const std::vector<std::string> choice_strings<ViewSelectionSolver>() {
+    return {"gco", "lbp", "multilevel"};
+}
+
+/** Enum representing the linear solver of the global seam leveling. */
+enum SeamLevelingSolver {
+    JACOBI_CG = 0,
+    MULTIGRID_CG = 1
+};
+template <> inline
+const std::vector<std::string> choice_strings<SeamLevelingSolver>() {
+    return {"jacobi_cg", "multigrid_cg"};
+}
+
 template <typename T> inline
 const std::string choice_string(T i) {
     return choice_strings<T>()[static_cast<std::size_t>(i)];
@@ -87,9 +118,12 @@ struct Settings {
     DataTerm data_term;
     SmoothnessTerm smoothness_term;
     OutlierRemoval outlier_removal;
+    ViewSelectionSolver view_selection_solver;
 
     bool geometric_visibility_test;
+    VisibilityTest visibility_test;
     bool global_seam_leveling;
+    SeamLevelingSolver seam_leveling_solver;
     bool local_seam_leveling;
 };
 
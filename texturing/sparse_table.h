@@ -11,32 +11,71 @@
 #define TEX_SPARSETABLE_HEADER
 
 #include <vector>
+#include <algorithm>
 
 #include <fstream>
+#include <cassert>
 #include <cstring>
 #include <cerrno>
+#include <cstdint>
+#include <numeric>
 #include <iostream>
 
 #include "util/file_system.h"
 #include "util/exception.h"
 
+#include "util/mapped_file.h"
+
 #define HEADER "SPT"
-#define VERSION "0.2"
+#define VERSION "0.3"
+#define LEGACY_VERSION "0.2"
+/* Binary header: "SPT 0.3\n", dimensions, nnz and the sizes of C, R and T. */
+#define BINARY_HEADER_SIZE 48
+/* Number of independent column blocks used to build the row-wise data. */
+#define SPARSE_TABLE_NUM_BLOCKS 128
 
 /**
   * Class representing a sparse table optimized for row and column wise access.
+  * Both orientations are stored compressed (CSR), i.e. the entries of all
+  * columns (rows) are stored contiguously together with the offsets of each
+  * column (row). The table is set as a whole from column-wise data.
   */
 template <typename C, typename R, typename T>
 class SparseTable {
     public:
-        typedef std::vector<std::pair<R, T> > Column;
-        typedef std::vector<std::pair<C, T> > Row;
+        typedef std::pair<R, T> ColumnEntry;
+        typedef std::pair<C, T> RowEntry;
+
+        /** Contiguous range of entries. */
+        template <typename E>
+        class Entries {
+            private:
+                E const * first;
+                E const * last;
+
+            public:
+                Entries(E const * first, E const * last) : first(first), last(last) {}
+
+                std::size_t size(void) const { return last - first; }
+                E const & operator[](std::size_t i) const { return first[i]; }
+                E const * begin(void) const { return first; }
+                E const * end(void) const { return last; }
+        };
+
+        typedef Entries<ColumnEntry> Column;
+        typedef Entries<RowEntry> Row;
 
     private:
-        std::vector<Column> column_wise_data;
-        std::vector<Row> row_wise_data;
+        std::vector<std::size_t> col_offsets;
+        std::vector<ColumnEntry> col_entries;
+        std::vector<std::size_t> row_offsets;
+        std::vector<RowEntry> row_entries;
+
+        /** Derives the row-wise data from the column-wise data. */
+        void build_rows(void);
+
+        static void load_legacy_file(std::string const & filename, SparseTable * sparse_table);
 
-        std::size_t nnz;
     public:
         SparseTable();
         SparseTable(C cols, R rows);
@@ -44,22 +83,30 @@ class SparseTable {
         C cols() const;
         R rows() const;
 
-        Column const & col(C id) const;
-        Row const & row(R id) const;
+        Column col(C id) const;
+        Row row(R id) const;
 
-        void set_value(C col, R row, T value);
+        /**
+          * Sets the content of the table, the entries of column c are
+          * entries[offsets[c], offsets[c + 1]). Both vectors are taken over.
+          * This replaces the former per entry set_value(), whose appends to
+          * per column and per row vectors cannot be done in compressed storage.
+          */
+        void set_columns(std::vector<std::size_t> * offsets, std::vector<ColumnEntry> * entries);
 
         std::size_t get_nnz(void) const;
 
         /**
           * Saves the SparseTable to the file given by filename.
-          * Version and size information is stored in ascii, values in binary.
+          * The file is binary and laid out to be memory mapped on loading:
+          * header, column offsets, row ids and values of the entries.
           * @throws util::FileException
           */
         static void save_to_file(SparseTable const & sparse_table, std::string const & filename);
 
         /**
-          * Loads a SparseTable from the file given by filename.
+          * Loads a SparseTable from the file given by filename,
+          * files of the previous (stream) version are supported as well.
           * @throws util::FileException if the file does not exist or if the header does not matches.
           */
         static void load_from_file(std::string const & filename, SparseTable * sparse_table);
@@ -67,96 +114,211 @@ class SparseTable {
 
 template <typename C, typename R, typename T> std::size_t
 SparseTable<C, R, T>::get_nnz(void) const {
-    return nnz;
+    return col_entries.size();
 }
 
 template <typename C, typename R, typename T> C
 SparseTable<C, R, T>::cols() const {
-    return column_wise_data.size();
+    return col_offsets.size() - 1;
 }
 
 template <typename C, typename R, typename T> R
 SparseTable<C, R, T>::rows() const {
-    return row_wise_data.size();
+    return row_offsets.size() - 1;
 }
 
-template <typename C, typename R, typename T> typename SparseTable<C, R, T>::Column const &
+template <typename C, typename R, typename T> typename SparseTable<C, R, T>::Column
 SparseTable<C, R, T>::col(C id) const {
-    return column_wise_data[id];
+    ColumnEntry const * entries = col_entries.data();
+    return Column(entries + col_offsets[id], entries + col_offsets[id + 1]);
 }
 
-template <typename C, typename R, typename T> typename SparseTable<C, R, T>::Row const &
+template <typename C, typename R, typename T> typename SparseTable<C, R, T>::Row
 SparseTable<C, R, T>::row(R id) const {
-    return row_wise_data[id];
+    RowEntry const * entries = row_entries.data();
+    return Row(entries + row_offsets[id], entries + row_offsets[id + 1]);
 }
 
 template <typename C, typename R, typename T>
-SparseTable<C, R, T>::SparseTable() {
-    nnz = 0;
-}
+SparseTable<C, R, T>::SparseTable()
+    : col_offsets(1, 0), row_offsets(1, 0) {}
 
 template <typename C, typename R, typename T>
-SparseTable<C, R, T>::SparseTable(C cols, R rows) {
-    column_wise_data.resize(cols);
-    row_wise_data.resize(rows);
-    nnz = 0;
+SparseTable<C, R, T>::SparseTable(C cols, R rows)
+    : col_offsets(cols + std::size_t(1), 0), row_offsets(rows + std::size_t(1), 0) {}
+
+template <typename C, typename R, typename T> void
+SparseTable<C, R, T>::set_columns(std::vector<std::size_t> * offsets,
+    std::vector<ColumnEntry> * entries) {
+    assert(offsets->size() == col_offsets.size());
+    assert(offsets->back() == entries->size());
+    col_offsets.swap(*offsets);
+    col_entries.swap(*entries);
+    offsets->clear();
+    entries->clear();
+    build_rows();
 }
 
 template <typename C, typename R, typename T> void
-SparseTable<C, R, T>::set_value(C col, R row, T value) {
-    column_wise_data[col].push_back(std::pair<R, T>(row, value));
-    row_wise_data[row].push_back(std::pair<C, T>(col, value));
-    nnz++;
+SparseTable<C, R, T>::build_rows(void) {
+    std::size_t const num_cols = cols();
+    std::size_t const num_rows = rows();
+    std::size_t const block_size = std::max<std::size_t>(1,
+        (num_cols + SPARSE_TABLE_NUM_BLOCKS - 1) / SPARSE_TABLE_NUM_BLOCKS);
+
+    /* Count the entries of every row within every block of columns. */
+    std::vector<std::size_t> positions(SPARSE_TABLE_NUM_BLOCKS * num_rows, 0);
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t block = 0; block < SPARSE_TABLE_NUM_BLOCKS; ++block) {
+        std::size_t * counts = &positions[block * num_rows];
+        std::size_t const end = std::min(num_cols, (block + 1) * block_size);
+        for (std::size_t col = block * block_size; col < end; ++col) {
+            for (std::size_t i = col_offsets[col]; i < col_offsets[col + 1]; ++i) {
+                counts[col_entries[i].first] += 1;
+            }
+        }
+    }
+
+    /* Prefix sum over rows and blocks yields the fill position of every block. */
+    row_offsets.assign(num_rows + 1, 0);
+    std::size_t offset = 0;
+    for (std::size_t row = 0; row < num_rows; ++row) {
+        row_offsets[row] = offset;
+        for (std::size_t block = 0; block < SPARSE_TABLE_NUM_BLOCKS; ++block) {
+            std::size_t const count = positions[block * num_rows + row];
+            positions[block * num_rows + row] = offset;
+            offset += count;
+        }
+    }
+    row_offsets[num_rows] = offset;
+
+    /* Blocks fill disjoint parts of the rows, which are ordered by column. */
+    row_entries.resize(offset);
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t block = 0; block < SPARSE_TABLE_NUM_BLOCKS; ++block) {
+        std::size_t * fill = &positions[block * num_rows];
+        std::size_t const end = std::min(num_cols, (block + 1) * block_size);
+        for (std::size_t col = block * block_size; col < end; ++col) {
+            for (std::size_t i = col_offsets[col]; i < col_offsets[col + 1]; ++i) {
+                ColumnEntry const & entry = col_entries[i];
+                row_entries[fill[entry.first]++] = RowEntry(col, entry.second);
+            }
+        }
+    }
 }
 
 template <typename C, typename R, typename T> void
 SparseTable<C, R, T>::save_to_file(SparseTable const & sparse_table, const std::string &filename) {
-    std::ofstream out(filename.c_str());
+    std::ofstream out(filename.c_str(), std::ios::binary);
     if (!out.good())
         throw util::FileException(filename, std::strerror(errno));
 
-    C cols = sparse_table.cols();
-    R rows = sparse_table.rows();
-    std::size_t nnz = sparse_table.get_nnz();
-    out << HEADER << " " << VERSION << " " << cols << " " << rows << " " << nnz << std::endl;
-
-    for (C col = 0; col < cols; ++col) {
-        SparseTable::Column column = sparse_table.col(col);
-        for (std::size_t i = 0; i < column.size(); ++i) {
-            std::pair<R, T> entry = column[i];
-            R row = entry.first;
-            T value = entry.second;
-
-            out.write((char const*)&col, sizeof(C));
-            out.write((char const*)&row, sizeof(R));
-            out.write((char const*)&value, sizeof(T));
-        }
+    std::uint64_t const cols = sparse_table.cols();
+    std::uint64_t const rows = sparse_table.rows();
+    std::uint64_t const nnz = sparse_table.get_nnz();
+    std::uint32_t const sizes[4] = {sizeof(C), sizeof(R), sizeof(T), 0};
+    out << HEADER << " " << VERSION << "\n";
+    out.write((char const*)&cols, sizeof(std::uint64_t));
+    out.write((char const*)&rows, sizeof(std::uint64_t));
+    out.write((char const*)&nnz, sizeof(std::uint64_t));
+    out.write((char const*)sizes, sizeof(sizes));
+
+    std::vector<std::uint64_t> offsets(sparse_table.col_offsets.begin(),
+        sparse_table.col_offsets.end());
+    out.write((char const*)offsets.data(), offsets.size() * sizeof(std::uint64_t));
+
+    /* Row ids and values are stored in separate arrays aligned to 8 bytes. */
+    std::vector<R> row_ids(nnz);
+    std::vector<T> values(nnz);
+    for (std::size_t i = 0; i < nnz; ++i) {
+        row_ids[i] = sparse_table.col_entries[i].first;
+        values[i] = sparse_table.col_entries[i].second;
     }
+    char const padding[8] = {0};
+    out.write((char const*)row_ids.data(), nnz * sizeof(R));
+    out.write(padding, (8 - (nnz * sizeof(R)) % 8) % 8);
+    out.write((char const*)values.data(), nnz * sizeof(T));
+
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
     out.close();
 }
 
 template <typename C, typename R, typename T> void
 SparseTable<C, R, T>::load_from_file(const std::string & filename, SparseTable<C, R, T> * sparse_table) {
-    std::ifstream in(filename.c_str());
-    if (!in.good())
-        throw util::FileException(filename, std::strerror(errno));
-
-    std::string header;
-
-    in >> header;
+    util::MappedFile file(filename);
+    char const * data = file.data();
+    std::string const header = std::string(HEADER) + " ";
+    std::string const version = header + VERSION + "\n";
 
-    if (header != HEADER) {
-        in.close();
+    if (file.size() < header.size() || std::memcmp(data, header.data(), header.size()) != 0)
         throw util::FileException(filename, "Not a SparseTable file!");
-    }
 
-    std::string version;
-    in >> version;
+    if (file.size() >= version.size()
+        && std::memcmp(data + header.size(), LEGACY_VERSION, std::strlen(LEGACY_VERSION)) == 0) {
+        load_legacy_file(filename, sparse_table);
+        return;
+    }
 
-    if (version != VERSION) {
-        in.close();
+    if (file.size() < BINARY_HEADER_SIZE || std::memcmp(data, version.data(), version.size()) != 0)
         throw util::FileException(filename, "Incompatible version of SparseTable file!");
+
+    std::uint64_t cols, rows, nnz;
+    std::uint32_t sizes[4];
+    std::memcpy(&cols, data + 8, sizeof(std::uint64_t));
+    std::memcpy(&rows, data + 16, sizeof(std::uint64_t));
+    std::memcpy(&nnz, data + 24, sizeof(std::uint64_t));
+    std::memcpy(sizes, data + 32, sizeof(sizes));
+
+    if (sizes[0] != sizeof(C) || sizes[1] != sizeof(R) || sizes[2] != sizeof(T))
+        throw util::FileException(filename, "SparseTable has different types!");
+
+    if (cols != sparse_table->cols() || rows != sparse_table->rows())
+        throw util::FileException(filename, "SparseTable has different dimension!");
+
+    std::size_t const offsets_pos = BINARY_HEADER_SIZE;
+    std::size_t const row_ids_pos = offsets_pos + (cols + 1) * sizeof(std::uint64_t);
+    std::size_t const values_pos = row_ids_pos + (nnz * sizeof(R) + 7) / 8 * 8;
+    if (file.size() != values_pos + nnz * sizeof(T))
+        throw util::FileException(filename, "SparseTable file is truncated!");
+
+    std::vector<std::size_t> offsets(cols + 1);
+    for (std::size_t col = 0; col <= cols; ++col) {
+        std::uint64_t offset;
+        std::memcpy(&offset, data + offsets_pos + col * sizeof(std::uint64_t), sizeof(offset));
+        offsets[col] = offset;
+        if ((col == 0 && offset != 0) || (col > 0 && offset < offsets[col - 1]))
+            throw util::FileException(filename, "SparseTable has invalid offsets!");
     }
+    if (offsets[cols] != nnz)
+        throw util::FileException(filename, "SparseTable has invalid offsets!");
+
+    std::vector<ColumnEntry> entries(nnz);
+    bool valid = true;
+    #pragma omp parallel for reduction(&&:valid)
+    for (std::size_t i = 0; i < nnz; ++i) {
+        R row;
+        T value;
+        std::memcpy(&row, data + row_ids_pos + i * sizeof(R), sizeof(R));
+        std::memcpy(&value, data + values_pos + i * sizeof(T), sizeof(T));
+        entries[i] = ColumnEntry(row, value);
+        valid = valid && row < rows;
+    }
+    if (!valid)
+        throw util::FileException(filename, "SparseTable has invalid row ids!");
+
+    sparse_table->set_columns(&offsets, &entries);
+}
+
+template <typename C, typename R, typename T> void
+SparseTable<C, R, T>::load_legacy_file(const std::string & filename, SparseTable<C, R, T> * sparse_table) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    std::string header;
+    std::string version;
+    in >> header >> version;
 
     C cols;
     R rows;
@@ -173,17 +335,30 @@ SparseTable<C, R, T>::load_from_file(const std::string & filename, SparseTable<C
     /* Discard the rest of the line. */
     std::getline(in, buffer);
 
-    C col;
-    R row;
-    T value;
+    std::vector<C> entry_cols(nnz);
+    std::vector<ColumnEntry> entries(nnz);
+    std::vector<std::size_t> offsets(cols + std::size_t(1), 0);
     for (std::size_t i = 0; i < nnz; ++i) {
-        in.read((char*)&col, sizeof(C));
-        in.read((char*)&row, sizeof(R));
-        in.read((char*)&value, sizeof(T));
-        sparse_table->set_value(col, row, value);
+        in.read((char*)&entry_cols[i], sizeof(C));
+        in.read((char*)&entries[i].first, sizeof(R));
+        in.read((char*)&entries[i].second, sizeof(T));
+        if (!in.good() || entry_cols[i] >= cols || entries[i].first >= rows) {
+            in.close();
+            throw util::FileException(filename, "SparseTable file is corrupt!");
+        }
+        offsets[entry_cols[i] + std::size_t(1)] += 1;
     }
-
     in.close();
+
+    /* Sort the entries by column, keeping the file order within a column. */
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+    std::vector<ColumnEntry> sorted(nnz);
+    for (std::size_t i = 0; i < nnz; ++i) {
+        sorted[fill[entry_cols[i]]++] = entries[i];
+    }
+
+    sparse_table->set_columns(&offsets, &sorted);
 }
 
 #endif /* TEX_SPARSETABLE_HEADER */
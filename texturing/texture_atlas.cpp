@@ -7,8 +7,9 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
-#include <set>
-#include <map>
+#include <limits>
+#include <cstdint>
+#include <cstring>
 
 #include <util/file_system.h>
 #include <core/image_tools.h>
@@ -17,7 +18,7 @@
 #include "texture_atlas.h"
 
 TextureAtlas::TextureAtlas(unsigned int size) :
-    size(size), padding(size >> 7), finalized(false) {
+    size(size), padding(size >> 7), finalized(false), packed_area(0) {
 
     bin = RectangularBin::create(size, size);
     image = core::ByteImage::create(size, size, 3);
@@ -59,51 +60,70 @@ void copy_into(core::ByteImage::ConstPtr src, int x, int y,
 }
 
 typedef std::vector<std::pair<int, int> > PixelVector;
-typedef std::set<std::pair<int, int> > PixelSet;
 
 bool
 TextureAtlas::insert(TexturePatch::ConstPtr texture_patch, float vmin, float vmax) {
+    if (!place(texture_patch)) return false;
+    copy_placed(vmin, vmax);
+    return true;
+}
+
+bool
+TextureAtlas::place(TexturePatch::ConstPtr texture_patch) {
     if (finalized) {
         throw util::Exception("No insertion possible, TextureAtlas already finalized");
     }
 
     assert(bin != NULL);
-    assert(validity_mask != NULL);
 
     int const width = texture_patch->get_width() + 2 * padding;
     int const height = texture_patch->get_height() + 2 * padding;
     Rect<int> rect(0, 0, width, height);
     if (!bin->insert(&rect)) return false;
 
-    /* Update texture atlas and its validity mask. */
-    core::ByteImage::Ptr patch_image = core::image::float_to_byte_image(
-        texture_patch->get_image(), vmin, vmax);
-    core::image::gamma_correct(patch_image, 1.0f / 2.2f);
+    placed_patches.push_back(std::make_pair(texture_patch, rect));
+    packed_area += rect.size();
+    return true;
+}
+
+void
+TextureAtlas::copy_placed(float vmin, float vmax) {
+    assert(validity_mask != NULL);
+
+    for (std::size_t k = 0; k < placed_patches.size(); ++k) {
+        TexturePatch::ConstPtr texture_patch = placed_patches[k].first;
+        Rect<int> const & rect = placed_patches[k].second;
+
+        /* Update texture atlas and its validity mask. */
+        core::ByteImage::Ptr patch_image = core::image::float_to_byte_image(
+            texture_patch->get_image(), vmin, vmax);
+        core::image::gamma_correct(patch_image, 1.0f / 2.2f);
 
-    copy_into(patch_image, rect.min_x, rect.min_y, image, padding);
-    core::ByteImage::ConstPtr patch_validity_mask = texture_patch->get_validity_mask();
-    copy_into(patch_validity_mask, rect.min_x, rect.min_y, validity_mask, padding);
+        copy_into(patch_image, rect.min_x, rect.min_y, image, padding);
+        core::ByteImage::ConstPtr patch_validity_mask = texture_patch->get_validity_mask();
+        copy_into(patch_validity_mask, rect.min_x, rect.min_y, validity_mask, padding);
 
-    TexturePatch::Faces const & patch_faces = texture_patch->get_faces();
-    TexturePatch::Texcoords const & patch_texcoords = texture_patch->get_texcoords();
+        TexturePatch::Faces const & patch_faces = texture_patch->get_faces();
+        TexturePatch::Texcoords const & patch_texcoords = texture_patch->get_texcoords();
 
-    /* Calculate the offset of the texture patches' relative texture coordinates */
-    math::Vec2f offset = math::Vec2f(rect.min_x + padding, rect.min_y + padding);
+        /* Calculate the offset of the texture patches' relative texture coordinates */
+        math::Vec2f offset = math::Vec2f(rect.min_x + padding, rect.min_y + padding);
 
-    faces.insert(faces.end(), patch_faces.begin(), patch_faces.end());
+        faces.insert(faces.end(), patch_faces.begin(), patch_faces.end());
 
-    /* Calculate the final textcoords of the faces. */
-    for (std::size_t i = 0; i < patch_faces.size(); ++i) {
-        for (int j = 0; j < 3; ++j) {
-            math::Vec2f rel_texcoord(patch_texcoords[i * 3 + j]);
-            math::Vec2f texcoord = rel_texcoord + offset;
+        /* Calculate the final textcoords of the faces. */
+        for (std::size_t i = 0; i < patch_faces.size(); ++i) {
+            for (int j = 0; j < 3; ++j) {
+                math::Vec2f rel_texcoord(patch_texcoords[i * 3 + j]);
+                math::Vec2f texcoord = rel_texcoord + offset;
 
-            texcoord[0] = texcoord[0] / (this->size - 1);
-            texcoord[1] = texcoord[1] / (this->size - 1);
-            texcoords.push_back(texcoord);
+                texcoord[0] = texcoord[0] / (this->size - 1);
+                texcoord[1] = texcoord[1] / (this->size - 1);
+                texcoords.push_back(texcoord);
+            }
         }
     }
-    return true;
+    placed_patches.clear();
 }
 
 
@@ -122,40 +142,46 @@ TextureAtlas::apply_edge_padding(void) {
     gauss[6] = 1.0f; gauss[7] = 2.0f; gauss[8] = 1.0f;
     gauss /= 16.0f;
 
-    /* Calculate the set of invalid pixels at the border of texture patches. */
-    PixelSet invalid_border_pixels;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if (validity_mask->at(x, y, 0) == 255) continue;
-
-            /* Check the direct neighbourhood of all invalid pixels. */
-            for (int j = -1; j <= 1; ++j) {
-                for (int i = -1; i <= 1; ++i) {
-                    int nx = x + i;
-                    int ny = y + j;
-                    /* If the invalid pixel has a valid neighbour: */
-                    if (0 <= nx && nx < width &&
-                        0 <= ny && ny < height &&
-                        validity_mask->at(nx, ny, 0) == 255) {
-
-                        /* Add the pixel to the set of invalid border pixels. */
-                        invalid_border_pixels.insert(std::pair<int, int>(x, y));
-                    }
+    core::ByteImage::Ptr new_validity_mask = validity_mask->duplicate();
+
+    /*
+     * The invalid pixels at the border of the valid area (frontier) are kept
+     * in a list, a bitmap marks the pixels of the list to avoid duplicates.
+     */
+    std::vector<int> invalid_border_pixels;
+    std::vector<std::uint8_t> is_border_pixel(width * height, 0);
+    auto add_invalid_neighbours = [&] (int x, int y) {
+        for (int j = -1; j <= 1; ++j) {
+            for (int i = -1; i <= 1; ++i) {
+                int nx = x + i;
+                int ny = y + j;
+                if (0 <= nx && nx < width &&
+                    0 <= ny && ny < height &&
+                    new_validity_mask->at(nx, ny, 0) == 0 &&
+                    !is_border_pixel[ny * width + nx]) {
+
+                    is_border_pixel[ny * width + nx] = 1;
+                    invalid_border_pixels.push_back(ny * width + nx);
                 }
             }
         }
-    }
+    };
 
-    core::ByteImage::Ptr new_validity_mask = validity_mask->duplicate();
+    /* Calculate the invalid pixels at the border of texture patches. */
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (validity_mask->at(x, y, 0) == 255) add_invalid_neighbours(x, y);
+        }
+    }
 
     /* Iteratively dilate border pixels until padding constants are reached. */
     for (unsigned int n = 0; n <= padding; ++n) {
         PixelVector new_valid_pixels;
 
-        PixelSet::iterator it = invalid_border_pixels.begin();
-        for (;it != invalid_border_pixels.end(); it++) {
-            int x = it->first;
-            int y = it->second;
+        for (int pixel : invalid_border_pixels) {
+            int x = pixel % width;
+            int y = pixel / width;
+            is_border_pixel[pixel] = 0;
 
             bool now_valid = false;
             /* Calculate new pixel value. */
@@ -185,7 +211,7 @@ TextureAtlas::apply_edge_padding(void) {
             }
 
             if (now_valid) {
-                new_valid_pixels.push_back(*it);
+                new_valid_pixels.push_back(std::pair<int, int>(x, y));
             }
         }
 
@@ -199,55 +225,58 @@ TextureAtlas::apply_edge_padding(void) {
              new_validity_mask->at(x, y, 0) = 255;
         }
 
-        /* Calculate the set of invalid pixels at the border of the valid area. */
+        /* Calculate the invalid pixels at the border of the valid area. */
         for (std::size_t i = 0; i < new_valid_pixels.size(); ++i) {
-            int x = new_valid_pixels[i].first;
-            int y = new_valid_pixels[i].second;
-
-            for (int j = -1; j <= 1; ++j) {
-                 for (int i = -1; i <= 1; ++i) {
-                     int nx = x + i;
-                     int ny = y + j;
-                     if (0 <= nx && nx < width &&
-                         0 <= ny && ny < height &&
-                         new_validity_mask->at(nx, ny, 0) == 0) {
-
-                         invalid_border_pixels.insert(std::pair<int, int>(nx, ny));
-                    }
-                }
-            }
+            add_invalid_neighbours(new_valid_pixels[i].first, new_valid_pixels[i].second);
         }
     }
 }
 
-struct VectorCompare {
-    bool operator()(math::Vec2f const & lhs, math::Vec2f const & rhs)const {
-        return lhs[0] < rhs[0] || (lhs[0] == rhs[0] && lhs[1] < rhs[1]);
-    }
-};
-
-typedef std::map<math::Vec2f, std::size_t, VectorCompare> TexcoordMap;
-
-
+namespace {
+
+/** Returns a well distributed hash of the bit pattern of a texture coordinate. */
+inline std::uint64_t
+hash_texcoord(math::Vec2f const & texcoord) {
+    std::uint32_t bits[2];
+    /* Adding zero maps -0.0f to 0.0f, which compare equal. */
+    float const values[2] = {texcoord[0] + 0.0f, texcoord[1] + 0.0f};
+    std::memcpy(bits, values, sizeof(bits));
+
+    std::uint64_t h = (static_cast<std::uint64_t>(bits[0]) << 32) | bits[1];
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
 
+}
 
 void
 TextureAtlas::merge_texcoords() {
     Texcoords tmp; tmp.swap(this->texcoords);
+    this->texcoord_ids.reserve(tmp.size());
+
+    /* Open addressing hash table with linear probing, which is at most half full. */
+    std::size_t capacity = 16;
+    while (capacity < 2 * tmp.size()) capacity *= 2;
+    std::size_t const mask = capacity - 1;
+    std::vector<std::size_t> table(capacity, std::numeric_limits<std::size_t>::max());
 
-    TexcoordMap texcoord_map;
     for (math::Vec2f const & texcoord : tmp) {
-        TexcoordMap::iterator iter = texcoord_map.find(texcoord);
-        if (iter == texcoord_map.end()) {
-            std::size_t texcoord_id = this->texcoords.size();
-            texcoord_map[texcoord] = texcoord_id;
+        std::size_t slot = hash_texcoord(texcoord) & mask;
+        while (table[slot] != std::numeric_limits<std::size_t>::max()
+            && this->texcoords[table[slot]] != texcoord) {
+            slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == std::numeric_limits<std::size_t>::max()) {
+            table[slot] = this->texcoords.size();
             this->texcoords.push_back(texcoord);
-            this->texcoord_ids.push_back(texcoord_id);
-        } else {
-            this->texcoord_ids.push_back(iter->second);
         }
+        this->texcoord_ids.push_back(table[slot]);
     }
-
 }
 
 void
@@ -256,6 +285,10 @@ TextureAtlas::finalize() {
         throw util::Exception("TextureAtlas already finalized");
     }
 
+    if (!placed_patches.empty()) {
+        throw util::Exception("TextureAtlas contains placed texture patches which are not copied");
+    }
+
     this->bin.reset();
     this->apply_edge_padding();
     this->validity_mask.reset();
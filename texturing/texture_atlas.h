@@ -46,6 +46,9 @@ class TextureAtlas {
         core::ByteImage::Ptr validity_mask;
 
         RectangularBin::Ptr bin;
+        /* Texture patches which are placed but not yet copied into the atlas. */
+        std::vector<std::pair<TexturePatch::ConstPtr, Rect<int> > > placed_patches;
+        std::size_t packed_area;
 
         std::string filename;
 
@@ -63,10 +66,21 @@ class TextureAtlas {
         TexcoordIds const & get_texcoord_ids(void) const;
         Texcoords const & get_texcoords(void) const;
         std::string const & get_filename(void) const;
+        /** Returns the fraction of the atlas covered by packed texture patches. */
+        float get_fill_rate(void) const;
 
+        /** Places and copies the texture patch, returns false if it does not fit. */
         bool insert(TexturePatch::ConstPtr texture_patch,
             float vmin, float vmax);
 
+        /**
+          * Places the texture patch without copying it, returns false if it
+          * does not fit. Placed texture patches are copied by copy_placed.
+          */
+        bool place(TexturePatch::ConstPtr texture_patch);
+        /** Copies the placed texture patches into the atlas. */
+        void copy_placed(float vmin, float vmax);
+
         void finalize(void);
 };
 
@@ -98,4 +112,9 @@ TextureAtlas::get_filename(void) const {
     return filename;
 }
 
+inline float
+TextureAtlas::get_fill_rate(void) const {
+    return static_cast<float>(packed_area) / (static_cast<float>(size) * size);
+}
+
 #endif /* TEX_TEXTUREATLAS_HEADER */
@@ -17,7 +17,7 @@
 
 TextureView::TextureView(std::size_t id, core::CameraInfo const & camera,
     std::string const & image_file)
-    : id(id), image_file(image_file) {
+    : id(id), image_file(image_file), image_loaded(false) {
 
     core::image::ImageHeaders header;
     try {
@@ -42,6 +42,18 @@ TextureView::TextureView(std::size_t id, core::CameraInfo const & camera,
 void
 TextureView::generate_validity_mask(void) {
     assert(image != NULL);
+
+    if (image_loaded) {
+        core::ByteImage::Ptr mask = ImageCache::find(image_file, ImageCache::VALIDITY_MASK);
+        if (mask != NULL) {
+            validity_mask.resize(width * height);
+            for (int i = 0; i < width * height; ++i) {
+                validity_mask[i] = mask->at(i) != 0;
+            }
+            return;
+        }
+    }
+
     validity_mask.resize(width * height, true);
     core::ByteImage::Ptr checked = core::ByteImage::create(width, height, 1);
 
@@ -91,19 +103,38 @@ TextureView::generate_validity_mask(void) {
             }
         }
     }
+
+    if (image_loaded) {
+        core::ByteImage::Ptr mask = core::ByteImage::create(width, height, 1);
+        for (int i = 0; i < width * height; ++i) {
+            mask->at(i) = validity_mask[i] ? 255 : 0;
+        }
+        ImageCache::insert(image_file, ImageCache::VALIDITY_MASK, mask);
+    }
 }
 
 void
 TextureView::load_image(void) {
     if(image != NULL) return;
-    image = core::image::load_file(image_file);
+    image = ImageCache::load_image(image_file);
+    image_loaded = true;
 }
 
 void
 TextureView::generate_gradient_magnitude(void) {
     assert(image != NULL);
+
+    if (image_loaded) {
+        gradient_magnitude = ImageCache::find(image_file, ImageCache::GRADIENT_MAGNITUDE);
+        if (gradient_magnitude != NULL) return;
+    }
+
     core::ByteImage::Ptr bw = core::image::desaturate<std::uint8_t>(image, core::image::DESATURATE_LUMINANCE);
     gradient_magnitude = core::image::sobel_edge<std::uint8_t>(bw);
+
+    if (image_loaded) {
+        ImageCache::insert(image_file, ImageCache::GRADIENT_MAGNITUDE, gradient_magnitude);
+    }
 }
 
 
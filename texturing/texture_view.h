@@ -19,6 +19,7 @@
 
 #include "tri.h"
 #include "settings.h"
+#include "image_cache.h"
 
 /** Struct containing the quality and mean color of a face within a view. */
 struct ProjectedFaceInfo {
@@ -46,6 +47,8 @@ class TextureView {
         int height;
         std::string image_file;
         core::ByteImage::Ptr image;
+        /* Whether image is the decoded image file, i.e. derived images may be shared. */
+        bool image_loaded;
         core::ByteImage::Ptr gradient_magnitude;
         std::vector<bool> validity_mask;
 
@@ -56,6 +59,8 @@ class TextureView {
 
         /** Returns the 2D pixel coordinates of the given vertex projected into the view. */
         math::Vec2f get_pixel_coords(math::Vec3f const & vertex) const;
+        /** Returns the depth of the given vertex in camera coordinates. */
+        float get_depth(math::Vec3f const & vertex) const;
         /** Returns the RGB pixel values [0, 1] for the given vertex projected into the view, calculated by linear interpolation. */
         math::Vec3f get_pixel_values(math::Vec3f const & vertex) const;
 
@@ -84,22 +89,24 @@ class TextureView {
         int get_height(void) const;
         /** Returns a reference pointer to the corresponding image. */
         core::ByteImage::Ptr get_image(void) const;
+        /** Returns the path of the corresponding image file. */
+        std::string const & get_image_file(void) const;
 
         /** Exchange encapsulated image. */
         void bind_image(core::ByteImage::Ptr new_image);
 
-        /** Loads the corresponding image. */
+        /** Loads the corresponding image through the ImageCache. */
         void load_image(void);
-        /** Generates the validity mask. */
+        /** Generates the validity mask or takes it from the ImageCache. */
         void generate_validity_mask(void);
-        /** Generates the gradient magnitude image for the encapsulated image. */
+        /** Generates the gradient magnitude image for the encapsulated image or takes it from the ImageCache. */
         void generate_gradient_magnitude(void);
 
         /** Releases the validity mask. */
         void release_validity_mask(void);
-        /** Releases the gradient magnitude image. */
+        /** Releases the gradient magnitude image, which may stay in the ImageCache. */
         void release_gradient_magnitude(void);
-        /** Releases the corresponding image. */
+        /** Releases the corresponding image, which may stay in the ImageCache. */
         void release_image(void);
 
         /** Erodes the validity mask by one pixel. */
@@ -148,6 +155,11 @@ TextureView::get_image(void) const {
     return image;
 }
 
+inline std::string const &
+TextureView::get_image_file(void) const {
+    return image_file;
+}
+
 inline bool
 TextureView::inside(math::Vec3f const & v1, math::Vec3f const & v2, math::Vec3f const & v3) const {
     math::Vec2f p1 = get_pixel_coords(v1);
@@ -163,6 +175,11 @@ TextureView::get_pixel_coords(math::Vec3f const & vertex) const {
     return math::Vec2f(pixel[0] - 0.5f, pixel[1] - 0.5f);
 }
 
+inline float
+TextureView::get_depth(math::Vec3f const & vertex) const {
+    return world_to_cam.mult(vertex, 1.0f)[2];
+}
+
 inline math::Vec3f
 TextureView::get_pixel_values(math::Vec3f const & vertex) const {
     math::Vec2f pixel = get_pixel_coords(vertex);
@@ -180,6 +197,7 @@ TextureView::get_pixel_values(math::Vec2f const & pixel) const {
 inline void
 TextureView::bind_image(core::ByteImage::Ptr new_image) {
     image = new_image;
+    image_loaded = false;
 }
 
 inline void
@@ -193,12 +211,15 @@ inline void
 TextureView::release_gradient_magnitude(void) {
     assert(gradient_magnitude != NULL);
     gradient_magnitude.reset();
+    ImageCache::cleanup();
 }
 
 inline void
 TextureView::release_image(void) {
     assert(image != NULL);
     image.reset();
+    image_loaded = false;
+    ImageCache::cleanup();
 }
 
 #endif /* TEX_TEXTUREVIEW_HEADER */
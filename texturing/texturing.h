@@ -99,7 +99,7 @@ void
 global_seam_leveling(UniGraph const & graph, core::TriangleMesh::ConstPtr mesh,
     core::VertexInfoList::ConstPtr vertex_infos,
     VertexProjectionInfos const & vertex_projection_infos,
-    TexturePatches * texture_patches);
+    TexturePatches * texture_patches, Settings const & settings);
 
 void
 local_seam_leveling(UniGraph const & graph, core::TriangleMesh::ConstPtr mesh,
@@ -125,11 +125,21 @@ view_selection(ST const & data_costs, UniGraph * graph, Settings const & setting
         }
     }
 
-    #ifdef RESEARCH
-    mrf::SOLVER_TYPE solver_type = mrf::GCO;
-    #else
+    /* Graph cuts are only available with RESEARCH, fall back to LBP. */
     mrf::SOLVER_TYPE solver_type = mrf::LBP;
-    #endif
+    switch (settings.view_selection_solver) {
+        case GRAPH_CUTS:
+            #ifdef RESEARCH
+            solver_type = mrf::GCO;
+            #endif
+        break;
+        case BELIEF_PROPAGATION:
+            solver_type = mrf::LBP;
+        break;
+        case MULTILEVEL:
+            solver_type = mrf::MULTILEVEL;
+        break;
+    }
 
     /* Label 0 is undefined. */
     const std::size_t num_labels = data_costs.rows() + 1;
@@ -145,7 +155,8 @@ view_selection(ST const & data_costs, UniGraph * graph, Settings const & setting
 
     bool multiple_components_simultaneously = false;
     #ifdef RESEARCH
-    multiple_components_simultaneously = true;
+    /* The multilevel solver parallelizes within a component instead. */
+    multiple_components_simultaneously = solver_type != mrf::MULTILEVEL;
     #endif
     #ifndef _OPENMP
     multiple_components_simultaneously = false;
@@ -158,8 +169,13 @@ view_selection(ST const & data_costs, UniGraph * graph, Settings const & setting
         }
         std::cout << "\tComp\tIter\tEnergy\t\tRuntime" << std::endl;
     }
+
+    /* Summed final energies of all components, for comparing solvers. */
+    double total_energy = 0.0;
+    bool any_verbose = false;
+    util::WallTimer total_timer;
     #ifdef RESEARCH
-    #pragma omp parallel for schedule(dynamic)
+    #pragma omp parallel for schedule(dynamic) if (multiple_components_simultaneously)
     #endif
     for (std::size_t i = 0; i < components.size(); ++i) {
         switch (settings.smoothness_term) {
@@ -197,14 +213,18 @@ view_selection(ST const & data_costs, UniGraph * graph, Settings const & setting
         }
 
         #pragma omp critical
-        if (verbose) {
-            std::cout << "\t" << comp << "\t" << iter << "\t" << energy << std::endl;
-            if (diff == zero) {
-                std::cout << "\t" << comp << "\t" << "Converged" << std::endl;
-            }
-            if (diff < zero) {
-                std::cout << "\t" << comp << "\t"
-                    << "Increase of energy - stopping optimization" << std::endl;
+        {
+            total_energy += energy;
+            any_verbose = any_verbose || verbose;
+            if (verbose) {
+                std::cout << "\t" << comp << "\t" << iter << "\t" << energy << std::endl;
+                if (diff == zero) {
+                    std::cout << "\t" << comp << "\t" << "Converged" << std::endl;
+                }
+                if (diff < zero) {
+                    std::cout << "\t" << comp << "\t"
+                        << "Increase of energy - stopping optimization" << std::endl;
+                }
             }
         }
 
@@ -215,6 +235,12 @@ view_selection(ST const & data_costs, UniGraph * graph, Settings const & setting
             graph->set_label(components[i][j], static_cast<std::size_t>(label));
         }
     }
+
+    if (any_verbose) {
+        std::cout << "\tSolver " << choice_string<ViewSelectionSolver>(settings.view_selection_solver)
+            << ": energy " << total_energy << ", took " << total_timer.get_elapsed_sec()
+            << "s" << std::endl;
+    }
 }
 
 TEX_NAMESPACE_END
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "z_buffer.h"
+
+void
+ZBuffer::rasterize(TextureView const & view, std::vector<unsigned int> const & faces,
+    std::vector<math::Vec3f> const & vertices) {
+    width = view.get_width();
+    height = view.get_height();
+    tiles_x = (width + Z_BUFFER_TILE_SIZE - 1) / Z_BUFFER_TILE_SIZE;
+    tiles_y = (height + Z_BUFFER_TILE_SIZE - 1) / Z_BUFFER_TILE_SIZE;
+    num_faces = faces.size() / 3;
+
+    inv_depths.assign(width * height, 0.0f);
+    inv_depth_slopes.assign(width * height, 0.0f);
+    clipped_faces.clear();
+    tile_faces.resize(tiles_x * tiles_y);
+    for (std::vector<std::uint32_t> & tile : tile_faces) {
+        tile.clear();
+    }
+
+    /* Project every vertex once, faces share them. */
+    projections.resize(vertices.size());
+    #pragma omp parallel for
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        float const depth = view.get_depth(vertices[i]);
+        if (depth < Z_BUFFER_NEAR_PLANE) {
+            projections[i] = math::Vec3f(0.0f, 0.0f, depth);
+            continue;
+        }
+        math::Vec2f const pixel = view.get_pixel_coords(vertices[i]);
+        projections[i] = math::Vec3f(pixel[0], pixel[1], depth);
+    }
+
+    /* Bin faces into the tiles overlapped by the pixel centers they cover. */
+    for (std::size_t i = 0; i < faces.size(); i += 3) {
+        if (projections[faces[i]][2] < Z_BUFFER_NEAR_PLANE
+            || projections[faces[i + 1]][2] < Z_BUFFER_NEAR_PLANE
+            || projections[faces[i + 2]][2] < Z_BUFFER_NEAR_PLANE) {
+            clip_face(view, &faces[i], vertices);
+            continue;
+        }
+        bin_face(i / 3, &faces[i]);
+    }
+
+    /* Tiles cover disjoint pixels, each stays in cache while rasterized. */
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile_id = 0; tile_id < tiles_x * tiles_y; ++tile_id) {
+        rasterize_tile(tile_id, faces);
+    }
+}
+
+void
+ZBuffer::clip_face(TextureView const & view, unsigned int const * face,
+    std::vector<math::Vec3f> const & vertices) {
+    /* The part of the face in front of the near plane is a triangle or a
+     * quadrilateral. Depth is affine in world coordinates, the vertices
+     * on the near plane are interpolated and projected like mesh vertices. */
+    unsigned int polygon[4];
+    int num_corners = 0;
+    for (int k = 0; k < 3; ++k) {
+        unsigned int const a = face[k];
+        unsigned int const b = face[(k + 1) % 3];
+        float const depth_a = projections[a][2];
+        float const depth_b = projections[b][2];
+        bool const front_a = depth_a >= Z_BUFFER_NEAR_PLANE;
+        bool const front_b = depth_b >= Z_BUFFER_NEAR_PLANE;
+        if (front_a) polygon[num_corners++] = a;
+        if (front_a == front_b) continue;
+
+        float const t = (Z_BUFFER_NEAR_PLANE - depth_a) / (depth_b - depth_a);
+        math::Vec3f const vertex = vertices[a] + (vertices[b] - vertices[a]) * t;
+        math::Vec2f const pixel = view.get_pixel_coords(vertex);
+        polygon[num_corners++] = projections.size();
+        projections.push_back(math::Vec3f(pixel[0], pixel[1], Z_BUFFER_NEAR_PLANE));
+    }
+
+    for (int k = 2; k < num_corners; ++k) {
+        std::size_t const face_id = num_faces + clipped_faces.size() / 3;
+        clipped_faces.push_back(polygon[0]);
+        clipped_faces.push_back(polygon[k - 1]);
+        clipped_faces.push_back(polygon[k]);
+        bin_face(face_id, &clipped_faces[clipped_faces.size() - 3]);
+    }
+}
+
+void
+ZBuffer::bin_face(std::uint32_t face_id, unsigned int const * face) {
+    math::Vec3f const & p1 = projections[face[0]];
+    math::Vec3f const & p2 = projections[face[1]];
+    math::Vec3f const & p3 = projections[face[2]];
+
+    float const min_x = std::min(p1[0], std::min(p2[0], p3[0]));
+    float const max_x = std::max(p1[0], std::max(p2[0], p3[0]));
+    float const min_y = std::min(p1[1], std::min(p2[1], p3[1]));
+    float const max_y = std::max(p1[1], std::max(p2[1], p3[1]));
+
+    /* Clamp in floating point, projections may exceed the int range. */
+    int const x0 = std::ceil(std::max(min_x, 0.0f));
+    int const x1 = std::floor(std::min(max_x, static_cast<float>(width - 1)));
+    int const y0 = std::ceil(std::max(min_y, 0.0f));
+    int const y1 = std::floor(std::min(max_y, static_cast<float>(height - 1)));
+    if (x0 > x1 || y0 > y1) return;
+
+    for (int ty = y0 / Z_BUFFER_TILE_SIZE; ty <= y1 / Z_BUFFER_TILE_SIZE; ++ty) {
+        for (int tx = x0 / Z_BUFFER_TILE_SIZE; tx <= x1 / Z_BUFFER_TILE_SIZE; ++tx) {
+            tile_faces[ty * tiles_x + tx].push_back(face_id);
+        }
+    }
+}
+
+void
+ZBuffer::rasterize_tile(int tile_id, std::vector<unsigned int> const & faces) {
+    int const tile_x0 = (tile_id % tiles_x) * Z_BUFFER_TILE_SIZE;
+    int const tile_y0 = (tile_id / tiles_x) * Z_BUFFER_TILE_SIZE;
+    int const tile_x1 = std::min(tile_x0 + Z_BUFFER_TILE_SIZE, width) - 1;
+    int const tile_y1 = std::min(tile_y0 + Z_BUFFER_TILE_SIZE, height) - 1;
+
+    for (std::uint32_t face_id : tile_faces[tile_id]) {
+        unsigned int const * face = get_face(face_id, faces);
+        math::Vec3f const & p1 = projections[face[0]];
+        math::Vec3f const & p2 = projections[face[1]];
+        math::Vec3f const & p3 = projections[face[2]];
+
+        float const min_x = std::min(p1[0], std::min(p2[0], p3[0]));
+        float const max_x = std::max(p1[0], std::max(p2[0], p3[0]));
+        float const min_y = std::min(p1[1], std::min(p2[1], p3[1]));
+        float const max_y = std::max(p1[1], std::max(p2[1], p3[1]));
+        int const x0 = std::ceil(std::max(min_x, static_cast<float>(tile_x0)));
+        int const x1 = std::floor(std::min(max_x, static_cast<float>(tile_x1)));
+        int const y0 = std::ceil(std::max(min_y, static_cast<float>(tile_y0)));
+        int const y1 = std::floor(std::min(max_y, static_cast<float>(tile_y1)));
+        if (x0 > x1 || y0 > y1) continue;
+
+        float const area = (p2[0] - p1[0]) * (p3[1] - p1[1])
+            - (p2[1] - p1[1]) * (p3[0] - p1[0]);
+        if (area == 0.0f) continue;
+        float const inv_area = 1.0f / area;
+
+        /* Barycentric coordinates are affine in the pixel coordinates,
+         * b1 = b1_0 + x * b1_dx + y * b1_dy (b2 likewise). */
+        float const b1_dx = -(p3[1] - p2[1]) * inv_area;
+        float const b1_dy = (p3[0] - p2[0]) * inv_area;
+        float const b1_0 = -(b1_dx * p2[0] + b1_dy * p2[1]);
+        float const b2_dx = -(p1[1] - p3[1]) * inv_area;
+        float const b2_dy = (p1[0] - p3[0]) * inv_area;
+        float const b2_0 = -(b2_dx * p3[0] + b2_dy * p3[1]);
+
+        /* Inverse depth is linear in image space. */
+        float const inv_depth1 = 1.0f / p1[2];
+        float const inv_depth2 = 1.0f / p2[2];
+        float const inv_depth3 = 1.0f / p3[2];
+        float const slope = std::max(
+            std::abs(b1_dx * (inv_depth1 - inv_depth3) + b2_dx * (inv_depth2 - inv_depth3)),
+            std::abs(b1_dy * (inv_depth1 - inv_depth3) + b2_dy * (inv_depth2 - inv_depth3)));
+
+        for (int y = y0; y <= y1; ++y) {
+            float * row = &inv_depths[y * width];
+            float * slope_row = &inv_depth_slopes[y * width];
+            for (int x = x0; x <= x1; ++x) {
+                /* Pixel centers on edges are inside. */
+                float const b1 = b1_0 + x * b1_dx + y * b1_dy;
+                float const b2 = b2_0 + x * b2_dx + y * b2_dy;
+                float const b3 = 1.0f - b1 - b2;
+                float const inv_depth = b1 * inv_depth1 + b2 * inv_depth2 + b3 * inv_depth3;
+                /* Branchless update, the inside test is hard to predict. */
+                bool const closer = (b1 >= 0.0f) & (b2 >= 0.0f) & (b3 >= 0.0f)
+                    & (inv_depth > row[x]);
+                row[x] = closer ? inv_depth : row[x];
+                slope_row[x] = closer ? slope : slope_row[x];
+            }
+        }
+    }
+}
+
+bool
+ZBuffer::is_visible(std::size_t vertex_id) const {
+    math::Vec3f const & p = projections[vertex_id];
+    if (p[2] < Z_BUFFER_NEAR_PLANE) return false;
+
+    /* Not covered by the buffer, nothing can occlude the vertex. */
+    if (!(p[0] > -1.0f && p[0] < width && p[1] > -1.0f && p[1] < height))
+        return true;
+
+    /* The face stored at a pixel changes its depth by at most the slope
+     * times the offset (in the L1 norm) between the center and the vertex.
+     * If the face is not adjacent to the vertex, the offset underestimates
+     * the distance, which the constant offset accounts for. */
+    float const inv_depth = 1.0f / p[2];
+    float const min_tolerance = inv_depth
+        * (1.0f / (1.0f - Z_BUFFER_DEPTH_TOLERANCE) - 1.0f);
+    int const x0 = std::floor(p[0]);
+    int const y0 = std::floor(p[1]);
+    for (int y = y0; y <= y0 + 1; ++y) {
+        for (int x = x0; x <= x0 + 1; ++x) {
+            /* Pixels outside of the buffer are not covered. */
+            if (x < 0 || x >= width || y < 0 || y >= height) return true;
+
+            std::size_t const pixel = y * width + x;
+            float const tolerance = std::max(min_tolerance, inv_depth_slopes[pixel]
+                * (std::abs(x - p[0]) + std::abs(y - p[1]) + Z_BUFFER_SLOPE_OFFSET));
+            if (inv_depths[pixel] <= inv_depth + tolerance) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015, Nils Moehrle
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef TEX_Z_BUFFER_HEADER
+#define TEX_Z_BUFFER_HEADER
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <limits>
+
+#include "math/vector.h"
+
+#include "texture_view.h"
+
+/* Edge length of the square tiles in pixels. */
+#define Z_BUFFER_TILE_SIZE 32
+/* Camera space depth of the near plane at which faces are clipped. */
+#define Z_BUFFER_NEAR_PLANE 1e-3f
+/* Minimal relative depth tolerance of the visibility test. */
+#define Z_BUFFER_DEPTH_TOLERANCE 1e-3f
+/* Offset in pixels added to the depth slope tolerance, covers faces smaller than a pixel. */
+#define Z_BUFFER_SLOPE_OFFSET 0.5f
+
+/**
+  * Depth buffer of a mesh rendered into a TextureView by a software
+  * rasterizer. The buffer has the resolution of the view's image and stores
+  * the inverse camera space depth of the closest face at every pixel center,
+  * which is linear in image space, together with the depth slope of that face.
+  * Faces are clipped at the near plane and binned into tiles which are
+  * rasterized in parallel. Within a parallel region (one buffer per thread
+  * and view) the tiles are rasterized by the calling thread.
+  *
+  * The buffer replaces ray casting for the per view visibility test of
+  * vertices. The test is conservative: a vertex is visible if any of the
+  * 2x2 pixels around its projection is not closer than the vertex. The
+  * tolerance at a pixel is the larger of Z_BUFFER_DEPTH_TOLERANCE (relative)
+  * and the depth change of the stored face between the pixel center and the
+  * projection (plus Z_BUFFER_SLOPE_OFFSET pixels).
+  */
+class ZBuffer {
+    public:
+        typedef std::shared_ptr<ZBuffer> Ptr;
+
+    private:
+        int width;
+        int height;
+        int tiles_x;
+        int tiles_y;
+        std::size_t num_faces;
+
+        /* Inverse depths, zero where no face covers the pixel. */
+        std::vector<float> inv_depths;
+        /* Largest absolute inverse depth derivative of the face at each pixel. */
+        std::vector<float> inv_depth_slopes;
+        /* Pixel coordinates and depth of every vertex in the current view,
+         * followed by the vertices created by clipping at the near plane. */
+        std::vector<math::Vec3f> projections;
+        /* Triangles of faces clipped at the near plane (three projections each). */
+        std::vector<unsigned int> clipped_faces;
+        /* Faces overlapping each tile, ids from num_faces on are clipped faces. */
+        std::vector<std::vector<std::uint32_t> > tile_faces;
+
+        void clip_face(TextureView const & view, unsigned int const * face,
+            std::vector<math::Vec3f> const & vertices);
+        void bin_face(std::uint32_t face_id, unsigned int const * face);
+        unsigned int const * get_face(std::uint32_t face_id,
+            std::vector<unsigned int> const & faces) const;
+        void rasterize_tile(int tile_id, std::vector<unsigned int> const & faces);
+
+    public:
+        ZBuffer(void);
+
+        static ZBuffer::Ptr create(void);
+
+        /**
+          * Renders the mesh given by faces (three vertex indices per face)
+          * and vertices into the buffer, replacing the previous content.
+          */
+        void rasterize(TextureView const & view, std::vector<unsigned int> const & faces,
+            std::vector<math::Vec3f> const & vertices);
+
+        /** Returns whether the vertex is visible in the rasterized view. */
+        bool is_visible(std::size_t vertex_id) const;
+
+        /** Returns the depth at the pixel, infinity if no face covers it. */
+        float get_depth(int x, int y) const;
+
+        int get_width(void) const;
+        int get_height(void) const;
+};
+
+inline
+ZBuffer::ZBuffer(void)
+    : width(0), height(0), tiles_x(0), tiles_y(0), num_faces(0) {}
+
+inline ZBuffer::Ptr
+ZBuffer::create(void) {
+    return Ptr(new ZBuffer());
+}
+
+inline unsigned int const *
+ZBuffer::get_face(std::uint32_t face_id, std::vector<unsigned int> const & faces) const {
+    return face_id < num_faces ? &faces[face_id * 3]
+        : &clipped_faces[(face_id - num_faces) * 3];
+}
+
+inline float
+ZBuffer::get_depth(int x, int y) const {
+    float const inv_depth = inv_depths[y * width + x];
+    return inv_depth > 0.0f ? 1.0f / inv_depth : std::numeric_limits<float>::infinity();
+}
+
+inline int
+ZBuffer::get_width(void) const {
+    return width;
+}
+
+inline int
+ZBuffer::get_height(void) const {
+    return height;
+}
+
+#endif /* TEX_Z_BUFFER_HEADER */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#   include "util/file_system.h"
+#else // _WIN32
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif // _WIN32
+
+#include "util/exception.h"
+#include "util/mapped_file.h"
+
+UTIL_NAMESPACE_BEGIN
+
+#ifdef _WIN32
+
+MappedFile::MappedFile (std::string const& filename)
+{
+    util::fs::read_file_to_string(filename, &this->buffer);
+}
+
+MappedFile::~MappedFile (void)
+{
+}
+
+char const*
+MappedFile::data (void) const
+{
+    return this->buffer.data();
+}
+
+std::size_t
+MappedFile::size (void) const
+{
+    return this->buffer.size();
+}
+
+#else // _WIN32
+
+MappedFile::MappedFile (std::string const& filename)
+    : address(nullptr)
+    , length(0)
+{
+    int const fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw util::FileException(filename, std::strerror(errno));
+
+    struct stat info;
+    if (::fstat(fd, &info) < 0)
+    {
+        int const error = errno;
+        ::close(fd);
+        throw util::FileException(filename, std::strerror(error));
+    }
+
+    this->length = static_cast<std::size_t>(info.st_size);
+    if (this->length > 0)
+    {
+        this->address = ::mmap(nullptr, this->length, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+        if (this->address == MAP_FAILED)
+        {
+            int const error = errno;
+            ::close(fd);
+            this->address = nullptr;
+            throw util::FileException(filename, std::strerror(error));
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile (void)
+{
+    if (this->address != nullptr)
+        ::munmap(this->address, this->length);
+}
+
+char const*
+MappedFile::data (void) const
+{
+    return static_cast<char const*>(this->address);
+}
+
+std::size_t
+MappedFile::size (void) const
+{
+    return this->length;
+}
+
+#endif // _WIN32
+
+UTIL_NAMESPACE_END
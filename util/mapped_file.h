@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef UTIL_MAPPED_FILE_HEADER
+#define UTIL_MAPPED_FILE_HEADER
+
+#include <string>
+
+#include "util/defines.h"
+
+UTIL_NAMESPACE_BEGIN
+
+/**
+ * Read-only mapping of a whole file into memory. On platforms without
+ * mmap the file is read into a buffer instead.
+ */
+class MappedFile
+{
+public:
+    /** Maps the given file, throws util::FileException on error. */
+    MappedFile (std::string const& filename);
+    ~MappedFile (void);
+
+    /** Returns the start of the file content. */
+    char const* data (void) const;
+    /** Returns the file size in bytes. */
+    std::size_t size (void) const;
+
+private:
+    MappedFile (MappedFile const& other);
+    MappedFile& operator= (MappedFile const& other);
+
+private:
+#ifdef _WIN32
+    std::string buffer;
+#else // _WIN32
+    void* address;
+    std::size_t length;
+#endif // _WIN32
+};
+
+UTIL_NAMESPACE_END
+
+#endif /* UTIL_MAPPED_FILE_HEADER */